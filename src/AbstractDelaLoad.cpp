@@ -37,6 +37,7 @@
 #include "AbstractDelaLoad.h"
 #include "AbstractDelaPlugCallback.h"
 #include "Persistence.h"
+#include "File.h"
 #include "UnusedParameter.h"
 
 //#ifndef HAS_UNITEX_NAMESPACE
@@ -175,7 +176,9 @@ static struct INF_codes* try_read_inp(const char*fn)
   strcpy(use_buffer, fn);
   *(use_buffer + len_file_name - 1) = 'p';
 
-  struct INF_codes* res = read_pack_inf_from_file(fn, NULL);
+  struct INF_codes* res = NULL;
+  if (fexists(use_buffer))
+    res = read_pack_inf_from_file(use_buffer, NULL);
   if (must_free_buffer)
     free(use_buffer);
   return res;
@@ -161,6 +161,18 @@ Fst2* load_abstract_fst2_infos(const VersatileEncodingConfig* vec,const char* fi
     const AbstractFst2Space * pads = GetFst2SpaceForFileName(filename) ;
     if (pads == NULL)
     {
+        res = read_fst2_image_from_file(filename, read_names, p_fst2_free_info);
+        if (res != NULL)
+        {
+          if (is_persistent != NULL) {
+            *is_persistent = false;
+          }
+          if (is_packed != NULL) {
+            *is_packed = false;
+          }
+          return res;
+        }
+
         res = read_pack_fst2_from_file(filename, NULL);
         if (res != NULL)
         {
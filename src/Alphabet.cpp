@@ -83,7 +83,7 @@ return alphabet;
  * Frees a given 'Alphabet*' structure
  */
 void free_alphabet(Alphabet* alphabet) {
-if (alphabet==NULL || is_persistent_structure(alphabet)) return;
+if (alphabet==NULL || release_persistent_structure(alphabet)) return;
 /*
 for (int i=0;i<alphabet->higher_written;i++) {
   if (alphabet->t[i]!=NULL)
@@ -154,7 +154,7 @@ int is_abstract_or_persistent_alphabet_filename(const char* filename)
  * characters.
  */
 Alphabet* load_alphabet(const VersatileEncodingConfig* vec,const char* filename,int korean) {
-void* a=get_persistent_structure(filename);
+void* a=acquire_persistent_structure(filename);
 if (a!=NULL) {
     return (Alphabet*)a;
 }
@@ -610,19 +610,30 @@ return i;
 }
 
 
-int load_persistent_alphabet(const char* name) {
+/**
+ * Loads the given alphabet as a persistent one, registered under
+ * 'persistent_name' if not NULL, or under its file name otherwise.
+ */
+int load_persistent_alphabet(const char* name,const char* persistent_name) {
 VersatileEncodingConfig vec=VEC_DEFAULT;
 Alphabet* a=load_alphabet(&vec,name);
 if (a==NULL) return 0;
-set_persistent_structure(name,a);
+if (set_persistent_structure((persistent_name!=NULL) ? persistent_name : name,a)!=NULL) {
+    /* The alphabet is already persistent: 'a' is either the acquired
+     * persistent one or our own copy, and free_alphabet handles both */
+    free_alphabet(a);
+}
 return 1;
 }
 
 
+static void free_persistent_alphabet_ptr(void* ptr) {
+free_alphabet((Alphabet*)ptr);
+}
+
+
 void free_persistent_alphabet(const char* name) {
-Alphabet* a=(Alphabet*)get_persistent_structure(name);
-set_persistent_structure(name,NULL);
-free_alphabet(a);
+remove_persistent_structure(name,free_persistent_alphabet_ptr);
 }
 
 }
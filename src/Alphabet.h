@@ -108,7 +108,7 @@ void turn_portuguese_sequence_to_lowercase(unichar*);
 void replace_letter_by_letter_set(const Alphabet*,unichar*,const unichar*);
 int get_longuest_prefix_ignoring_case(const unichar*,const unichar*,const Alphabet*);
 
-int load_persistent_alphabet(const char* name);
+int load_persistent_alphabet(const char* name,const char* persistent_name=NULL);
 void free_persistent_alphabet(const char* name);
 
 } // namespace unitex
@@ -25,6 +25,7 @@
 #include "Error.h"
 #include "File.h"
 #include "BuildTextAutomaton.h"
+#include "logger/SyncLogger.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -186,7 +187,7 @@ while (t!=NULL) {
  * This function returns a struct offset_list* that contains the given offset.
  * If the offset is not in the list, the function adds it.
  */
-struct offset_list* get_offset(int offset,struct offset_list* l,unichar* content,int base,unichar* output) {
+struct offset_list* get_offset(int offset,struct offset_list* l,const unichar* content,int base,const unichar* output) {
 if (l==NULL) {
    /* If the offset is not in the list, we add it */
    l=(struct offset_list*)malloc(sizeof(struct offset_list));
@@ -220,7 +221,7 @@ return l;
  * (noun: electrical connection stuff, card figure, etc).
  */
 void add_offset_for_token(struct word_struct_array* word_array,
-                          int token_number,int offset,unichar* content,
+                          int token_number,int offset,const unichar* content,
                           int base,Ustring* output) {
 if (word_array->element[token_number]==NULL) {
    word_array->element[token_number]=new_word_struct();
@@ -252,7 +253,7 @@ while (l!=NULL) {
  * function extracted from explore_bin_simple_words, because each recursive call
  * allocated 4096 unichar (and produce stack overflow)
  */
-void display_uncompressed_entry(U_FILE* f,unichar* inflected,unichar* INF_code) {
+void display_uncompressed_entry(U_FILE* f,const unichar* inflected,const unichar* INF_code) {
 Ustring* s=new_Ustring(DIC_LINE_SIZE);
 uncompress_entry(inflected,INF_code,s);
 u_fprintf(f,"%S\n",s->str);
@@ -271,6 +272,38 @@ free_Ustring(s);
  * dictionary with a greater priority, we save the corresponding DELAF line
  * in the DLF.
  */
+static void save_simple_word(struct dico_application_info* info,int offset,int final,int inf_number,
+                             const unichar* inflected,int token_number,int priority,Ustring* ustr,int base) {
+if (final) {
+   /* If the node is final */
+    if (info->word_array!=NULL) add_offset_for_token(info->word_array,token_number,offset,inflected,0,NULL);
+   int p=0;
+   if (info->simple_word!=NULL) p=get_value(info->simple_word,token_number);
+   if (p==0 || p==priority) {
+      /* We save the token only if it has not already been matched by
+       * dictionary with a greater priority. Moreover, we indicate that
+       * this token is part of a word and that it has been processed. */
+       if (info->part_of_a_word!=NULL) set_value(info->part_of_a_word,token_number,1);
+      if (info->simple_word!=NULL) set_value(info->simple_word,token_number,priority);
+      /* We get the INF codes */
+      struct INF_line_codes* codes=info->inf_line_codes;
+      get_inf_line_codes(info->d,inf_number,ustr,base,codes);
+      /* Then, we produce the DELAF line corresponding to each compressed line */
+      for (int i=0;i<codes->n;i++) {
+          if (info->dic_name[0]!='\0') {
+             u_fprintf(info->dlf,"%s\n",info->dic_name);
+             info->dic_name[0]='\0';
+          }
+          display_uncompressed_entry(info->dlf,inflected,codes->buffer+codes->codes[i]);
+      }
+   }
+} else {
+    /* The node is not final */
+    if (info->word_array!=NULL) add_offset_for_token(info->word_array,token_number,offset,inflected,base,ustr);
+}
+}
+
+
 void explore_bin_simple_words(struct dico_application_info* info,
                               int offset,const unichar* token,unichar* inflected,
                               int pos,int token_number,int priority,Ustring* ustr,int base) {
@@ -281,37 +314,7 @@ int new_offset=read_dictionary_state(info->d,offset,&final,&n_transitions,&inf_n
 if (token[pos]=='\0') {
    /* If we are at the end of the token */
    inflected[pos]='\0';
-   if (final) {
-      /* If the node is final */
-       if (info->word_array!=NULL) add_offset_for_token(info->word_array,token_number,offset,inflected,0,NULL);
-      int p=0;
-      if (info->simple_word!=NULL) p=get_value(info->simple_word,token_number);
-      if (p==0 || p==priority) {
-         /* We save the token only if it has not already been matched by
-          * dictionary with a greater priority. Moreover, we indicate that
-          * this token is part of a word and that it has been processed. */
-          if (info->part_of_a_word!=NULL) set_value(info->part_of_a_word,token_number,1);
-         if (info->simple_word!=NULL) set_value(info->simple_word,token_number,priority);
-         /* We get the INF codes */
-         struct list_ustring* head;
-         int to_be_freed=get_inf_codes(info->d,inf_number,ustr,&head,base);
-         struct list_ustring* tmp=head;
-         /* Then, we produce the DELAF line corresponding to each compressed line */
-         while (tmp!=NULL) {
-             if (info->dic_name[0]!='\0') {
-                u_fprintf(info->dlf,"%s\n",info->dic_name);
-                info->dic_name[0]='\0';
-             }
-             display_uncompressed_entry(info->dlf,inflected,tmp->string);
-             tmp=tmp->next;
-         }
-         if (to_be_freed) free_list_ustring(head);
-         base=ustr->len;
-      }
-   } else {
-       /* The node is not final */
-       if (info->word_array!=NULL) add_offset_for_token(info->word_array,token_number,offset,inflected,base,ustr);
-   }
+   save_simple_word(info,offset,final,inf_number,inflected,token_number,priority,ustr,base);
    /* If we are at the end of the token, there is no need to look at the
     * outgoing transitions */
    restore_output(z,ustr);
@@ -339,24 +342,37 @@ for (int i=0;i<n_transitions;i++) {
 }
 
 
+/**
+ * Private data of simple_word_found.
+ */
+struct simple_word_lookup {
+   struct dico_application_info* info;
+   int priority;
+};
+
+
+static void simple_word_found(void* private_data,int token,int offset,int final,int inf_number,
+                              const unichar* inflected,Ustring* output,int base) {
+struct simple_word_lookup* lookup=(struct simple_word_lookup*)private_data;
+struct dico_application_info* info=lookup->info;
+save_simple_word(info,offset,final,inf_number,inflected,info->sorted_token_numbers[token],
+                 lookup->priority,output,base);
+}
+
+
 /**
  * This function looks for every token of the text if it can
  * be a simple word. If it is the case, the corresponding DELAF lines
  * are saved in 'info->dlf' if the word has not already been matched
- * by a dictionary with a greater priority.
+ * by a dictionary with a greater priority. All the tokens are looked up
+ * in one walk, so the DELAF lines come in the order of the sorted tokens.
  */
 void look_for_simple_words(struct dico_application_info* info,int priority) {
-/* this function is called only once by dico application, so we will use heap instead stack */
-unichar* entry=(unichar*)malloc(sizeof(unichar)*DIC_WORD_SIZE);
-if (entry==NULL) {
-   fatal_alloc_error("look_for_simple_words");
-}
-Ustring* ustr=new_Ustring();
-for (int i=0;i<info->tokens->N;i++) {
-   explore_bin_simple_words(info,info->d->initial_state_offset,info->tokens->token[i],entry,0,i,priority,ustr,0);
-}
-free_Ustring(ustr);
-free(entry);
+struct simple_word_lookup lookup;
+lookup.info=info;
+lookup.priority=priority;
+lookup_sorted_tokens(info->d,info->sorted_tokens,info->tokens->N,BIN_LOOKUP_EQUAL_OR_UPPERCASE,
+                     info->alphabet,simple_word_found,&lookup);
 }
 
 
@@ -412,7 +428,13 @@ if (current_token[pos_in_current_token]=='\0') {
        trans->node->list=get_offset(offset,trans->node->list,inflected,0,NULL);
       token_sequence[pos_token_sequence]=-1;
       /* We look if the compound word has already been matched */
-      int w=was_already_in_tct_hash(token_sequence,info->tct_h,priority);
+      int w=0;
+      if (info->tct_h_previous!=NULL) {
+         w=get_tct_hash_priority(token_sequence,info->tct_h_previous);
+      }
+      if (w==0) {
+         w=was_already_in_tct_hash(token_sequence,info->tct_h,priority);
+      }
       if (w==0 || w==priority) {
          /* If the compound has not already been matched by a dictionary
           * with a greater priority */
@@ -421,22 +443,19 @@ if (current_token[pos_in_current_token]=='\0') {
             set_value(info->part_of_a_word,info->text_cod_buf[k],1);
          }
          /* We get the INF codes */
-         struct list_ustring* head;
-         int to_be_freed=get_inf_codes(info->d,inf_number,ustr,&head,base);
-         struct list_ustring* tmp=head;
+         struct INF_line_codes* codes=info->inf_line_codes;
+         get_inf_line_codes(info->d,inf_number,ustr,base,codes);
          /* We increase the number of compound word occurrences.
           * Note that we count occurrences and not number of entries, so that
           * if we find "copy and paste" in the text we will count one more
           * compound occurrence, even if this word can be a noun and a verb. */
          info->COMPOUND_WORDS++;
-         while (tmp!=NULL) {
+         for (int i=0;i<codes->n;i++) {
             /* For each compressed code of the INF line, we save the corresponding
              * DELAF line in 'info->dlc' */
-            uncompress_entry(inflected,tmp->string,line_buf);
+            uncompress_entry(inflected,codes->buffer+codes->codes[i],line_buf);
             u_fprintf(info->dlc,"%S\n",line_buf->str);
-            tmp=tmp->next;
          }
-         if (to_be_freed) free_list_ustring(head);
       }
       base=ustr->len;
    } else {
@@ -511,7 +530,6 @@ fill_buffer(info->buffer,info->text_cod);
 Ustring* line_buf=new_Ustring(4096);
 Ustring* ustr=new_Ustring();
 int current_start_pos=0;
-u_printf("First block...              \r");
 while (current_start_pos<info->text_cod_size_nb_int) {/*
    if (!info->buffer->end_of_file
        && current_start_pos>(info->buffer->size-MARGIN_BEFORE_BUFFER_END)) {
@@ -570,7 +588,6 @@ while (current_start_pos<info->text_cod_size_nb_int) {/*
    }
    current_start_pos++;
 }
-u_printf("\n");
 free_Ustring(line_buf);
 free_Ustring(ustr);
 free(inflected);
@@ -610,6 +627,43 @@ for (int i=0;i<info->tokens->N;i++) {
 }
 
 
+struct sorted_token {
+   const unichar* token;
+   int number;
+};
+
+
+static int compare_sorted_tokens(const void* a,const void* b) {
+return u_strcmp(((const struct sorted_token*)a)->token,((const struct sorted_token*)b)->token);
+}
+
+
+/**
+ * Fills info->sorted_tokens with the tokens of the text sorted with u_strcmp,
+ * as required by lookup_sorted_tokens, and info->sorted_token_numbers with
+ * the corresponding token numbers.
+ */
+static void sort_tokens(struct dico_application_info* info) {
+int n=info->tokens->N;
+struct sorted_token* tmp=(struct sorted_token*)malloc((n+1)*sizeof(struct sorted_token));
+info->sorted_tokens=(const unichar**)malloc((n+1)*sizeof(const unichar*));
+info->sorted_token_numbers=(int*)malloc((n+1)*sizeof(int));
+if (tmp==NULL || info->sorted_tokens==NULL || info->sorted_token_numbers==NULL) {
+   fatal_alloc_error("sort_tokens");
+}
+for (int i=0;i<n;i++) {
+   tmp[i].token=info->tokens->token[i];
+   tmp[i].number=i;
+}
+qsort(tmp,n,sizeof(struct sorted_token),compare_sorted_tokens);
+for (int i=0;i<n;i++) {
+   info->sorted_tokens[i]=tmp[i].token;
+   info->sorted_token_numbers[i]=tmp[i].number;
+}
+free(tmp);
+}
+
+
 /**
  * This function initializes and returns a structure that all
  * the information needed for the application of dictionaries.
@@ -635,6 +689,7 @@ info->dic_name[0]='\0';
 strcpy(info->tags_ind,tags);
 info->alphabet=alphabet;
 info->d=NULL;
+info->inf_line_codes=new_INF_line_codes();
 info->word_array=NULL;
 info->part_of_a_word=new_bit_array(tokens->N,ONE_BIT);
 info->part_of_a_word2=new_bit_array(tokens->N,ONE_BIT);
@@ -648,6 +703,8 @@ for (int j=0;j<tokens->N;j++) {
    info->n_occurrences[j]=0;
 }
 info->tct_h=new_tct_hash();
+info->tct_h_previous=NULL;
+sort_tokens(info);
 info->tct_h_tags_ind=new_tct_hash();
 info->SIMPLE_WORDS=0;
 info->COMPOUND_WORDS=0;
@@ -677,10 +734,13 @@ free_bit_array(info->simple_word);
 free(info->n_occurrences);
 free_tct_hash(info->tct_h);
 free_tct_hash(info->tct_h_tags_ind);
+free(info->sorted_tokens);
+free(info->sorted_token_numbers);
 for (int i=0;i<info->n_tag_sequences;i++) {
     free_match_list_element(info->tag_sequences[i]);
 }
 free_Dictionary(info->d);
+free_INF_line_codes(info->inf_line_codes);
 free(info->tag_sequences);
 free(info);
 }
@@ -696,7 +756,7 @@ int dico_application(const VersatileEncodingConfig* vec,const char* name_bin,str
 char name_inf[FILENAME_MAX];
 remove_extension(name_bin,name_inf);
 strcat(name_inf,".inf");
-info->d=new_Dictionary(vec,name_bin,name_inf);
+info->d=new_lazy_Dictionary(vec,name_bin,name_inf);
 if (info->d==NULL) {
     error("Cannot open dictionary %s\n",name_bin);
     return 1;
@@ -714,7 +774,9 @@ u_printf("Looking for compound words...\n");
 #ifdef DEBUG
 clock_t startTime=clock();
 #endif
+u_printf("First block...              \r");
 look_for_compound_words(info,priority);
+u_printf("\n");
 #ifdef DEBUG
 clock_t endTime = clock();
 double  elapsedTime = (double) (endTime - startTime);
@@ -727,6 +789,175 @@ return 0;
 }
 
 
+/**
+ * Private data of a thread applying one .bin dictionary in
+ * dico_application_in_threads.
+ */
+struct dico_worker {
+   struct dico_application_info* info;
+   int priority;
+};
+
+
+static void ABSTRACT_CALLBACK_UNITEX dico_worker_thread(void* private_data,unsigned int /* thread_number */) {
+struct dico_worker* worker=(struct dico_worker*)private_data;
+look_for_simple_words(worker->info,worker->priority);
+look_for_compound_words(worker->info,worker->priority);
+}
+
+
+/**
+ * Creates a copy of 'info' that can be used by a thread to apply the given
+ * dictionary 'd'. The copy has its own recognition arrays initialized from
+ * 'info', its own compound word hash table and its own output files. The
+ * compound words of 'info' are only read through 'tct_h_previous'.
+ */
+static struct dico_application_info* new_dico_worker_info(struct dico_application_info* info,Dictionary* d,
+                                                          const char* dlf,const char* dlc) {
+struct dico_application_info* w=(struct dico_application_info*)malloc(sizeof(struct dico_application_info));
+if (w==NULL) {
+   fatal_alloc_error("new_dico_worker_info");
+}
+*w=*info;
+w->d=d;
+w->inf_line_codes=new_INF_line_codes();
+w->word_array=new_word_struct_array(info->tokens->N);
+w->part_of_a_word=clone_bit_array(info->part_of_a_word);
+w->simple_word=clone_bit_array(info->simple_word);
+w->tct_h=new_tct_hash();
+w->tct_h_previous=info->tct_h;
+w->COMPOUND_WORDS=0;
+w->tag_sequences=NULL;
+w->n_tag_sequences=0;
+w->tag_sequences_capacity=0;
+w->dlf=u_fopen(&(info->vec),dlf,U_WRITE);
+w->dlc=u_fopen(&(info->vec),dlc,U_WRITE);
+if (w->dlf==NULL || w->dlc==NULL) {
+   fatal_error("Cannot create temporary dictionary files %s and %s\n",dlf,dlc);
+}
+return w;
+}
+
+
+/**
+ * Frees a structure created by new_dico_worker_info.
+ */
+static void free_dico_worker_info(struct dico_application_info* w) {
+free_word_struct_array(w->word_array);
+free_bit_array(w->part_of_a_word);
+free_bit_array(w->simple_word);
+free_tct_hash(w->tct_h);
+free_Dictionary(w->d);
+free_INF_line_codes(w->inf_line_codes);
+free(w);
+}
+
+
+/**
+ * Appends the content of the file 'name' to 'out' and removes it.
+ */
+static void append_and_remove_dic_part(U_FILE* out,const char* name,const VersatileEncodingConfig* vec,Ustring* line) {
+U_FILE* f=u_fopen(vec,name,U_READ);
+if (f==NULL) {
+   fatal_error("Cannot read %s\n",name);
+}
+while (EOF!=readline_keep_CR(line,f)) {
+   u_fputs(line->str,out);
+}
+u_fclose(f);
+af_remove(name);
+}
+
+
+/**
+ * This function applies the given .bin dictionaries that all have the same
+ * priority, using up to 'n_threads' threads. This is possible because a
+ * dictionary of a given priority is only restricted by words that have been
+ * matched with another priority, so that such dictionaries do not depend
+ * on each other. Each thread works on its own copy of the recognition arrays
+ * and writes in its own dlf/dlc files. Then, the results are merged in
+ * dictionary order, so that the output is the same than the one obtained
+ * by applying the dictionaries one after the other with dico_application.
+ *
+ * 'dlf' and 'dlc' are the names of the files opened as info->dlf and
+ * info->dlc; they are used to build the names of the temporary files.
+ * Returns 0 if all dictionaries could be applied; 1 otherwise.
+ */
+int dico_application_in_threads(const VersatileEncodingConfig* vec,const char* const* name_bins,int n_dics,
+                                struct dico_application_info* info,int priority,
+                                const char* dlf,const char* dlc,int n_threads) {
+int ret=0;
+if (n_threads<1) {
+   n_threads=1;
+}
+struct dico_worker* workers=(struct dico_worker*)malloc(n_threads*sizeof(struct dico_worker));
+void** workers_ptr=(void**)malloc(n_threads*sizeof(void*));
+char* dlf_part=(char*)malloc(strlen(dlf)+16);
+char* dlc_part=(char*)malloc(strlen(dlc)+16);
+if (workers==NULL || workers_ptr==NULL || dlf_part==NULL || dlc_part==NULL) {
+   fatal_alloc_error("dico_application_in_threads");
+}
+Ustring* line=new_Ustring(1024);
+int first=0;
+while (first<n_dics) {
+   /* We load the dictionaries of the current batch. This must be done
+    * here, because loading may access the persistent structures */
+   int n_workers=0;
+   int last=first;
+   while (last<n_dics && n_workers<n_threads) {
+      char name_inf[FILENAME_MAX];
+      remove_extension(name_bins[last],name_inf);
+      strcat(name_inf,".inf");
+      Dictionary* d=new_lazy_Dictionary(vec,name_bins[last],name_inf);
+      if (d==NULL) {
+         error("Cannot open dictionary %s\n",name_bins[last]);
+         ret=1;
+      } else {
+         u_printf("Applying dico  %s...\n",name_bins[last]);
+         sprintf(dlf_part,"%s.thread%d",dlf,n_workers);
+         sprintf(dlc_part,"%s.thread%d",dlc,n_workers);
+         workers[n_workers].info=new_dico_worker_info(info,d,dlf_part,dlc_part);
+         workers[n_workers].priority=priority;
+         workers_ptr[n_workers]=&(workers[n_workers]);
+         n_workers++;
+      }
+      last++;
+   }
+   if (n_workers!=0) {
+      logger::SyncDoRunThreads((unsigned int)n_workers,dico_worker_thread,workers_ptr);
+   }
+   /* We merge the results in dictionary order */
+   for (int i=0;i<n_workers;i++) {
+      struct dico_application_info* w=workers[i].info;
+      u_fclose(w->dlf);
+      u_fclose(w->dlc);
+      sprintf(dlf_part,"%s.thread%d",dlf,i);
+      sprintf(dlc_part,"%s.thread%d",dlc,i);
+      append_and_remove_dic_part(info->dlf,dlf_part,vec,line);
+      append_and_remove_dic_part(info->dlc,dlc_part,vec,line);
+      for (int j=0;j<info->tokens->N;j++) {
+         if (get_value(w->part_of_a_word,j)) {
+            set_value(info->part_of_a_word,j,1);
+         }
+         if (get_value(w->simple_word,j)==priority) {
+            set_value(info->simple_word,j,priority);
+         }
+      }
+      merge_tct_hash(info->tct_h,w->tct_h);
+      info->COMPOUND_WORDS=info->COMPOUND_WORDS+w->COMPOUND_WORDS;
+      free_dico_worker_info(w);
+   }
+   first=last;
+}
+free_Ustring(line);
+free(dlc_part);
+free(dlf_part);
+free(workers_ptr);
+free(workers);
+return ret;
+}
+
+
 /**
  * This function launches the application of the given .bin dictionary.
  *
@@ -737,11 +968,19 @@ int dico_application_simplified(const VersatileEncodingConfig* vec,const unichar
 char name_inf[FILENAME_MAX];
 remove_extension(name_bin,name_inf);
 strcat(name_inf,".inf");
-info->d=new_Dictionary(vec,name_bin,name_inf);
+info->d=new_lazy_Dictionary(vec,name_bin,name_inf);
 if (info->d==NULL) return 1;
 unichar entry[DIC_WORD_SIZE];
 Ustring* ustr=new_Ustring();
+int own_inf_line_codes=(info->inf_line_codes==NULL);
+if (own_inf_line_codes) {
+    info->inf_line_codes=new_INF_line_codes();
+}
 explore_bin_simple_words(info,info->d->initial_state_offset,text,entry,0,-1,0,ustr,0);
+if (own_inf_line_codes) {
+    free_INF_line_codes(info->inf_line_codes);
+    info->inf_line_codes=NULL;
+}
 free_Ustring(ustr);
 free_Dictionary(info->d);
 info->d=NULL;
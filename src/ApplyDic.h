@@ -103,6 +103,10 @@ struct dico_application_info {
    const int* text_cod_buf;
    int text_cod_size_nb_int;
    struct text_tokens* tokens;
+   /* The tokens sorted with u_strcmp, used to look them up in one walk
+    * in .bin dictionaries, and their token numbers */
+   const unichar** sorted_tokens;
+   int* sorted_token_numbers;
    U_FILE* dlf;
    U_FILE* dlc;
    U_FILE* err;
@@ -117,6 +121,8 @@ struct dico_application_info {
    Alphabet* alphabet;
    /* The dictionary to use */
    Dictionary* d;
+   /* Buffers used to get the codes of the dictionary entries */
+   struct INF_line_codes* inf_line_codes;
 #if 0
    const unsigned char* bin;
    const struct INF_codes* inf;
@@ -147,6 +153,11 @@ struct dico_application_info {
     * sequence matched when applying a .bin dictionary. Keys are sequences
     * of token numbers. */
    struct tct_hash* tct_h;
+   /* When not NULL, tct_h_previous is a read-only table containing the
+    * compound words matched by the previous dictionaries. In that case, tct_h
+    * only receives the ones matched by the current dictionary. This is used
+    * when several dictionaries are applied in parallel. */
+   struct tct_hash* tct_h_previous;
    /* tct_h_tags_ind is a hash table used to associate a priority to each token
     * sequence matched when applying a .fst2 dictionary.
     * IMPORTANT: unlike tct_h, keys are couple of offsets [start;end], because
@@ -172,6 +183,8 @@ struct dico_application_info* init_dico_application(struct text_tokens*,U_FILE*,
                                                     U_FILE*,const char*,const char*,Alphabet*,
                                                     const VersatileEncodingConfig*);
 int dico_application(const VersatileEncodingConfig*,const char*,struct dico_application_info*,int);
+int dico_application_in_threads(const VersatileEncodingConfig*,const char* const*,int,
+                                struct dico_application_info*,int,const char*,const char*,int);
 int dico_application_simplified(const VersatileEncodingConfig*,const unichar*,const char*,struct dico_application_info*);
 void free_dico_application(struct dico_application_info*);
 void count_token_occurrences(struct dico_application_info*);
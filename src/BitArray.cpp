@@ -61,6 +61,16 @@ return bit_array;
 }
 
 
+/**
+ * Allocates and returns a copy of the given bit array.
+ */
+struct bit_array* clone_bit_array(const struct bit_array* src,Abstract_allocator prv_alloc) {
+struct bit_array* bit_array=new_bit_array(src->size_in_elements,src->info_length,prv_alloc);
+memcpy(bit_array->array,src->array,sizeof(unsigned char)*(src->size_in_bytes));
+return bit_array;
+}
+
+
 /**
  * Frees a bit array, assuming that the field 'array' was not already freed.
  */
@@ -59,6 +59,7 @@ struct bit_array {
 
 
 struct bit_array* new_bit_array(int,InfoLength,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
+struct bit_array* clone_bit_array(const struct bit_array*,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 void free_bit_array(struct bit_array*,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 void set_value(struct bit_array*,int,int);
 int get_value(const struct bit_array*,int);
@@ -47,7 +47,7 @@
 
 namespace unitex {
 
-const char *optstring_Cassys = ":bp:t:a:w:l:Vhk:q:g:dvuNncm:s:ir:f:T:L:C:O$:x:";
+const char *optstring_Cassys = ":bp:t:a:w:l:Vhk:q:g:dvuNncm:s:ir:f:T:L:C:O$:x:MS";
 const struct option_TS lopts_Cassys[] = {
   {"text", required_argument_TS, NULL, 't'},
   {"alphabet", required_argument_TS, NULL, 'a'},
@@ -61,6 +61,8 @@ const struct option_TS lopts_Cassys[] = {
   {"transducer_file",required_argument_TS,NULL,'s'},
   {"transducer_dir",required_argument_TS,NULL,'r'},
   {"in_place", no_argument_TS,NULL,'i'},
+  {"in_memory", no_argument_TS,NULL,'M'},
+  {"no_skip_index", no_argument_TS,NULL,'S'},
   {"dump_token_graph", no_argument_TS, NULL, 'u' },
   {"no_dump_token_graph", no_argument_TS, NULL, 'N' },
   {"realign_token_graph_pointer", no_argument_TS, NULL, 'n' },
@@ -98,6 +100,12 @@ const char* usage_Cassys =
         "-O/--produce_offsets_file produce offsets file (automatic if --input_offsets=XXX is used)\n"
         "-t TXT/--text=TXT the text file to be modified, with extension .snt\n"
         "-i/--in_place mean uses the same csc/snt directories for each transducer\n"
+        "-M/--in_memory keep the tokenized text in memory between transducers: only the spans\n"
+        "      modified by each transducer are retokenized, and the labeled texts and their token\n"
+        "      files are written from memory instead of running Concord and Tokenize\n"
+        "-S/--no_skip_index apply every transducer, even when no token of the text can start\n"
+        "      one of its matches (by default, such transducers are skipped, their labeled\n"
+        "      text being a copy of their input)\n"
         "-p X/--working_dir=X uses directory X for intermediate working file\n"
         "-b/--cleanup_working_files remove intermediate working file after usage\n"
         "-u/--dump_token_graph create a .dot file with graph dump infos\n"
@@ -1769,6 +1777,8 @@ int main_Cassys(int argc,char* const argv[]) {
     VersatileEncodingConfig vec=VEC_DEFAULT;
     int must_create_directory = 1;
     int in_place = 0;
+    int in_memory = 0;
+    int skip_index = 1;
     int realign_token_graph_pointer = 0;
     int translate_path_separator_to_native = 0;
     int dump_graph = 0; // By default, don't build a .dot file.
@@ -2054,6 +2064,14 @@ int main_Cassys(int argc,char* const argv[]) {
             in_place = 1;
             break;
         }
+        case 'M': {
+            in_memory = 1;
+            break;
+        }
+        case 'S': {
+            skip_index = 0;
+            break;
+        }
         case 'u': {
             dump_graph = 1;
             break;
@@ -2269,7 +2287,7 @@ int main_Cassys(int argc,char* const argv[]) {
         transducer_list, textbuf->alphabet_file_name, textbuf->name_input_offsets_file, produce_offsets_file, textbuf->name_uima_offsets_file, negation_operator,
         &vec, morpho_dic,
         tokenize_additional_args, locate_additional_args, concord_additional_args,
-        dump_graph, realign_token_graph_pointer, display_perf, istex_param, textbuf->language,textbuf->stdoff_file);
+        dump_graph, realign_token_graph_pointer, display_perf, istex_param, textbuf->language,textbuf->stdoff_file, in_memory, skip_index);
 
     free_fifo(transducer_list);
     free_transducer_name_and_mode_linked_list(transducer_name_and_mode_linked_list_arg);
@@ -2363,6 +2381,30 @@ static void quicksort(int nb_items, locate_perf_info* transitions) {
 }
 
 
+/**
+ * Returns 1 if no token of the text can start a match of the given
+ * transducer, so that applying it would leave the text unchanged.
+ * The name of the transducer is then added to 'skipped_transducers'.
+ */
+static int skip_transducer(transducer* current_transducer, int transducer_number,
+        struct string_hash* text_tokens, const Alphabet* alphabet,
+        const VersatileEncodingConfig* vec, vector_ptr* skipped_transducers) {
+    if (text_tokens == NULL || current_transducer->generic_graph) {
+        return 0;
+    }
+    if (current_transducer->first_tokens == NULL) {
+        current_transducer->first_tokens = compute_cassys_first_tokens(current_transducer->transducer_file_name, vec);
+    }
+    if (cassys_first_tokens_in_text(current_transducer->first_tokens, text_tokens, alphabet)) {
+        return 0;
+    }
+    u_printf("Skipping transducer %s (numbered %d): no token of the text can start a match\n",
+        current_transducer->transducer_file_name, transducer_number);
+    vector_ptr_add(skipped_transducers, strdup(current_transducer->transducer_file_name));
+    return 1;
+}
+
+
 /**
  * The main function of the cascade
  *
@@ -2374,12 +2416,13 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
     const char*negation_operator,
     VersatileEncodingConfig* vec,
     const char *morpho_dic, vector_ptr* tokenize_args, vector_ptr* locate_args, vector_ptr* concord_args,
-    int dump_graph, int realign_token_graph_pointer, int display_perf, int istex_param, const char* lang, const char* stdoff_file) {
+    int dump_graph, int realign_token_graph_pointer, int display_perf, int istex_param, const char* lang, const char* stdoff_file, int in_memory, int skip_index) {
 
     unsigned int time_tokenize = 0;
     unsigned int time_grf2fst2 = 0;
     unsigned int time_locate = 0;
     unsigned int time_concord = 0;
+    unsigned int time_text_update = 0;
     unsigned int time_cascade = 0;
 
     unsigned int nb_perf_info = 0;
@@ -2528,6 +2571,37 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
     struct text_tokens* tokens = NULL;
     cassys_tokens_list* tokens_list = cassys_load_text(vec,snt_text_files->tokens_txt, snt_text_files->text_cod,&tokens, uima_offsets,tokens_allocation_tool);
 
+    /* With the in memory mode, the tokenized text is kept between two transducers.
+     * Additional Tokenize or Concord arguments may change the way the text is
+     * rebuilt, so that we use the real programs in that case */
+    cassys_text_stream* text_stream = NULL;
+    if (in_memory) {
+        if ((tokenize_args != NULL && tokenize_args->nbelems != 0) || (concord_args != NULL && concord_args->nbelems != 0)) {
+            error("Tokenize or Concord arguments were given, ignoring the in memory mode\n");
+            in_memory = 0;
+        }
+    }
+
+    /* Additional Locate arguments may change the way the grammar tokens are
+     * matched against the text ones (e.g. Arabic typographic rules), so that
+     * we don't try to skip transducers in that case */
+    if (locate_args != NULL && locate_args->nbelems != 0) {
+        skip_index = 0;
+    }
+    Alphabet* text_alphabet = NULL;
+    if (in_memory || skip_index) {
+        text_alphabet = load_alphabet(vec, alphabet);
+        if (text_alphabet == NULL) {
+            error("Cannot load alphabet %s, ignoring the in memory mode and the skip index\n", alphabet);
+            in_memory = 0;
+            skip_index = 0;
+        }
+    }
+    /* Tokens of the current text, only known when the skip index is used. They
+     * remain valid as long as no transducer modifies the text */
+    struct string_hash* text_tokens = NULL;
+    vector_ptr* skipped_transducers = new_vector_ptr();
+
     u_printf("CasSys Cascade begins\n");
 
     int transducer_number = 1;
@@ -2559,6 +2633,10 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
 
         if ((!is_template_grf) && is_debug_mode(current_transducer, vec) == true) {
             error("graph %s has been compiled in debug mode. Please recompile it in normal mode\n", current_transducer->transducer_file_name);
+            free_cassys_text_stream(text_stream);
+            free_alphabet(text_alphabet);
+            free_string_hash(text_tokens);
+            free_vector_ptr(skipped_transducers, free);
             free(labeled_text_name);
             free_text_tokens(tokens);
             free_snt_files(snt_text_files);
@@ -2577,17 +2655,61 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
         }
 
         for (iteration = 0; current_transducer->repeat_mode == REPEAT_INFINITY || iteration < current_transducer->repeat_mode; iteration++) {
+            // when the tokens of the text are known, we don't even need to tokenize it
+            if (skip_index && skip_transducer(current_transducer, transducer_number,
+                    text_tokens, text_alphabet, vec, skipped_transducers)) {
+                if (in_place == 0) {
+                    // the labeled text of the skipped transducer is a copy of its input, as if no match was found
+                    free(labeled_text_name);
+                    labeled_text_name = create_labeled_files_and_directory(text, previous_transducer_number,
+                        transducer_number, previous_iteration, iteration, must_create_directory,
+                        (text_stream != NULL) ? CASSYS_COPY_DICTIONARIES_ONLY : CASSYS_COPY_TEXT_AND_DICTIONARIES);
+                    if (text_stream != NULL) {
+                        save_cassys_text_stream(text_stream, labeled_text_name, text_alphabet, vec);
+                        save_cassys_text_stream_text(text_stream, labeled_text_name, vec);
+                    }
+                }
+                break;
+            }
+
             if (in_place == 0) {
 
                 if (labeled_text_name != NULL) {
                     free(labeled_text_name);
                 }
                 labeled_text_name = create_labeled_files_and_directory(text, previous_transducer_number,
-                    transducer_number, previous_iteration, iteration, must_create_directory, 1);
+                    transducer_number, previous_iteration, iteration, must_create_directory,
+                    (text_stream != NULL) ? CASSYS_COPY_DICTIONARIES_ONLY : CASSYS_COPY_TEXT_AND_DICTIONARIES);
             }
 
-            launch_tokenize_in_Cassys(labeled_text_name, alphabet,
-                snt_text_files->tokens_txt, vec, tokenize_args, display_perf, display_perf ? &time_tokenize : NULL);
+            if (text_stream != NULL) {
+                save_cassys_text_stream(text_stream, labeled_text_name, text_alphabet, vec);
+            } else {
+                launch_tokenize_in_Cassys(labeled_text_name, alphabet,
+                    snt_text_files->tokens_txt, vec, tokenize_args, display_perf, display_perf ? &time_tokenize : NULL);
+                if (in_memory) {
+                    text_stream = load_cassys_text_stream(labeled_text_name, vec);
+                }
+            }
+
+            if (skip_index && text_tokens == NULL) {
+                struct snt_files* labeled_snt_files = new_snt_files(labeled_text_name);
+                int sentence_marker, stop_marker, number_of_tokens;
+                text_tokens = load_text_tokens_hash(labeled_snt_files->tokens_txt, vec,
+                    &sentence_marker, &stop_marker, &number_of_tokens);
+                free_snt_files(labeled_snt_files);
+                if (skip_transducer(current_transducer, transducer_number,
+                        text_tokens, text_alphabet, vec, skipped_transducers)) {
+                    if (previous_transducer_number == 0) {
+                        // no transducer has been applied yet, this labeled text is the original one
+                        sprintf(textbuf->last_labeled_text_name, "%s", labeled_text_name);
+                    } else if (in_place == 0 && text_stream != NULL) {
+                        // the text of this labeled copy has not been written yet
+                        save_cassys_text_stream_text(text_stream, labeled_text_name, vec);
+                    }
+                    break;
+                }
+            }
 
             //int entity = 0;
             char* updated_grf_file_name = NULL;
@@ -2701,6 +2823,10 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
                             p_locate_perf_info = p_locate_perf_info_more;
                         } else {
                             alloc_error("cascade");
+                            free_cassys_text_stream(text_stream);
+                            free_alphabet(text_alphabet);
+                            free_string_hash(text_tokens);
+                            free_vector_ptr(skipped_transducers, free);
                             free(labeled_text_name);
                             free_text_tokens(tokens);
                             free_snt_files(snt_text_files);
@@ -2729,9 +2855,26 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
                 free_snt_files(snt_text_files);
                 snt_text_files = new_snt_files(labeled_text_name);
                 protect_lexical_tag_in_concord(snt_text_files->concord_ind, current_transducer->output_policy, vec);
-                // generate concordance for this transducer
-                launch_concord_in_Cassys(labeled_text_name,
-                    snt_text_files->concord_ind, alphabet, NULL, NULL, NULL, vec, concord_args, display_perf, display_perf ? &time_concord : NULL);
+                int text_updated_in_memory = 0;
+                if (text_stream != NULL) {
+                    hTimeElapsed htm_text_update = display_perf ? SyncBuidTimeMarkerObject() : NULL;
+                    text_updated_in_memory = update_cassys_text_stream(text_stream, snt_text_files->concord_ind, text_alphabet, vec);
+                    if (display_perf) {
+                        time_text_update += SyncGetMSecElapsed(htm_text_update);
+                    }
+                    if (text_updated_in_memory) {
+                        save_cassys_text_stream_text(text_stream, labeled_text_name, vec);
+                    } else {
+                        u_printf("The matches cannot be applied in memory, using Concord\n");
+                        free_cassys_text_stream(text_stream);
+                        text_stream = NULL;
+                    }
+                }
+                if (!text_updated_in_memory) {
+                    // generate concordance for this transducer
+                    launch_concord_in_Cassys(labeled_text_name,
+                        snt_text_files->concord_ind, alphabet, NULL, NULL, NULL, vec, concord_args, display_perf, display_perf ? &time_concord : NULL);
+                }
 
                 //
                 add_replaced_text(labeled_text_name, tokens_list, previous_transducer_number, previous_iteration,
@@ -2764,6 +2907,9 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
                 break;
             }
             else {
+                // the text has been modified, so that its tokens must be loaded again
+                free_string_hash(text_tokens);
+                text_tokens = NULL;
                 u_printf("transducer %s\n %d iteration %d --> %d concordances\n",
                     current_transducer->transducer_file_name,
                     transducer_number,
@@ -2782,6 +2928,7 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
         }
 
 
+        free_cassys_first_tokens(current_transducer->first_tokens);
         free(current_transducer -> transducer_file_name);
         free(current_transducer);
 
@@ -2790,6 +2937,10 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
 
     free_snt_files(snt_text_files);
 
+    free_cassys_text_stream(text_stream);
+    free_alphabet(text_alphabet);
+    free_string_hash(text_tokens);
+
     // create the concord file with XML
     construct_cascade_concord(tokens_list,text,transducer_number, iteration, vec);
     // construct_xml_concord must be applied to create the xmlized concordance
@@ -2895,6 +3046,13 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
         u_printf("time on grf2fst2 = %.3f sec, %.1f %% total\n", time_grf2fst2 / 1000., time_grf2fst2 / ratio);
         u_printf("time on locate = %.3f sec, %.1f %% total\n", time_locate / 1000., time_locate / ratio);
         u_printf("time on concord = %.3f sec, %.1f %% total\n", time_concord / 1000., time_concord / ratio);
+        if (in_memory) {
+            u_printf("time on in memory text update = %.3f sec, %.1f %% total\n", time_text_update / 1000., time_text_update / ratio);
+        }
+
+        u_printf("\n%d transducer(s) skipped since no token of the text could start a match\n", skipped_transducers->nbelems);
+        for (int loop_skipped = 0; loop_skipped < skipped_transducers->nbelems; loop_skipped++)
+            u_printf("skipped %s\n", (char*)skipped_transducers->tab[loop_skipped]);
 
         u_printf("\nlocate time on transduced order:\n");
         for (unsigned int loop_display_perf = 0; loop_display_perf < nb_perf_info; loop_display_perf++)
@@ -2919,6 +3077,7 @@ int cascade(const char* original_text, int in_place, int must_create_directory,
         }
         free(p_locate_perf_info);
     }
+    free_vector_ptr(skipped_transducers, free);
 
     return SUCCESS_RETURN_CODE;
 }
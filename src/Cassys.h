@@ -87,7 +87,7 @@ int cascade(const char* text, int in_place, int must_create_directory, int must_
     const char *morpho_dic,
     vector_ptr* tokenize_args, vector_ptr* locate_args, vector_ptr* concord_args,
     int dump_graph, int realign_token_graph_pointer, int display_perf, int param, const char* lang,
-    const char *stdoff_file);
+    const char *stdoff_file, int in_memory = 0, int skip_index = 1);
 
 
 
@@ -232,7 +232,9 @@ char* create_labeled_files_and_directory(
 
     if (must_copy_file != 0)
     {
-        copy_file(new_labeled_text_name, old_labeled_text_name);
+        if (must_copy_file != CASSYS_COPY_DICTIONARIES_ONLY) {
+            copy_file(new_labeled_text_name, old_labeled_text_name);
+        }
 
         // create snt directory labeled i
         char old_labeled_snt_directory[FILENAME_MAX];
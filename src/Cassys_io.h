@@ -92,11 +92,18 @@ void get_csc_path(const char* filename, char* result);
  */
 void get_csc_wd_path(const char* filename, char* result);
 
+/* Values of the 'must_copy_file' parameter of create_labeled_files_and_directory */
+#define CASSYS_COPY_TEXT_AND_DICTIONARIES 1
+#define CASSYS_COPY_DICTIONARIES_ONLY 2
+
 /**
  * \brief
  *
  * \param[in] text
  * \param[in] next_transducer_label
+ * \param[in] must_copy_file CASSYS_COPY_TEXT_AND_DICTIONARIES to copy the previous labeled
+ * text and its dictionaries, CASSYS_COPY_DICTIONARIES_ONLY when the text is kept in memory
+ * by the cascade, 0 to copy nothing
  */
 char* create_labeled_files_and_directory(
         const char *text,
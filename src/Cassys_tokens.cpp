@@ -30,6 +30,11 @@
 #include "Cassys_lexical_tags.h"
 #include "Snt.h"
 #include "UnusedParameter.h"
+#include "LocateMatches.h"
+#include "DELA.h"
+#include "File.h"
+#include "Offsets.h"
+#include "Tokenize.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -675,5 +680,300 @@ cassys_tokens_list* cassys_trim(cassys_tokens_list *l, unichar *string_before, u
 }
 
 
+/**
+ * Loads a file made of ints, like text.cod or enter.pos. Returns NULL
+ * if the file cannot be read.
+ */
+static vector_int *load_int_file(const char *name) {
+    U_FILE *f = u_fopen(BINARY, name, U_READ);
+    if (f == NULL) {
+        return NULL;
+    }
+    int n = (int)(get_file_size(f) / sizeof(int));
+    vector_int *v = new_vector_int(n + 1);
+    if (n != (int)fread(v->tab, sizeof(int), n, f)) {
+        free_vector_int(v);
+        u_fclose(f);
+        return NULL;
+    }
+    v->nbelems = n;
+    u_fclose(f);
+    return v;
+}
+
+
+static int save_int_file(const char *name, const vector_int *v) {
+    U_FILE *f = u_fopen(BINARY, name, U_WRITE);
+    if (f == NULL) {
+        error("Cannot write %s\n", name);
+        return 0;
+    }
+    int ok = (v->nbelems == (int)fwrite(v->tab, sizeof(int), v->nbelems, f));
+    u_fclose(f);
+    return ok;
+}
+
+
+cassys_text_stream *load_cassys_text_stream(const char *text, const VersatileEncodingConfig *vec) {
+    struct snt_files *snt_files = new_snt_files(text);
+    int sentence_marker, stop_marker, n_tokens;
+    struct string_hash *tokens = load_text_tokens_hash(snt_files->tokens_txt, vec,
+            &sentence_marker, &stop_marker, &n_tokens);
+    vector_int *cod = load_int_file(snt_files->text_cod);
+    vector_int *enter_pos = load_int_file(snt_files->enter_pos);
+    free_snt_files(snt_files);
+    if (tokens == NULL || cod == NULL || enter_pos == NULL) {
+        if (tokens != NULL) {
+            free_string_hash(tokens);
+        }
+        free_vector_int(cod);
+        free_vector_int(enter_pos);
+        return NULL;
+    }
+    cassys_text_stream *stream = (cassys_text_stream*)malloc(sizeof(cassys_text_stream));
+    if (stream == NULL) {
+        fatal_alloc_error("load_cassys_text_stream");
+    }
+    stream->tokens = tokens;
+    stream->cod = cod;
+    stream->enter_pos = enter_pos;
+    return stream;
+}
+
+
+void free_cassys_text_stream(cassys_text_stream *stream) {
+    if (stream == NULL) {
+        return;
+    }
+    free_string_hash(stream->tokens);
+    free_vector_int(stream->cod);
+    free_vector_int(stream->enter_pos);
+    free(stream);
+}
+
+
+/**
+ * Returns 1 if the token at the given position stands for a new line.
+ * As positions are tested in increasing order, '*pos_in_enter_pos' is
+ * used as a cursor in the enter position array.
+ */
+static int is_enter_position(const vector_int *enter_pos, int *pos_in_enter_pos, int position) {
+    while (*pos_in_enter_pos < enter_pos->nbelems && enter_pos->tab[*pos_in_enter_pos] < position) {
+        (*pos_in_enter_pos)++;
+    }
+    return (*pos_in_enter_pos < enter_pos->nbelems && enter_pos->tab[*pos_in_enter_pos] == position);
+}
+
+
+/**
+ * Copies the tokens [start;end[ of the stream at the end of the new token sequence.
+ */
+static void copy_tokens(const cassys_text_stream *stream, int start, int end, int *pos_in_enter_pos,
+        vector_int *cod, vector_int *enter_pos) {
+    for (int i = start; i < end; i++) {
+        if (is_enter_position(stream->enter_pos, pos_in_enter_pos, i)) {
+            vector_int_add(enter_pos, cod->nbelems);
+        }
+        vector_int_add(cod, stream->cod->tab[i]);
+    }
+}
+
+
+/**
+ * Appends the content of the token at the given position to 'window',
+ * the new lines being restored as Concord does.
+ */
+static void append_token(const cassys_text_stream *stream, int position, int *pos_in_enter_pos, Ustring *window) {
+    if (is_enter_position(stream->enter_pos, pos_in_enter_pos, position)) {
+        u_strcat(window, '\n');
+    } else {
+        u_strcat(window, stream->tokens->value[stream->cod->tab[position]]);
+    }
+}
+
+
+/**
+ * Tokenizes 'window' with the tokenizer of Tokenize in word by word mode,
+ * appending the tokens to 'cod' and the new line positions to 'enter_pos'.
+ * 'table' numbers the tokens of all the windows, and 'ids' gives for each of
+ * them its number in the stream. Returns 0 if the window contains a tag that
+ * Tokenize would reject or that is not closed inside the window.
+ */
+static int tokenize_window(const Ustring *window, cassys_text_stream *stream, const Alphabet *alphabet,
+        struct token_table *table, vector_int *ids, vector_int *window_cod, vector_int *window_enter_pos,
+        vector_int *cod, vector_int *enter_pos) {
+    window_cod->nbelems = 0;
+    window_enter_pos->nbelems = 0;
+    if (tokenize_buffer(window->str, (int)window->len, alphabet, 0, table,
+            window_cod, window_enter_pos, 0) != SUCCESS_RETURN_CODE) {
+        return 0;
+    }
+    for (int i = ids->nbelems; i < table->tokens->nbelems; i++) {
+        vector_int_add(ids, get_value_index((unichar*)table->tokens->tab[i], stream->tokens));
+    }
+    for (int i = 0; i < window_enter_pos->nbelems; i++) {
+        vector_int_add(enter_pos, cod->nbelems + window_enter_pos->tab[i]);
+    }
+    for (int i = 0; i < window_cod->nbelems; i++) {
+        vector_int_add(cod, ids->tab[window_cod->tab[i]]);
+    }
+    return 1;
+}
+
+
+/**
+ * The text is rebuilt by copying the tokens that are not touched by a match
+ * and by retokenizing windows made of the match outputs and of the tokens that
+ * surround them. A token cannot be merged with a neighbour that has not been
+ * modified, since the previous tokenization was maximal, so that retokenizing
+ * one token on each side of an output is enough to get the same result as
+ * Tokenize on the whole text.
+ */
+int update_cassys_text_stream(cassys_text_stream *stream, const char *concord_ind,
+        const Alphabet *alphabet, const VersatileEncodingConfig *vec) {
+    U_FILE *f = u_fopen(vec, concord_ind, U_READ);
+    if (f == NULL) {
+        return 0;
+    }
+    OutputPolicy policy;
+    struct match_list *matches = load_match_list(f, &policy, NULL);
+    u_fclose(f);
+    if (policy == DEBUG_OUTPUTS) {
+        free_match_list(matches);
+        return 0;
+    }
+    int n = stream->cod->nbelems;
+    vector_int *cod = new_vector_int(n + 16);
+    vector_int *enter_pos = new_vector_int(stream->enter_pos->nbelems + 16);
+    Ustring *window = new_Ustring(256);
+    struct token_table *table = new_token_table();
+    vector_int *ids = new_vector_int(256);
+    vector_int *window_cod = new_vector_int(256);
+    vector_int *window_enter_pos = new_vector_int(16);
+    int pos_in_enter_pos = 0;
+    int window_open = 0;
+    int pos = 0;
+    int ok = 1;
+    for (struct match_list *l = matches; l != NULL && ok; l = l->next) {
+        int start = l->m.start_pos_in_token;
+        int end = l->m.end_pos_in_token;
+        if (start < pos) {
+            /* Like Concord, we ignore a match that overlaps a previous one */
+            continue;
+        }
+        if (end < start || end >= n || l->m.start_pos_in_char != 0
+                || l->m.start_pos_in_letter != 0 || l->m.end_pos_in_letter != 0
+                || stream->tokens->value[stream->cod->tab[end]][l->m.end_pos_in_char + 1] != '\0') {
+            /* Matches inside tokens are left to Concord */
+            ok = 0;
+            break;
+        }
+        if (window_open && start - pos >= 1) {
+            /* The token that follows the previous output */
+            append_token(stream, pos, &pos_in_enter_pos, window);
+            pos++;
+        }
+        if (start - pos >= 1) {
+            if (window_open) {
+                ok = tokenize_window(window, stream, alphabet, table, ids, window_cod, window_enter_pos,
+                        cod, enter_pos);
+                empty(window);
+            }
+            copy_tokens(stream, pos, start - 1, &pos_in_enter_pos, cod, enter_pos);
+            /* The token that precedes the output */
+            append_token(stream, start - 1, &pos_in_enter_pos, window);
+        }
+        if (l->output != NULL) {
+            u_strcat(window, l->output);
+        }
+        window_open = 1;
+        pos = end + 1;
+    }
+    if (ok && window_open) {
+        if (pos < n) {
+            append_token(stream, pos, &pos_in_enter_pos, window);
+            pos++;
+        }
+        ok = tokenize_window(window, stream, alphabet, table, ids, window_cod, window_enter_pos,
+                cod, enter_pos);
+    }
+    if (ok) {
+        copy_tokens(stream, pos, n, &pos_in_enter_pos, cod, enter_pos);
+    }
+    free_vector_int(window_enter_pos);
+    free_vector_int(window_cod);
+    free_vector_int(ids);
+    free_token_table(table);
+    free_Ustring(window);
+    free_match_list(matches);
+    if (!ok) {
+        free_vector_int(cod);
+        free_vector_int(enter_pos);
+        return 0;
+    }
+    free_vector_int(stream->cod);
+    free_vector_int(stream->enter_pos);
+    stream->cod = cod;
+    stream->enter_pos = enter_pos;
+    return 1;
+}
+
+
+int save_cassys_text_stream(const cassys_text_stream *stream, const char *text, const Alphabet *alphabet,
+        const VersatileEncodingConfig *vec) {
+    struct snt_files *snt_files = new_snt_files(text);
+    U_FILE *f = u_fopen(vec, snt_files->tokens_txt, U_WRITE);
+    if (f == NULL) {
+        error("Cannot write %s\n", snt_files->tokens_txt);
+        free_snt_files(snt_files);
+        return 0;
+    }
+    char number[16];
+    sprintf(number, "%010d", stream->tokens->size);
+    u_fprintf(f, "%s\n", number);
+    for (int i = 0; i < stream->tokens->size; i++) {
+        u_fprintf(f, "%S\n", stream->tokens->value[i]);
+    }
+    u_fclose(f);
+    int ok = save_int_file(snt_files->text_cod, stream->cod)
+            && save_int_file(snt_files->enter_pos, stream->enter_pos);
+    /* save_cassys_text_stream_text writes each new line as \r\n, so that
+     * each of them shifts the .snt by one char, as Tokenize would note it */
+    vector_int *snt_offsets = new_vector_int(3 * stream->enter_pos->nbelems + 1);
+    for (int i = 0; i < stream->enter_pos->nbelems; i++) {
+        add_snt_offsets(snt_offsets, stream->enter_pos->tab[i], i, i + 1);
+    }
+    if (ok && !save_snt_offsets(snt_offsets, snt_files->snt_offsets_pos)) {
+        error("Cannot save snt offsets in file %s\n", snt_files->snt_offsets_pos);
+        ok = 0;
+    }
+    free_vector_int(snt_offsets);
+    save_token_statistics(vec, snt_files->path, stream->tokens->value, stream->tokens->size,
+            stream->cod, alphabet, 0);
+    free_snt_files(snt_files);
+    return ok;
+}
+
+
+int save_cassys_text_stream_text(const cassys_text_stream *stream, const char *text, const VersatileEncodingConfig *vec) {
+    U_FILE *f = u_fopen(vec, text, U_WRITE);
+    if (f == NULL) {
+        error("Cannot write %s\n", text);
+        return 0;
+    }
+    int pos_in_enter_pos = 0;
+    for (int i = 0; i < stream->cod->nbelems; i++) {
+        if (is_enter_position(stream->enter_pos, &pos_in_enter_pos, i)) {
+            u_fputc_conv_lf_to_crlf_option('\n', f, 1);
+        } else {
+            u_fputs(stream->tokens->value[stream->cod->tab[i]], f);
+        }
+    }
+    u_fclose(f);
+    return 1;
+}
+
+
+
 } // namespace unitex
 
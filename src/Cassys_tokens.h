@@ -30,6 +30,8 @@
 #include "List_ustring.h"
 #include "Vector.h"
 #include "Text_tokens.h"
+#include "String_hash.h"
+#include "Alphabet.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -139,6 +141,65 @@ cassys_tokens_list *new_element(const unichar *u, int transducer_id, int iterati
 cassys_tokens_list *add_output(cassys_tokens_list *list,
 cassys_tokens_list *output, int previous_transducer, int previous_iteration, int transducer_id, int iteration, int number_of_tokens_replaced, int number_of_output_tokens);
 
+
+/**
+ * \struct cassys_text_stream
+ * \brief The tokenized form of the current text of the cascade.
+ *
+ * With the in memory mode, this structure is kept between two transducers, so that
+ * the text of the next stage is obtained by retokenizing only the spans modified by
+ * the matches, instead of running Concord and Tokenize on the whole text.
+ */
+typedef struct cassys_text_stream {
+    /**
+     * The tokens of the text, numbered as in the tokens.txt files of the cascade
+     */
+    struct string_hash *tokens;
+
+    /**
+     * The token sequence of the text, as in text.cod
+     */
+    vector_int *cod;
+
+    /**
+     * The positions of the space tokens that stand for new lines, as in enter.pos
+     */
+    vector_int *enter_pos;
+} cassys_text_stream;
+
+/**
+ * \brief Loads the tokens.txt, text.cod and enter.pos files of the given text
+ *
+ * \return the text stream, or NULL if one of those files cannot be read
+ */
+cassys_text_stream *load_cassys_text_stream(const char *text, const VersatileEncodingConfig *vec);
+
+void free_cassys_text_stream(cassys_text_stream *stream);
+
+/**
+ * \brief Applies the given concord.ind file to the stream, as Concord does when it merges
+ * the matches with the text, followed by Tokenize in word by word mode
+ *
+ * \return 1 on success; 0 if the concordance cannot be applied in memory (a match that
+ * does not cover whole tokens, an output with an unbalanced or invalid tag, etc.), in
+ * which case the stream is left unchanged
+ */
+int update_cassys_text_stream(cassys_text_stream *stream, const char *concord_ind,
+        const Alphabet *alphabet, const VersatileEncodingConfig *vec);
+
+/**
+ * \brief Saves the files that Tokenize would have produced for the text written by
+ * save_cassys_text_stream_text: tokens.txt, text.cod, enter.pos, snt_offsets.pos,
+ * stats.n, tok_by_freq.txt and tok_by_alph.txt
+ */
+int save_cassys_text_stream(const cassys_text_stream *stream, const char *text, const Alphabet *alphabet,
+        const VersatileEncodingConfig *vec);
+
+/**
+ * \brief Saves the text itself, as Concord would have written it
+ */
+int save_cassys_text_stream_text(const cassys_text_stream *stream, const char *text, const VersatileEncodingConfig *vec);
+
 void display_text(cassys_tokens_list *l, int transducer_id, int iteration);
 cassys_tokens_list *get_output(cassys_tokens_list *list, int transducer_id, int iteration);
 
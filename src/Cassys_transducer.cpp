@@ -30,6 +30,10 @@
 #include "File.h"
 #include "Cassys.h"
 #include "Cassys_transducer.h"
+#include "AbstractFst2Load.h"
+#include "BitMasks.h"
+#include "Text_tokens.h"
+#include "DELA.h"
 
 
 #ifndef HAS_UNITEX_NAMESPACE
@@ -302,6 +306,7 @@ struct fifo *load_transducer_from_linked_list(const struct transducer_name_and_m
             t->output_policy = transducer_policy;
             t->repeat_mode = repeat_policy;
                         t->generic_graph = generic_graph;
+            t->first_tokens = NULL;
 
             struct any value;
             value._ptr = t;
@@ -544,5 +549,247 @@ bool is_debug_mode(transducer *t, const VersatileEncodingConfig* vec) {
 }
 
 
+/**
+ * Returns 1 if the given meta, without its angle brackets, can only
+ * match tokens starting with a letter.
+ */
+static int is_letter_meta(const unichar* meta) {
+    return !u_strcmp(meta, "MOT") || !u_strcmp(meta, "WORD")
+        || !u_strcmp(meta, "MAJ") || !u_strcmp(meta, "UPPER")
+        || !u_strcmp(meta, "MIN") || !u_strcmp(meta, "LOWER")
+        || !u_strcmp(meta, "PRE") || !u_strcmp(meta, "FIRST");
+}
+
+
+/**
+ * Adds to 'first_tokens' what the given tag can match. Returns 1 if the
+ * tag does not consume any token, so that the exploration must go on
+ * with the destination state, 0 otherwise.
+ */
+static int add_first_tag(Fst2Tag tag, cassys_first_tokens* first_tokens) {
+    switch (tag->type) {
+    case BEGIN_VAR_TAG:
+    case END_VAR_TAG:
+    case BEGIN_OUTPUT_VAR_TAG:
+    case END_OUTPUT_VAR_TAG:
+    case BEGIN_POSITIVE_CONTEXT_TAG:
+    /* Going through negative contexts as if they were positive ones
+     * only makes the set bigger than necessary */
+    case BEGIN_NEGATIVE_CONTEXT_TAG:
+    case END_CONTEXT_TAG:
+    case LEFT_CONTEXT_TAG:
+    case TEXT_START_TAG:
+    case TEXT_END_TAG: return 1;
+    case UNDEFINED_TAG: break;
+    /* The morphological mode matches pieces of tokens */
+    default: first_tokens->any_token = 1; return 0;
+    }
+    const unichar* input = tag->input;
+    int length = u_strlen(input);
+    if (length == 0 || tag->morphological_filter != NULL || input[0] == '$' || u_strchr(input, '\\') != NULL) {
+        first_tokens->any_token = 1;
+        return 0;
+    }
+    if (!u_strcmp(input, "<E>")) {
+        return 1;
+    }
+    int respect_case = is_bit_mask_set(tag->control, RESPECT_CASE_TAG_BIT_MASK);
+    if (!u_strcmp(input, "#") && !respect_case) {
+        /* The meta that forbids a space */
+        return 1;
+    }
+    if (length > 2 && input[0] == '<' && input[length - 1] == '>') {
+        unichar meta[16];
+        if (length - 2 < (int)(sizeof(meta) / sizeof(unichar))) {
+            u_strcpy_sized(meta, length - 1, input + 1);
+            if (!u_strcmp(meta, "NB")) {
+                first_tokens->digit_token = 1;
+                return 0;
+            }
+            if (is_letter_meta(meta)) {
+                first_tokens->letter_token = 1;
+                return 0;
+            }
+        }
+        /* Lexical masks would require the text dictionaries */
+        first_tokens->any_token = 1;
+        return 0;
+    }
+    if (length > 1 && input[0] == '{') {
+        if (u_strcmp(input, "{S}") && u_strcmp(input, "{STOP}")) {
+            /* A lexical tag may match a dictionary entry of the text */
+            first_tokens->any_token = 1;
+            return 0;
+        }
+        respect_case = 1;
+    }
+    if (respect_case) {
+        first_tokens->case_tokens = sorted_insert(input, first_tokens->case_tokens);
+    } else {
+        first_tokens->tokens = sorted_insert(input, first_tokens->tokens);
+    }
+    return 0;
+}
+
+
+/**
+ * Computes what can start a match of the given grammar, by exploring
+ * the grammar from the initial state of its main graph through the
+ * transitions that do not consume any token. Subgraph calls are explored
+ * as well as the states they lead to, since we do not look for the
+ * subgraphs that can match the empty word.
+ *
+ * This function never returns NULL: if the grammar cannot be loaded,
+ * the result has its 'any_token' field set.
+ */
+cassys_first_tokens* compute_cassys_first_tokens(const char* fst2_name, const VersatileEncodingConfig* vec) {
+    cassys_first_tokens* first_tokens = (cassys_first_tokens*)malloc(sizeof(cassys_first_tokens));
+    if (first_tokens == NULL) {
+        fatal_alloc_error("compute_cassys_first_tokens");
+    }
+    first_tokens->any_token = 0;
+    first_tokens->letter_token = 0;
+    first_tokens->digit_token = 0;
+    first_tokens->tokens = NULL;
+    first_tokens->case_tokens = NULL;
+
+    struct FST2_free_info fst2_free;
+    Fst2* fst2 = load_abstract_fst2(vec, fst2_name, 0, &fst2_free);
+    if (fst2 == NULL) {
+        first_tokens->any_token = 1;
+        return first_tokens;
+    }
+    char* visited = (char*)calloc(fst2->number_of_states, sizeof(char));
+    int* stack = (int*)malloc(fst2->number_of_states * sizeof(int));
+    if (visited == NULL || stack == NULL) {
+        fatal_alloc_error("compute_cassys_first_tokens");
+    }
+    int main_start = fst2->initial_states[1];
+    int main_end = main_start + fst2->number_of_states_per_graphs[1];
+    int stack_size = 0;
+    stack[stack_size++] = main_start;
+    visited[main_start] = 1;
+    while (stack_size != 0 && !first_tokens->any_token) {
+        int state_number = stack[--stack_size];
+        Fst2State state = fst2->states[state_number];
+        if (is_final_state(state) && state_number >= main_start && state_number < main_end) {
+            /* The grammar can match the empty word */
+            first_tokens->any_token = 1;
+            break;
+        }
+        for (Transition* t = state->transitions; t != NULL; t = t->next) {
+            int next[2];
+            int n_next = 0;
+            if (t->tag_number < 0) {
+                next[n_next++] = fst2->initial_states[-(t->tag_number)];
+                next[n_next++] = t->state_number;
+            } else if (add_first_tag(fst2->tags[t->tag_number], first_tokens)) {
+                next[n_next++] = t->state_number;
+            }
+            for (int i = 0; i < n_next; i++) {
+                if (!visited[next[i]]) {
+                    visited[next[i]] = 1;
+                    stack[stack_size++] = next[i];
+                }
+            }
+        }
+    }
+    free(stack);
+    free(visited);
+    free_abstract_Fst2(fst2, &fst2_free);
+    if (first_tokens->any_token) {
+        free_list_ustring(first_tokens->tokens);
+        free_list_ustring(first_tokens->case_tokens);
+        first_tokens->tokens = NULL;
+        first_tokens->case_tokens = NULL;
+    }
+    return first_tokens;
+}
+
+
+void free_cassys_first_tokens(cassys_first_tokens* first_tokens) {
+    if (first_tokens == NULL) {
+        return;
+    }
+    free_list_ustring(first_tokens->tokens);
+    free_list_ustring(first_tokens->case_tokens);
+    free(first_tokens);
 }
 
+
+/**
+ * Returns 1 if the given token can be matched by a token of 'list'. As in
+ * Locate, a token of the grammar also matches the tag tokens of the text
+ * whose inflected form is the same.
+ */
+static int token_list_in_text(const struct list_ustring* list, int respect_case, struct string_hash* text_tokens,
+        const Alphabet* alphabet) {
+    for (; list != NULL; list = list->next) {
+        if (respect_case) {
+            if (get_value_index(list->string, text_tokens, DONT_INSERT) != -1) {
+                return 1;
+            }
+        } else {
+            struct list_int* matching = get_token_list_for_sequence(list->string, alphabet, text_tokens);
+            if (matching != NULL) {
+                free_list_int(matching);
+                return 1;
+            }
+        }
+    }
+    for (int i = 0; i < text_tokens->size; i++) {
+        const unichar* token = text_tokens->value[i];
+        if (token[0] != '{' || token[1] == '\0' || !u_strcmp(token, "{S}") || !u_strcmp(token, "{STOP}")) {
+            continue;
+        }
+        struct dela_entry* entry = tokenize_tag_token(token, 1);
+        if (entry == NULL) {
+            return 1;
+        }
+        int found = 0;
+        for (const struct list_ustring* l = list; l != NULL && !found; l = l->next) {
+            found = respect_case ? !u_strcmp(l->string, entry->inflected)
+                                 : is_equal_or_uppercase(l->string, entry->inflected, alphabet);
+        }
+        free_dela_entry(entry);
+        if (found) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Returns 0 if no token of the text can start a match of the transducer
+ * described by 'first_tokens', 1 otherwise.
+ */
+int cassys_first_tokens_in_text(const cassys_first_tokens* first_tokens, struct string_hash* text_tokens,
+        const Alphabet* alphabet) {
+    if (first_tokens == NULL || first_tokens->any_token || text_tokens == NULL || alphabet == NULL) {
+        return 1;
+    }
+    if (first_tokens->letter_token || first_tokens->digit_token) {
+        for (int i = 0; i < text_tokens->size; i++) {
+            unichar c = text_tokens->value[i][0];
+            if (c == '{' && text_tokens->value[i][1] != '\0') {
+                /* Tag tokens are matched by metas according to their content */
+                return 1;
+            }
+            if ((first_tokens->letter_token && is_letter(c, alphabet))
+                    || (first_tokens->digit_token && c >= '0' && c <= '9')) {
+                return 1;
+            }
+        }
+    }
+    if (first_tokens->tokens != NULL && token_list_in_text(first_tokens->tokens, 0, text_tokens, alphabet)) {
+        return 1;
+    }
+    if (first_tokens->case_tokens != NULL && token_list_in_text(first_tokens->case_tokens, 1, text_tokens, alphabet)) {
+        return 1;
+    }
+    return 0;
+}
+
+
+}
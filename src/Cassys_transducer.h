@@ -35,6 +35,9 @@
 #include "LocateConstants.h"
 #include "FileEncoding.h"
 #include "Error.h"
+#include "List_ustring.h"
+#include "String_hash.h"
+#include "Alphabet.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -60,11 +63,33 @@ struct transducer_name_and_mode_linked_list
  * Structure storing informations about a transducer
  */
 
+/**
+ * Structure describing what can start a match of a transducer. It is used
+ * to skip the transducers that cannot match anything in the current text.
+ * 'any_token' is set when a match may start with something that cannot be
+ * checked against the text tokens only (lexical masks, morphological mode,
+ * empty matches, ...). In that case, the transducer is never skipped.
+ */
+typedef struct cassys_first_tokens {
+    int any_token;
+    /* <MOT>, <MAJ>, <MIN>, <PRE> and their english names */
+    int letter_token;
+    /* <NB> */
+    int digit_token;
+    /* tokens that also match their case variants */
+    struct list_ustring* tokens;
+    /* tokens that must be matched with the same case */
+    struct list_ustring* case_tokens;
+} cassys_first_tokens;
+
+
 typedef struct transducer{
     char *transducer_file_name;
     OutputPolicy output_policy;
     int repeat_mode;
     int generic_graph;
+    /* computed the first time the transducer is about to be applied */
+    cassys_first_tokens* first_tokens;
 }transducer;
 
 
@@ -147,6 +172,13 @@ int extract_cassys_tranducer_star(const char *line);
 
 bool is_debug_mode(transducer *t, const VersatileEncodingConfig* vec);
 
+cassys_first_tokens* compute_cassys_first_tokens(const char* fst2_name, const VersatileEncodingConfig* vec);
+
+void free_cassys_first_tokens(cassys_first_tokens* first_tokens);
+
+int cassys_first_tokens_in_text(const cassys_first_tokens* first_tokens, struct string_hash* text_tokens,
+        const Alphabet* alphabet);
+
 }
 
 #endif /* CASSYS_TRANSDUCER_H_ */
@@ -37,6 +37,8 @@
 #include "BitArray.h"
 #include "CompressedDic.h"
 #include "Ustring.h"
+#include "SyncTool.h"
+#include "logger/SyncLogger.h"
 #include "UnitexRevisionInfo.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
@@ -49,6 +51,7 @@ const char* usage_Compress =
 "Usage:\n"
 "  Compress [options] DICTIONARY\n"
 "  Compress [options] DICTIONARY... -o BINFILE\n"
+"  Compress [options] --batch DICTIONARY...\n"
 "  \n"
 "Compress one or more DELAF dictionaries into a finite state automaton.\n"
 "\n"
@@ -62,6 +65,15 @@ const char* usage_Compress =
 "  -s, --semitic                   uses the semitic compression algorithm. This\n"
 "                                  option is useful to reduce the size of the\n"
 "                                  output when dealing with semitic languages\n"
+"  --incremental                   builds the minimal automaton while reading\n"
+"                                  the entries instead of building first the\n"
+"                                  whole tree. The output is the same, but much\n"
+"                                  less memory is used. This is faster when the\n"
+"                                  dictionaries are sorted (see SortTxt)\n"
+"  -j N, --threads=N               uses N threads to parse the lines and to\n"
+"                                  collect the inflectional codes. With\n"
+"                                  --batch, compresses up to N dictionaries at\n"
+"                                  the same time instead [default: 1]\n"
 " \n"
 "Output options:\n"
 "  -t TYPE, --output_type=TYPE     specifies the type of the output file.\n"
@@ -73,6 +85,9 @@ const char* usage_Compress =
 "                                  [default: bin1]\n"
 "  -o BINFILE, --output=BINFILE    filename used to write the produced automaton\n"
 "  -p, --pack-inf                  create a packed inf file (.inp)\n"
+"  -b, --batch                     compresses each DICTIONARY into its own\n"
+"                                  file, named after it, e.g. foo.dic produces\n"
+"                                  foo.bin. Cannot be used with --output\n"
 " \n"
 "Deprecated options:\n"
 "  --v1                            produces an old style .bin file with a size\n"
@@ -94,7 +109,7 @@ const char* usage_Compress =
 "  --version                       show version and exit\n"
 "";
 
-const char* optstring_Compress = ":fpo:hk:t:Vq:s";
+const char* optstring_Compress = ":fpo:hk:t:Vq:sbj:";
 
 const struct option_TS lopts_Compress[] = {
   { (char *) "bin2"                 , no_argument_TS       , NULL,   2  },
@@ -103,6 +118,9 @@ const struct option_TS lopts_Compress[] = {
   { (char *) "help"                 , no_argument_TS       , NULL,  'h' },
   { (char *) "only-verify-arguments", no_argument_TS       , NULL,  'V' },
   { (char *) "semitic"              , no_argument_TS       , NULL,  's' },
+  { (char *) "incremental"          , no_argument_TS       , NULL,   5  },
+  { (char *) "batch"                , no_argument_TS       , NULL,  'b' },
+  { (char *) "threads"              , required_argument_TS , NULL,  'j' },
   { (char *) "v1"                   , no_argument_TS       , NULL,   3  },
   { (char *) "v2"                   , no_argument_TS       , NULL,   4  },
   { (char *) "version"              , no_argument_TS       , NULL,   1  },
@@ -150,6 +168,354 @@ static void write_INF_file_header(const VersatileEncodingConfig* vec,
   u_fclose(f);
 }
 
+/**
+ * Inserts an entry either in the dictionary tree 'root' or, if 'incremental'
+ * is not NULL, in the minimal automaton being built incrementally
+ */
+static void add_entry(unichar* inflected,
+                      unichar* compress_line,
+                      struct dictionary_node* root,
+                      struct incremental_dictionary* incremental,
+                      struct string_hash* inf_codes,
+                      int line,
+                      Abstract_allocator compress_abstract_allocator) {
+  if (incremental != NULL) {
+    add_entry_to_incremental_dictionary(incremental,
+                                        inflected,
+                                        compress_line);
+    return;
+  }
+  add_entry_to_dictionary_tree(inflected,
+                               compress_line,
+                               root,
+                               inf_codes,
+                               line,
+                               compress_abstract_allocator);
+}
+
+/**
+ * The same as above, except that the INF code is given by its index
+ * in 'inf_codes'
+ */
+static void add_entry(unichar* inflected,
+                      int INF_code,
+                      struct dictionary_node* root,
+                      struct incremental_dictionary* incremental,
+                      struct string_hash* inf_codes,
+                      int line,
+                      Abstract_allocator compress_abstract_allocator) {
+  if (incremental != NULL) {
+    add_entry_to_incremental_dictionary(incremental,
+                                        inflected,
+                                        INF_code);
+    return;
+  }
+  add_entry_to_dictionary_tree(inflected,
+                               INF_code,
+                               root,
+                               inf_codes,
+                               line,
+                               compress_abstract_allocator);
+}
+
+// number of lines parsed by each thread when using several threads
+#define COMPRESS_LINES_PER_THREAD 0x4000
+
+/**
+ * An entry parsed by a thread: its inflected form and the index of
+ * its compressed line in the INF codes of the thread
+ */
+struct parsed_entry {
+  unichar* inflected;
+  int INF_code;
+};
+
+/**
+ * The entries of a DELAF line parsed by a thread. A line with unprotected
+ * = signs gives two entries. 'n_entries' is 0 when the line must be
+ * processed sequentially as usual, i.e. for comments, empty lines and
+ * lines with errors, so that messages and includes keep their order
+ */
+struct parsed_line {
+  int n_entries;
+  struct parsed_entry entries[2];
+};
+
+/**
+ * A slice of lines parsed by a thread. The compressed lines are interned
+ * in 'inf_codes', a hash table private to the thread. It is merged into
+ * the global one when the entries are added sequentially, through
+ * 'inf_indirection', so that the INF codes are numbered as if the
+ * lines had been read by a single thread
+ */
+struct compress_parsing_slice {
+  Ustring** lines;
+  struct parsed_line* parsed;
+  int n_lines;
+  int FLIP;
+  int semitic;
+  struct string_hash* inf_codes;
+  int* inf_indirection;
+};
+
+/**
+ * Lines read by block and parsed by several threads
+ */
+struct compress_parsing {
+  int n_threads;
+  struct compress_parsing_slice* slices;
+  void** slices_ptr;
+  Ustring** lines;
+  struct parsed_line* parsed;
+  // number of lines of the current block
+  int n_lines;
+  // position of the next line of the block to be processed
+  int position;
+};
+
+/**
+ * Stores an entry parsed by a thread
+ */
+static void add_parsed_entry(struct parsed_line* parsed,
+                             const unichar* inflected,
+                             const unichar* compress_line,
+                             struct string_hash* inf_codes) {
+  struct parsed_entry* entry = &(parsed->entries[parsed->n_entries]);
+  entry->inflected = u_strdup(inflected);
+  entry->INF_code  = get_value_index(compress_line, inf_codes);
+  parsed->n_entries++;
+}
+
+/**
+ * Parses the lines of a slice. This does for each line what
+ * build_tree_from_dictionary does, except adding the entries
+ * to the tree
+ */
+static void ABSTRACT_CALLBACK_UNITEX parse_DELAF_lines_thread(
+                                       void* private_data,
+                                       unsigned int /* thread_number */) {
+  struct compress_parsing_slice* slice =
+                     (struct compress_parsing_slice*) private_data;
+  Ustring* line = new_Ustring(DIC_WORD_SIZE);
+  unichar* compress_line = (unichar*) malloc(step_filename_buffer);
+  if (compress_line == NULL) {
+    fatal_alloc_error("parse_DELAF_lines_thread");
+  }
+  for (int i = 0; i < slice->n_lines; ++i) {
+    const Ustring* source = slice->lines[i];
+    struct parsed_line* parsed = &(slice->parsed[i]);
+    parsed->n_entries = 0;
+    // comments, empty lines and lines that would make
+    // replace_special_equal_signs() fail are left to the sequential pass
+    if (source->len == 0 || source->str[0] == '/' ||
+        source->str[source->len-1] == '\\') {
+      continue;
+    }
+    u_strcpy(line, source);
+    replace_special_equal_signs(line->str);
+    int error_code = 0;
+    struct dela_entry* entry = tokenize_DELAF_line(line->str,
+                                                   1,
+                                                   &error_code);
+    if (entry == NULL) {
+      continue;
+    }
+    for (int j = 0; j < entry->n_semantic_codes; ++j) {
+      replace_unprotected_equal_sign(entry->semantic_codes[j],
+                                     (unichar)'=');
+    }
+    for (int j = 0; j < entry->n_inflectional_codes; ++j) {
+      replace_unprotected_equal_sign(entry->inflectional_codes[j],
+                                     (unichar)'=');
+    }
+    if (slice->FLIP) {
+      unichar* o       = entry->inflected;
+      entry->inflected = entry->lemma;
+      entry->lemma     = o;
+    }
+    if (contains_unprotected_equal_sign(entry->inflected)
+        || contains_unprotected_equal_sign(entry->lemma)) {
+      // "pomme de terre, pomme de terre.N"
+      unichar* inflected = u_strdup(entry->inflected);
+      unichar* lemma     = u_strdup(entry->lemma);
+      replace_unprotected_equal_sign(entry->inflected, (unichar)' ');
+      replace_unprotected_equal_sign(entry->lemma, (unichar)' ');
+      get_compressed_line(entry, compress_line, slice->semitic);
+      add_parsed_entry(parsed, entry->inflected, compress_line,
+                       slice->inf_codes);
+      // "pomme-de-terre, pomme-de-terre.N"
+      free(entry->inflected);
+      entry->inflected = inflected;
+      free(entry->lemma);
+      entry->lemma     = lemma;
+      replace_unprotected_equal_sign(entry->inflected, (unichar)'-');
+      replace_unprotected_equal_sign(entry->lemma, (unichar)'-');
+      get_compressed_line(entry, compress_line, slice->semitic);
+      add_parsed_entry(parsed, entry->inflected, compress_line,
+                       slice->inf_codes);
+    } else {
+      get_compressed_line(entry, compress_line, slice->semitic);
+      add_parsed_entry(parsed, entry->inflected, compress_line,
+                       slice->inf_codes);
+    }
+    free_dela_entry(entry);
+  }
+  free(compress_line);
+  free_Ustring(line);
+}
+
+static struct compress_parsing* new_compress_parsing(int n_threads,
+                                                     int FLIP,
+                                                     int semitic) {
+  struct compress_parsing* parsing =
+       (struct compress_parsing*) malloc(sizeof(struct compress_parsing));
+  if (parsing == NULL) {
+    fatal_alloc_error("new_compress_parsing");
+  }
+  int capacity = n_threads * COMPRESS_LINES_PER_THREAD;
+  parsing->n_threads  = n_threads;
+  parsing->slices     = (struct compress_parsing_slice*)
+                        malloc(n_threads * sizeof(struct compress_parsing_slice));
+  parsing->slices_ptr = (void**) malloc(n_threads * sizeof(void*));
+  parsing->lines      = (Ustring**) malloc(capacity * sizeof(Ustring*));
+  parsing->parsed     = (struct parsed_line*)
+                        malloc(capacity * sizeof(struct parsed_line));
+  if (parsing->slices == NULL || parsing->slices_ptr == NULL ||
+      parsing->lines == NULL || parsing->parsed == NULL) {
+    fatal_alloc_error("new_compress_parsing");
+  }
+  for (int i = 0; i < capacity; ++i) {
+    parsing->lines[i] = new_Ustring(DIC_WORD_SIZE);
+    parsing->parsed[i].n_entries = 0;
+  }
+  for (int i = 0; i < n_threads; ++i) {
+    struct compress_parsing_slice* slice = &(parsing->slices[i]);
+    slice->lines           = parsing->lines  + i * COMPRESS_LINES_PER_THREAD;
+    slice->parsed          = parsing->parsed + i * COMPRESS_LINES_PER_THREAD;
+    slice->n_lines         = 0;
+    slice->FLIP            = FLIP;
+    slice->semitic         = semitic;
+    slice->inf_codes       = NULL;
+    slice->inf_indirection = NULL;
+    parsing->slices_ptr[i] = slice;
+  }
+  parsing->n_lines  = 0;
+  parsing->position = 0;
+  return parsing;
+}
+
+/**
+ * Frees the INF codes of the slices and the entries that have not
+ * been added to the tree
+ */
+static void clear_compress_parsing(struct compress_parsing* parsing) {
+  for (int i = parsing->position; i < parsing->n_lines; ++i) {
+    for (int j = 0; j < parsing->parsed[i].n_entries; ++j) {
+      free(parsing->parsed[i].entries[j].inflected);
+    }
+    parsing->parsed[i].n_entries = 0;
+  }
+  for (int i = 0; i < parsing->n_threads; ++i) {
+    free_string_hash(parsing->slices[i].inf_codes);
+    free(parsing->slices[i].inf_indirection);
+    parsing->slices[i].inf_codes       = NULL;
+    parsing->slices[i].inf_indirection = NULL;
+  }
+  parsing->n_lines  = 0;
+  parsing->position = 0;
+}
+
+static void free_compress_parsing(struct compress_parsing* parsing) {
+  if (parsing == NULL) return;
+  clear_compress_parsing(parsing);
+  for (int i = 0; i < parsing->n_threads * COMPRESS_LINES_PER_THREAD; ++i) {
+    free_Ustring(parsing->lines[i]);
+  }
+  free(parsing->parsed);
+  free(parsing->lines);
+  free(parsing->slices_ptr);
+  free(parsing->slices);
+  free(parsing);
+}
+
+/**
+ * Reads the next block of lines and parses them in threads. Returns
+ * the number of lines read, 0 at the end of the file
+ */
+static int parse_next_lines(struct compress_parsing* parsing,
+                            U_FILE* file_handler) {
+  clear_compress_parsing(parsing);
+  int capacity = parsing->n_threads * COMPRESS_LINES_PER_THREAD;
+  while (parsing->n_lines < capacity &&
+         EOF != readline(parsing->lines[parsing->n_lines], file_handler)) {
+    parsing->n_lines++;
+  }
+  int n_slices = 0;
+  for (int i = 0; i < parsing->n_threads; ++i) {
+    struct compress_parsing_slice* slice = &(parsing->slices[i]);
+    slice->n_lines = parsing->n_lines - i * COMPRESS_LINES_PER_THREAD;
+    if (slice->n_lines <= 0) {
+      slice->n_lines = 0;
+      break;
+    }
+    if (slice->n_lines > COMPRESS_LINES_PER_THREAD) {
+      slice->n_lines = COMPRESS_LINES_PER_THREAD;
+    }
+    slice->inf_codes = new_string_hash();
+    n_slices++;
+  }
+  if (n_slices != 0) {
+    logger::SyncDoRunThreads((unsigned int) n_slices,
+                           parse_DELAF_lines_thread,
+                           parsing->slices_ptr);
+  }
+  for (int i = 0; i < n_slices; ++i) {
+    struct compress_parsing_slice* slice = &(parsing->slices[i]);
+    int n = slice->inf_codes->size;
+    slice->inf_indirection = (int*) malloc((n > 0 ? n : 1) * sizeof(int));
+    if (slice->inf_indirection == NULL) {
+      fatal_alloc_error("parse_next_lines");
+    }
+    for (int j = 0; j < n; ++j) {
+      slice->inf_indirection[j] = -1;
+    }
+  }
+  return parsing->n_lines;
+}
+
+/**
+ * Adds to the tree the entries of a line parsed by a thread. The INF codes
+ * of the thread are interned in 'inf_codes' the first time they are used
+ */
+static void add_parsed_line(struct compress_parsing* parsing,
+                            int position,
+                            struct dictionary_node* root,
+                            struct incremental_dictionary* incremental,
+                            struct string_hash* inf_codes,
+                            int line,
+                            Abstract_allocator compress_abstract_allocator) {
+  struct compress_parsing_slice* slice =
+               &(parsing->slices[position / COMPRESS_LINES_PER_THREAD]);
+  struct parsed_line* parsed = &(parsing->parsed[position]);
+  for (int i = 0; i < parsed->n_entries; ++i) {
+    struct parsed_entry* entry = &(parsed->entries[i]);
+    int* code = &(slice->inf_indirection[entry->INF_code]);
+    if (*code == -1) {
+      *code = get_value_index(slice->inf_codes->value[entry->INF_code],
+                              inf_codes);
+    }
+    add_entry(entry->inflected,
+              *code,
+              root,
+              incremental,
+              inf_codes,
+              line,
+              compress_abstract_allocator);
+    free(entry->inflected);
+  }
+  parsed->n_entries = 0;
+}
+
 /**
  * @brief Builds a tree representation of a DELAF dictionary
  *
@@ -162,8 +528,11 @@ static void write_INF_file_header(const VersatileEncodingConfig* vec,
  * @param[in] filename null-terminated string, with a filename to process
  * @param[in] FLIP inflected and lemma forms must be swapped 0:no 1:yes
  * @param[in] semitic use the semitic compression algorithm 0:no 1:yes
+ * @param[in] n_threads number of threads used to parse the lines
  * @param[out] dictionary_list insert other dictionaries referred by \a filename
  * @param[out] root initial state of the dictionary tree
+ * @param[out] incremental if not NULL, the entries are added to this
+ *             minimal automaton instead of the tree
  * @param[out] inf_codes all the INF codes used by the dictionary tree
  * @param[out] n_entries total entries processed without comments
  * @param[out] n_lines total lines scanned including comments
@@ -177,8 +546,10 @@ static int build_tree_from_dictionary(
                      const unichar* filename,
                      int FLIP,
                      int semitic,
+                     int n_threads,
                      list_ustring_ptr dictionary_list,
                      struct dictionary_node* root,
+                     struct incremental_dictionary* incremental,
                      struct string_hash* inf_codes,
                      int* n_entries,
                      int* n_lines,
@@ -234,7 +605,17 @@ static int build_tree_from_dictionary(
   int current_entry = 0;
 
   // current line string
-  Ustring* line     = new_Ustring(DIC_WORD_SIZE);
+  Ustring* line_buffer = new_Ustring(DIC_WORD_SIZE);
+  Ustring* line        = line_buffer;
+
+  // lines read by block and parsed by several threads, if any
+  struct compress_parsing* parsing = NULL;
+  if (n_threads > 1) {
+    parsing = new_compress_parsing(n_threads, FLIP, semitic);
+  }
+
+  // position in 'parsing' of the current line, if it has been parsed
+  int parsed_position = -1;
 
   // represents an entry of the current dictionary
   struct dela_entry* entry = NULL;
@@ -245,7 +626,22 @@ static int build_tree_from_dictionary(
                                        AllocatorCleanPresent) != 0);
 
   // read dictionary line-by-line
-  while (EOF != readline(line, file_handler)) {
+  for (;;) {
+    if (parsing == NULL) {
+      if (EOF == readline(line, file_handler)) {
+        break;
+      }
+    } else {
+      if (parsing->position == parsing->n_lines &&
+          parse_next_lines(parsing, file_handler) == 0) {
+        break;
+      }
+      line = parsing->lines[parsing->position];
+      parsed_position = (parsing->parsed[parsing->position].n_entries != 0) ?
+                        parsing->position : -1;
+      parsing->position++;
+    }
+
     switch (line->str[0]) {
       // disallow empty lines
       case '\0':
@@ -344,6 +740,20 @@ static int build_tree_from_dictionary(
         break;
 
       default:
+        // if the line has already been parsed by a thread,
+        // we only have to add its entries
+        if (parsed_position != -1) {
+          add_parsed_line(parsing,
+                          parsed_position,
+                          root,
+                          incremental,
+                          inf_codes,
+                          current_line,
+                          compress_abstract_allocator);
+          current_entry++;
+          break;
+        }
+
         // if we have a line, we tokenize it
 
         // reinitialize entry to NULL, in this way if replace_special_equal_signs()
@@ -412,7 +822,8 @@ static int build_tree_from_dictionary(
               free_dela_entry(entry, compress_tokenize_abstract_allocator);
             }
 #           endif
-            free_Ustring(line);
+            free_compress_parsing(parsing);
+            free_Ustring(line_buffer);
             u_fclose(file_handler);
             free(heap_buffer);
             return ALLOC_ERROR_CODE;
@@ -429,12 +840,13 @@ static int build_tree_from_dictionary(
 
           // we insert "pomme de terre, pomme de terre.N"
           get_compressed_line(entry, compress_line, semitic);
-          add_entry_to_dictionary_tree(entry->inflected,
-                                       compress_line,
-                                       root,
-                                       inf_codes,
-                                       current_line,
-                                       compress_abstract_allocator);
+          add_entry(entry->inflected,
+                    compress_line,
+                    root,
+                    incremental,
+                    inf_codes,
+                    current_line,
+                    compress_abstract_allocator);
 
           // and then we insert "pomme-de-terre, pomme-de-terre.N"
           u_strcpy(entry->inflected, inf_tmp);
@@ -448,20 +860,22 @@ static int build_tree_from_dictionary(
           replace_unprotected_equal_sign(entry->inflected, (unichar)'-');
           replace_unprotected_equal_sign(entry->lemma, (unichar)'-');
           get_compressed_line(entry, compress_line, semitic);
-          add_entry_to_dictionary_tree(entry->inflected,
-                                       compress_line,
-                                       root,
-                                       inf_codes,
-                                       current_line,
-                                       compress_abstract_allocator);
+          add_entry(entry->inflected,
+                    compress_line,
+                    root,
+                    incremental,
+                    inf_codes,
+                    current_line,
+                    compress_abstract_allocator);
         } else {
           get_compressed_line(entry, compress_line, semitic);
-          add_entry_to_dictionary_tree(entry->inflected,
-                                       compress_line,
-                                       root,
-                                       inf_codes,
-                                       current_line,
-                                       compress_abstract_allocator);
+          add_entry(entry->inflected,
+                    compress_line,
+                    root,
+                    incremental,
+                    inf_codes,
+                    current_line,
+                    compress_abstract_allocator);
         }
 
         // and last, but not least: don't forget to free your memory
@@ -492,12 +906,13 @@ static int build_tree_from_dictionary(
         }
       }
     }
-  }  // while (EOF!=readline(line, file_handler)) {
+  }  // for (;;)
 
   *n_lines   = current_line;
   *n_entries = current_entry;
 
-  free_Ustring(line);
+  free_compress_parsing(parsing);
+  free_Ustring(line_buffer);
   u_fclose(file_handler);
   free(heap_buffer);
 
@@ -517,8 +932,11 @@ static int build_tree_from_dictionary(
  * @param[in] vec encoding I/O Configuration
  * @param[in] FLIP inflected and lemma forms must be swapped 0:no 1:yes
  * @param[in] semitic use the semitic compression algorithm 0:no 1:yes
+ * @param[in] n_threads number of threads used to parse the lines
  * @param[in] dictionary_list of dictionaries to process
  * @param[out] root initial state of the dictionary tree
+ * @param[out] incremental if not NULL, the entries are added to this
+ *             minimal automaton instead of the tree
  * @param[out] inf_codes all the INF codes used by the dictionary tree
  * @param[out] n_files total file read
  * @param[out] n_lines total lines scanned including commentaries
@@ -530,8 +948,10 @@ static int build_tree_from_dictionary_list(
                      const VersatileEncodingConfig* vec,
                      int FLIP,
                      int semitic,
+                     int n_threads,
                      list_ustring_ptr dictionary_list,
                      struct dictionary_node* root,
+                     struct incremental_dictionary* incremental,
                      struct string_hash* inf_codes,
                      int* n_entries,
                      int* n_lines,
@@ -572,8 +992,10 @@ static int build_tree_from_dictionary_list(
        current_dictionary->string,             // current dictionary filename
        FLIP,                                   // inflected and lemma swap
        semitic,                                // semitic compression algorithm
+       n_threads,                              // threads parsing the lines
        dictionary_list,                        // dictionaries filenames
        root,                                   // automaton initial state
+       incremental,                            // minimal automaton, if any
        inf_codes,                              // all the INF codes
        &current_file_total_entries,            // entries processed
        &current_file_total_lines,              // lines scanned
@@ -758,6 +1180,7 @@ static int minimize_and_save_tree_as_bin_classic(
  * @param[in] bin_filename null-terminated string, with the output .bin2 filename
  * @param[in] inf_codes all the INF codes used by the dictionary tree
  * @param[in] minimize function that minimizes the dictionary tree
+ * @param[in] outputs_moved set 1 if the INF codes are already on transitions
  * @param[in,out] root initial state of the dictionary tree
  * @param[out] n_inf_codes total number of inflectional codes used
  * @param[out] n_states total number of states of the automaton
@@ -770,6 +1193,7 @@ static int minimize_and_save_tree_as_bin_two(
                                    const char* bin_filename,
                                    struct string_hash* INF_codes,
                                    minimize_func minimize,
+                                   int outputs_moved,
                                    struct dictionary_node* root,
                                    int* n_states,
                                    int* n_transitions,
@@ -777,7 +1201,9 @@ static int minimize_and_save_tree_as_bin_two(
                                    Abstract_allocator prv_alloc = NULL) {
   // for a .bin2 dictionary, we need to place first the inf codes on
   // the transitions outputs
-  move_outputs_on_transitions(root, INF_codes);
+  if (!outputs_moved) {
+    move_outputs_on_transitions(root, INF_codes);
+  }
 
   // bit array to track INF codes that are actually referenced in the .bin file
   struct bit_array* used_inf_values = new_bit_array(INF_codes->size, ONE_BIT);
@@ -835,6 +1261,244 @@ free_ProgramInvoker(invoker);
 return ret;
 }
 
+/**
+ * Computes the default name of the output file of a dictionary,
+ * e.g. foo.dic produces foo.bin (or foo.bin2).
+ */
+static void default_bin_filename(const char* dictionary_filename,
+                                 BinType bin_type,
+                                 char* bin_filename) {
+  strcpy(bin_filename, dictionary_filename);
+  remove_extension(bin_filename);
+  switch (bin_type) {
+    case BIN_CLASSIC: strcat(bin_filename, ".bin");  break;
+    case BIN_BIN2:    strcat(bin_filename, ".bin2"); break;
+  }
+}
+
+/**
+ * Options shared by all the dictionaries compressed by a Compress call.
+ */
+struct compress_options {
+  const VersatileEncodingConfig* vec;
+  int FLIP;
+  int semitic;
+  BinType bin_type;
+  int new_style_bin;
+  int pack_inp;
+  int incremental_build;
+  // number of threads used to parse the lines of a dictionary
+  int n_threads;
+  // 1 if each dictionary is compressed into its own file
+  int batch;
+  // in batch mode, prevents the stats of two dictionaries from being mixed
+  SYNC_Mutex_OBJECT stats_mutex;
+};
+
+/**
+ * Compresses the dictionaries of 'dictionary_list' into 'bin_filename'
+ * and the associated .inf (or .inp) file, and prints some stats.
+ */
+static int compress_dictionary_list(const struct compress_options* options,
+                                    list_ustring_ptr dictionary_list,
+                                    const char* bin_filename) {
+  char* buffer_filename = (char*) malloc(step_filename_buffer * 2);
+  if (buffer_filename == NULL) {
+    alloc_error("compress_dictionary_list");
+    return ALLOC_ERROR_CODE;
+  }
+
+  // compute the name of the output .inf file associated to a classic .bin
+  char* inf_filename = (buffer_filename + (step_filename_buffer * 0));
+  remove_extension(bin_filename, inf_filename);
+  strcat(inf_filename, ".inf");
+
+  char* inp_filename = (buffer_filename + (step_filename_buffer * 1));
+  remove_extension(bin_filename, inp_filename);
+  strcat(inp_filename, ".inp");
+
+  Abstract_allocator compress_abstract_allocator =
+      create_abstract_allocator("main_Compress",
+      AllocatorCreationFlagAutoFreePrefered);
+
+  Abstract_allocator compress_tokenize_abstract_allocator =
+      create_abstract_allocator("main_Compress_tokenize_first",
+      AllocatorCreationFlagAutoFreePrefered |
+      AllocatorCreationFlagCleanPrefered);
+
+  // root of the dictionary tree
+  struct dictionary_node* root  = new_dictionary_node(compress_abstract_allocator);
+
+  // structure that will contain all the INF codes
+  struct string_hash* INF_codes = new_string_hash();
+
+  // minimal automaton being built while reading, if any
+  struct incremental_dictionary* incremental = NULL;
+  if (options->incremental_build) {
+    incremental = new_incremental_dictionary(root,
+                                             INF_codes,
+                                             options->bin_type == BIN_BIN2,
+                                             compress_abstract_allocator);
+  }
+
+  int return_value  = SUCCESS_RETURN_CODE; // default return code
+  int n_entries     = 0;                   // number of entries processed
+  int n_lines       = 0;                   // number of lines scanned
+  int n_line_errors = 0;                   // number of line errors
+  int n_files       = 0;                   // number of files read
+  int n_inf_codes   = 0;                   // number of inflectional codes used
+  int n_states      = 0;                   // number of states of the automaton
+  int n_transitions = 0;                   // number of transitions of the automaton
+  int bin_size      = 0;                   // size of the resulting .bin file
+
+  // build a tree representation of all the DELAF entries pointed
+  // by the files in the dictionary list
+  return_value = build_tree_from_dictionary_list(
+                         options->vec,     // I/O encoding
+                         options->FLIP,    // inflected and lemma must be swapped
+                         options->semitic, // semitic compression algorithm
+                         options->n_threads, // threads used to parse lines
+                         dictionary_list,  // dictionaries filenames
+                         root,             // automaton initial state
+                         incremental,      // minimal automaton, if any
+                         INF_codes,        // all the INF codes
+                         &n_entries,       // number of entries processed
+                         &n_lines,         // number of lines scanned
+                         &n_line_errors,   // number of line errors
+                         &n_files,         // number of files read
+                         compress_abstract_allocator,
+                         compress_tokenize_abstract_allocator);
+
+  // the incremental automaton is minimal once its last nodes are frozen
+  if (incremental != NULL) {
+    if (return_value == SUCCESS_RETURN_CODE) {
+      close_incremental_dictionary(incremental);
+    }
+    free_incremental_dictionary(incremental);
+  }
+
+  // minimize and save the tree in a binary file always that there are
+  // at least one entry to process
+  if (return_value == SUCCESS_RETURN_CODE) {
+    // function to construct a minimal ADFA
+    minimize_func minimize = options->incremental_build ? mark_used_INF_codes : minimize_tree;
+    switch (options->bin_type) {
+      // classical .bin file
+      case BIN_CLASSIC:
+        return_value = minimize_and_save_tree_as_bin_classic(
+                         options->vec,     // .inf I/O encoding
+                         bin_filename,     // output .bin filename
+                         inf_filename,     // output .inf filename
+                         options->new_style_bin, // 0: old style, 1: new style (>16Mb)
+                         INF_codes,        // all the INF codes
+                         minimize,         // function to construct a minimal ADFA
+                         root,             // automaton initial state
+                         &n_inf_codes,     // inflectional codes used
+                         &n_states,        // states of the automaton
+                         &n_transitions,   // transitions of the automaton
+                         &bin_size,        // size of the resulting .bin file
+                         compress_abstract_allocator);
+        break;
+      // .bin2 style, with outputs included in the transducer
+      case BIN_BIN2:
+        return_value = minimize_and_save_tree_as_bin_two(
+                         bin_filename,     // output .bin filename
+                         INF_codes,        // all the INF codes
+                         minimize,         // function to construct a minimal ADFA
+                         options->incremental_build, // INF codes already on transitions
+                         root,             // automaton initial state
+                         &n_states,        // states of the automaton
+                         &n_transitions,   // transitions of the automaton
+                         &bin_size,        // size of the resulting .bin file
+                         compress_abstract_allocator);
+        break;
+    }
+  }
+
+  // finally, print some stats
+  if (options->stats_mutex != NULL) {
+    SyncGetMutex(options->stats_mutex);
+  }
+  if (options->batch) {
+    u_printf("%s:\n", bin_filename);
+  }
+  if (return_value == SUCCESS_RETURN_CODE) {
+    u_printf("Binary file: %d bytes\n",     bin_size);
+    u_printf("%d file%s read\n",            n_files,       (n_files         > 1)? "s"   :  "");
+    u_printf("%d line%s scanned\n",         n_lines,       (n_lines         > 1)? "s"   :  "");
+    if(n_line_errors > 0 ) {
+      u_printf("%d line%s with errors\n",   n_line_errors, (n_line_errors   > 1)? "s"   :  "");
+    }
+    u_printf("%d entr%s processed\n",       n_entries,     (n_entries       > 1)? "ies" : "y");
+    if (options->bin_type == BIN_CLASSIC) {
+      u_printf("%d INF entr%s created\n",   n_inf_codes,   (n_inf_codes     > 1)? "ies" : "y");
+    }
+    u_printf("%d states, %d transitions\n", n_states,       n_transitions);
+  } else {
+    error("Compress terminated with errors.\n");
+  }
+  if (options->stats_mutex != NULL) {
+    SyncReleaseMutex(options->stats_mutex);
+  }
+
+  /*
+   * WARNING: we do not free the 'INF_codes' structure because of a slowness
+   *          problem with very large INF lines.
+   */
+  // cleanup to avoid leaks when using as library, or when other
+  // dictionaries are still to be compressed in batch mode
+# if !(defined(UNITEX_LIBRARY) || defined(UNITEX_RELEASE_MEMORY_AT_EXIT))
+  if (options->batch)
+# endif
+  {
+    free_dictionary_node(root, compress_abstract_allocator);
+    close_abstract_allocator(compress_abstract_allocator);
+    close_abstract_allocator(compress_tokenize_abstract_allocator);
+    free_string_hash(INF_codes);
+  }
+
+  if (options->pack_inp && (options->bin_type!=BIN_BIN2) && (return_value==SUCCESS_RETURN_CODE)) {
+    if (!convert_inf_to_inp_pack_file(inf_filename, inp_filename)) {
+      return_value = DEFAULT_ERROR_CODE;
+    }
+    af_remove(inf_filename);
+  }
+  free(buffer_filename);
+  return return_value;
+}
+
+/**
+ * A dictionary to compress in batch mode.
+ */
+struct compress_job {
+  list_ustring_ptr dictionary_list;
+  char* bin_filename;
+  int return_value;
+};
+
+/**
+ * The jobs of a batch, shared by all the threads of the pool. Each thread
+ * takes the next job to do until there is no more.
+ */
+struct compress_batch {
+  const struct compress_options* options;
+  struct compress_job* jobs;
+  int n_jobs;
+  volatile long next_job;
+};
+
+static void ABSTRACT_CALLBACK_UNITEX compress_batch_thread(void* private_data,
+                                                          unsigned int /* thread_number */) {
+  struct compress_batch* batch = (struct compress_batch*) private_data;
+  long n;
+  while ((n = SyncAtomicIncrement(&(batch->next_job)) - 1) < batch->n_jobs) {
+    struct compress_job* job = &(batch->jobs[n]);
+    job->return_value = compress_dictionary_list(batch->options,
+                                                 job->dictionary_list,
+                                                 job->bin_filename);
+  }
+}
+
 /**
  * This program reads a .dic file and compress it into a .bin and a .inf file.
  * First, it builds a tree with all the entries, and then, it builds a minimal
@@ -847,7 +1511,7 @@ if (argc == 1) {
 }
 
 // reserve some heap memory to manipulate string buffers
-char* buffer_filename   = (char*) malloc(step_filename_buffer * 5);
+char* buffer_filename   = (char*) malloc(step_filename_buffer * 3);
 if (buffer_filename == NULL) {
   alloc_error("main_Compress");
   return ALLOC_ERROR_CODE;
@@ -857,20 +1521,12 @@ if (buffer_filename == NULL) {
 char* bin_filename      = (buffer_filename + (step_filename_buffer * 0));
 *bin_filename           = '\0';
 
-// name of the file where the packed inflectional codes will be stored
-char* inf_filename      = (buffer_filename + (step_filename_buffer * 1));
-*inf_filename           = '\0';
-
-// name of the file where the packed inflectional codes will be stored packed
-char* inp_filename      = (buffer_filename + (step_filename_buffer * 2));
-*inp_filename           = '\0';
-
 // real path of the dictionary filename that is being processed
-char* resolved_filename = (buffer_filename + (step_filename_buffer * 3));
+char* resolved_filename = (buffer_filename + (step_filename_buffer * 1));
 *resolved_filename      = '\0';
 
 // output_type: "bin1" or "bin2"
-char* output_type       = (buffer_filename + (step_filename_buffer * 4));
+char* output_type       = (buffer_filename + (step_filename_buffer * 2));
 *output_type            = '\0';
 
 // specifies if the inflected and lemma forms must be swapped 0:no 1:yes
@@ -890,6 +1546,17 @@ int new_style_bin       = 1;
 // specifies if the semitic compression algorithm will be used
 int semitic             = 0;
 
+// specifies if the minimal automaton must be built incrementally
+int incremental_build   = 0;
+
+// specifies if each dictionary must be compressed into its own file
+int batch               = 0;
+
+// number of threads used to parse the lines, or to compress the
+// dictionaries in batch mode
+int n_threads           = 1;
+char foo;
+
 // describes the encoding configuration for I/O
 VersatileEncodingConfig vec = VEC_DEFAULT;
 
@@ -909,6 +1576,15 @@ while (EOF != (val = options.parse_long(argc, argv, optstring_Compress, lopts_Co
     case  2 : new_style_bin = 1; bin_type = BIN_BIN2;    break;
     case  3 : new_style_bin = 0; bin_type = BIN_CLASSIC; break;
     case  4 : new_style_bin = 1; bin_type = BIN_CLASSIC; break;
+    case  5 : incremental_build = 1; break;
+    case 'b': batch = 1; break;
+    case 'j': if (1 != sscanf(options.vars()->optarg, "%d%c", &n_threads, &foo)
+                  || n_threads <= 0) {
+                error("Invalid number of threads: %s\n", options.vars()->optarg);
+                free(buffer_filename);
+                return USAGE_ERROR_CODE;
+              }
+              break;
     case 'V': only_verify_arguments = true;
               break;
     case 'h': usage();
@@ -967,8 +1643,15 @@ if (options.vars()->optind == argc) {
   return USAGE_ERROR_CODE;
 }
 
+// in batch mode, each dictionary produces its own output file
+if (batch && bin_filename[0] != '\0') {
+  error("The -o option cannot be used with --batch\n");
+  free(buffer_filename);
+  return USAGE_ERROR_CODE;
+}
+
 // an output filename is mandatory when compressing more than one file
-if (options.vars()->optind != argc-1 && bin_filename[0] == '\0') {
+if (!batch && options.vars()->optind != argc-1 && bin_filename[0] == '\0') {
   error("You must use the -o option when there are more than one .dic\n");
   free(buffer_filename);
   return USAGE_ERROR_CODE;
@@ -999,21 +1682,36 @@ if (only_verify_arguments) {
 
 // If the output .bin name was not passed as an argument,
 // we compute a default filename for it
-if (bin_filename[0] == '\0') {
-  strcpy(bin_filename, argv[options.vars()->optind]);
-  remove_extension(bin_filename);
-  switch (bin_type) {
-    case BIN_CLASSIC: strcat(bin_filename, ".bin");  break;
-    case BIN_BIN2:    strcat(bin_filename, ".bin2"); break;
-  }
+if (!batch && bin_filename[0] == '\0') {
+  default_bin_filename(argv[options.vars()->optind], bin_type, bin_filename);
 }
 
-// compute the name of the output .inf file associated to a classic .bin
-remove_extension(bin_filename, inf_filename);
-strcat(inf_filename, ".inf");
-
-remove_extension(bin_filename, inp_filename);
-strcat(inp_filename, ".inp");
+// the options shared by all the compressions
+struct compress_options compress_opts;
+compress_opts.vec               = &vec;
+compress_opts.FLIP              = FLIP;
+compress_opts.semitic           = semitic;
+compress_opts.bin_type          = bin_type;
+compress_opts.new_style_bin     = new_style_bin;
+compress_opts.pack_inp          = pack_inp;
+compress_opts.incremental_build = incremental_build;
+compress_opts.n_threads         = batch ? 1 : n_threads;
+compress_opts.batch             = batch;
+compress_opts.stats_mutex       = NULL;
+
+// each job compresses one of the dictionaries in batch mode, else there
+// is a single job with all the dictionaries
+int n_args = argc - options.vars()->optind;
+struct compress_job* jobs = (struct compress_job*) malloc(n_args * sizeof(struct compress_job));
+char* bin_filenames = (char*) malloc(n_args * step_filename_buffer);
+if (jobs == NULL || bin_filenames == NULL) {
+  alloc_error("main_Compress");
+  free(jobs);
+  free(bin_filenames);
+  free(buffer_filename);
+  return ALLOC_ERROR_CODE;
+}
+int n_jobs = 0;
 
 // list to store the filenames to process
 list_ustring_ptr dictionary_list = NULL;
@@ -1028,6 +1726,14 @@ for (; options.vars()->optind != argc; (options.vars()->optind)++) {
     if (!is_in_list(resolved_filename, dictionary_list, u_strcmp_ignore_case)) {
       dictionary_list = new_list_ustring(resolved_filename,
                                          dictionary_list);
+      // in batch mode, the .bin name is computed from each dictionary name
+      if (batch) {
+        jobs[n_jobs].dictionary_list = new_list_ustring(resolved_filename);
+        jobs[n_jobs].bin_filename    = bin_filenames + (n_jobs * step_filename_buffer);
+        default_bin_filename(argv[options.vars()->optind], bin_type,
+                             jobs[n_jobs].bin_filename);
+        n_jobs++;
+      }
     // warn about a possible duplicate inclusion
     } else {
       error("The specified filename occurred more than once in the list "
@@ -1043,122 +1749,53 @@ for (; options.vars()->optind != argc; (options.vars()->optind)++) {
 // only continue if there are at least one file to process
 if(!dictionary_list) {
   error("There are no files to process\n");
+  free(jobs);
+  free(bin_filenames);
   free(buffer_filename);
   return DEFAULT_ERROR_CODE;
 }
 
-Abstract_allocator compress_abstract_allocator =
-    create_abstract_allocator("main_Compress",
-    AllocatorCreationFlagAutoFreePrefered);
-
-Abstract_allocator compress_tokenize_abstract_allocator =
-    create_abstract_allocator("main_Compress_tokenize_first",
-    AllocatorCreationFlagAutoFreePrefered |
-    AllocatorCreationFlagCleanPrefered);
-
-// root of the dictionary tree
-struct dictionary_node* root  = new_dictionary_node(compress_abstract_allocator);
-
-// structure that will contain all the INF codes
-struct string_hash* INF_codes = new_string_hash();
-
-int return_value  = SUCCESS_RETURN_CODE; // default return code
-int n_entries     = 0;                   // number of entries processed
-int n_lines       = 0;                   // number of lines scanned
-int n_line_errors = 0;                   // number of line errors
-int n_files       = 0;                   // number of files read
-int n_inf_codes   = 0;                   // number of inflectional codes used
-int n_states      = 0;                   // number of states of the automaton
-int n_transitions = 0;                   // number of transitions of the automaton
-int bin_size      = 0;                   // size of the resulting .bin file
-
-// build a tree representation of all the DELAF entries pointed
-// by the files in the dictionary list
-return_value = build_tree_from_dictionary_list(
-                       &vec,             // I/O encoding
-                       FLIP,             // inflected and lemma must be swapped
-                       semitic,          // semitic compression algorithm
-                       dictionary_list,  // dictionaries filenames
-                       root,             // automaton initial state
-                       INF_codes,        // all the INF codes
-                       &n_entries,       // number of entries processed
-                       &n_lines,         // number of lines scanned
-                       &n_line_errors,   // number of line errors
-                       &n_files,         // number of files read
-                       compress_abstract_allocator,
-                       compress_tokenize_abstract_allocator);
-
-// minimize and save the tree in a binary file always that there are
-// at least one entry to process
-if (return_value == SUCCESS_RETURN_CODE) {
-  switch (bin_type) {
-    // classical .bin file
-    case BIN_CLASSIC:
-      return_value = minimize_and_save_tree_as_bin_classic(
-                       &vec,             // .inf I/O encoding
-                       bin_filename,     // output .bin filename
-                       inf_filename,     // output .inf filename
-                       new_style_bin,    // 0: old style, 1: new style (>16Mb)
-                       INF_codes,        // all the INF codes
-                       minimize_tree,    // function to construct a minimal ADFA
-                       root,             // automaton initial state
-                       &n_inf_codes,     // inflectional codes used
-                       &n_states,        // states of the automaton
-                       &n_transitions,   // transitions of the automaton
-                       &bin_size,        // size of the resulting .bin file
-                       compress_abstract_allocator);
-      break;
-    // .bin2 style, with outputs included in the transducer
-    case BIN_BIN2:
-      return_value = minimize_and_save_tree_as_bin_two(
-                       bin_filename,     // output .bin filename
-                       INF_codes,        // all the INF codes
-                       minimize_tree,    // function to construct a minimal ADFA
-                       root,             // automaton initial state
-                       &n_states,        // states of the automaton
-                       &n_transitions,   // transitions of the automaton
-                       &bin_size,        // size of the resulting .bin file
-                       compress_abstract_allocator);
-      break;
-  }
-}
-
-// finally, print some stats
-if (return_value == SUCCESS_RETURN_CODE) {
-  u_printf("Binary file: %d bytes\n",     bin_size);
-  u_printf("%d file%s read\n",            n_files,       (n_files         > 1)? "s"   :  "");
-  u_printf("%d line%s scanned\n",         n_lines,       (n_lines         > 1)? "s"   :  "");
-  if(n_line_errors > 0 ) {
-    u_printf("%d line%s with errors\n",   n_line_errors, (n_line_errors   > 1)? "s"   :  "");
+int return_value = SUCCESS_RETURN_CODE;
+if (!batch) {
+  return_value = compress_dictionary_list(&compress_opts,
+                                          dictionary_list,
+                                          bin_filename);
+} else {
+  // a pool of threads compresses the dictionaries, each thread taking
+  // the next dictionary to compress when it is done with the previous one
+  struct compress_batch compress_batch;
+  compress_batch.options  = &compress_opts;
+  compress_batch.jobs     = jobs;
+  compress_batch.n_jobs   = n_jobs;
+  compress_batch.next_job = 0;
+  int n_workers = (n_threads < n_jobs) ? n_threads : n_jobs;
+  if (n_workers > 1) {
+    compress_opts.stats_mutex = SyncBuildMutex();
+    void** batch_ptrs = (void**) malloc(n_workers * sizeof(void*));
+    if (batch_ptrs == NULL) {
+      fatal_alloc_error("main_Compress");
+    }
+    for (int i = 0; i < n_workers; ++i) {
+      batch_ptrs[i] = &compress_batch;
+    }
+    logger::SyncDoRunThreads((unsigned int) n_workers, compress_batch_thread, batch_ptrs);
+    free(batch_ptrs);
+    SyncDeleteMutex(compress_opts.stats_mutex);
+  } else {
+    compress_batch_thread(&compress_batch, 0);
   }
-  u_printf("%d entr%s processed\n",       n_entries,     (n_entries       > 1)? "ies" : "y");
-  if (bin_type == BIN_CLASSIC) {
-    u_printf("%d INF entr%s created\n",   n_inf_codes,   (n_inf_codes     > 1)? "ies" : "y");
+  // the first error found, if any, is the return code
+  for (int i = 0; i < n_jobs; ++i) {
+    if (return_value == SUCCESS_RETURN_CODE) {
+      return_value = jobs[i].return_value;
+    }
+    free_list_ustring(jobs[i].dictionary_list);
   }
-  u_printf("%d states, %d transitions\n", n_states,       n_transitions);
-} else {
-  error("Compress terminated with errors.\n");
 }
 
-/*
- * WARNING: we do not free the 'INF_codes' structure because of a slowness
- *          problem with very large INF lines.
- */
-# if (defined(UNITEX_LIBRARY) || defined(UNITEX_RELEASE_MEMORY_AT_EXIT))
-// cleanup to avoid leaks when using as library
-free_dictionary_node(root, compress_abstract_allocator);
-close_abstract_allocator(compress_abstract_allocator);
-close_abstract_allocator(compress_tokenize_abstract_allocator);
-free_string_hash(INF_codes);
-# endif
-
 free_list_ustring(dictionary_list);
-if (pack_inp && (bin_type!=BIN_BIN2) && (return_value==SUCCESS_RETURN_CODE)) {
-  if (!convert_inf_to_inp_pack_file(inf_filename, inp_filename)) {
-    return_value = DEFAULT_ERROR_CODE;
-  }
-  af_remove(inf_filename);
-}
+free(jobs);
+free(bin_filenames);
 free(buffer_filename);
 return return_value;
 }  // int main_Compress(int argc, char* const argv[])
@@ -29,6 +29,7 @@
 #include "LoadInf.h"
 #include "AbstractDelaLoad.h"
 #include "Persistence.h"
+#include "PackInf.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -57,13 +58,12 @@ int isDictionaryNeedInf(const unsigned char* binData, size_t binSize)
 
 
 /**
- * Loads and returns a compressed dictionary.
+ * Loads a compressed dictionary. If 'inp' is not NULL, the .inf codes are
+ * taken from this mapped .inp file, or from 'inf' if it cannot be used.
+ * If 'lazy_inf' is not null, 'inf' is mapped and only indexed if possible.
  */
-Dictionary* new_Dictionary(const VersatileEncodingConfig* vec,const char* bin,const char* inf,Abstract_allocator prv_alloc) {
-void* ptr=get_persistent_structure(bin);
-if (ptr!=NULL) {
-    return (Dictionary*)ptr;
-}
+static Dictionary* load_Dictionary(const VersatileEncodingConfig* vec,const char* bin,const char* inf,
+                                   const char* inp,int lazy_inf,Abstract_allocator prv_alloc) {
 Dictionary* d=(Dictionary*)malloc_cb(sizeof(Dictionary),prv_alloc);
 if (d==NULL) {
     fatal_alloc_error("new_Dictionary");
@@ -79,24 +79,61 @@ if (!read_bin_header(d)) {
     return NULL;
 }
 d->inf=NULL;
+d->inf_lines=NULL;
 if (d->type==BIN_CLASSIC) {
-    if (inf==NULL) {
-        error("NULL .inf file in new_Dictionary\n");
-        free_abstract_BIN(d->bin,&d->bin_free);
-        free_cb(d,prv_alloc);
-        return NULL;
+    if (inp!=NULL) {
+        d->inf=load_mapped_inp_file(inp,&d->inf_free);
     }
-    d->inf=load_abstract_INF_file(vec,inf,&d->inf_free);
-    if (d->inf==NULL) {
-        free_abstract_BIN(d->bin,&d->bin_free);
-        free_cb(d,prv_alloc);
-        return NULL;
+    if (d->inf==NULL && lazy_inf && inf!=NULL && !is_abstract_or_persistent_dictionary_filename(inf)) {
+        d->inf_lines=load_INF_lines(vec,inf);
+    }
+    if (d->inf==NULL && d->inf_lines==NULL) {
+        if (inf==NULL) {
+            error("NULL .inf file in new_Dictionary\n");
+            free_abstract_BIN(d->bin,&d->bin_free);
+            free_cb(d,prv_alloc);
+            return NULL;
+        }
+        d->inf=load_abstract_INF_file(vec,inf,&d->inf_free);
+        if (d->inf==NULL) {
+            free_abstract_BIN(d->bin,&d->bin_free);
+            free_cb(d,prv_alloc);
+            return NULL;
+        }
     }
 }
 return d;
 }
 
 
+/**
+ * Loads and returns a compressed dictionary.
+ */
+Dictionary* new_Dictionary(const VersatileEncodingConfig* vec,const char* bin,const char* inf,Abstract_allocator prv_alloc) {
+void* ptr=acquire_persistent_structure(bin);
+if (ptr!=NULL) {
+    return (Dictionary*)ptr;
+}
+return load_Dictionary(vec,bin,inf,NULL,0,prv_alloc);
+}
+
+
+/**
+ * Like new_Dictionary, but the .inf file is mapped and its lines are only
+ * decoded when they are needed, which saves the time and the memory needed
+ * to load the codes that are never used. The codes of such a dictionary
+ * must be accessed with get_inf_codes or get_inf_line_codes, since
+ * d->inf may be NULL.
+ */
+Dictionary* new_lazy_Dictionary(const VersatileEncodingConfig* vec,const char* bin,const char* inf,Abstract_allocator prv_alloc) {
+void* ptr=acquire_persistent_structure(bin);
+if (ptr!=NULL) {
+    return (Dictionary*)ptr;
+}
+return load_Dictionary(vec,bin,inf,NULL,1,prv_alloc);
+}
+
+
 /**
  * Loads and returns a compressed dictionary, but no need to specify the .inf file
  * that is deduced from 'bin'.
@@ -113,11 +150,12 @@ return new_Dictionary(vec,bin,inf,prv_alloc);
  * Frees all resources associated to the given dictionary
  */
 void free_Dictionary(Dictionary* d,Abstract_allocator prv_alloc) {
-if (d==NULL || is_persistent_structure(d)) return;
+if (d==NULL || release_persistent_structure(d)) return;
 if (d->bin!=NULL) free_abstract_BIN(d->bin,&d->bin_free);
 if (d->inf!=NULL) {
     free_abstract_INF(d->inf,&d->inf_free);
 }
+free_INF_lines(d->inf_lines);
 free_cb(d,prv_alloc);
 }
 
@@ -561,15 +599,24 @@ if (s!=NULL && n!=-1) {
 /**
  * This function stores in *inf_codes the inf code list associated either to the inf number
  * or to the given output, if the dictionary is a .bin2 one. The function returns 1
- * if *inf_codes should be freed (.bin2), 0 if not (.bin).
+ * if *inf_codes should be freed (.bin2 or .bin loaded with new_lazy_Dictionary),
+ * 0 if not (.bin).
  */
 int get_inf_codes(Dictionary* d,int inf_number,Ustring* output,struct list_ustring* *inf_codes,
                 int base) {
 *inf_codes=NULL;
 if (d->type==BIN_CLASSIC) {
-    if (inf_number!=-1) {
-        *inf_codes=d->inf->codes[inf_number];
+    if (inf_number==-1) {
+        return 0;
     }
+    if (d->inf_lines!=NULL) {
+        Ustring* line=new_Ustring();
+        get_INF_line(d->inf_lines,inf_number,line);
+        *inf_codes=tokenize_compressed_info(line->str);
+        free_Ustring(line);
+        return 1;
+    }
+    *inf_codes=d->inf->codes[inf_number];
     return 0;
 }
 if (d->type!=BIN_BIN2) {
@@ -583,19 +630,208 @@ return 1;
 
 
 
-int load_persistent_dictionary(const char* name) {
+/**
+ * Like get_inf_codes, but stores the codes in 'codes', whose buffers are
+ * reused, so that this function does not allocate memory once they are
+ * large enough.
+ */
+void get_inf_line_codes(const Dictionary* d,int inf_number,Ustring* output,int base,
+                        struct INF_line_codes* codes) {
+codes->n=0;
+if (d->type==BIN_CLASSIC) {
+    if (inf_number==-1) {
+        return;
+    }
+    if (d->inf_lines!=NULL) {
+        get_INF_line_codes(d->inf_lines,inf_number,codes);
+    } else {
+        set_INF_line_codes(d->inf->codes[inf_number],codes);
+    }
+    return;
+}
+if (d->type!=BIN_BIN2) {
+    fatal_error("get_inf_line_codes: unsupported dictionary type\n");
+}
+if (output!=NULL && output->str[base]!='\0') {
+    set_INF_line_codes(output->str+base,codes);
+}
+}
+
+
+/**
+ * Information shared by the recursive calls of explore_sorted_tokens.
+ * 'groups' is a stack used to store the bounds of the groups of tokens
+ * that share the same character at the current position.
+ */
+struct bin_lookup {
+   const Dictionary* d;
+   const unichar* const* tokens;
+   BinLookupMode mode;
+   const Alphabet* alphabet;
+   t_bin_lookup_callback f;
+   void* private_data;
+   unichar* inflected;
+   Ustring* ustr;
+   int* groups;
+   int groups_size;
+   int groups_capacity;
+};
+
+
+static int bin_lookup_match(unichar c,unichar token_char,const struct bin_lookup* l) {
+switch (l->mode) {
+case BIN_LOOKUP_EXACT: return c==token_char;
+case BIN_LOOKUP_EQUAL_OR_UPPERCASE: return is_equal_or_uppercase(c,token_char,l->alphabet);
+case BIN_LOOKUP_IGNORE_CASE: return is_equal_ignore_case(token_char,c,l->alphabet);
+}
+return 0;
+}
+
+
+/**
+ * Explores the dictionary from the state at 'offset' with the tokens
+ * in [start;end[, that all share the same 'pos' first characters. Since the
+ * tokens are sorted, the ones that end here are at the beginning of the range
+ * and the others form groups of tokens with the same character at 'pos'.
+ * Each group is then explored at most once per compatible transition,
+ * instead of once per token.
+ */
+static void explore_sorted_tokens(struct bin_lookup* l,int offset,int start,int end,int pos,int base) {
+int final,n_transitions,inf_number;
+int z=save_output(l->ustr);
+int new_offset=read_dictionary_state(l->d,offset,&final,&n_transitions,&inf_number);
+l->inflected[pos]='\0';
+while (start<end && l->tokens[start][pos]=='\0') {
+   l->f(l->private_data,start,offset,final,inf_number,l->inflected,l->ustr,base);
+   restore_output(z,l->ustr);
+   start++;
+}
+if (start==end) {
+   return;
+}
+if (final) {
+   base=l->ustr->len;
+}
+/* We push the bounds of the groups of tokens */
+int first_group=l->groups_size;
+for (int i=start;i<end;) {
+   int j=i+1;
+   while (j<end && l->tokens[j][pos]==l->tokens[i][pos]) {
+      j++;
+   }
+   if (l->groups_size==l->groups_capacity) {
+      l->groups_capacity=2*l->groups_capacity;
+      l->groups=(int*)realloc(l->groups,l->groups_capacity*sizeof(int));
+      if (l->groups==NULL) {
+         fatal_alloc_error("explore_sorted_tokens");
+      }
+   }
+   l->groups[l->groups_size++]=i;
+   i=j;
+}
+int last_group=l->groups_size;
+unichar c;
+int dest;
+offset=new_offset;
+for (int i=0;i<n_transitions;i++) {
+   offset=read_dictionary_transition(l->d,offset,&c,&dest,l->ustr);
+   for (int g=first_group;g<last_group;g++) {
+      int group_start=l->groups[g];
+      int group_end=(g+1<last_group)?l->groups[g+1]:end;
+      if (bin_lookup_match(c,l->tokens[group_start][pos],l)) {
+         l->inflected[pos]=c;
+         explore_sorted_tokens(l,dest,group_start,group_end,pos+1,base);
+      }
+   }
+   restore_output(z,l->ustr);
+}
+l->groups_size=first_group;
+}
+
+
+/**
+ * Looks up all the given tokens in the dictionary in one walk, sharing the
+ * exploration of their common prefixes. 'tokens' must be sorted with
+ * u_strcmp. For each token, 'f' is called with the same states and in the
+ * same order than if the token was looked up alone.
+ */
+void lookup_sorted_tokens(const Dictionary* d,const unichar* const* tokens,int n_tokens,
+                          BinLookupMode mode,const Alphabet* alphabet,
+                          t_bin_lookup_callback f,void* private_data) {
+if (n_tokens<=0) return;
+int max_length=0;
+for (int i=0;i<n_tokens;i++) {
+   int length=u_strlen(tokens[i]);
+   if (length>max_length) max_length=length;
+}
+struct bin_lookup l;
+l.d=d;
+l.tokens=tokens;
+l.mode=mode;
+l.alphabet=alphabet;
+l.f=f;
+l.private_data=private_data;
+l.inflected=(unichar*)malloc((max_length+1)*sizeof(unichar));
+l.groups_capacity=1024;
+l.groups_size=0;
+l.groups=(int*)malloc(l.groups_capacity*sizeof(int));
+if (l.inflected==NULL || l.groups==NULL) {
+   fatal_alloc_error("lookup_sorted_tokens");
+}
+l.ustr=new_Ustring();
+explore_sorted_tokens(&l,d->initial_state_offset,0,n_tokens,0,0);
+free_Ustring(l.ustr);
+free(l.groups);
+free(l.inflected);
+}
+
+
+static int build_inp_cache_file(const char* inf,const char* inp) {
+return convert_inf_to_inp_pack_file(inf,inp) ? 1 : 0;
+}
+
+
+/**
+ * Loads the given dictionary as a persistent one. If a persistence cache
+ * directory is set, the .inf file is converted once into a .inp file of
+ * this directory that is then mapped, like the .bin file, so that several
+ * processes share the same pages. The dictionary is registered under
+ * 'persistent_name' if not NULL, or under its file name otherwise.
+ */
+int load_persistent_dictionary(const char* name,const char* persistent_name) {
 VersatileEncodingConfig vec=VEC_DEFAULT;
-Dictionary* d=new_Dictionary(&vec,name);
+char inf[FILENAME_MAX];
+remove_extension(name,inf);
+strcat(inf,".inf");
+if (persistent_name==NULL) {
+    persistent_name=name;
+}
+Dictionary* d=(Dictionary*)acquire_persistent_structure(persistent_name);
+if (d!=NULL) {
+    /* The dictionary is already persisted: it must not be registered twice */
+    release_persistent_structure(d);
+    return 1;
+}
+char inp[FILENAME_MAX];
+int use_cache=get_persistence_cache_filename(name,".inp",inp)
+              && update_persistence_cache_file(inf,inp,build_inp_cache_file);
+d=load_Dictionary(&vec,name,inf,use_cache ? inp : NULL,0,STANDARD_ALLOCATOR);
 if (d==NULL) return 0;
-set_persistent_structure(name,d);
+if (set_persistent_structure(persistent_name,d)!=NULL) {
+    /* Another thread persisted the dictionary while we were loading it */
+    free_Dictionary(d);
+}
 return 1;
 }
 
 
+static void free_persistent_dictionary_ptr(void* ptr) {
+free_Dictionary((Dictionary*)ptr);
+}
+
+
 void free_persistent_dictionary(const char* name) {
-Dictionary* d=(Dictionary*)get_persistent_structure(name);
-set_persistent_structure(name,NULL);
-free_Dictionary(d);
+remove_persistent_structure(name,free_persistent_dictionary_ptr);
 }
 
 } // namespace unitex
@@ -25,6 +25,7 @@
 #include "Unicode.h"
 #include "AbstractDelaLoad.h"
 #include "Ustring.h"
+#include "Alphabet.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -95,6 +96,9 @@ typedef struct {
     /* The codes contained in the .inf file */
     const struct INF_codes* inf;
     struct INF_free_info inf_free;
+    /* The mapped .inf file of a dictionary loaded with new_lazy_Dictionary;
+     * in that case, 'inf' is NULL */
+    struct INF_lines* inf_lines;
 } Dictionary;
 
 
@@ -102,6 +106,7 @@ typedef struct {
 int isDictionaryNeedInf(const unsigned char* binData, size_t binSize);
 Dictionary* new_Dictionary(const VersatileEncodingConfig*,const char* bin,const char* inf,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 Dictionary* new_Dictionary(const VersatileEncodingConfig*,const char* bin,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
+Dictionary* new_lazy_Dictionary(const VersatileEncodingConfig*,const char* bin,const char* inf,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 void free_Dictionary(Dictionary* d,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 int read_dictionary_state(const Dictionary*,int,int*,int*,int*);
 t_fnc_bin_write_bytes get_bin_write_function_for_encoding(BinEncoding e) ;
@@ -124,8 +129,35 @@ int save_output(Ustring*);
 void restore_output(int,Ustring*);
 
 int get_inf_codes(Dictionary* d,int inf_number,Ustring* output,struct list_ustring* *inf_codes,int base);
+void get_inf_line_codes(const Dictionary* d,int inf_number,Ustring* output,int base,struct INF_line_codes* codes);
 
-int load_persistent_dictionary(const char* name);
+/**
+ * The ways a dictionary character can match a character of a looked up token.
+ */
+typedef enum {
+    BIN_LOOKUP_EXACT,              /* both characters must be equal */
+    BIN_LOOKUP_EQUAL_OR_UPPERCASE, /* the token character may be an uppercase
+                                      variant of the dictionary one */
+    BIN_LOOKUP_IGNORE_CASE         /* case variants match in both ways */
+} BinLookupMode;
+
+
+/**
+ * Function called by lookup_sorted_tokens for each token and for each
+ * dictionary state reached at the end of this token. 'token' is the index
+ * of the token in the sorted array, 'offset' is the position of the state
+ * in the .bin, 'inflected' is the dictionary form that leads to it and
+ * 'output'/'base' are the values to give to get_inf_codes.
+ */
+typedef void (*t_bin_lookup_callback)(void* private_data,int token,int offset,int final,
+                                      int inf_number,const unichar* inflected,
+                                      Ustring* output,int base);
+
+void lookup_sorted_tokens(const Dictionary* d,const unichar* const* tokens,int n_tokens,
+                          BinLookupMode mode,const Alphabet* alphabet,
+                          t_bin_lookup_callback f,void* private_data);
+
+int load_persistent_dictionary(const char* name,const char* persistent_name=NULL);
 void free_persistent_dictionary(const char* name);
 
 } // namespace unitex
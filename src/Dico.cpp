@@ -81,6 +81,9 @@ const char* usage_Dico =
          "  -K/--korean: tells Dico that it works on Korean\n"
          "  -s/--semitic: tells Dico that it works on a semitic language\n"
          "  -u X/--arabic_rules=X: Arabic typographic rule configuration file\n"
+         "  -j N/--threads=N: applies up to N consecutive .bin dictionaries of the same\n"
+         "                    priority in parallel (default: 1). Results are the same\n"
+         "                    as with a single thread\n"
          "  -r X/--raw=X: indicates that Dico should just produce one output file X containing\n"
          "                both simple and compound words, without requiring a text directory.\n"
          "                If X is omitted, results are displayed on the standard output.\n"
@@ -205,7 +208,7 @@ if (len==0 || s[len]!='-') {
 
 
 
-const char* optstring_Dico=":t:a:m:KVhk:q:u:g:sr::";
+const char* optstring_Dico=":t:a:m:KVhk:q:u:g:sr::j:";
 const struct option_TS lopts_Dico[]= {
   {"text",required_argument_TS,NULL,'t'},
   {"alphabet",required_argument_TS,NULL,'a'},
@@ -219,10 +222,36 @@ const struct option_TS lopts_Dico[]= {
   {"arabic_rules",required_argument_TS,NULL,'u'},
   {"raw",optional_argument_TS,NULL,'r'},
   {"semitic",no_argument_TS,NULL,'s'},
+  {"threads",required_argument_TS,NULL,'j'},
   {NULL,no_argument_TS,NULL,0}
 };
 
 
+/**
+ * Returns the priority of the given dictionary according to the mark that
+ * ends its name: 1 for '-', 3 for '+' and 2 otherwise.
+ */
+static int get_dictionary_priority(const char* name) {
+char tmp[FILENAME_MAX];
+remove_extension(name,tmp);
+size_t len=strlen(tmp);
+char priority_mark=(len==0)?'\0':tmp[len-1];
+if (priority_mark=='-') return 1;
+if (priority_mark=='+') return 3;
+return 2;
+}
+
+
+/**
+ * Returns 1 if the given dictionary is a .bin or .bin2 one; 0 otherwise.
+ */
+static int is_bin_dictionary(const char* name) {
+char ext[FILENAME_MAX];
+get_extension(name,ext);
+return !strcmp(ext,".bin") || !strcmp(ext,".bin2");
+}
+
+
 int main_Dico(int argc,char* const argv[]) {
 if (argc==1) {
    usage();
@@ -252,6 +281,8 @@ char negation_operator[0x20]="";
 char* morpho_dic=NULL;
 int is_korean=0;
 int semitic=0;
+int n_threads=1;
+char foo;
 U_FILE* f_raw_output=NULL;
 VersatileEncodingConfig vec=VEC_DEFAULT;
 bool only_verify_arguments = false;
@@ -344,6 +375,14 @@ while (EOF!=(val=options.parse_long(argc,argv,optstring_Dico,lopts_Dico,&index))
              }
              strcpy(raw_output,options.vars()->optarg);
              break;
+   case 'j': if (1!=sscanf(options.vars()->optarg,"%d%c",&n_threads,&foo) || n_threads<=0) {
+                /* foo is used to check that the param is not like "45gjh" */
+                error("Invalid number of threads: %s\n",options.vars()->optarg);
+                free(morpho_dic);
+                free(buffer_filename);
+                return USAGE_ERROR_CODE;
+             }
+             break;
    case ':': index==-1 ? error("Missing argument for option -%c\n",options.vars()->optopt) :
                          error("Missing argument for option --%s\n",lopts_Dico[index].name);
              free(morpho_dic);
@@ -508,6 +547,12 @@ u_fclose(text_cod);
 u_printf("Initializing...\n");
 struct dico_application_info* info=init_dico_application(tokens,NULL,NULL,NULL,NULL,NULL,snt_files->tags_ind,snt_files->text_cod,alphabet,&vec);
 
+/* Used to gather the .bin dictionaries to be applied in parallel */
+const char** bin_group=(const char**)malloc(argc*sizeof(const char*));
+if (bin_group==NULL) {
+   fatal_alloc_error("main_Dico");
+}
+
 /* First of all, we compute the number of occurrences of each token */
 u_printf("Counting tokens...\n");
 count_token_occurrences(info);
@@ -518,12 +563,41 @@ for (int priority=1;priority<4;priority++) {
    for (int i=options.vars()->optind;i<argc;i++) {
       char* tmp = (buffer_filename + (step_filename_buffer * 4));
       remove_extension(argv[i],tmp);
-      char priority_mark=tmp[strlen(tmp)-1];
-      if ((priority==1 && priority_mark=='-') ||  (priority==2 && priority_mark!='-' && priority_mark!='+') ||  (priority==3 && priority_mark=='+')) {
+      if (get_dictionary_priority(argv[i])==priority) {
          /* If we must must process a dictionary, we check its type */
          char* tmp2 = (buffer_filename + (step_filename_buffer * 5));
          get_extension(argv[i],tmp2);
-         if (!strcmp(tmp2,".bin") || !strcmp(tmp2,".bin2"))    {
+         if (n_threads>1 && is_bin_dictionary(argv[i])) {
+            /*
+             * If it is a .bin dictionary and if we can use several threads,
+             * we apply it together with the next .bin dictionaries of the
+             * same priority, stopping on the first .fst2 one of this priority
+             */
+            int n_dics=0;
+            int last=i;
+            for (int j=i;j<argc;j++) {
+               if (get_dictionary_priority(argv[j])!=priority) continue;
+               if (!is_bin_dictionary(argv[j])) break;
+               bin_group[n_dics++]=argv[j];
+               last=j;
+            }
+            info->dlf=u_fopen(&vec,snt_files->dlf,U_APPEND);
+            info->dlc=u_fopen(&vec,snt_files->dlc,U_APPEND);
+            info->err=u_fopen(&vec,snt_files->err,U_WRITE);
+            if (dico_application_in_threads(&vec,bin_group,n_dics,info,priority,
+                                            snt_files->dlf,snt_files->dlc,n_threads) != 0) {
+                ret = 1;
+            }
+            save_unknown_words(info);
+            u_fclose(info->dlf);
+            u_fclose(info->dlc);
+            u_fclose(info->err);
+            info->dlf=NULL;
+            info->dlc=NULL;
+            info->err=NULL;
+            i=last;
+         }
+         else if (is_bin_dictionary(argv[i]))    {
             /*
              * If it is a .bin dictionary
              */
@@ -594,6 +668,7 @@ for (int priority=1;priority<4;priority++) {
                      free_alphabet(alphabet);
                      free(morpho_dic);
                      free(buffer_filename);
+                     free(bin_group);
                      return DEFAULT_ERROR_CODE;
                   }
                }
@@ -626,6 +701,7 @@ for (int priority=1;priority<4;priority++) {
                  free_alphabet(alphabet);
                  free(morpho_dic);
                  free(buffer_filename);
+                 free(bin_group);
                  return DEFAULT_ERROR_CODE;
                }
             }
@@ -641,6 +717,7 @@ for (int priority=1;priority<4;priority++) {
     }
    }
 }
+free(bin_group);
 /* We process the tag sequences, if any */
 u_printf("Sorting and saving tag sequences...\n");
 save_and_sort_tag_sequences(info);
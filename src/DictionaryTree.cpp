@@ -22,6 +22,7 @@
 #include "DictionaryTree.h"
 #include "Error.h"
 #include "Ustring.h"
+#include "HashTable.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -146,7 +147,8 @@ return tmp->next;
  * 'add_entry_to_dictionary_tree'.
  */
 struct dictionnary_info {
-    unichar* INF_code;
+    /* Index of the INF code in 'INF_code_list' */
+    int INF_code;
     struct string_hash* INF_code_list;
 };
 
@@ -177,6 +179,32 @@ static int get_value_index_for_string_colon_string(const unichar* str1,const uni
    return value;
 }
 
+/**
+ * This function adds the INF code described by 'infos' to the given node,
+ * which is the one reached by the inflected form of the entry.
+ */
+static void add_INF_code_to_node(struct dictionary_node* node,struct dictionnary_info* infos,
+                                 Abstract_allocator prv_alloc) {
+int N=infos->INF_code;
+if (node->single_INF_code_list==NULL) {
+   /* If there is no INF code in the node, then
+    * we add one and we return */
+   node->single_INF_code_list=new_list_int(N,prv_alloc);
+   node->INF_code=N;
+   return;
+}
+/* If there is an INF code list in the node ...*/
+if (is_in_list(N,node->single_INF_code_list)) {
+   /* If the INF code has already been taken into account for this node
+    * (case of duplicates), we do nothing */
+   return;
+}
+/* Otherwise, we add it to the INF code list */
+node->single_INF_code_list=head_insert(N,node->single_INF_code_list,prv_alloc);
+/* And we update the global INF line for this node */
+node->INF_code=get_value_index_for_string_colon_string(infos->INF_code_list->value[node->INF_code],infos->INF_code_list->value[N],infos->INF_code_list);
+}
+
 /**
  * This function explores a dictionary tree in order to insert an entry.
  * 'inflected' is the inflected form to insert, and 'pos' is the current position
@@ -189,24 +217,7 @@ for (;;) {
 if (inflected[pos]=='\0') {
    /* If we have reached the end of 'inflected', then we are in the
     * node where the INF code must be inserted */
-   int N=get_value_index(infos->INF_code,infos->INF_code_list);
-   if (node->single_INF_code_list==NULL) {
-      /* If there is no INF code in the node, then
-       * we add one and we return */
-      node->single_INF_code_list=new_list_int(N,prv_alloc);
-      node->INF_code=N;
-      return;
-   }
-   /* If there is an INF code list in the node ...*/
-   if (is_in_list(N,node->single_INF_code_list)) {
-      /* If the INF code has already been taken into account for this node
-       * (case of duplicates), we do nothing */
-      return;
-   }
-   /* Otherwise, we add it to the INF code list */
-   node->single_INF_code_list=head_insert(N,node->single_INF_code_list,prv_alloc);
-    /* And we update the global INF line for this node */
-   node->INF_code=get_value_index_for_string_colon_string(infos->INF_code_list->value[node->INF_code],infos->INF_code,infos->INF_code_list);
+   add_INF_code_to_node(node,infos,prv_alloc);
    return;
 }
 /* If we are not at the end of 'inflected', then we look for
@@ -233,6 +244,18 @@ pos++;
 void add_entry_to_dictionary_tree(unichar* inflected,unichar* INF_code,
                                   struct dictionary_node* root,struct string_hash* INF_code_list,
                                   int line,Abstract_allocator prv_alloc) {
+add_entry_to_dictionary_tree(inflected,get_value_index(INF_code,INF_code_list),root,INF_code_list,
+                             line,prv_alloc);
+}
+
+
+/**
+ * The same than above, except that the INF code is given by its index in
+ * 'INF_code_list'.
+ */
+void add_entry_to_dictionary_tree(unichar* inflected,int INF_code,
+                                  struct dictionary_node* root,struct string_hash* INF_code_list,
+                                  int line,Abstract_allocator prv_alloc) {
 struct dictionnary_info infos;
 infos.INF_code=INF_code;
 infos.INF_code_list=INF_code_list;
@@ -691,4 +714,352 @@ subsequential_to_normal_transducer(root,root,inf_codes,pos,z,normalizedOutput);
 free_Ustring(normalizedOutput);
 }
 
+
+/******************************************************************
+ *
+ *
+ * The following code builds the minimal automaton incrementally,
+ * using Jan Daciuk's algorithm.
+ *
+ *
+ ******************************************************************/
+
+
+/**
+ * This structure is used to build a minimal dictionary automaton while
+ * reading entries, instead of building the whole tree and minimizing it
+ * afterwards. When a new inflected form leaves the path of the previous
+ * one, the nodes of this path are frozen: each one is replaced by an
+ * equivalent node of the register, if any, or inserted into it. This way,
+ * the memory used is proportional to the size of the minimal automaton
+ * rather than to the size of the tree.
+ *
+ * If the dictionary is sorted, a frozen node is never modified again. Otherwise,
+ * the frozen nodes on the path of a new inflected form are taken out of the
+ * register, or cloned if they are shared, which is slower but gives the
+ * same automaton.
+ */
+struct incremental_dictionary {
+    struct dictionary_node* root;
+    struct string_hash* INF_code_list;
+    /* If not null, the outputs are moved on transitions while freezing
+     * nodes, in the same way than 'move_outputs_on_transitions' */
+    int bin2;
+    /* The inflected form of the previous entry */
+    Ustring* previous;
+    /* path[i] is the node reached by the i first letters of 'previous', and
+     * path_trans[i] is the transition from path[i] to path[i+1]. These nodes
+     * are the only ones that are not in the register */
+    struct dictionary_node** path;
+    struct dictionary_node_transition** path_trans;
+    int path_capacity;
+    /* The register of the frozen nodes */
+    struct hash_table* node_register;
+    Abstract_allocator prv_alloc;
+};
+
+
+/**
+ * Hash function for the register. It takes into account the same things
+ * than 'compare_nodes'.
+ */
+static unsigned int hash_dictionary_node(const void* ptr) {
+const struct dictionary_node* node=(const struct dictionary_node*)ptr;
+unsigned int h=0;
+if (node->single_INF_code_list!=NULL) {
+   h=1+(unsigned int)node->INF_code;
+}
+for (const struct dictionary_node_transition* t=node->trans;t!=NULL;t=t->next) {
+   h=h*31+t->letter;
+   h=h*31+(unsigned int)(((size_t)t->node)>>4);
+   if (t->output!=NULL) {
+      for (const unichar* c=t->output;*c!='\0';c++) {
+         h=h*31+*c;
+      }
+   }
+}
+return h;
+}
+
+
+/**
+ * Equal function for the register. Two frozen nodes are equivalent if they have
+ * the same INF code and the same transitions, the destination nodes being
+ * compared by address since they are already unique.
+ */
+static int equal_dictionary_nodes(const void* ptr1,const void* ptr2) {
+const struct dictionary_node* a=(const struct dictionary_node*)ptr1;
+const struct dictionary_node* b=(const struct dictionary_node*)ptr2;
+if ((a->single_INF_code_list==NULL)!=(b->single_INF_code_list==NULL)) return 0;
+if (a->single_INF_code_list!=NULL && a->INF_code!=b->INF_code) return 0;
+const struct dictionary_node_transition* t1=a->trans;
+const struct dictionary_node_transition* t2=b->trans;
+while (t1!=NULL && t2!=NULL) {
+   if (t1->letter!=t2->letter || t1->node!=t2->node || u_strcmp(t1->output,t2->output)) {
+      return 0;
+   }
+   t1=t1->next;
+   t2=t2->next;
+}
+return t1==t2;
+}
+
+
+/**
+ * The registered nodes belong to the automaton, so the register must not free them.
+ */
+static void keep_dictionary_node(void*) {
+}
+
+
+/**
+ * Allocates, initializes and returns a structure for building incrementally
+ * the minimal automaton whose initial state is 'root'. If 'bin2' is not null,
+ * the INF codes are moved on transitions as required for a .bin2 dictionary.
+ */
+struct incremental_dictionary* new_incremental_dictionary(struct dictionary_node* root,
+                                  struct string_hash* INF_code_list,int bin2,
+                                  Abstract_allocator prv_alloc) {
+struct incremental_dictionary* d=(struct incremental_dictionary*)malloc(sizeof(struct incremental_dictionary));
+if (d==NULL) {
+   fatal_alloc_error("new_incremental_dictionary");
+}
+d->root=root;
+d->INF_code_list=INF_code_list;
+d->bin2=bin2;
+d->previous=new_Ustring();
+d->path_capacity=256;
+d->path=(struct dictionary_node**)malloc((d->path_capacity+1)*sizeof(struct dictionary_node*));
+d->path_trans=(struct dictionary_node_transition**)malloc(d->path_capacity*sizeof(struct dictionary_node_transition*));
+if (d->path==NULL || d->path_trans==NULL) {
+   fatal_alloc_error("new_incremental_dictionary");
+}
+d->path[0]=root;
+d->node_register=new_hash_table(hash_dictionary_node,equal_dictionary_nodes,keep_dictionary_node,NULL,NULL);
+d->prv_alloc=prv_alloc;
+return d;
+}
+
+
+/**
+ * Frees the given structure, but not the automaton that has been built.
+ */
+void free_incremental_dictionary(struct incremental_dictionary* d) {
+if (d==NULL) return;
+free_Ustring(d->previous);
+free(d->path);
+free(d->path_trans);
+free_hash_table(d->node_register);
+free(d);
+}
+
+
+/**
+ * For a .bin2 dictionary, this function does for the node pointed by 't' what
+ * 'subsequential_to_normal_transducer' does when it comes back from it: the
+ * common prefix of the outputs of the node is removed from them and placed on
+ * 't', or the INF code of the node is placed on 't' if the node is final.
+ */
+static void move_outputs_before_node(struct dictionary_node_transition* t,
+                                     struct string_hash* INF_code_list,Ustring* prefix) {
+struct dictionary_node* node=t->node;
+if (node->single_INF_code_list!=NULL) {
+   t->output=u_strdup(INF_code_list->value[node->INF_code]);
+   return;
+}
+struct dictionary_node_transition* tmp=node->trans;
+if (tmp==NULL) return;
+u_strcpy(prefix,tmp->output);
+for (tmp=tmp->next;tmp!=NULL;tmp=tmp->next) {
+   get_longest_common_prefix(prefix,tmp->output);
+}
+if (prefix->len==0) return;
+for (tmp=node->trans;tmp!=NULL;tmp=tmp->next) {
+   remove_prefix(prefix->len,tmp->output);
+}
+t->output=u_strdup(prefix->str);
+}
+
+
+/**
+ * For a .bin2 dictionary, this function undoes what 'move_outputs_before_node'
+ * did for the node pointed by 't', which must not be shared.
+ */
+static void move_outputs_back_after_node(struct dictionary_node_transition* t) {
+if (t->output==NULL) return;
+if (t->node->single_INF_code_list==NULL) {
+   int prefix_length=u_strlen(t->output);
+   for (struct dictionary_node_transition* tmp=t->node->trans;tmp!=NULL;tmp=tmp->next) {
+      int length=u_strlen(tmp->output);
+      tmp->output=(unichar*)realloc(tmp->output,sizeof(unichar)*(prefix_length+length+1));
+      if (tmp->output==NULL) {
+         fatal_alloc_error("move_outputs_back_after_node");
+      }
+      memmove(tmp->output+prefix_length,tmp->output,sizeof(unichar)*(length+1));
+      memcpy(tmp->output,t->output,sizeof(unichar)*prefix_length);
+   }
+}
+free(t->output);
+t->output=NULL;
+}
+
+
+/**
+ * Takes the frozen node pointed by 't' out of the register, so that it can be
+ * modified. If the node is shared, 't' is redirected to a copy of it.
+ */
+static void unfreeze_node(struct incremental_dictionary* d,struct dictionary_node_transition* t) {
+struct dictionary_node* node=t->node;
+if (node->incoming==1) {
+   remove_key(d->node_register,node);
+} else {
+   struct dictionary_node* copy=new_dictionary_node(d->prv_alloc);
+   copy->single_INF_code_list=clone(node->single_INF_code_list,d->prv_alloc);
+   copy->INF_code=node->INF_code;
+   struct dictionary_node_transition** last=&(copy->trans);
+   for (struct dictionary_node_transition* tmp=node->trans;tmp!=NULL;tmp=tmp->next) {
+      *last=new_dictionary_node_transition(d->prv_alloc);
+      (*last)->letter=tmp->letter;
+      (*last)->output=u_strdup(tmp->output);
+      (*last)->node=tmp->node;
+      (tmp->node->incoming)++;
+      last=&((*last)->next);
+   }
+   (node->incoming)--;
+   copy->incoming=1;
+   t->node=copy;
+}
+if (d->bin2) {
+   move_outputs_back_after_node(t);
+}
+}
+
+
+/**
+ * Freezes all the nodes of the current path that are deeper than 'depth',
+ * from the deepest one: each of them is either replaced by an equivalent
+ * node of the register or inserted into it.
+ */
+static void freeze_path(struct incremental_dictionary* d,int depth) {
+Ustring* prefix=d->bin2 ? new_Ustring() : NULL;
+for (int i=d->previous->len;i>depth;i--) {
+   struct dictionary_node_transition* t=d->path_trans[i-1];
+   struct dictionary_node* node=t->node;
+   if (d->bin2) {
+      move_outputs_before_node(t,d->INF_code_list,prefix);
+   }
+   int ret;
+   struct any* value=get_value(d->node_register,node,HT_INSERT_IF_NEEDED,&ret);
+   if (ret==HT_KEY_ADDED) {
+      value->_ptr=node;
+      continue;
+   }
+   /* The node is equivalent to a registered one, so we redirect the
+    * transition and we free the node, which is not pointed anymore */
+   free_dictionary_node(node,d->prv_alloc);
+   t->node=(struct dictionary_node*)value->_ptr;
+   (t->node->incoming)++;
+}
+free_Ustring(prefix);
+d->previous->len=depth;
+d->previous->str[depth]='\0';
+}
+
+
+/**
+ * This function adds an entry to the automaton being built. 'inflected' and
+ * 'INF_code' are the same than for 'add_entry_to_dictionary_tree'.
+ */
+void add_entry_to_incremental_dictionary(struct incremental_dictionary* d,
+                                        const unichar* inflected,unichar* INF_code) {
+add_entry_to_incremental_dictionary(d,inflected,get_value_index(INF_code,d->INF_code_list));
+}
+
+
+/**
+ * The same than above, except that the INF code is given by its index in
+ * the INF code list of the automaton.
+ */
+void add_entry_to_incremental_dictionary(struct incremental_dictionary* d,
+                                        const unichar* inflected,int INF_code) {
+int depth=0;
+while ((unsigned int)depth<d->previous->len && inflected[depth]==d->previous->str[depth]) {
+   depth++;
+}
+freeze_path(d,depth);
+struct dictionary_node* node=d->path[depth];
+for (;inflected[depth]!='\0';depth++) {
+   struct dictionary_node_transition* t=get_transition(inflected[depth],&node,d->prv_alloc);
+   if (t->node!=NULL) {
+      /* This only happens if the dictionary is not sorted */
+      unfreeze_node(d,t);
+   } else {
+      t->node=new_dictionary_node(d->prv_alloc);
+      (t->node->incoming)++;
+   }
+   if (depth==d->path_capacity) {
+      d->path_capacity*=2;
+      d->path=(struct dictionary_node**)realloc(d->path,(d->path_capacity+1)*sizeof(struct dictionary_node*));
+      d->path_trans=(struct dictionary_node_transition**)realloc(d->path_trans,d->path_capacity*sizeof(struct dictionary_node_transition*));
+      if (d->path==NULL || d->path_trans==NULL) {
+         fatal_alloc_error("add_entry_to_incremental_dictionary");
+      }
+   }
+   d->path_trans[depth]=t;
+   d->path[depth+1]=t->node;
+   u_strcat(d->previous,inflected[depth]);
+   node=t->node;
+}
+struct dictionnary_info infos;
+infos.INF_code=INF_code;
+infos.INF_code_list=d->INF_code_list;
+add_INF_code_to_node(node,&infos,d->prv_alloc);
+}
+
+
+/**
+ * Freezes the remaining nodes once all the entries have been added. The
+ * automaton is then minimal, and for a .bin2 dictionary, its outputs
+ * are on its transitions.
+ */
+void close_incremental_dictionary(struct incremental_dictionary* d) {
+freeze_path(d,0);
+}
+
+
+/**
+ * This function marks in 'used_inf_values' the INF codes of the final nodes of
+ * the given automaton, using the 'offset' field to visit each node once.
+ */
+static void mark_used_INF_codes(struct dictionary_node* node,struct bit_array* used_inf_values) {
+if (node->offset==-2) return;
+node->offset=-2;
+if (node->single_INF_code_list!=NULL) {
+   set_value(used_inf_values,node->INF_code,1);
+}
+for (struct dictionary_node_transition* t=node->trans;t!=NULL;t=t->next) {
+   mark_used_INF_codes(t->node,used_inf_values);
+}
+}
+
+
+static void unmark_nodes(struct dictionary_node* node) {
+if (node->offset!=-2) return;
+node->offset=-1;
+for (struct dictionary_node_transition* t=node->trans;t!=NULL;t=t->next) {
+   unmark_nodes(t->node);
+}
+}
+
+
+/**
+ * This function has the same prototype than 'minimize_tree', so that it can be
+ * used in its place for an automaton built with 'add_entry_to_incremental_dictionary',
+ * which is already minimal. It only marks the INF codes that are actually used.
+ */
+void mark_used_INF_codes(struct dictionary_node* root,struct bit_array* used_inf_values,Abstract_allocator) {
+mark_used_INF_codes(root,used_inf_values);
+unmark_nodes(root);
+}
+
 } // namespace unitex
@@ -97,11 +97,22 @@ void free_dictionary_node(struct dictionary_node*,Abstract_allocator);
 void free_dictionary_node_transition(struct dictionary_node_transition*,Abstract_allocator);
 void add_entry_to_dictionary_tree(unichar*,unichar*,struct dictionary_node*,struct string_hash*,
         int,Abstract_allocator);
+void add_entry_to_dictionary_tree(unichar*,int,struct dictionary_node*,struct string_hash*,
+        int,Abstract_allocator);
 struct dictionary_node* new_dictionary_node(Abstract_allocator);
 
 void minimize_tree(struct dictionary_node*,struct bit_array*,Abstract_allocator);
 void move_outputs_on_transitions(struct dictionary_node* root,struct string_hash* inf_codes);
 
+struct incremental_dictionary;
+struct incremental_dictionary* new_incremental_dictionary(struct dictionary_node*,struct string_hash*,int,
+        Abstract_allocator);
+void free_incremental_dictionary(struct incremental_dictionary*);
+void add_entry_to_incremental_dictionary(struct incremental_dictionary*,const unichar*,unichar*);
+void add_entry_to_incremental_dictionary(struct incremental_dictionary*,const unichar*,int);
+void close_incremental_dictionary(struct incremental_dictionary*);
+void mark_used_INF_codes(struct dictionary_node*,struct bit_array*,Abstract_allocator);
+
 } // namespace unitex
 
 #endif
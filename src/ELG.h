@@ -1001,6 +1001,10 @@ class vm {
     elg_stack_dump(L);
   }
 
+  int has_main_event(int event_number) const {
+    return main_env_loaded_[event_number];
+  }
+
   int call_token_event(struct locate_parameters* p, int event_number, int* pos, int* current_origin) {
     // only if the main extension was loaded and a token_event is available
     if (UNITEX_LIKELY(!main_env_loaded_[event_number])) {
@@ -1579,6 +1583,58 @@ class vm {
     return 1;
   }
 
+  // 17.10.26 tells if the extended function loaded by load_extension was
+  // declared pure by its extension, i.e. if its name is a value (e.g.
+  // pure_functions = { "foo" }) or a key (e.g. pure_functions = { foo = true })
+  // of the ELG_EXTENSION_PURE_FUNCTIONS table of the extension. The result
+  // of a pure function only depends on its arguments, so it can be memoized
+  // in:             (+2) 1:environment, 2:function
+  // out: [-0, +0] > (+2)
+  int is_pure_function(const char* function_name) {
+    int pure = 0;
+
+    // get the table of pure functions from the extension environment
+    // [-0, +1] > (+3)
+    lua_getfield(L, -2, ELG_EXTENSION_PURE_FUNCTIONS);
+    elg_stack_dump(L);
+
+    if (lua_istable(L, -1)) {
+      // { foo = true }
+      // [-0, +1] > (+4)
+      lua_getfield(L, -1, function_name);
+      pure = lua_toboolean(L, -1);
+      // [-1, +0] > (+3)
+      lua_pop(L, 1);
+
+      // { "foo" }
+      int n_elements = lua_objlen(L, -1);
+      for (int i = 1; !pure && i <= n_elements; ++i) {
+        // [-0, +1] > (+4)
+        lua_rawgeti(L, -1, i);
+        pure = lua_type(L, -1) == LUA_TSTRING &&
+               strcmp(lua_tostring(L, -1), function_name) == 0;
+        // [-1, +0] > (+3)
+        lua_pop(L, 1);
+      }
+    }
+
+    // pop the table of pure functions
+    // [-1, +0] > (+2)
+    lua_pop(L, 1);
+    elg_stack_dump(L);
+    return pure;
+  }
+
+  // 17.10.26 drops an extended function call prepared by load_extension
+  // and the push* functions, without doing it. This is used when the result
+  // of the call was memoized
+  // in:                 (+2+n) 1:environment, 2:function, n:params
+  // out: [-(2+n), +0] > (+0)
+  void cancel_call(int nargs) {
+    lua_pop(L, nargs + 2);
+    elg_stack_dump(L);
+  }
+
   // L is the main thread, lua_State represents this thread
   // this function creates a new thread (not at OS thread)
   static lua_State* create_mirror_state(lua_State* L, int* m_refkey) {
@@ -90,6 +90,8 @@ a->number_of_states_per_graphs=NULL;
 a->input_variables=NULL;
 a->output_variables=NULL;
 a->debug=0;
+a->locate_tags=NULL;
+a->locate_tags_tilde_negation_operator=1;
 return a;
 }
 
@@ -99,7 +101,7 @@ return a;
  * its field are neither NULL nor already freed.
  */
 void free_Fst2(Fst2* fst2,Abstract_allocator prv_alloc) {
-if (fst2==NULL || is_persistent_structure(fst2)) return;
+if (fst2==NULL || release_persistent_structure(fst2)) return;
 int i;
 for (i=0;i<fst2->number_of_states;i++) {
   free_Fst2State(fst2->states[i],prv_alloc);
@@ -663,9 +665,11 @@ read_fst2_states(f,fst2,read_names,NO_GRAPH_NUMBER_SPECIFIED,NULL,prv_alloc);
 #define FILE_POINTER_NULL 2
 
 Fst2* load_fst2(const VersatileEncodingConfig* vec,const char* filename,int read_names,int graph_number,Abstract_allocator prv_alloc) {
-void* ptr=get_persistent_structure(filename);
+void* ptr=acquire_persistent_structure(filename);
 if (ptr!=NULL) {
-    return new_Fst2_clone((Fst2*)ptr);
+    Fst2* clone=new_Fst2_clone((Fst2*)ptr);
+    release_persistent_structure(ptr);
+    return clone;
 }
 U_FILE* f;
 f=u_fopen(vec,filename,U_READ);
@@ -902,6 +906,93 @@ int get_graph_compatibility_mode_by_file(const VersatileEncodingConfig* vec,int
 }
 
 
+/**
+ * The metas that can appear in a tag like <MOT> or <!MOT>.
+ */
+static const struct {
+   const char* name;
+   enum meta_symbol meta;
+} locate_metas[]={
+   {"MOT",META_MOT},
+   {"DIC",META_DIC},
+   {"CDIC",META_CDIC},
+   {"SDIC",META_SDIC},
+   {"TDIC",META_TDIC},
+   {"MAJ",META_MAJ},
+   {"MIN",META_MIN},
+   {"PRE",META_PRE},
+   {"NB",META_NB},
+   {"TOKEN",META_TOKEN},
+   {"LETTER",META_LETTER},
+   {"LETTRE",META_LETTER},
+   {"WORD",META_WORD},
+   {"FIRST",META_FIRST},
+   {"UPPER",META_UPPER},
+   {"LOWER",META_LOWER}
+};
+
+
+/**
+ * Analyses a tag input of the form <...> like Locate does: it can be a meta
+ * like <MOT> or <!DIC>, or a pattern like <be.V>, <V:K> or <be>. In the last
+ * case, 'semantic_codes' is used to decide if 'be' is a lemma or a code, and if
+ * it is NULL, the pattern is an AMBIGUOUS_PATTERN. The pattern, if any, must be
+ * freed by the caller. Returns LOCATE_TAG_NOT_ANALYZED if the input is not of
+ * the form <...>.
+ */
+enum locate_tag_kind analyze_locate_tag(const unichar* input,struct string_hash* semantic_codes,
+                                        int tilde_negation_operator,struct fst2_locate_tag* result,
+                                        Abstract_allocator prv_alloc) {
+result->kind=LOCATE_TAG_NOT_ANALYZED;
+result->meta=(enum meta_symbol)(-1);
+result->negation=0;
+result->pattern=NULL;
+int length=u_strlen(input);
+if (length<2 || input[0]!='<' || input[length-1]!='>') {
+   return LOCATE_TAG_NOT_ANALYZED;
+}
+/* We must test first if it is or not a negative tag like <!XXX> */
+result->negation=(input[1]=='!')?1:0;
+/* Then, we must test if we have or not a meta. To do that, we
+ * look at the content without < > and ! if any.*/
+const unichar* content_start=&(input[1+result->negation]);
+int len_content=length-2-result->negation;
+for (size_t i=0;i<sizeof(locate_metas)/sizeof(locate_metas[0]);i++) {
+   const char* name=locate_metas[i].name;
+   int j;
+   for (j=0;j<len_content && name[j]!='\0' && content_start[j]==(unichar)name[j];j++) {}
+   if (j==len_content && name[j]=='\0') {
+      result->kind=LOCATE_TAG_META;
+      result->meta=locate_metas[i].meta;
+      return LOCATE_TAG_META;
+   }
+}
+/* If we arrive here, we have not a meta but a pattern like
+ * <be>, <be.V>, <V:K>, ... */
+// we allocate an heap buffer only for long meta
+#define STATIC_BUFFER_CONTENT_PROCESS_TAGS_SIZE (0x40)
+unichar static_buffer_content[STATIC_BUFFER_CONTENT_PROCESS_TAGS_SIZE];
+unichar* content;
+if (len_content>=STATIC_BUFFER_CONTENT_PROCESS_TAGS_SIZE) {
+   content=(unichar*)malloc_cb((len_content+1)*sizeof(unichar),prv_alloc);
+   if (content==NULL) {
+      fatal_alloc_error("analyze_locate_tag");
+   }
+} else {
+   content=static_buffer_content;
+}
+memcpy(content,content_start,len_content*sizeof(unichar));
+content[len_content]='\0';
+result->pattern=build_pattern(content,semantic_codes,tilde_negation_operator,prv_alloc);
+/* We don't forget to free the content if needed */
+if (len_content>=STATIC_BUFFER_CONTENT_PROCESS_TAGS_SIZE) {
+   free_cb(content,prv_alloc);
+}
+result->kind=LOCATE_TAG_PATTERN;
+return LOCATE_TAG_PATTERN;
+}
+
+
 /*******************************************************************/
 /* cloning
 */
@@ -969,6 +1060,8 @@ Fst2* fst2ret;
         fst2ret->input_variables = NULL;
         fst2ret->output_variables = NULL;
         fst2ret->debug = fst2org->debug;
+        fst2ret->locate_tags = NULL;
+        fst2ret->locate_tags_tilde_negation_operator = 1;
 
         fst2ret->states = (Fst2State*)malloc_cb(sizeof(Fst2State)*fst2ret->number_of_states,prv_alloc);
         for (i=0;i<fst2org->number_of_states;i++)
@@ -1031,6 +1124,58 @@ Fst2* fst2ret;
 }
 
 
+/**
+ * Returns a fst2 that shares the states, transitions, graph arrays and strings
+ * of 'fst2org' and only owns private copies of the tag structures, which are the
+ * only part of a fst2 that Locate modifies (type, meta, pattern, matching tokens,
+ * filter number, etc). This way, a grammar loaded from a mapped image or from
+ * the persistence layer can be used in place instead of being deep copied.
+ * 'fst2org' must stay alive as long as the view is used, and the view must be
+ * freed with free_Fst2_view.
+ */
+Fst2* new_Fst2_view(const Fst2* fst2org,Abstract_allocator prv_alloc) {
+Fst2* view=(Fst2*)malloc_cb(sizeof(Fst2),prv_alloc);
+if (view==NULL) {
+   fatal_alloc_error("new_Fst2_view");
+}
+*view=*fst2org;
+view->tags=NULL;
+if (fst2org->number_of_tags==0) {
+   return view;
+}
+view->tags=(Fst2Tag*)malloc_cb(fst2org->number_of_tags*sizeof(Fst2Tag),prv_alloc);
+/* All the tag structures are allocated as a single block */
+struct fst2Tag* block=(struct fst2Tag*)malloc_cb(fst2org->number_of_tags*sizeof(struct fst2Tag),prv_alloc);
+if (view->tags==NULL || block==NULL) {
+   fatal_alloc_error("new_Fst2_view");
+}
+for (int i=0;i<fst2org->number_of_tags;i++) {
+   block[i]=*(fst2org->tags[i]);
+   block[i].pattern=clone(fst2org->tags[i]->pattern,prv_alloc);
+   block[i].matching_tokens=clone(fst2org->tags[i]->matching_tokens,prv_alloc);
+   view->tags[i]=&(block[i]);
+}
+return view;
+}
+
+
+/**
+ * Frees a fst2 created by new_Fst2_view, without touching the shared parts.
+ */
+void free_Fst2_view(Fst2* view,Abstract_allocator prv_alloc) {
+if (view==NULL) return;
+if (view->tags!=NULL) {
+   for (int i=0;i<view->number_of_tags;i++) {
+      if (view->tags[i]->pattern!=NULL) free_pattern(view->tags[i]->pattern,prv_alloc);
+      free_list_int(view->tags[i]->matching_tokens,prv_alloc);
+   }
+   free_cb(view->tags[0],prv_alloc);
+   free_cb(view->tags,prv_alloc);
+}
+free_cb(view,prv_alloc);
+}
+
+
 /**
  * Returns the number of the graph (starting at 1) containing the given state.
  *
@@ -181,6 +181,30 @@ struct fst2State {
 typedef struct fst2State* Fst2State;
 
 
+/**
+ * Here we define what Locate can know about a tag input without the text.
+ */
+enum locate_tag_kind {
+   LOCATE_TAG_NOT_ANALYZED, // a token, or a <XXX> pattern that depends on the dictionary codes
+   LOCATE_TAG_META,         // <MOT>, <!DIC>, etc.
+   LOCATE_TAG_PATTERN       // <be.V>, <V:K>, <am,be.V>, etc.
+};
+
+
+/**
+ * This structure represents the analysis of a tag input of the form <...>,
+ * as done by Locate before it looks at the text.
+ */
+struct fst2_locate_tag {
+   enum locate_tag_kind kind;
+   enum meta_symbol meta;
+   /* 1 for <!XXX> */
+   int negation;
+   /* The pattern, for LOCATE_TAG_PATTERN */
+   struct pattern* pattern;
+};
+
+
 /*
  * This structure represent a fst2.
  */
@@ -222,6 +246,15 @@ struct fst2 {
     /* If debug is not 0, then the transition tags are expected to have
      * a special debug format */
     int debug;
+
+    /*
+     * When the fst2 is read from an image (see PackFst2.cpp), this array gives
+     * for each tag the analysis of its input that was done when the image was
+     * written, with the given tilde negation operator. It is NULL otherwise.
+     * Note that it is not owned by copies of the fst2.
+     */
+    struct fst2_locate_tag* locate_tags;
+    int locate_tags_tilde_negation_operator;
 };
 typedef struct fst2 Fst2;
 
@@ -238,6 +271,8 @@ void free_Fst2(Fst2*,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 int get_graph_compatibility_mode_by_file(const VersatileEncodingConfig*,int *p_tilde_negation_operator);
 
 Fst2* new_Fst2_clone(Fst2* fst2org,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
+Fst2* new_Fst2_view(const Fst2* fst2org,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
+void free_Fst2_view(Fst2* view,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 
 Fst2Tag new_Fst2Tag_clone(Fst2Tag Fst2TagSrc,Abstract_allocator prv_alloc);
 
@@ -251,14 +286,18 @@ int is_initial_state(Fst2State);
 int is_final_state(Fst2State);
 
 
-int load_persistent_fst2(const char* filename);
+int load_persistent_fst2(const char* filename,const char* persistent_name=NULL);
 void free_persistent_fst2(const char* filename);
 
 int get_graph_index(Fst2* fst2,int n_state);
 void fst2_output_dot(Fst2 * A);
 
 Fst2Tag create_tag(Fst2* fst2,unichar* line,Abstract_allocator prv_alloc);
+enum locate_tag_kind analyze_locate_tag(const unichar* input,struct string_hash* semantic_codes,
+                                        int tilde_negation_operator,struct fst2_locate_tag* result,
+                                        Abstract_allocator prv_alloc);
 
+Fst2* new_Fst2(Abstract_allocator prv_alloc);
 Fst2State new_Fst2State(Abstract_allocator prv_alloc);
 Fst2Tag new_Fst2Tag(Abstract_allocator prv_alloc);
 Fst2Tag new_Fst2Tag_clone(Fst2Tag Fst2TagSrc,Abstract_allocator prv_alloc);
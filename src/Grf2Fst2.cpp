@@ -35,6 +35,7 @@
 #include "Grf2Fst2.h"
 #include "UnitexGetOpt.h"
 #include "ProgramInvoker.h"
+#include "DirHelper.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -73,10 +74,19 @@ const char* usage_Grf2Fst2 =
      "  -V/--only-verify-arguments: only verify arguments syntax and exit\n"
      "  -C/--clean: compile only with outputs\n"
      "  -p/--pack-fst2: create a packed fst2 file\n"
+     "  -i/--image-fst2: create a memory-mappable fst2 image, that Locate and the other\n"
+     "                   programs can use without parsing it\n"
+     "  -j N/--threads=N: compiles the graphs with N threads (default: 1)\n"
+     "  --cache=DIR: saves each compiled graph in DIR, and reuses it on the next\n"
+     "               compilations as long as its .grf and the options do not change\n"
+     "               (ignored with --debug)\n"
      "  -h/--help: this help\n"
      "\n"
      "Compiles the grammar <grf> and saves the result in a FST2 file\n"
-     "stored in the same directory as <grf>.\n";
+     "stored in the same directory as <grf>.\n"
+     "\n"
+     "With -j or --cache, each graph is compiled on its own and then linked into the\n"
+     "FST2, which gives an equivalent FST2 whose tags may be numbered differently.\n";
 
 
 static void usage() {
@@ -139,7 +149,7 @@ return ret;
 }
 
 
-const char* optstring_Grf2Fst2=":ypntsa:d:ecVho:k:q:r:vS:C";
+const char* optstring_Grf2Fst2=":ypintsa:d:ecVho:k:q:r:vS:Cj:";
 const struct option_TS lopts_Grf2Fst2[]= {
   {"loop_check",no_argument_TS,NULL,'y'},
   {"no_loop_check",no_argument_TS,NULL,'n'},
@@ -160,6 +170,9 @@ const struct option_TS lopts_Grf2Fst2[]= {
   {"strict_tokenization",no_argument_TS,NULL,'S'},
   {"clean",no_argument_TS,NULL,'C'},
   {"pack-fst2",no_argument_TS,NULL,'p'},
+  {"image-fst2",no_argument_TS,NULL,'i'},
+  {"threads",required_argument_TS,NULL,'j'},
+  {"cache",required_argument_TS,NULL,2},
   {NULL,no_argument_TS,NULL,0}
 };
 
@@ -237,12 +250,14 @@ int val,index=-1;
 fst2_file_name[0]='\0';
 bool only_verify_arguments = false;
 bool pack_fst2 = false;
+bool image_fst2 = false;
 UnitexGetOpt options;
 int clean=0;
 
 while (EOF!=(val=options.parse_long(argc,argv,optstring_Grf2Fst2,lopts_Grf2Fst2,&index))) {
    switch(val) {
-   case 'p': pack_fst2=true; break;
+   case 'p': pack_fst2=true; image_fst2=false; break;
+   case 'i': image_fst2=true; pack_fst2=false; break;
    case 'y': check_recursion=1; break;
    case 'n': check_recursion=0; break;
    case 't': tfst_check=1;
@@ -267,6 +282,24 @@ while (EOF!=(val=options.parse_long(argc,argv,optstring_Grf2Fst2,lopts_Grf2Fst2,
              break;
    case 'd': strcpy(infos->repository,options.vars()->optarg); break;
    case 1: infos->debug=1; break;
+   case 2: if (options.vars()->optarg[0]=='\0') {
+                error("You must specify a non empty cache directory\n");
+                free(named);
+                free_compilation_info(infos);
+                return USAGE_ERROR_CODE;
+             }
+             strcpy(infos->cache_dir,options.vars()->optarg);
+             break;
+   case 'j': {
+             char foo;
+             if (1!=sscanf(options.vars()->optarg,"%d%c",&(infos->n_threads),&foo) || infos->n_threads<=0) {
+                error("Invalid number of threads: %s\n",options.vars()->optarg);
+                free(named);
+                free_compilation_info(infos);
+                return USAGE_ERROR_CODE;
+             }
+             break;
+             }
    case 'V': only_verify_arguments = true;
              break;
    case 'h': usage();
@@ -341,6 +374,7 @@ deal_with_named_repositories(named,infos->named_repositories);
 free(named);
 
 if (alph[0]!='\0') {
+  strcpy(infos->alphabet_name,alph);
   infos->alphabet=load_alphabet(&(infos->vec),alph);
   if (infos->alphabet==NULL) {
     error("Cannot load alphabet file %s\n",alph);
@@ -353,7 +387,7 @@ if (fst2_file_name[0]=='\0') {
   strcpy(fst2_file_name,argv[options.vars()->optind]);
 }
 remove_extension(fst2_file_name);
-if (pack_fst2) {
+if (pack_fst2 || image_fst2) {
   strcpy(fst2_packed_file_name, fst2_file_name); 
   strcat(fst2_packed_file_name, ".fst2");
   strcat(fst2_file_name, "_unpacked");
@@ -365,6 +399,9 @@ if ((infos->fst2=u_fopen(&(infos->vec),fst2_file_name,U_WRITE))==NULL) {
    free_compilation_info(infos);
    return DEFAULT_ERROR_CODE;
 }
+if (infos->cache_dir[0]!='\0') {
+  mkDirPortable(infos->cache_dir);
+}
 u_fprintf(infos->fst2,"0000000000\n");
 int result=compile_grf(argv[options.vars()->optind],infos,clean);
 if (result==0) {
@@ -391,7 +428,7 @@ if (infos->renumber->tab[infos->graph_names->size-1]!=infos->graph_names->size)
 if (check_recursion) {
    if (!OK_for_Locate(&(infos->vec),fst2_file_name,infos->no_empty_graph_warning)) {
       free_compilation_info(infos);
-      if (pack_fst2) {
+      if (pack_fst2 || image_fst2) {
         af_rename(fst2_file_name,fst2_packed_file_name);
       }
       return DEFAULT_ERROR_CODE;
@@ -401,7 +438,7 @@ if (check_recursion) {
 if (tfst_check) {
    if (!valid_sentence_automaton(&(infos->vec),fst2_file_name)) {
       free_compilation_info(infos);
-      if (pack_fst2) {
+      if (pack_fst2 || image_fst2) {
         af_rename(fst2_file_name, fst2_packed_file_name);
      }
      return DEFAULT_ERROR_CODE;
@@ -413,6 +450,10 @@ if (pack_fst2) {
   convert_fst2_to_fst2_pack_file(fst2_file_name, fst2_packed_file_name, false);
   af_remove(fst2_file_name);
 }
+if (image_fst2) {
+  convert_fst2_to_fst2_image_file(fst2_file_name, fst2_packed_file_name, false);
+  af_remove(fst2_file_name);
+}
 u_printf("Compilation has succeeded\n");
 return SUCCESS_RETURN_CODE;
 }
@@ -27,6 +27,8 @@
 #include "SingleGraph.h"
 #include "DebugMode.h"
 #include "Grf_lib.h"
+#include "SyncTool.h"
+#include "logger/SyncLogger.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -196,6 +198,10 @@ vector_int_add(infos->part_of_precompiled_fst2,0);
 infos->current_saved_graph=0;
 infos->check_outputs=0;
 infos->strict_tokenization=0;
+infos->cache_dir[0]='\0';
+infos->alphabet_name[0]='\0';
+infos->n_threads=1;
+infos->n_warnings=0;
 return infos;
 }
 
@@ -849,6 +855,7 @@ if (token[0]==':' && token[1]!='\0') {
     else if (is_an_output) {
       error("WARNING in %S: ignoring output associated to subgraph call %S\n",
             infos->graph_names->value[current_graph],token);
+      infos->n_warnings++;
    }
    if (!is_empty(u_tokens)) {
       fatal_error("%S: unexpected token after subgraph call in token_sequence_2_integer_sequence\n",
@@ -1347,8 +1354,10 @@ for (int i=m;i<n;i++) {
  * transition to itself.
  *
  * Note also that this function does not apply to the initial and final states.
+ * It returns the number of boxes that could not be read.
  */
-static void expand_box_ranges(Grf* grf,const char* graphFileName) {
+static int expand_box_ranges(Grf* grf,const char* graphFileName) {
+int n_errors=0;
 ReverseTransitions* reverse=compute_reverse_transitions(grf);
 int n=grf->n_states;
 for (int i=2;i<n;i++) {
@@ -1358,6 +1367,7 @@ for (int i=2;i<n;i++) {
     // tokenize_box_content return NULL if there is error
     if (lines==NULL) {
       error("Bad graph content '%S' at state position %d of file %s\n",s->box_content,i,graphFileName);
+      n_errors++;
       continue;
     }
     unichar* last=(unichar*)lines->tab[lines->nbelems-1];
@@ -1400,6 +1410,7 @@ for (int i=2;i<n;i++) {
     free_vector_ptr(lines,free);
 }
 free_ReverseTransitions(reverse);
+return n_errors;
 }
 
 
@@ -1458,79 +1469,34 @@ free_Ustring(ustr);
 
 
 /**
- * This function compiles the graph number #n and saves its states into the
- * output .fst2.
+ * Computes the file name of the graph #n and, if it is a subgraph, the
+ * file name of the graph that calls it.
  */
-static int compile_grf(int n,struct compilation_info* infos,int clean) {
-int i;
-char called_from[FILENAME_MAX]="";
-char name[FILENAME_MAX];
-char name_fst2[FILENAME_MAX];
+static void get_graph_file_name(int n,char* name,char* called_from,const struct compilation_info* infos) {
 int n_caller;
-SingleGraph graph=new_SingleGraph();
+called_from[0]='\0';
 /* We get the absolute path of the graph */
 get_absolute_name(&n_caller,name,n,infos);
 if (n_caller!=-1) {
     get_absolute_name(NULL,called_from,n_caller,infos);
 }
-char* full_name=NULL;
-if (infos->debug) {
-    full_name=name;
-}
-infos->current_saved_graph++;
-vector_int_add(infos->renumber,infos->current_saved_graph);
 char foo[FILENAME_MAX];
 get_extension(name,foo);
 if (foo[0]=='\0') {
     strcat(name,".grf");
 }
-Grf* grf=NULL;
-if (fexists(name)) {
-    grf=load_Grf(&(infos->vec),name);
-}
-if (grf==NULL) {
-    /* If we can't load the .grf, maybe we should try the .fst2 */
-    remove_extension(name,name_fst2);
-    strcat(name_fst2,".fst2");
-    Fst2* fst2=NULL;
-    if (n!=1 && fexists(name_fst2)) {
-        /* We don't try to load the .fst2 for the main graph */
-        fst2=load_fst2(&(infos->vec),name_fst2,1);
-        if (fst2==NULL) {
-            error("Cannot load %s\n",name_fst2);
-            write_graph(infos->fst2,graph,-n,infos->graph_names->value[n],full_name);
-            free_SingleGraph(graph,NULL);
-            vector_int_add(infos->part_of_precompiled_fst2,0);
-            if (n==1) return 0;
-            return 1;
-        }
-    } else {
-        error("Cannot open graph %s\n",name);
-        if (called_from[0]!='\0') {
-            error("which is called from %s\n",called_from);
-        }
-        write_graph(infos->fst2,graph,-n,infos->graph_names->value[n],full_name);
-        free_SingleGraph(graph,NULL);
-        vector_int_add(infos->part_of_precompiled_fst2,0);
-        if (n==1) return 0;
-        return 1;
-    }
-    if (infos->verbose_name_grf!=0) {
-        u_printf("Loading compiled graph %s\n",name_fst2);
-    }
-    save_compiled_fst2(name_fst2,fst2,infos);
-    /* -1 because we already made infos->current_saved_graph++ */
-    infos->current_saved_graph+=(fst2->number_of_graphs-1);
-    free_Fst2(fst2);
-    free_SingleGraph(graph,NULL);
-    return 1;
-}
-if (n==1 || infos->verbose_name_grf!=0) {
-  u_printf("Compiling graph %s\n",/*infos->graph_names->value[n]*/name);
 }
-/* We indicate that we have a .grf */
-vector_int_add(infos->part_of_precompiled_fst2,0);
-expand_box_ranges(grf,name);
+
+
+/**
+ * Turns the given .grf, that is the graph #n, into a minimal automaton
+ * saved in 'graph'. The .grf is freed. Returns 0 if the graph has been
+ * emptied; 1 otherwise.
+ */
+static int build_graph_from_grf(SingleGraph graph,Grf* grf,const char* name,int n,
+                                struct compilation_info* infos,int clean) {
+int i;
+infos->n_warnings+=expand_box_ranges(grf,name);
 /* If necessary, we resize the graph that it can hold all the states */
 if (graph->capacity<grf->n_states) {
    set_state_array_capacity(graph,grf->n_states);
@@ -1644,27 +1610,114 @@ remove_epsilon_transitions(graph,1);
 check_accessibility(graph->states,0);
 remove_useless_states(graph,NULL);
 if (graph->states[0]==NULL) {
+   return 0;
+}
+/* Now, we minimize the automaton assuming that reversed transitions are still there */
+minimize(graph,0);
+return 1;
+}
+
+
+/**
+ * Prints the warning or the error about the graph #n that has been emptied.
+ * Returns 0 if it makes the compilation fail; 1 otherwise.
+ */
+static int report_emptied_graph(int n,const struct compilation_info* infos) {
+if (n!=1 && infos->no_empty_graph_warning) return 1;
+unichar* emptied_graph_name = u_strdup(infos->graph_names->value[n]);
+unsigned int emptied_graph_name_size = u_strlen(emptied_graph_name);
+for (unsigned int loop = 0; loop < emptied_graph_name_size; loop++) {
+  if (*(emptied_graph_name + loop) == 2)
+    *(emptied_graph_name + loop) = 0;
+}
+if (n==1) {
+   error("ERROR: Main graph %S.grf has been emptied\n", emptied_graph_name);
+   free(emptied_graph_name);
+   return 0;
+}
+error("WARNING: graph %S.grf has been emptied\n", emptied_graph_name);
+free(emptied_graph_name);
+return 1;
+}
+
+
+struct compiled_grf;
+static int link_compiled_grf(const struct compiled_grf*,int,struct compilation_info*);
+
+
+/**
+ * This function compiles the graph number #n, whose file name is 'name',
+ * and saves its states into the output .fst2. If 'compiled' is not NULL,
+ * the graph has already been compiled by compile_grf_locally, and we only
+ * have to link it. If 'try_grf' is 0, we already know that there is
+ * no valid .grf for this graph.
+ */
+static int compile_grf(int n,char* name,const char* called_from,struct compilation_info* infos,
+                       int clean,const struct compiled_grf* compiled,int try_grf) {
+char name_fst2[FILENAME_MAX];
+SingleGraph graph=new_SingleGraph();
+char* full_name=NULL;
+if (infos->debug) {
+    full_name=name;
+}
+infos->current_saved_graph++;
+vector_int_add(infos->renumber,infos->current_saved_graph);
+Grf* grf=NULL;
+if (compiled==NULL && try_grf && fexists(name)) {
+    grf=load_Grf(&(infos->vec),name);
+}
+if (compiled==NULL && grf==NULL) {
+    /* If we can't load the .grf, maybe we should try the .fst2 */
+    remove_extension(name,name_fst2);
+    strcat(name_fst2,".fst2");
+    Fst2* fst2=NULL;
+    if (n!=1 && fexists(name_fst2)) {
+        /* We don't try to load the .fst2 for the main graph */
+        fst2=load_fst2(&(infos->vec),name_fst2,1);
+        if (fst2==NULL) {
+            error("Cannot load %s\n",name_fst2);
+            write_graph(infos->fst2,graph,-n,infos->graph_names->value[n],full_name);
+            free_SingleGraph(graph,NULL);
+            vector_int_add(infos->part_of_precompiled_fst2,0);
+            if (n==1) return 0;
+            return 1;
+        }
+    } else {
+        error("Cannot open graph %s\n",name);
+        if (called_from[0]!='\0') {
+            error("which is called from %s\n",called_from);
+        }
+        write_graph(infos->fst2,graph,-n,infos->graph_names->value[n],full_name);
+        free_SingleGraph(graph,NULL);
+        vector_int_add(infos->part_of_precompiled_fst2,0);
+        if (n==1) return 0;
+        return 1;
+    }
+    if (infos->verbose_name_grf!=0) {
+        u_printf("Loading compiled graph %s\n",name_fst2);
+    }
+    save_compiled_fst2(name_fst2,fst2,infos);
+    /* -1 because we already made infos->current_saved_graph++ */
+    infos->current_saved_graph+=(fst2->number_of_graphs-1);
+    free_Fst2(fst2);
+    free_SingleGraph(graph,NULL);
+    return 1;
+}
+if (n==1 || infos->verbose_name_grf!=0) {
+  u_printf("Compiling graph %s\n",/*infos->graph_names->value[n]*/name);
+}
+/* We indicate that we have a .grf */
+vector_int_add(infos->part_of_precompiled_fst2,0);
+if (compiled!=NULL) {
+   free_SingleGraph(graph,NULL);
+   return link_compiled_grf(compiled,n,infos);
+}
+if (!build_graph_from_grf(graph,grf,name,n,infos,clean)) {
    /* If the graph has been emptied */
    write_graph(infos->fst2,graph,-n,infos->graph_names->value[n],full_name);
    free_SingleGraph(graph,NULL);
-   if (n!=1 && infos->no_empty_graph_warning) return 1;
-   unichar* emptied_graph_name = u_strdup(infos->graph_names->value[n]);
-   unsigned int emptied_graph_name_size = u_strlen(emptied_graph_name);
-   for (unsigned int loop = 0; loop < emptied_graph_name_size; loop++) {
-     if (*(emptied_graph_name + loop) == 2)
-       *(emptied_graph_name + loop) = 0;
-   }
-   if (n==1) {
-      error("ERROR: Main graph %S.grf has been emptied\n", emptied_graph_name);
-      free(emptied_graph_name);
-      return 0;
-   }
-   error("WARNING: graph %S.grf has been emptied\n", emptied_graph_name);
-   free(emptied_graph_name);
-   return 1;
+   return report_emptied_graph(n,infos);
 }
-/* Now, we minimize the automaton assuming that reversed transitions are still there */
-minimize(graph,0);
 /* Finally we save the graph */
 write_graph(infos->fst2,graph,-infos->current_saved_graph,infos->graph_names->value[n],full_name);
 free_SingleGraph(graph,NULL);
@@ -1672,6 +1725,454 @@ return 1;
 }
 
 
+/**
+ * This function compiles the graph number #n and saves its states into the
+ * output .fst2.
+ */
+static int compile_grf(int n,struct compilation_info* infos,int clean) {
+char name[FILENAME_MAX];
+char called_from[FILENAME_MAX];
+get_graph_file_name(n,name,called_from,infos);
+return compile_grf(n,name,called_from,infos,clean,NULL,1);
+}
+
+
+/**
+ * A graph compiled on its own, with its own tag and graph call numbering,
+ * so that it can be compiled in parallel with other graphs, saved in the
+ * cache, and then linked into the .fst2 being built.
+ */
+struct compiled_grf {
+   int emptied;
+   /* Number of warnings emitted during the compilation */
+   int n_warnings;
+   /* Number of context start marks $[ and $![ of the graph, that are
+    * numbered from 0 */
+   int n_contexts;
+   /* The tags, tag #0 being always <E> */
+   int n_tags;
+   unichar** tags;
+   /* The called graphs: #0 is unused and #1 is the graph itself */
+   int n_calls;
+   unichar** calls;
+   /* The values added to compilation_info's preferred vector */
+   int n_preferred;
+   int* preferred;
+   /* The automaton: the transitions of state #i are the (tag, destination)
+    * pairs at positions [first_transition[i];first_transition[i+1]) of
+    * 'transitions'. Graph calls are negative tags, as in the .fst2 */
+   int n_states;
+   int* final;
+   int* first_transition;
+   int* transitions;
+};
+
+
+static void free_compiled_grf(struct compiled_grf* c) {
+if (c==NULL) return;
+for (int i=0;i<c->n_tags;i++) free(c->tags[i]);
+free(c->tags);
+for (int i=2;i<c->n_calls;i++) free(c->calls[i]);
+free(c->calls);
+free(c->preferred);
+free(c->final);
+free(c->first_transition);
+free(c->transitions);
+free(c);
+}
+
+
+static struct compiled_grf* new_compiled_grf() {
+struct compiled_grf* c=(struct compiled_grf*)malloc(sizeof(struct compiled_grf));
+if (c==NULL) {
+   fatal_alloc_error("new_compiled_grf");
+}
+memset(c,0,sizeof(struct compiled_grf));
+return c;
+}
+
+
+static void* malloc_compiled_grf_array(size_t n,size_t size) {
+void* t=malloc((n>0 ? n : 1)*size);
+if (t==NULL) {
+   fatal_alloc_error("malloc_compiled_grf_array");
+}
+return t;
+}
+
+
+/**
+ * Returns the length of the graph name 's', without the caller
+ * number that follows char #2, if any.
+ */
+static int graph_key_length(const unichar* s) {
+int i=0;
+while (s[i]!='\0' && s[i]!=2) i++;
+return i;
+}
+
+
+/**
+ * Compiles the given .grf, that is the graph #n of the grammar, as graph #1
+ * of a private compilation, so that nothing is shared with the other graphs.
+ * The .grf is freed.
+ */
+static struct compiled_grf* compile_grf_locally(Grf* grf,const char* name,int n,
+                                                const struct compilation_info* infos,int clean) {
+struct compilation_info* local=new_compilation_info();
+local->tokenization_policy=infos->tokenization_policy;
+local->alphabet=infos->alphabet;
+local->vec=infos->vec;
+local->check_outputs=infos->check_outputs;
+local->strict_tokenization=infos->strict_tokenization;
+local->no_empty_graph_warning=infos->no_empty_graph_warning;
+const unichar* graph_name=infos->graph_names->value[n];
+unichar* key=u_strdup(graph_name,(unsigned int)graph_key_length(graph_name));
+get_value_index(key,local->graph_names,graph_name);
+free(key);
+SingleGraph graph=new_SingleGraph();
+struct compiled_grf* c=new_compiled_grf();
+c->emptied=!build_graph_from_grf(graph,grf,name,1,local,clean);
+c->n_contexts=local->CONTEXT_COUNTER;
+c->n_warnings=local->n_warnings;
+c->n_tags=local->tags->size;
+c->tags=(unichar**)malloc_compiled_grf_array(c->n_tags,sizeof(unichar*));
+for (int i=0;i<c->n_tags;i++) {
+   c->tags[i]=u_strdup(local->tags->value[i]);
+}
+c->n_calls=local->graph_names->size;
+c->calls=(unichar**)malloc_compiled_grf_array(c->n_calls,sizeof(unichar*));
+c->calls[0]=c->calls[1]=NULL;
+for (int i=2;i<c->n_calls;i++) {
+   const unichar* call=local->graph_names->value[i];
+   c->calls[i]=u_strdup(call,(unsigned int)graph_key_length(call));
+}
+c->n_preferred=local->preferred->nbelems;
+c->preferred=(int*)malloc_compiled_grf_array(c->n_preferred,sizeof(int));
+for (int i=0;i<c->n_preferred;i++) {
+   c->preferred[i]=local->preferred->tab[i];
+}
+if (!c->emptied) {
+   int n_transitions=0;
+   for (int i=0;i<graph->number_of_states;i++) {
+      for (Transition* t=graph->states[i]->outgoing_transitions;t!=NULL;t=t->next) {
+         n_transitions++;
+      }
+   }
+   c->n_states=graph->number_of_states;
+   c->final=(int*)malloc_compiled_grf_array(c->n_states,sizeof(int));
+   c->first_transition=(int*)malloc_compiled_grf_array(c->n_states+1,sizeof(int));
+   c->transitions=(int*)malloc_compiled_grf_array(2*n_transitions,sizeof(int));
+   int pos=0;
+   for (int i=0;i<graph->number_of_states;i++) {
+      c->final[i]=is_final_state(graph->states[i]);
+      c->first_transition[i]=pos;
+      for (Transition* t=graph->states[i]->outgoing_transitions;t!=NULL;t=t->next) {
+         c->transitions[2*pos]=t->tag_number;
+         c->transitions[2*pos+1]=t->state_number;
+         pos++;
+      }
+   }
+   c->first_transition[c->n_states]=pos;
+}
+free_SingleGraph(graph,NULL);
+free_compilation_info(local);
+return c;
+}
+
+
+/**
+ * Returns the number k if 'tag' is the context start mark $[k or $![k
+ * of a graph with n_contexts such marks; -1 otherwise.
+ */
+static int get_context_mark_number(const unichar* tag,int n_contexts) {
+int i;
+if (tag[0]!='$') return -1;
+if (tag[1]=='[') i=2;
+else if (tag[1]=='!' && tag[2]=='[') i=3;
+else return -1;
+if (tag[i]=='\0') return -1;
+int k=0;
+for (;tag[i]!='\0';i++) {
+   if (tag[i]<'0' || tag[i]>'9' || k>=n_contexts) return -1;
+   k=k*10+(tag[i]-'0');
+}
+return (k<n_contexts) ? k : -1;
+}
+
+
+/**
+ * Adds the given compiled graph as the graph #n of the .fst2 being built:
+ * its tags, graph calls and context marks are renumbered as if the graph
+ * had been compiled with the others.
+ */
+static int link_compiled_grf(const struct compiled_grf* c,int n,struct compilation_info* infos) {
+int* tag_numbers=(int*)malloc_compiled_grf_array(c->n_tags,sizeof(int));
+Ustring* tmp=new_Ustring();
+for (int i=0;i<c->n_tags;i++) {
+   int k=get_context_mark_number(c->tags[i],c->n_contexts);
+   if (k==-1) {
+      tag_numbers[i]=get_value_index(c->tags[i],infos->tags);
+   } else {
+      u_sprintf(tmp,"%s%d",(c->tags[i][1]=='!')?"$![":"$[",infos->CONTEXT_COUNTER+k);
+      tag_numbers[i]=get_value_index(tmp->str,infos->tags);
+   }
+}
+infos->CONTEXT_COUNTER+=c->n_contexts;
+int* graph_numbers=(int*)malloc_compiled_grf_array(c->n_calls,sizeof(int));
+graph_numbers[0]=0;
+if (c->n_calls>1) {
+   graph_numbers[1]=n;
+}
+for (int i=2;i<c->n_calls;i++) {
+   u_sprintf(tmp,"%S%C%d",c->calls[i],0x02,n);
+   graph_numbers[i]=get_value_index(c->calls[i],infos->graph_names,tmp->str);
+}
+free_Ustring(tmp);
+for (int i=0;i<c->n_preferred;i++) {
+   vector_int_add(infos->preferred,c->preferred[i]);
+}
+U_FILE* f=infos->fst2;
+int ret=1;
+if (c->emptied) {
+   u_fprintf(f,"%d ",-n);
+} else {
+   u_fprintf(f,"%d ",-infos->current_saved_graph);
+}
+for (const unichar* name=infos->graph_names->value[n];(*name)!='\0' && (*name)!=2;name++) {
+    u_fputc(*name,f);
+}
+u_fprintf(f,"\n");
+if (c->emptied) {
+   u_fprintf(f, ": \n");
+   ret=report_emptied_graph(n,infos);
+}
+for (int i=0;i<c->n_states;i++) {
+   u_fputc(c->final[i] ? 't' : ':',f);
+   for (int j=c->first_transition[i];j<c->first_transition[i+1];j++) {
+      int tag=c->transitions[2*j];
+      tag=(tag<0) ? -graph_numbers[-tag] : tag_numbers[tag];
+      u_fprintf(f," %d %d",tag,c->transitions[2*j+1]);
+   }
+   u_fprintf(f," \n");
+}
+u_fprintf(f,"f \n");
+free(tag_numbers);
+free(graph_numbers);
+return ret;
+}
+
+
+#define GRF_CACHE_FNV_BASIS 14695981039346656037ULL
+#define GRF_CACHE_FNV_PRIME 1099511628211ULL
+#define GRF_CACHE_MAGIC 0x31434647   /* "GFC1" */
+
+
+static uint64_t hash_bytes(uint64_t h,const void* data,size_t size) {
+const unsigned char* p=(const unsigned char*)data;
+for (size_t i=0;i<size;i++) {
+   h=(h^p[i])*GRF_CACHE_FNV_PRIME;
+}
+return h;
+}
+
+
+/**
+ * Adds the content of the given file to the hash 'h'. Returns 0 if
+ * the file cannot be read; 1 otherwise.
+ */
+static int hash_file_content(const char* name,uint64_t* h) {
+ABSTRACTMAPFILE* amf=af_open_mapfile(name,MAPFILE_OPTION_READ,0);
+if (amf==NULL) return 0;
+size_t size=af_get_mapfile_size(amf);
+const void* buffer=(size>0) ? af_get_mapfile_pointer(amf,0,size) : NULL;
+if (buffer!=NULL) {
+   *h=hash_bytes(*h,buffer,size);
+   af_release_mapfile_pointer(amf,buffer,size);
+}
+af_close_mapfile(amf);
+*h=hash_bytes(*h,&size,sizeof(size));
+return (size==0 || buffer!=NULL);
+}
+
+
+/**
+ * Computes the hash of the options that have an influence on
+ * the compilation of a graph.
+ */
+static uint64_t hash_compilation_options(const struct compilation_info* infos,int clean) {
+char options[256];
+sprintf(options,"grf2fst2 %d %d %d %d %d %d",(int)infos->tokenization_policy,clean,
+        (int)infos->check_outputs,(int)infos->strict_tokenization,
+        (int)infos->vec.mask_encoding_compatibility_input,(int)sizeof(unichar));
+uint64_t h=hash_bytes(GRF_CACHE_FNV_BASIS,options,strlen(options));
+if (infos->alphabet_name[0]!='\0') {
+   hash_file_content(infos->alphabet_name,&h);
+}
+return h;
+}
+
+
+static void get_cache_file_name(const struct compilation_info* infos,uint64_t key,char* name) {
+char tmp[32];
+sprintf(tmp,"%08x%08x.gfc",(unsigned int)(key>>32),(unsigned int)(key&0xFFFFFFFF));
+strcpy(name,infos->cache_dir);
+add_path_separator(name);
+strcat(name,tmp);
+}
+
+
+static void write_cache_ints(ABSTRACTFILE* f,const int* t,int n) {
+if (n>0) af_fwrite(t,sizeof(int),n,f);
+}
+
+
+static void write_cache_strings(ABSTRACTFILE* f,unichar* const* t,int first,int n) {
+for (int i=first;i<n;i++) {
+   int len=u_strlen(t[i]);
+   af_fwrite(&len,sizeof(int),1,f);
+   af_fwrite(t[i],sizeof(unichar),len,f);
+}
+}
+
+
+/**
+ * Saves the given compiled graph in the cache. The file is written under
+ * a temporary name and then renamed, so that a concurrent compilation never
+ * reads a partial file.
+ */
+static void save_compiled_grf(const struct compilation_info* infos,uint64_t key,const struct compiled_grf* c) {
+char name[FILENAME_MAX];
+char tmp_name[FILENAME_MAX+64];
+get_cache_file_name(infos,key,name);
+sprintf(tmp_name,"%s.%p.tmp",name,(const void*)c);
+ABSTRACTFILE* f=af_fopen(tmp_name,"wb");
+if (f==NULL) return;
+int header[9]={GRF_CACHE_MAGIC,(int)(key>>32),(int)(key&0xFFFFFFFF),c->emptied,c->n_contexts,
+               c->n_tags,c->n_calls,c->n_preferred,c->n_states};
+af_fwrite(header,sizeof(int),9,f);
+write_cache_strings(f,c->tags,0,c->n_tags);
+write_cache_strings(f,c->calls,2,c->n_calls);
+write_cache_ints(f,c->preferred,c->n_preferred);
+if (!c->emptied) {
+   write_cache_ints(f,c->final,c->n_states);
+   write_cache_ints(f,c->first_transition,c->n_states+1);
+   write_cache_ints(f,c->transitions,2*c->first_transition[c->n_states]);
+}
+int ok=(af_fclose(f)==0);
+if (!ok || af_rename(tmp_name,name)!=0) {
+   af_remove(tmp_name);
+}
+}
+
+
+/**
+ * A cursor on the content of a cache file.
+ */
+struct cache_reader {
+   const char* pos;
+   const char* end;
+};
+
+
+static int read_cache_int(struct cache_reader* r,int* value) {
+if ((size_t)(r->end-r->pos)<sizeof(int)) return 0;
+memcpy(value,r->pos,sizeof(int));
+r->pos+=sizeof(int);
+return 1;
+}
+
+
+/**
+ * Reads n ints. Returns NULL if the file is too short.
+ */
+static int* read_cache_ints(struct cache_reader* r,int n) {
+if (n<0 || (size_t)(r->end-r->pos)/sizeof(int)<(size_t)n) return NULL;
+int* t=(int*)malloc_compiled_grf_array(n,sizeof(int));
+memcpy(t,r->pos,n*sizeof(int));
+r->pos+=n*sizeof(int);
+return t;
+}
+
+
+static int read_cache_strings(struct cache_reader* r,unichar** t,int first,int n) {
+for (int i=first;i<n;i++) {
+   int len;
+   if (!read_cache_int(r,&len) || len<0
+       || (size_t)(r->end-r->pos)/sizeof(unichar)<(size_t)len) return 0;
+   t[i]=(unichar*)malloc_compiled_grf_array(len+1,sizeof(unichar));
+   memcpy(t[i],r->pos,len*sizeof(unichar));
+   t[i][len]='\0';
+   r->pos+=len*sizeof(unichar);
+}
+return 1;
+}
+
+
+/**
+ * Loads the compiled graph saved in the cache with the given key. Returns
+ * NULL if there is no such graph, or if the cache file is not valid.
+ */
+static struct compiled_grf* load_compiled_grf(const struct compilation_info* infos,uint64_t key) {
+char name[FILENAME_MAX];
+get_cache_file_name(infos,key,name);
+if (!fexists(name)) return NULL;
+ABSTRACTMAPFILE* amf=af_open_mapfile(name,MAPFILE_OPTION_READ,0);
+if (amf==NULL) return NULL;
+size_t size=af_get_mapfile_size(amf);
+const char* buffer=(size>0) ? (const char*)af_get_mapfile_pointer(amf,0,size) : NULL;
+if (buffer==NULL) {
+   af_close_mapfile(amf);
+   return NULL;
+}
+struct cache_reader r={buffer,buffer+size};
+struct compiled_grf* c=new_compiled_grf();
+int header[9];
+int ok=1;
+for (int i=0;ok && i<9;i++) {
+   ok=read_cache_int(&r,&(header[i]));
+}
+ok=ok && header[0]==GRF_CACHE_MAGIC && header[1]==(int)(key>>32) && header[2]==(int)(key&0xFFFFFFFF)
+      && header[5]>0 && header[6]>=2 && header[7]>=0 && header[8]>=0;
+if (ok) {
+   c->emptied=header[3];
+   c->n_contexts=header[4];
+   c->n_tags=header[5];
+   c->n_calls=header[6];
+   c->n_preferred=header[7];
+   c->tags=(unichar**)malloc_compiled_grf_array(c->n_tags,sizeof(unichar*));
+   c->calls=(unichar**)malloc_compiled_grf_array(c->n_calls,sizeof(unichar*));
+   /* All the strings are set to NULL, so that they can be freed if the file is truncated */
+   memset(c->tags,0,c->n_tags*sizeof(unichar*));
+   memset(c->calls,0,c->n_calls*sizeof(unichar*));
+   ok=read_cache_strings(&r,c->tags,0,c->n_tags) && read_cache_strings(&r,c->calls,2,c->n_calls)
+      && (c->preferred=read_cache_ints(&r,c->n_preferred))!=NULL;
+}
+if (ok && !c->emptied) {
+   c->n_states=header[8];
+   ok=(c->final=read_cache_ints(&r,c->n_states))!=NULL
+      && (c->first_transition=read_cache_ints(&r,c->n_states+1))!=NULL
+      && c->first_transition[c->n_states]>=0
+      && (c->transitions=read_cache_ints(&r,2*c->first_transition[c->n_states]))!=NULL;
+   for (int i=0;ok && i<c->n_states;i++) {
+      ok=(c->first_transition[i]>=0 && c->first_transition[i]<=c->first_transition[i+1]);
+   }
+   for (int i=0;ok && i<c->first_transition[c->n_states];i++) {
+      int tag=c->transitions[2*i];
+      int dest=c->transitions[2*i+1];
+      ok=(tag<c->n_tags && -tag<c->n_calls && dest>=0 && dest<c->n_states);
+   }
+}
+af_release_mapfile_pointer(amf,buffer,size);
+af_close_mapfile(amf);
+if (!ok || r.pos!=r.end) {
+   free_compiled_grf(c);
+   return NULL;
+}
+return c;
+}
+
+
 /**
  * This function takes the main graph name as given to the program and
  * computes its path and its name without path and extension. Then, the
@@ -1699,6 +2200,148 @@ get_value_index(temp3,infos->graph_names);
 }
 
 
+/**
+ * A graph to compile during a step of the incremental compilation.
+ */
+struct grf_job {
+   int n;
+   char* name;
+   char* called_from;
+   /* NULL if there is no valid .grf for this graph */
+   struct compiled_grf* compiled;
+   int from_cache;
+};
+
+
+/**
+ * The graphs discovered so far and not compiled yet, that are compiled
+ * by a pool of threads.
+ */
+struct grf_wave {
+   struct grf_job* jobs;
+   int n_jobs;
+   volatile long next_job;
+   const struct compilation_info* infos;
+   int clean;
+   uint64_t options_hash;
+};
+
+
+static void compile_grf_job(struct grf_job* job,const struct grf_wave* wave) {
+const struct compilation_info* infos=wave->infos;
+if (!fexists(job->name)) return;
+uint64_t key=0;
+int use_cache=(infos->cache_dir[0]!='\0');
+if (use_cache) {
+   /* The graph name is a part of the key, as relative subgraph calls
+    * are resolved from it */
+   const unichar* graph_name=infos->graph_names->value[job->n];
+   key=hash_bytes(wave->options_hash,graph_name,graph_key_length(graph_name)*sizeof(unichar));
+   use_cache=hash_file_content(job->name,&key);
+   if (use_cache && (job->compiled=load_compiled_grf(infos,key))!=NULL) {
+      job->from_cache=1;
+      return;
+   }
+}
+Grf* grf=load_Grf(&(infos->vec),job->name);
+if (grf==NULL) return;
+job->compiled=compile_grf_locally(grf,job->name,job->n,infos,wave->clean);
+if (use_cache && job->compiled->n_warnings==0) {
+   /* A graph with warnings is not saved, so that they are emitted
+    * each time the grammar is compiled */
+   save_compiled_grf(infos,key,job->compiled);
+}
+}
+
+
+static void ABSTRACT_CALLBACK_UNITEX compile_grf_thread(void* private_data,
+                                                        unsigned int /* thread_number */) {
+struct grf_wave* wave=(struct grf_wave*)private_data;
+long n;
+while ((n=SyncAtomicIncrement(&(wave->next_job))-1)<wave->n_jobs) {
+   compile_grf_job(&(wave->jobs[n]),wave);
+}
+}
+
+
+/**
+ * Compiles the grammar like compile_grf, but all the graphs discovered so
+ * far are compiled at once, in parallel or by loading them from the cache,
+ * and then they are linked in order. As each graph is compiled with its own
+ * tag numbering, the .fst2 may not be identical to the one produced by the
+ * sequential compilation, but it is equivalent. It is always the same
+ * whatever the number of threads and the content of the cache.
+ */
+static int compile_grf_incremental(struct compilation_info* infos,int clean) {
+struct grf_wave wave;
+wave.infos=infos;
+wave.clean=clean;
+wave.options_hash=(infos->cache_dir[0]!='\0') ? hash_compilation_options(infos,clean) : 0;
+int n_compiled=0,n_reused=0;
+int current_graph=1;
+int result=1;
+while (result && current_graph<infos->graph_names->size) {
+   wave.n_jobs=infos->graph_names->size-current_graph;
+   wave.next_job=0;
+   wave.jobs=(struct grf_job*)malloc(wave.n_jobs*sizeof(struct grf_job));
+   if (wave.jobs==NULL) {
+      fatal_alloc_error("compile_grf_incremental");
+   }
+   for (int i=0;i<wave.n_jobs;i++) {
+      char name[FILENAME_MAX];
+      char called_from[FILENAME_MAX];
+      get_graph_file_name(current_graph+i,name,called_from,infos);
+      wave.jobs[i].n=current_graph+i;
+      wave.jobs[i].name=strdup(name);
+      wave.jobs[i].called_from=strdup(called_from);
+      if (wave.jobs[i].name==NULL || wave.jobs[i].called_from==NULL) {
+         fatal_alloc_error("compile_grf_incremental");
+      }
+      wave.jobs[i].compiled=NULL;
+      wave.jobs[i].from_cache=0;
+   }
+   int n_workers=(infos->n_threads<wave.n_jobs) ? infos->n_threads : wave.n_jobs;
+   if (n_workers>1) {
+      void** wave_ptrs=(void**)malloc(n_workers*sizeof(void*));
+      if (wave_ptrs==NULL) {
+         fatal_alloc_error("compile_grf_incremental");
+      }
+      for (int i=0;i<n_workers;i++) {
+         wave_ptrs[i]=&wave;
+      }
+      logger::SyncDoRunThreads((unsigned int)n_workers,compile_grf_thread,wave_ptrs);
+      free(wave_ptrs);
+   } else {
+      compile_grf_thread(&wave,0);
+   }
+   /* Linking the graphs in order gives the same numbering as
+    * a sequential compilation */
+   for (int i=0;i<wave.n_jobs;i++) {
+      struct grf_job* job=&(wave.jobs[i]);
+      if (result) {
+         int ret=compile_grf(job->n,job->name,job->called_from,infos,clean,job->compiled,0);
+         if ((ret==0 && job->n==1) || ret==-1) {
+            result=0;
+         }
+         if (job->compiled!=NULL) {
+            if (job->from_cache) n_reused++;
+            else n_compiled++;
+         }
+      }
+      free_compiled_grf(job->compiled);
+      free(job->name);
+      free(job->called_from);
+   }
+   free(wave.jobs);
+   current_graph+=wave.n_jobs;
+}
+if (result && infos->cache_dir[0]!='\0' && infos->verbose_name_grf!=0) {
+   u_printf("%d graph(s) reused from %s, %d compiled\n",n_reused,infos->cache_dir,n_compiled);
+}
+return result;
+}
+
+
 /**
  * This is the main function that takes a main graph and compiles it.
  * It returns 1 in case of success; 0 otherwise.
@@ -1707,6 +2350,11 @@ int compile_grf(char* main_graph,struct compilation_info* infos,int clean) {
 int current_graph=1;
 int result;
 extract_path_and_main_graph(main_graph,infos);
+if (!infos->debug && (infos->cache_dir[0]!='\0' || infos->n_threads>1)) {
+   /* In debug mode, tags contain graph numbers, so that graphs
+    * cannot be compiled on their own */
+   return compile_grf_incremental(infos,clean);
+}
 do {
    result=compile_grf(current_graph,infos, clean);
    if (result==0 && current_graph==1) {
@@ -1757,7 +2405,7 @@ for (int i=0;i<n_tags;i++) {
       u_fprintf(fst2,"%%%S",tags->value[i]);
    }
 
-   if (preferred->tab[i]==1){
+   if (i<preferred->nbelems && preferred->tab[i]==1){
        u_fprintf(fst2,"/p\n");
    } else{
        u_fprintf(fst2,"\n");
@@ -92,6 +92,17 @@ struct compilation_info {
    int current_saved_graph;
    char check_outputs;
    char strict_tokenization;
+
+   /* If not empty, the compiled graphs are saved in this directory, and
+    * a graph whose .grf has not changed since its last compilation with
+    * the same options is reused instead of being compiled again */
+   char cache_dir[FILENAME_MAX];
+   /* The alphabet file, if any, as it is a compilation option */
+   char alphabet_name[FILENAME_MAX];
+   /* Number of threads used to compile the graphs */
+   int n_threads;
+   /* Number of warnings emitted while compiling the graphs */
+   int n_warnings;
 };
 
 
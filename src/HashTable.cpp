@@ -403,6 +403,36 @@ return value;
 }
 
 
+/**
+ * Removes the given pointer key from the given hash table, freeing the
+ * key and its value as 'free_hash_table' does. Returns 1 if the key was
+ * in the table; 0 otherwise.
+ */
+int remove_key(struct hash_table* h,void* key) {
+if (h==NULL) {
+   fatal_error("NULL hash table error in remove_key\n");
+}
+if (h->hash==NULL) {
+   fatal_error("NULL hash function error in remove_key\n");
+}
+int cell_index=h->hash(key) & (h->capacity-1);
+struct hash_list** list=&(h->table[cell_index]);
+while (*list!=NULL) {
+   if (h->equal(key,(*list)->ptr_key)) {
+      struct hash_list* tmp=*list;
+      *list=tmp->next;
+      tmp->next=NULL;
+      int free_hash_list_struct=(get_allocator_cb_flag(h->allocator_hash_list) & AllocatorGetFlagAutoFreePresent) ? 0 : 1;
+      free_hash_list(tmp,h->free_key,h->free_ptr_value,free_hash_list_struct,h);
+      h->number_of_elements--;
+      return 1;
+   }
+   list=&((*list)->next);
+}
+return 0;
+}
+
+
 /**
  * This function looks in the given list if it contains the given integer
  * key. In that case, it returns a pointer on its associated value; NULL
@@ -110,6 +110,7 @@ struct any* get_value(struct hash_table*,void*,int,int*);
 struct any* get_value(struct hash_table*,int,int,int*);
 struct any* get_value(struct hash_table*,void*,int);
 struct any* get_value(struct hash_table*,int,int);
+int remove_key(struct hash_table*,void*);
 void free_any_ptr(void*);
 
 } // namespace unitex
@@ -21,6 +21,8 @@
 
 #include "LoadInf.h"
 #include "StringParsing.h"
+#include "Af_stdio.h"
+#include "Error.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -96,5 +98,314 @@ free_cb(INF->codes,prv_alloc);
 free_cb(INF,prv_alloc);
 }
 
-} // namespace unitex
 
+
+/**
+ * The mapped content of an .inf file. 'offsets' contains the position in
+ * bytes of the beginning of each line of codes, and then the position of
+ * the end of the last one.
+ */
+struct INF_lines {
+    ABSTRACTMAPFILE* amf;
+    const unsigned char* buffer;
+    size_t size;
+    Encoding encoding;
+    int N;
+    size_t* offsets;
+};
+
+
+/**
+ * Returns the position of the first byte after the end of the line that
+ * starts at 'pos'.
+ */
+static size_t next_INF_line(const struct INF_lines* l,size_t pos) {
+if (l->encoding==UTF8) {
+    const unsigned char* p=(const unsigned char*)memchr(l->buffer+pos,'\n',l->size-pos);
+    return (p==NULL) ? l->size : (size_t)(p-l->buffer)+1;
+}
+int hi=(l->encoding==UTF16_LE) ? 1 : 0;
+for (;pos+1<l->size;pos=pos+2) {
+    if (l->buffer[pos+1-hi]=='\n' && l->buffer[pos+hi]==0) {
+        return pos+2;
+    }
+}
+return l->size;
+}
+
+
+/**
+ * Decodes the bytes [start;end[ into 'dest', that must be large enough,
+ * ignoring the final new line. Like the other UTF8 readers, a malformed
+ * sequence is replaced by '?' with an error message; so is a character
+ * above 0xFFFF, that does not fit in a unichar. Returns the number of
+ * characters decoded.
+ */
+static int decode_INF_line(const struct INF_lines* l,size_t start,size_t end,unichar* dest) {
+const unsigned char* p=l->buffer;
+int n=0;
+if (l->encoding==UTF8) {
+    while (start<end) {
+        unsigned char c=p[start++];
+        if (c<=0x7F) {
+            dest[n++]=c;
+            continue;
+        }
+        int number_of_bytes;
+        unsigned int value;
+        if ((c&0xE0)==0xC0) {value=c&31; number_of_bytes=2;}
+        else if ((c&0xF0)==0xE0) {value=c&15; number_of_bytes=3;}
+        else if ((c&0xF8)==0xF0) {value=c&7; number_of_bytes=4;}
+        else {
+            error("Encoding error in first byte of a unicode sequence\n");
+            dest[n++]='?';
+            continue;
+        }
+        int i;
+        for (i=1;i<number_of_bytes && start<end;i++) {
+            if ((p[start]&0xC0)!=0x80) {
+                break;
+            }
+            value=(value<<6)|(p[start++]&0x3F);
+        }
+        if (i<number_of_bytes) {
+            error("Encoding error in byte %d of a %d byte unicode sequence\n",i+1,number_of_bytes);
+            value='?';
+        } else if (value>0xFFFF) {
+            /* unichar cannot hold such a character, see u_fputc_UTF8_raw */
+            error("Unicode character above 0xFFFF in a .inf line\n");
+            value='?';
+        }
+        dest[n++]=(unichar)value;
+    }
+} else {
+    int hi=(l->encoding==UTF16_LE) ? 1 : 0;
+    for (;start+1<end;start=start+2) {
+        dest[n++]=(unichar)((p[start+hi]<<8)|p[start+1-hi]);
+    }
+}
+while (n>0 && (dest[n-1]=='\n' || dest[n-1]=='\r')) {
+    n--;
+}
+dest[n]='\0';
+return n;
+}
+
+
+/**
+ * Maps the given .inf file and indexes the beginning of its lines, without
+ * decoding them. Returns NULL if the file cannot be mapped or if its
+ * encoding is not one that can be decoded from memory, in which case
+ * load_INF_file must be used.
+ */
+struct INF_lines* load_INF_lines(const VersatileEncodingConfig* vec,const char* name) {
+ABSTRACTMAPFILE* amf=af_open_mapfile(name,MAPFILE_OPTION_READ,0);
+if (amf==NULL) {
+    return NULL;
+}
+struct INF_lines* l=(struct INF_lines*)malloc(sizeof(struct INF_lines));
+if (l==NULL) {
+    fatal_alloc_error("load_INF_lines");
+}
+l->amf=amf;
+l->buffer=(const unsigned char*)af_get_mapfile_pointer(amf);
+l->size=af_get_mapfile_size(amf);
+l->offsets=NULL;
+l->N=0;
+const unsigned char* p=l->buffer;
+int mask=vec->mask_encoding_compatibility_input;
+size_t pos;
+if (p==NULL) {
+    pos=(size_t)-1;
+} else if (l->size>=2 && p[0]==0xFF && p[1]==0xFE && (mask&UTF16_LE_BOM_POSSIBLE)) {
+    l->encoding=UTF16_LE;
+    pos=2;
+} else if (l->size>=2 && p[0]==0xFE && p[1]==0xFF && (mask&BIG_ENDIAN_UTF16_BOM_POSSIBLE)) {
+    l->encoding=BIG_ENDIAN_UTF16;
+    pos=2;
+} else if (l->size>=3 && p[0]==0xEF && p[1]==0xBB && p[2]==0xBF && (mask&UTF8_BOM_POSSIBLE)) {
+    l->encoding=UTF8;
+    pos=3;
+} else if (mask&UTF8_NO_BOM_POSSIBLE) {
+    l->encoding=UTF8;
+    pos=0;
+} else {
+    pos=(size_t)-1;
+}
+if (pos!=(size_t)-1) {
+    /* The first line contains the number of lines of codes */
+    size_t end=next_INF_line(l,pos);
+    unichar tmp[64];
+    int ok=0;
+    if (end-pos<sizeof(tmp)/sizeof(unichar)) {
+        decode_INF_line(l,pos,end,tmp);
+        ok=(1==u_sscanf(tmp,"%d",&(l->N)) && l->N>=0);
+    }
+    if (ok) {
+        l->offsets=(size_t*)malloc(sizeof(size_t)*(l->N+1));
+        if (l->offsets==NULL) {
+            fatal_alloc_error("load_INF_lines");
+        }
+        pos=end;
+        for (int i=0;i<l->N;i++) {
+            l->offsets[i]=pos;
+            pos=next_INF_line(l,pos);
+        }
+        l->offsets[l->N]=pos;
+    }
+}
+if (l->offsets==NULL) {
+    if (p!=NULL) af_release_mapfile_pointer(amf,p);
+    af_close_mapfile(amf);
+    free(l);
+    return NULL;
+}
+return l;
+}
+
+
+void free_INF_lines(struct INF_lines* l) {
+if (l==NULL) return;
+af_release_mapfile_pointer(l->amf,l->buffer);
+af_close_mapfile(l->amf);
+free(l->offsets);
+free(l);
+}
+
+
+int get_INF_lines_number(const struct INF_lines* l) {
+return l->N;
+}
+
+
+/**
+ * Returns the maximum number of characters of the given line.
+ */
+static int get_INF_line_max_length(const struct INF_lines* l,int n) {
+return (int)(l->offsets[n+1]-l->offsets[n]);
+}
+
+
+/**
+ * Decodes the given line of codes into 'line'.
+ */
+void get_INF_line(const struct INF_lines* l,int n,Ustring* line) {
+resize(line,get_INF_line_max_length(l,n)+1);
+line->len=decode_INF_line(l,l->offsets[n],l->offsets[n+1],line->str);
+}
+
+
+struct INF_line_codes* new_INF_line_codes() {
+struct INF_line_codes* c=(struct INF_line_codes*)malloc(sizeof(struct INF_line_codes));
+if (c==NULL) {
+    fatal_alloc_error("new_INF_line_codes");
+}
+c->buffer_capacity=256;
+c->buffer=(unichar*)malloc(sizeof(unichar)*c->buffer_capacity);
+c->codes_capacity=16;
+c->codes=(int*)malloc(sizeof(int)*c->codes_capacity);
+if (c->buffer==NULL || c->codes==NULL) {
+    fatal_alloc_error("new_INF_line_codes");
+}
+c->n=0;
+return c;
+}
+
+
+void free_INF_line_codes(struct INF_line_codes* c) {
+if (c==NULL) return;
+free(c->buffer);
+free(c->codes);
+free(c);
+}
+
+
+static void reserve_INF_line_buffer(struct INF_line_codes* c,int size) {
+if (size<=c->buffer_capacity) return;
+while (c->buffer_capacity<size) {
+    c->buffer_capacity=c->buffer_capacity*2;
+}
+c->buffer=(unichar*)realloc(c->buffer,sizeof(unichar)*c->buffer_capacity);
+if (c->buffer==NULL) {
+    fatal_alloc_error("reserve_INF_line_buffer");
+}
+}
+
+
+static void add_INF_line_code(struct INF_line_codes* c,int start) {
+if (c->n==c->codes_capacity) {
+    c->codes_capacity=c->codes_capacity*2;
+    c->codes=(int*)realloc(c->codes,sizeof(int)*c->codes_capacity);
+    if (c->codes==NULL) {
+        fatal_alloc_error("add_INF_line_code");
+    }
+}
+c->codes[(c->n)++]=start;
+}
+
+
+/**
+ * Splits the line stored in c->buffer into codes, like
+ * tokenize_compressed_info does, but in place.
+ */
+static void split_INF_line_codes(struct INF_line_codes* c) {
+unichar* line=c->buffer;
+int pos=0;
+c->n=0;
+while (line[pos]!='\0') {
+    add_INF_line_code(c,pos);
+    while (line[pos]!='\0' && line[pos]!=',') {
+        /* Protected characters stay protected */
+        if (line[pos]==PROTECTION_CHAR && line[pos+1]!='\0') pos++;
+        pos++;
+    }
+    if (line[pos]==',') {
+        line[pos++]='\0';
+    }
+}
+/* Codes are given in reverse order, like in INF_codes */
+for (int i=0,j=c->n-1;i<j;i++,j--) {
+    int tmp=c->codes[i];
+    c->codes[i]=c->codes[j];
+    c->codes[j]=tmp;
+}
+}
+
+
+/**
+ * Decodes and splits the given line of codes into 'c'.
+ */
+void get_INF_line_codes(const struct INF_lines* l,int n,struct INF_line_codes* c) {
+reserve_INF_line_buffer(c,get_INF_line_max_length(l,n)+1);
+decode_INF_line(l,l->offsets[n],l->offsets[n+1],c->buffer);
+split_INF_line_codes(c);
+}
+
+
+/**
+ * Splits the given line of codes into 'c'.
+ */
+void set_INF_line_codes(const unichar* line,struct INF_line_codes* c) {
+int len=u_strlen(line);
+reserve_INF_line_buffer(c,len+1);
+u_strcpy(c->buffer,line);
+split_INF_line_codes(c);
+}
+
+
+/**
+ * Copies the given list of codes into 'c'.
+ */
+void set_INF_line_codes(const struct list_ustring* codes,struct INF_line_codes* c) {
+int size=0;
+c->n=0;
+for (const struct list_ustring* tmp=codes;tmp!=NULL;tmp=tmp->next) {
+    int len=u_strlen(tmp->string);
+    reserve_INF_line_buffer(c,size+len+1);
+    u_strcpy(c->buffer+size,tmp->string);
+    add_INF_line_code(c,size);
+    size=size+len+1;
+}
+}
+
+} // namespace unitex
@@ -24,6 +24,7 @@
 
 #include "Unicode.h"
 #include "List_ustring.h"
+#include "Ustring.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -52,10 +53,43 @@ struct INF_codes {
 
 
 
+/**
+ * An .inf file mapped in memory, whose lines are only decoded when they are
+ * needed. Its content is private to LoadInf.cpp.
+ */
+struct INF_lines;
+
+
+/**
+ * The codes of one line of an .inf file. The buffers are reused from one
+ * line to the next, so that no memory is allocated once they are large
+ * enough. The codes are given in the same reversed order as in INF_codes:
+ * code i is the string that starts at buffer+codes[i].
+ */
+struct INF_line_codes {
+    unichar* buffer;
+    int buffer_capacity;
+    int* codes;
+    int n;
+    int codes_capacity;
+};
+
+
 struct INF_codes* load_INF_file(const VersatileEncodingConfig*,const char*,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 void free_INF_codes(struct INF_codes*,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 struct list_ustring* tokenize_compressed_info(const unichar* line,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 
+struct INF_lines* load_INF_lines(const VersatileEncodingConfig*,const char*);
+void free_INF_lines(struct INF_lines*);
+int get_INF_lines_number(const struct INF_lines*);
+void get_INF_line(const struct INF_lines*,int n,Ustring* line);
+void get_INF_line_codes(const struct INF_lines*,int n,struct INF_line_codes*);
+
+struct INF_line_codes* new_INF_line_codes();
+void free_INF_line_codes(struct INF_line_codes*);
+void set_INF_line_codes(const unichar* line,struct INF_line_codes*);
+void set_INF_line_codes(const struct list_ustring* codes,struct INF_line_codes*);
+
 } // namespace unitex
 
 #endif
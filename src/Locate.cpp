@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <time.h>
 
 #include "Unicode.h"
@@ -82,6 +83,21 @@ const char* usage_Locate =
          "  -u X/--arabic_rules=X: Arabic typographic rule configuration file\n"
          "  -g minus/--negation_operator=minus: uses minus as negation operator for Unitex 2.0 graphs\n"
          "  -g tilde/--negation_operator=tilde: uses tilde as negation operator (default)\n"
+         "  -j N/--threads=N: splits the text on sentence delimiters {S} and explores it\n"
+         "                    with N threads (default: 1). The search limit option -n\n"
+         "                    forces the use of a single thread\n"
+         "  --locate_cache=X: selects how matches are cached: tree (default), hash or none.\n"
+         "                    hash uses a hash table with a memory limit and prints its\n"
+         "                    hit/miss counters in concord.n\n"
+         "  --locate_cache_size=N: memory limit of the hash cache in megabytes (default: " STRINGIZE(DEFAULT_LOCATE_HASH_CACHE_SIZE) "),\n"
+         "                         or in kilobytes with a k suffix, like 512k\n"
+         "  --elg_cache_size=N: maximum number of results of pure extended functions\n"
+         "                      memoized by each thread (default: " STRINGIZE(DEFAULT_ELG_CALL_CACHE_SIZE) "). 0 disables\n"
+         "                      the memoization. An extension declares its pure functions\n"
+         "                      with a table like: pure_functions = { \"foo\", \"bar\" }\n"
+         "  --filter_index: saves in the text directory (filters.idx) which tokens match\n"
+         "                  the morphological filters of the grammar, so that the next\n"
+         "                  grammars applied to the same text reuse it\n"
          "\n"
          "Search limit options:\n"
          "  -l/--all: looks for all matches (default)\n"
@@ -150,7 +166,7 @@ static void usage() {
 #endif
 }
 
-const char* optstring_Locate=":t:a:m:SLAIMRXYZln:d:E:cewsxbzpKVhk:q:o:u:g:Tv:$:@:C:P:HQN+:";
+const char* optstring_Locate=":t:a:m:SLAIMRXYZln:d:E:cewsxbzpKVhk:q:o:u:g:Tv:$:@:C:P:HQN+:j:";
 const struct option_TS lopts_Locate[]= {
   {"text",required_argument_TS,NULL,'t'},
   {"alphabet",required_argument_TS,NULL,'a'},
@@ -182,6 +198,10 @@ const struct option_TS lopts_Locate[]= {
   {"arabic_rules",required_argument_TS,NULL,'u'},
   {"negation_operator",required_argument_TS,NULL,'g'},
   {"dont_use_locate_cache",no_argument_TS,NULL,'e'},
+  {"locate_cache",required_argument_TS,NULL,'&'},
+  {"locate_cache_size",required_argument_TS,NULL,'%'},
+  {"elg_cache_size",required_argument_TS,NULL,'*'},
+  {"filter_index",no_argument_TS,NULL,'#'},
   {"dont_allow_trace",no_argument_TS,NULL,'T'},
   {"variable",required_argument_TS,NULL,'v'},
   {"stack_max",required_argument_TS,NULL,'$'},
@@ -192,6 +212,7 @@ const struct option_TS lopts_Locate[]= {
   {"lesser_tolerant",no_argument_TS,NULL,'Q'},
   {"least_tolerant",no_argument_TS,NULL,'N'},
   {"trace_option",required_argument_TS,NULL,'+'},
+  {"threads",required_argument_TS,NULL,'j'},
   {"only_verify_arguments",no_argument_TS,NULL,'V'},
   {"help",no_argument_TS,NULL,'h'},
   {NULL,no_argument_TS,NULL,0}
@@ -281,9 +302,14 @@ int max_matches_per_subgraph=MAX_MATCHES_PER_SUBGRAPH;
 int tolerance_divide_factor=1;
 int max_errors=0;
 int tilde_negation_operator=1;
-int useLocateCache=1;
+int useLocateCache=TREE_LOCATE_CACHE;
+/* In kilobytes */
+int locate_cache_size=DEFAULT_LOCATE_HASH_CACHE_SIZE*1024;
+int elg_cache_size=DEFAULT_ELG_CALL_CACHE_SIZE;
+int use_filter_index=0;
 int selected_negation_operator=0;
 int allow_trace=1;
+int n_threads=1;
 char** list_param_trace=new_locate_trace_param();
 char foo;
 vector_ptr* injected_vars=new_vector_ptr();
@@ -362,7 +388,46 @@ while (EOF!=(val=options.parse_long(argc,argv,optstring_Locate,lopts_Locate,&ind
    case 'Y': variable_error_policy=IGNORE_VARIABLE_ERRORS; break;
    case 'Z': variable_error_policy=BACKTRACK_ON_VARIABLE_ERRORS; break;
    case 'l': search_limit=NO_MATCH_LIMIT; break;
-   case 'e': useLocateCache=0; break;
+   case 'e': useLocateCache=NO_LOCATE_CACHE; break;
+   case '&': if (!strcmp(options.vars()->optarg,"tree")) {
+                useLocateCache=TREE_LOCATE_CACHE;
+             } else if (!strcmp(options.vars()->optarg,"hash")) {
+                useLocateCache=HASH_LOCATE_CACHE;
+             } else if (!strcmp(options.vars()->optarg,"none")) {
+                useLocateCache=NO_LOCATE_CACHE;
+             } else {
+                error("Invalid locate cache argument: %s\n",options.vars()->optarg);
+                free_vector_ptr(injected_vars,free);
+                free_locate_trace_param(list_param_trace);
+                free(morpho_dic);
+                return USAGE_ERROR_CODE;
+             }
+             break;
+   case '%': {
+               char unit='\0';
+               int n=sscanf(options.vars()->optarg,"%d%c%c",&locate_cache_size,&unit,&foo);
+               if (n==1 && locate_cache_size>0 && locate_cache_size<=INT_MAX/1024) {
+                  locate_cache_size=locate_cache_size*1024;
+               } else if (!(n==2 && (unit=='k' || unit=='K') && locate_cache_size>0)) {
+                  /* foo is used to check that the param is not like "45gjh" */
+                  error("Invalid locate cache size: %s\n",options.vars()->optarg);
+                  free_vector_ptr(injected_vars,free);
+                  free_locate_trace_param(list_param_trace);
+                  free(morpho_dic);
+                  return USAGE_ERROR_CODE;
+               }
+               break;
+             }
+   case '*': if (1!=sscanf(options.vars()->optarg,"%d%c",&elg_cache_size,&foo) || elg_cache_size<0) {
+                /* foo is used to check that the param is not like "45gjh" */
+                error("Invalid ELG cache size: %s\n",options.vars()->optarg);
+                free_vector_ptr(injected_vars,free);
+                free_locate_trace_param(list_param_trace);
+                free(morpho_dic);
+                return USAGE_ERROR_CODE;
+             }
+             break;
+   case '#': use_filter_index=1; break;
    case 'T': allow_trace=0; break;
    case 'n': if (1!=sscanf(options.vars()->optarg,"%d%c",&search_limit,&foo) || search_limit<=0) {
                 /* foo is used to check that the search limit is not like "45gjh" */
@@ -436,6 +501,15 @@ while (EOF!=(val=options.parse_long(argc,argv,optstring_Locate,lopts_Locate,&ind
                 return USAGE_ERROR_CODE;
              }
              break;
+   case 'j': if (1!=sscanf(options.vars()->optarg,"%d%c",&n_threads,&foo) || n_threads<=0) {
+                /* foo is used to check that the param is not like "45gjh" */
+                error("Invalid number of threads: %s\n",options.vars()->optarg);
+                free_vector_ptr(injected_vars,free);
+                free_locate_trace_param(list_param_trace);
+                free(morpho_dic);
+                return USAGE_ERROR_CODE;
+             }
+             break;
    case 'H': {
                 tolerance_divide_factor=2;
              }
@@ -585,7 +659,7 @@ if (selected_negation_operator==0) {
 
 size_t step_filename_buffer = (((FILENAME_MAX / 0x10) + 1) * 0x10);
 
-char* buffer_filename = (char*)malloc(step_filename_buffer * 7);
+char* buffer_filename = (char*)malloc(step_filename_buffer * 8);
 if (buffer_filename == NULL) {
     alloc_error("main_Locate");
   free_vector_ptr(injected_vars,free);
@@ -601,6 +675,7 @@ char* dlf = (buffer_filename + (step_filename_buffer * 3));
 char* dlc = (buffer_filename + (step_filename_buffer * 4));
 char* err = (buffer_filename + (step_filename_buffer * 5));
 char* enter_pos = (buffer_filename + (step_filename_buffer * 6));
+char* filter_index = (buffer_filename + (step_filename_buffer * 7));
 
 get_snt_path(text,staticSntDir);
 if (dynamicSntDir[0]=='\0') {
@@ -640,6 +715,9 @@ strcat(err,"err");
 strcpy(enter_pos,staticSntDir);
 strcat(enter_pos,"enter.pos");
 
+strcpy(filter_index,staticSntDir);
+strcat(filter_index,"filters.idx");
+
 int OK=locate_pattern(text_cod,
                tokens_txt,
                argv[options.vars()->optind],
@@ -671,7 +749,12 @@ int OK=locate_pattern(text_cod,
                allow_trace,
                list_param_trace,
                injected_vars,
-               elg_extensions_path);
+               elg_extensions_path,
+               NULL,
+               n_threads,
+               locate_cache_size,
+               elg_cache_size,
+               use_filter_index ? filter_index : NULL);
 
 free(buffer_filename);
 free_vector_ptr(injected_vars,free);
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "LocateCache.h"
 #include "Error.h"
 #include "Match.h"
@@ -167,4 +168,352 @@ explore_cache_node(tab,start+1,tab_size,caches[first_token],res);
 return res->nbelems!=0;
 }
 
+
+/* Initial number of slots of a hashed cache, must be a power of 2 */
+#define LOCATE_HASH_CACHE_INITIAL_CAPACITY 1024
+
+#define LOCATE_HASH_CACHE_FNV_BASIS 2166136261u
+#define LOCATE_HASH_CACHE_FNV_PRIME 16777619u
+
+
+static inline unsigned int hash_cache_step(unsigned int h,int token) {
+return (h^(unsigned int)token)*LOCATE_HASH_CACHE_FNV_PRIME;
+}
+
+
+/**
+ * Returns the bit of the length mask that corresponds to the given key length.
+ */
+static inline unsigned int length_bit(int length) {
+return (length<LOCATE_HASH_CACHE_LONG_KEY)?(unsigned int)(length-1):(unsigned int)(LOCATE_HASH_CACHE_LONG_KEY-1);
+}
+
+
+/**
+ * Returns the number of bytes used by the given match list.
+ */
+static size_t match_list_size(const struct match_list* l) {
+size_t size=0;
+while (l!=NULL) {
+    size=size+sizeof(struct match_list);
+    if (l->output!=NULL) {
+        size=size+(u_strlen(l->output)+1)*sizeof(unichar);
+    }
+    l=l->next;
+}
+return size;
+}
+
+
+/**
+ * Builds, initializes and returns a new hashed cache for a text whose
+ * tokens are numbered from 0 to n_tokens-1. 'max_size' is the approximate
+ * memory limit, in bytes.
+ */
+LocateHashCache* new_LocateHashCache(int n_tokens,size_t max_size) {
+LocateHashCache* c=(LocateHashCache*)malloc(sizeof(LocateHashCache));
+if (c==NULL) {
+    fatal_alloc_error("new_LocateHashCache");
+}
+c->capacity=LOCATE_HASH_CACHE_INITIAL_CAPACITY;
+c->slots=(LocateHashCacheSlot*)malloc(c->capacity*sizeof(LocateHashCacheSlot));
+c->length_masks=(unsigned int*)calloc((n_tokens>0)?n_tokens:1,sizeof(unsigned int));
+if (c->slots==NULL || c->length_masks==NULL) {
+    fatal_alloc_error("new_LocateHashCache");
+}
+for (int i=0;i<c->capacity;i++) {
+    c->slots[i].key=-1;
+    c->slots[i].matches=NULL;
+}
+c->n_entries=0;
+c->arena=NULL;
+c->arena_size=0;
+c->arena_capacity=0;
+c->arena_garbage=0;
+c->n_tokens=n_tokens;
+c->max_length=0;
+c->clock_hand=0;
+c->size=c->capacity*sizeof(LocateHashCacheSlot)+n_tokens*sizeof(unsigned int);
+c->max_size=max_size;
+c->hits=0;
+c->misses=0;
+c->evictions=0;
+return c;
+}
+
+
+/**
+ * Frees all the memory associated to the given hashed cache, including
+ * its match lists.
+ */
+void free_LocateHashCache(LocateHashCache* c,Abstract_allocator prv_alloc) {
+if (c==NULL) return;
+for (int i=0;i<c->capacity;i++) {
+    if (c->slots[i].key!=-1) {
+        free_match_list(c->slots[i].matches,prv_alloc);
+    }
+}
+free(c->slots);
+free(c->arena);
+free(c->length_masks);
+free(c);
+}
+
+
+/**
+ * Looks for the slot of the key tab[start..start+length-1]. Returns its index
+ * if found; otherwise, returns -1 and stores in *free_slot the index of the
+ * free slot where the key should be inserted.
+ */
+static int find_hash_cache_slot(const LocateHashCache* c,unsigned int hash,const int* tab,int start,
+                                int length,int* free_slot) {
+int mask=c->capacity-1;
+int i=(int)(hash&(unsigned int)mask);
+while (c->slots[i].key!=-1) {
+    const LocateHashCacheSlot* slot=&(c->slots[i]);
+    if (slot->hash==hash && slot->length==length
+        && !memcmp(c->arena+slot->key,tab+start,length*sizeof(int))) {
+        return i;
+    }
+    i=(i+1)&mask;
+}
+if (free_slot!=NULL) *free_slot=i;
+return -1;
+}
+
+
+/**
+ * Doubles the number of slots and reinserts all the entries.
+ */
+static void grow_hash_cache(LocateHashCache* c) {
+int new_capacity=2*c->capacity;
+int mask=new_capacity-1;
+LocateHashCacheSlot* slots=(LocateHashCacheSlot*)malloc(new_capacity*sizeof(LocateHashCacheSlot));
+if (slots==NULL) {
+    fatal_alloc_error("grow_hash_cache");
+}
+for (int i=0;i<new_capacity;i++) {
+    slots[i].key=-1;
+    slots[i].matches=NULL;
+}
+for (int i=0;i<c->capacity;i++) {
+    if (c->slots[i].key==-1) continue;
+    int j=(int)(c->slots[i].hash&(unsigned int)mask);
+    while (slots[j].key!=-1) {
+        j=(j+1)&mask;
+    }
+    slots[j]=c->slots[i];
+}
+free(c->slots);
+c->size=c->size+(new_capacity-c->capacity)*sizeof(LocateHashCacheSlot);
+c->slots=slots;
+c->capacity=new_capacity;
+c->clock_hand=0;
+}
+
+
+/**
+ * Copies the keys that are still alive at the beginning of the arena.
+ */
+static void compact_hash_cache_arena(LocateHashCache* c) {
+int* arena=(int*)malloc((c->arena_capacity>0?c->arena_capacity:1)*sizeof(int));
+if (arena==NULL) {
+    fatal_alloc_error("compact_hash_cache_arena");
+}
+int size=0;
+for (int i=0;i<c->capacity;i++) {
+    LocateHashCacheSlot* slot=&(c->slots[i]);
+    if (slot->key==-1) continue;
+    memcpy(arena+size,c->arena+slot->key,slot->length*sizeof(int));
+    slot->key=size;
+    size=size+slot->length;
+}
+free(c->arena);
+c->arena=arena;
+c->arena_size=size;
+c->arena_garbage=0;
+}
+
+
+/**
+ * Stores the given key in the arena and returns its offset.
+ */
+static int add_hash_cache_key(LocateHashCache* c,const int* tab,int start,int length) {
+if (c->arena_size+length>c->arena_capacity) {
+    if (c->arena_garbage>c->arena_size/2) {
+        compact_hash_cache_arena(c);
+    }
+    if (c->arena_size+length>c->arena_capacity) {
+        int capacity=(c->arena_capacity>0)?c->arena_capacity:1024;
+        while (c->arena_size+length>capacity) {
+            capacity=capacity*2;
+        }
+        int* arena=(int*)realloc(c->arena,capacity*sizeof(int));
+        if (arena==NULL) {
+            fatal_alloc_error("add_hash_cache_key");
+        }
+        c->arena=arena;
+        c->arena_capacity=capacity;
+    }
+}
+int key=c->arena_size;
+memcpy(c->arena+key,tab+start,length*sizeof(int));
+c->arena_size=c->arena_size+length;
+return key;
+}
+
+
+/**
+ * Removes the entry of the given slot, using backward shift deletion so
+ * that no tombstone is needed.
+ */
+static void remove_hash_cache_slot(LocateHashCache* c,int i,Abstract_allocator prv_alloc) {
+int mask=c->capacity-1;
+LocateHashCacheSlot* slot=&(c->slots[i]);
+c->size=c->size-match_list_size(slot->matches)-slot->length*sizeof(int);
+free_match_list(slot->matches,prv_alloc);
+c->arena_garbage=c->arena_garbage+slot->length;
+c->n_entries--;
+int j=i;
+for (;;) {
+    j=(j+1)&mask;
+    if (c->slots[j].key==-1) break;
+    int home=(int)(c->slots[j].hash&(unsigned int)mask);
+    int in_range=(i<j)?(home>i && home<=j):(home>i || home<=j);
+    if (!in_range) {
+        c->slots[i]=c->slots[j];
+        i=j;
+    }
+}
+c->slots[i].key=-1;
+c->slots[i].matches=NULL;
+}
+
+
+/**
+ * Evicts one entry, chosen with the CLOCK algorithm: entries that were
+ * used since the last turn of the hand get a second chance. The entry whose
+ * key is at the arena offset 'pinned' is never evicted; use -1 to evict
+ * any entry.
+ */
+static void evict_hash_cache_entry(LocateHashCache* c,int pinned,Abstract_allocator prv_alloc) {
+int mask=c->capacity-1;
+for (;;) {
+    LocateHashCacheSlot* slot=&(c->slots[c->clock_hand]);
+    if (slot->key!=-1 && slot->key!=pinned) {
+        if (!slot->referenced) {
+            remove_hash_cache_slot(c,c->clock_hand,prv_alloc);
+            c->evictions++;
+            return;
+        }
+        slot->referenced=0;
+    }
+    c->clock_hand=(c->clock_hand+1)&mask;
+}
+}
+
+
+/**
+ * Caches the given matches for the token sequence tab[start..end] in the
+ * given hashed cache. Unlike with cache_match, 'match' is the list of all
+ * the matches found from the origin 'start', so that an entry never holds
+ * only a part of them: evictions are done once the whole list is stored,
+ * and they never remove the entry that is being filled.
+ */
+void hash_cache_match(struct match_list* match,const int* tab,int start,int end,LocateHashCache* c,
+                      Abstract_allocator prv_alloc) {
+int length=end-start+1;
+unsigned int hash=LOCATE_HASH_CACHE_FNV_BASIS;
+for (int i=start;i<=end;i++) {
+    hash=hash_cache_step(hash,tab[i]);
+}
+int free_slot=-1;
+int i=find_hash_cache_slot(c,hash,tab,start,length,&free_slot);
+struct match_list* list=(i!=-1)?c->slots[i].matches:NULL;
+size_t needed=0;
+while (match!=NULL) {
+    struct match_list* next=match->next;
+    match->next=NULL;
+    /* Same as in the tree: we append the match if it is not already there */
+    struct match_list* *ptr=&list;
+    while ((*ptr)!=NULL && !(compare_matches(&((*ptr)->m),&(match->m))==A_EQUALS_B
+                             && !u_strcmp((*ptr)->output,match->output))) {
+        ptr=&((*ptr)->next);
+    }
+    if ((*ptr)==NULL) {
+        (*ptr)=match;
+        needed=needed+match_list_size(match);
+    } else {
+        free_match_list_element(match,prv_alloc);
+    }
+    match=next;
+}
+if (i!=-1) {
+    c->slots[i].matches=list;
+    c->size=c->size+needed;
+    int pinned=c->slots[i].key;
+    while (c->size>c->max_size && c->n_entries>1) {
+        evict_hash_cache_entry(c,pinned,prv_alloc);
+    }
+    return;
+}
+if (list==NULL) {
+    return;
+}
+needed=needed+length*sizeof(int);
+while (c->size+needed>c->max_size && c->n_entries>0) {
+    evict_hash_cache_entry(c,-1,prv_alloc);
+}
+if (4*(c->n_entries+1)>3*c->capacity) {
+    grow_hash_cache(c);
+}
+/* Evictions and growth may have moved the slots */
+find_hash_cache_slot(c,hash,tab,start,length,&free_slot);
+LocateHashCacheSlot* slot=&(c->slots[free_slot]);
+slot->hash=hash;
+slot->key=add_hash_cache_key(c,tab,start,length);
+slot->length=length;
+slot->referenced=1;
+slot->matches=list;
+c->n_entries++;
+c->size=c->size+needed;
+c->length_masks[tab[start]]|=(1u<<length_bit(length));
+if (length>c->max_length) {
+    c->max_length=length;
+}
+}
+
+
+/**
+ * Same as consult_cache, but with a hashed cache. The match lists are
+ * returned by increasing key length, like the tree exploration does, so
+ * that matches are added in the same order. Updates the hit/miss counters.
+ */
+int consult_hash_cache(const int* tab,int start,int tab_size,LocateHashCache* c,vector_ptr* res) {
+res->nbelems=0;
+int first_token=tab[start];
+if (first_token==-1) {
+    return 0;
+}
+unsigned int mask=c->length_masks[first_token];
+unsigned int hash=LOCATE_HASH_CACHE_FNV_BASIS;
+for (int length=1;mask!=0 && start+length<=tab_size && length<=c->max_length;length++) {
+    hash=hash_cache_step(hash,tab[start+length-1]);
+    unsigned int bit=length_bit(length);
+    if ((mask>>bit)==0) break;
+    if (!(mask&(1u<<bit))) continue;
+    int i=find_hash_cache_slot(c,hash,tab,start,length,NULL);
+    if (i!=-1) {
+        c->slots[i].referenced=1;
+        vector_ptr_add(res,c->slots[i].matches);
+    }
+}
+if (res->nbelems!=0) {
+    c->hits++;
+    return 1;
+}
+c->misses++;
+return 0;
+}
+
 } // namespace unitex
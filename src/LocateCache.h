@@ -51,6 +51,70 @@ void free_LocateCache(LocateCache c,Abstract_allocator);
 void cache_match(struct match_list* matches,const int* tab,int start,int end,LocateCache* c,Abstract_allocator);
 int consult_cache(const int* tab,int start,int tab_size,LocateCache* c,vector_ptr* res);
 
+
+/**
+ * Values of the 'useLocateCache' Locate parameter.
+ */
+#define NO_LOCATE_CACHE 0
+#define TREE_LOCATE_CACHE 1
+#define HASH_LOCATE_CACHE 2
+
+/* Default memory limit of the hashed cache, in megabytes */
+#define DEFAULT_LOCATE_HASH_CACHE_SIZE 256
+
+/* Key lengths from 1 to 31 have their own bit in the length masks, longer
+ * keys all share the last bit */
+#define LOCATE_HASH_CACHE_LONG_KEY 31
+
+/**
+ * A slot of the hashed cache. 'key' is the offset of the token sequence in
+ * the token arena, or -1 if the slot is free.
+ */
+typedef struct {
+    unsigned int hash;
+    int key;
+    int length;
+    int referenced;
+    struct match_list* matches;
+} LocateHashCacheSlot;
+
+
+/**
+ * This is an alternative to the ternary search tree: the token sequences
+ * are stored in a single token arena, and they are indexed by an open
+ * addressing table (linear probing) whose slots are stored contiguously.
+ * For each first token, 'length_masks' tells which key lengths may be
+ * present, so that a consultation only probes those lengths. When the
+ * memory used exceeds 'max_size', entries are evicted with the CLOCK
+ * algorithm.
+ */
+typedef struct {
+    LocateHashCacheSlot* slots;
+    /* Always a power of 2 */
+    int capacity;
+    int n_entries;
+    int* arena;
+    int arena_size;
+    int arena_capacity;
+    /* Number of arena cells that belong to evicted keys */
+    int arena_garbage;
+    unsigned int* length_masks;
+    int n_tokens;
+    int max_length;
+    int clock_hand;
+    size_t size;
+    size_t max_size;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+} LocateHashCache;
+
+
+LocateHashCache* new_LocateHashCache(int n_tokens,size_t max_size);
+void free_LocateHashCache(LocateHashCache* c,Abstract_allocator);
+void hash_cache_match(struct match_list* match,const int* tab,int start,int end,LocateHashCache* c,Abstract_allocator);
+int consult_hash_cache(const int* tab,int start,int tab_size,LocateHashCache* c,vector_ptr* res);
+
 } // namespace unitex
 
 #endif
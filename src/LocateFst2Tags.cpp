@@ -66,7 +66,6 @@ for (int i=0;i<fst2->number_of_tags;i++) {
        * that have already been processed at the time of loading the fst2 */
       continue;
    }
-   int length=u_strlen(tag[i]->input);
    if (!u_strcmp(tag[i]->input,"#")) {
       /* If we have a #, we must check if it is the meta one that
        * forbids space or the "#" token */
@@ -103,8 +102,20 @@ for (int i=0;i<fst2->number_of_tags;i++) {
       else {
          /* This input is not an existing token. Two cases can happen:
           * 1) metas like <!MOT> or patterns like <V:K>
-          * 2) a word that is not in the text tokens */
-         if (tag[i]->input[0]!='<' || tag[i]->input[length-1]!='>') {
+          * 2) a word that is not in the text tokens
+          * If the fst2 was read from an image, the first case has already been
+          * analysed, except for <XXX> patterns that depend on the dictionary codes */
+         struct fst2_locate_tag analysis;
+         const struct fst2_locate_tag* stored=NULL;
+         if (fst2->locate_tags!=NULL
+               && fst2->locate_tags_tilde_negation_operator==parameters->tilde_negation_operator
+               && fst2->locate_tags[i].kind!=LOCATE_TAG_NOT_ANALYZED) {
+            stored=&(fst2->locate_tags[i]);
+            analysis=*stored;
+         } else {
+            analyze_locate_tag(tag[i]->input,semantic_codes,parameters->tilde_negation_operator,&analysis,prv_alloc);
+         }
+         if (analysis.kind==LOCATE_TAG_NOT_ANALYZED) {
             /* If we are in case 2, it may not be an error. For instance,
              * if the tag contains "foo" and if it is a tag that allows
              * case variations, we could match "FOO" if this token is in the
@@ -112,142 +123,40 @@ for (int i=0;i<fst2->number_of_tags;i++) {
             tag[i]->type=PATTERN_TAG;
             tag[i]->pattern=build_token_pattern(tag[i]->input,prv_alloc);
          } else {
-            /* If we have something of the form <...>, we must test first if it is
-             * or not a negative tag like <!XXX> */
-            int negative_tag=(tag[i]->input[1]=='!')?1:0;
-            if (negative_tag) {
+            if (analysis.negation) {
                set_bit_mask(&(tag[i]->control),NEGATION_TAG_BIT_MASK);
             }
-            /* Then, we must test if we have or not a meta. To do that, we
-             * extract the content without < > and ! if any.*/
-            //unichar* content=u_strdup(&(tag[i]->input[1+negative_tag]),length-2-negative_tag,prv_alloc);
-            const unichar* content_start = &(tag[i]->input[1 + negative_tag]);
-            int len_content = length - 2 - negative_tag;
-
-            const unichar content_meta_mot[] = { 'M' , 'O' , 'T' };
-            const unichar content_meta_dic[] = { 'D' , 'I' , 'C' };
-            const unichar content_meta_cdic[] = { 'C' , 'D' , 'I' , 'C' };
-            const unichar content_meta_sdic[] = { 'S' , 'D' , 'I' , 'C' };
-            const unichar content_meta_tdic[] = { 'T' , 'D' , 'I' , 'C' };
-            const unichar content_meta_maj[] = { 'M' , 'A' , 'J' };
-            const unichar content_meta_min[] = { 'M' , 'I' , 'N' };
-            const unichar content_meta_pre[] = { 'P' , 'R' , 'E' };
-            const unichar content_meta_nb[] = { 'N' , 'B' };
-            const unichar content_meta_token[] = { 'T', 'O' , 'K' , 'E' , 'N' };
-            const unichar content_meta_letter[] = { 'L', 'E' , 'T' , 'T' , 'E' , 'R' };
-            const unichar content_meta_lettre[] = { 'L', 'E' , 'T' , 'T' , 'R' , 'E' };
-            const unichar content_meta_word[] = { 'W', 'O' , 'R' , 'D'  };
-            const unichar content_meta_first[] = { 'F', 'I' , 'R' , 'S' , 'T' };
-            const unichar content_meta_upper[] = { 'U', 'P' , 'P' , 'E' , 'R' };
-            const unichar content_meta_lower[] = { 'L', 'O' , 'W' , 'E' , 'R' };
-
-
-            /* And we test all the possible metas */
-            if ((len_content==3) && (!memcmp(content_start, content_meta_mot, 3*sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_MOT;
-            }
-            else if ((len_content == 3) && (!memcmp(content_start, content_meta_dic, 3 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_DIC;
-               if (!negative_tag) {
-                  /* We mark that the DIC tag has been found, but only
-                   * if it is not the negative one (<!DIC>). We do this
-                   * because things matched by <DIC> will be taken from
-                   * the 'dlf' and 'dlc' files, whereas things matched by <!DIC>
-                   * will be taken from the 'err' file. Such a trick is necessary
-                   * if we don't want 'priori' to be taken as an unknown word since
-                   * it is  part of the compound word 'a priori' */
-                  (*is_DIC)=1;
-               }
-            }
-            else if ((len_content == 4) && (!memcmp(content_start, content_meta_cdic, 4 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_CDIC;
-               (*is_CDIC)=1;
-            }
-            else if ((len_content == 4) && (!memcmp(content_start, content_meta_sdic, 4 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_SDIC;
-               (*is_SDIC)=1;
-            }
-            else if ((len_content == 4) && (!memcmp(content_start, content_meta_tdic, 4 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_TDIC;
-            }
-            else if ((len_content == 3) && (!memcmp(content_start, content_meta_maj, 3 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_MAJ;
-            }
-            else if ((len_content == 3) && (!memcmp(content_start, content_meta_min, 3 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_MIN;
-            }
-            else if ((len_content == 3) && (!memcmp(content_start, content_meta_pre, 3 * sizeof(unichar)))) {
+            if (analysis.kind==LOCATE_TAG_META) {
                tag[i]->type=META_TAG;
-               tag[i]->meta=META_PRE;
-            }
-            else if ((len_content == 2) && (!memcmp(content_start, content_meta_nb, 2 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_NB;
-               if (negative_tag) {
-                  error("Negative mark will be ignored in <!NB>\n");
+               tag[i]->meta=analysis.meta;
+               switch (analysis.meta) {
+                  case META_DIC:
+                     if (!analysis.negation) {
+                        /* We mark that the DIC tag has been found, but only
+                         * if it is not the negative one (<!DIC>). We do this
+                         * because things matched by <DIC> will be taken from
+                         * the 'dlf' and 'dlc' files, whereas things matched by <!DIC>
+                         * will be taken from the 'err' file. Such a trick is necessary
+                         * if we don't want 'priori' to be taken as an unknown word since
+                         * it is  part of the compound word 'a priori' */
+                        (*is_DIC)=1;
+                     }
+                     break;
+                  case META_CDIC: (*is_CDIC)=1; break;
+                  case META_SDIC: (*is_SDIC)=1; break;
+                  case META_NB:
+                     if (analysis.negation) {
+                        error("Negative mark will be ignored in <!NB>\n");
+                     }
+                     break;
+                  default: break;
                }
             }
-            else if ((len_content == 5) && (!memcmp(content_start, content_meta_token, 5 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_TOKEN;
-            }
-            else if ((len_content == 6) && (!memcmp(content_start, content_meta_letter, 6 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_LETTER;
-            }
-            else if ((len_content == 6) && (!memcmp(content_start, content_meta_lettre, 6 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_LETTER;
-            }
-            else if ((len_content == 4) && (!memcmp(content_start, content_meta_word, 4 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_WORD;
-            }
-            else if ((len_content == 5) && (!memcmp(content_start, content_meta_first, 5 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_FIRST;
-            }
-            else if ((len_content == 5) && (!memcmp(content_start, content_meta_upper, 5 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_UPPER;
-            }
-            else if ((len_content == 5) && (!memcmp(content_start, content_meta_lower, 5 * sizeof(unichar)))) {
-               tag[i]->type=META_TAG;
-               tag[i]->meta=META_LOWER;
-            }
             else {
                /* If we arrive here, we have not a meta but a pattern like
                 * <be>, <be.V>, <V:K>, ... */
                tag[i]->type=PATTERN_TAG;
-
-               // we allocate an heap buffer only for long meta
-#define STATIC_BUFFER_CONTENT_PROCESS_TAGS_SIZE (0x40)
-               unichar static_buffer_content[STATIC_BUFFER_CONTENT_PROCESS_TAGS_SIZE];
-               unichar * content;
-               if (len_content >= STATIC_BUFFER_CONTENT_PROCESS_TAGS_SIZE)
-               {
-                   content = (unichar*)malloc_cb((len_content + 1)*sizeof(unichar), prv_alloc);
-                   if (content == NULL) {
-                       fatal_alloc_error("process_tags");
-                   }
-               }
-               else
-                   content = static_buffer_content;
-               memcpy(content, &(tag[i]->input[1 + negative_tag]), len_content*sizeof(unichar));
-               *(content + len_content) = '\0';
-               tag[i]->pattern=build_pattern(content,semantic_codes,parameters->tilde_negation_operator,prv_alloc);
-
-               /* We don't forget to free the content if needed */
-               if (len_content >= STATIC_BUFFER_CONTENT_PROCESS_TAGS_SIZE) {
-                   free_cb(content, prv_alloc);
-               }
+               tag[i]->pattern=(stored!=NULL)?clone(stored->pattern,prv_alloc):analysis.pattern;
 
                if (tag[i]->pattern->type==CODE_PATTERN ||
                    tag[i]->pattern->type==LEMMA_AND_CODE_PATTERN ||
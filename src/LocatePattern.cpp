@@ -30,6 +30,9 @@
 #include "File.h"
 #include "UserCancelling.h"
 #include "LocateTrace.h"
+#include "logger/SyncLogger.h"
+#include "Ustring.h"
+#include "TransductionStack.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -52,7 +55,8 @@ if (p==NULL) {
 }
 memset(p,0,sizeof(struct locate_parameters));
 p->tilde_negation_operator=1;
-p->useLocateCache=1;
+p->useLocateCache=TREE_LOCATE_CACHE;
+p->locate_cache_size=DEFAULT_LOCATE_HASH_CACHE_SIZE*1024;
 p->token_control=NULL;
 p->matching_patterns=NULL;
 p->current_compound_pattern=0;
@@ -74,6 +78,9 @@ p->enter_pos=NULL;
 p->enter_pos_filename=NULL;
 p->current_origin=-1;
 p->last_origin=-1;
+p->range_start=0;
+p->range_end=0;
+p->range_overflow=0;
 p->max_count_call=0;
 p->max_count_call_warning=0;
 p->buffer=NULL;
@@ -97,6 +104,8 @@ p->output_variables=NULL;
 p->nb_output_variables=0;
 p->literal_output=new_stack_unichar(TRANSDUCTION_STACK_SIZE);
 p->stack_elg=new_stack_unichar(TRANSDUCTION_STACK_SIZE);
+p->elg_cache=NULL;
+p->elg_cache_size=0;
 p->alphabet=NULL;
 p->morpho_dic=NULL;
 p->morpho_dic_inf_free=NULL;
@@ -120,9 +129,11 @@ if (p->recyclable_unichar_buffer==NULL) {
 }
 p->size_recyclable_unichar_buffer = SIZE_RECYCLABLE_UNICHAR_BUFFER;
 p->failfast=NULL;
+p->first_tokens=NULL;
 p->match_cache_first=NULL;
 p->match_cache_last=NULL;
 p->match_cache=NULL;
+p->hash_cache=NULL;
 p->al.prv_alloc_generic=NULL;
 p->al.pa.prv_alloc_vector_int_inside_token=NULL;
 p->al.pa.prv_alloc_recycle=NULL;
@@ -172,6 +183,7 @@ void free_locate_parameters(struct locate_parameters* p) {
 if (p==NULL) return;
 // first of all
 delete(p->elg);
+free_elg_call_cache(p->elg_cache);
 
 if (p->recyclable_wchart_buffer!=NULL) {
     free(p->recyclable_wchart_buffer);
@@ -216,6 +228,502 @@ int ABSTRACT_CALLBACK_UNITEX locate_trace(const struct locate_trace_info* locate
 }
 
 
+/**
+ * This structure describes the work of a Locate thread: the origins in
+ * [start;end[ are explored with the worker's own locate_parameters and
+ * the matches are saved in the worker's own concordance file 'part'.
+ * 'p' is NULL while the chunk remains to be explored.
+ */
+struct locate_worker {
+   struct locate_parameters* p;
+   int start;
+   int end;
+   char* part;
+   U_FILE* out;
+   unsigned long count_step;
+};
+
+
+/**
+ * Builds the locate_parameters of a Locate thread. Everything that is
+ * read-only during the exploration (fst2, tokens, patterns, dictionaries, etc.)
+ * is shared with the main parameters 'p', while the ELG vm and its cache, the stacks,
+ * the variables, the allocators, the fail fast array and the match cache
+ * belong to the worker.
+ */
+static struct locate_parameters* new_locate_worker_parameters(const struct locate_parameters* p,
+                        const char* elg_extensions_path,vector_ptr* injected_vars,int n_text_tokens) {
+struct locate_parameters* w=new_locate_parameters(elg_extensions_path);
+vm* elg=w->elg;
+struct stack_unichar* literal_output=w->literal_output;
+struct stack_unichar* stack_elg=w->stack_elg;
+unichar_regex* recyclable_wchart_buffer=w->recyclable_wchart_buffer;
+unichar* recyclable_unichar_buffer=w->recyclable_unichar_buffer;
+vector_ptr* cached_match_vector=w->cached_match_vector;
+*w=*p;
+w->elg=elg;
+w->literal_output=literal_output;
+w->stack_elg=stack_elg;
+w->recyclable_wchart_buffer=recyclable_wchart_buffer;
+w->recyclable_unichar_buffer=recyclable_unichar_buffer;
+w->size_recyclable_unichar_buffer=SIZE_RECYCLABLE_UNICHAR_BUFFER;
+w->cached_match_vector=cached_match_vector;
+w->elg_cache=NULL;
+if (w->elg_cache_size>0) {
+   w->elg_cache=new_elg_call_cache(w->elg_cache_size);
+}
+w->match_list=NULL;
+w->match_cache_first=NULL;
+w->match_cache_last=NULL;
+w->dic_variables=NULL;
+w->backup_memory_reserve=NULL;
+w->number_of_matches=0;
+w->number_of_outputs=0;
+w->matching_units=0;
+w->start_position_last_printed_match=-1;
+w->end_position_last_printed_match=-1;
+w->is_in_cancel_state=0;
+memset(&(w->token_error_ctx),0,sizeof(struct Token_error_ctx));
+memset(&(w->counting_step),0,sizeof(struct counting_step_st));
+int nb_input_variable=0;
+w->input_variables=new_Variables(w->fst2->input_variables,&nb_input_variable);
+w->output_variables=new_OutputVariables(w->fst2->output_variables,&w->nb_output_variables,injected_vars);
+w->failfast=new_bit_array(n_text_tokens,ONE_BIT);
+w->al.prv_alloc_generic=create_abstract_allocator("locate_worker",AllocatorCreationFlagAutoFreePrefered);
+w->al.pa.prv_alloc_vector_int_inside_token=create_abstract_allocator("locate_worker_inside_token",
+                                 AllocatorCreationFlagAutoFreePrefered);
+w->al.pa.prv_alloc_recycle=create_abstract_allocator("locate_worker_recycle",
+                                 AllocatorFreeOnlyAtAllocatorDelete|AllocatorTipOftenRecycledObject,
+                                 get_prefered_allocator_item_size_for_nb_variable(nb_input_variable));
+w->al.prv_alloc_recycle_morphlogical_content_buffer=create_abstract_allocator("locate_worker_morphlogical_content_buffer_recycle",
+                                 AllocatorFreeOnlyAtAllocatorDelete|AllocatorTipGrowingOftenRecycledObject,
+                                 0);
+w->al.pa.prv_alloc_backup_growing_recycle=create_abstract_allocator("locate_worker_growing_recycle",
+                                 AllocatorFreeOnlyAtAllocatorDelete|AllocatorTipGrowingOftenRecycledObject,
+                                 0);
+w->al.prv_alloc_context=create_abstract_allocator("locate_worker_growing_recycle",
+                                 AllocatorFreeOnlyAtAllocatorDelete|AllocatorTipGrowingOftenRecycledObject,
+                                 0);
+w->al.prv_alloc_trace_info_allocator=create_abstract_allocator("locate_worker_recycle_locate_trace_info",
+                                 AllocatorFreeOnlyAtAllocatorDelete|AllocatorTipOftenRecycledObject,
+                                 sizeof(locate_trace_info));
+w->match_cache=(LocateCache*)malloc_cb(w->tokens->size * sizeof(LocateCache),w->al.prv_alloc_generic);
+if (w->match_cache==NULL) {
+   fatal_alloc_error("new_locate_worker_parameters");
+}
+memset(w->match_cache,0,w->tokens->size * sizeof(LocateCache));
+w->hash_cache=NULL;
+if (w->useLocateCache==HASH_LOCATE_CACHE) {
+   w->hash_cache=new_LocateHashCache(w->tokens->size,(size_t)w->locate_cache_size*1024);
+}
+w->elg->load_main_extension(w->graph_filename,w->fst2);
+return w;
+}
+
+
+/**
+ * Frees the locate_parameters of a Locate thread, without touching the
+ * data shared with the main parameters.
+ */
+static void free_locate_worker_parameters(struct locate_parameters* w) {
+if (w==NULL) return;
+w->elg->unload_main_extension();
+for (int i=0;i<w->tokens->size;i++) {
+   free_LocateCache(w->match_cache[i],w->al.prv_alloc_generic);
+}
+free_cb(w->match_cache,w->al.prv_alloc_generic);
+free_LocateHashCache(w->hash_cache,w->al.prv_alloc_generic);
+free_bit_array(w->failfast);
+free_Variables(w->input_variables);
+free_OutputVariables(w->output_variables);
+free_stack_unichar(w->literal_output);
+free_stack_unichar(w->stack_elg);
+close_abstract_allocator(w->al.prv_alloc_generic);
+close_abstract_allocator(w->al.pa.prv_alloc_vector_int_inside_token);
+close_abstract_allocator(w->al.pa.prv_alloc_recycle);
+close_abstract_allocator(w->al.prv_alloc_recycle_morphlogical_content_buffer);
+close_abstract_allocator(w->al.pa.prv_alloc_backup_growing_recycle);
+close_abstract_allocator(w->al.prv_alloc_context);
+close_abstract_allocator(w->al.prv_alloc_trace_info_allocator);
+free_locate_parameters(w);
+}
+
+
+static void ABSTRACT_CALLBACK_UNITEX locate_worker_thread(void* private_data,unsigned int /* thread_number */) {
+struct locate_worker* worker=(struct locate_worker*)private_data;
+worker->count_step=launch_locate_on_range(worker->out,worker->start,worker->end,0,worker->p);
+}
+
+
+/**
+ * Splits the token buffer into at most 'n' chunks whose bounds are positions
+ * that follow a sentence delimiter {S}. bounds[i] and bounds[i+1] are the
+ * limits of the chunk #i. Returns the number of chunks.
+ */
+static int split_text_on_sentences(const struct locate_parameters* p,int n,int* bounds) {
+int n_chunks=0;
+bounds[0]=0;
+if (p->SENTENCE!=-1 && p->buffer_size>=n) {
+   int chunk_size=p->buffer_size/n;
+   for (int i=1;i<n;i++) {
+      int pos=i*chunk_size;
+      if (pos<=bounds[n_chunks]) {
+         pos=bounds[n_chunks]+1;
+      }
+      while (pos<p->buffer_size && p->buffer[pos-1]!=p->SENTENCE) {
+         pos++;
+      }
+      if (pos>=p->buffer_size) {
+         break;
+      }
+      bounds[++n_chunks]=pos;
+   }
+}
+bounds[++n_chunks]=p->buffer_size;
+return n_chunks;
+}
+
+
+/**
+ * Forgets the result of the exploration of the given chunk, so that it is
+ * explored again.
+ */
+static void reset_locate_worker(struct locate_worker* worker) {
+free_locate_worker_parameters(worker->p);
+worker->p=NULL;
+af_remove(worker->part);
+}
+
+
+/**
+ * Performs the Locate operation with several threads. The text is split on
+ * sentence delimiters, each thread explores the origins of its chunk and
+ * then the per-thread concordances are appended to 'out' in start order.
+ * Since the match policy cannot be applied between two chunks, a chunk
+ * with a match that crosses one of its bounds is merged with the chunk on
+ * the other side of that bound, and only the merged chunks are explored
+ * again, until no match crosses a chunk bound.
+ */
+static void launch_locate_in_threads(U_FILE* out,long int text_size,U_FILE* info,const char* concord,
+                                     const VersatileEncodingConfig* vec,const char* elg_extensions_path,
+                                     vector_ptr* injected_vars,int n_text_tokens,int n_threads,
+                                     struct locate_parameters* p) {
+int* bounds=(int*)malloc((n_threads+1)*sizeof(int));
+if (bounds==NULL) {
+   fatal_alloc_error("launch_locate_in_threads");
+}
+int n_chunks=split_text_on_sentences(p,n_threads,bounds);
+if (n_chunks==1) {
+   free(bounds);
+   launch_locate(out,text_size,info,p);
+   return;
+}
+u_printf("Using %d threads...\n",n_chunks);
+struct locate_worker* workers=(struct locate_worker*)malloc(n_chunks*sizeof(struct locate_worker));
+void** workers_ptr=(void**)malloc(n_chunks*sizeof(void*));
+if (workers==NULL || workers_ptr==NULL) {
+   fatal_alloc_error("launch_locate_in_threads");
+}
+for (int i=0;i<n_chunks;i++) {
+   workers[i].part=(char*)malloc(strlen(concord)+16);
+   if (workers[i].part==NULL) {
+      fatal_alloc_error("launch_locate_in_threads");
+   }
+   sprintf(workers[i].part,"%s.thread%d",concord,i);
+   workers[i].p=NULL;
+   workers[i].start=bounds[i];
+   workers[i].end=bounds[i+1];
+   workers[i].out=NULL;
+   workers[i].count_step=0;
+}
+free(bounds);
+int ok=1;
+int n_pending=n_chunks;
+while (ok && n_pending!=0) {
+   /* We explore the chunks that have no result yet */
+   n_pending=0;
+   for (int i=0;i<n_chunks;i++) {
+      if (workers[i].p!=NULL) continue;
+      workers[i].p=new_locate_worker_parameters(p,elg_extensions_path,injected_vars,n_text_tokens);
+      workers[i].count_step=0;
+      workers[i].out=u_fopen(vec,workers[i].part,U_WRITE);
+      if (workers[i].out==NULL) {
+         error("Cannot write %s\n",workers[i].part);
+         ok=0;
+      }
+      workers_ptr[n_pending++]=&(workers[i]);
+   }
+   if (ok) {
+      logger::SyncDoRunThreads((unsigned int)n_pending,locate_worker_thread,workers_ptr);
+   }
+   for (int i=0;i<n_pending;i++) {
+      struct locate_worker* worker=(struct locate_worker*)workers_ptr[i];
+      if (worker->out!=NULL) {
+         u_fclose(worker->out);
+         worker->out=NULL;
+      }
+   }
+   if (!ok) break;
+   /* Then we merge each chunk with a match that crosses a bound with the
+    * chunk on the other side. A single chunk cannot overflow, so that this
+    * process ends */
+   int n_merged=0;
+   int previous_overflow=0;
+   n_pending=0;
+   for (int i=0;i<n_chunks;i++) {
+      int overflow=workers[i].p->range_overflow;
+      if (n_merged!=0 && ((overflow & RANGE_OVERFLOW_BEFORE) || (previous_overflow & RANGE_OVERFLOW_AFTER))) {
+         struct locate_worker* merged=&(workers[n_merged-1]);
+         if (merged->p!=NULL) {
+            reset_locate_worker(merged);
+            n_pending++;
+         }
+         merged->end=workers[i].end;
+         reset_locate_worker(&(workers[i]));
+         free(workers[i].part);
+      } else {
+         workers[n_merged++]=workers[i];
+      }
+      previous_overflow=overflow;
+   }
+   if (n_pending!=0) {
+      u_printf("Some matches cross sentence bounds, exploring again %d merged chunk%s...\n",
+               n_pending,(n_pending>1)?"s":"");
+   }
+   n_chunks=n_merged;
+}
+unsigned long total_count_step=0;
+if (ok) {
+   Ustring* line=new_Ustring(1024);
+   for (int i=0;i<n_chunks;i++) {
+      U_FILE* f=u_fopen(vec,workers[i].part,U_READ);
+      if (f==NULL) {
+         fatal_error("Cannot read %s\n",workers[i].part);
+      }
+      while (EOF!=readline_keep_CR(line,f)) {
+         u_fputs(line->str,out);
+      }
+      u_fclose(f);
+      p->number_of_matches+=workers[i].p->number_of_matches;
+      p->number_of_outputs+=workers[i].p->number_of_outputs;
+      p->matching_units+=workers[i].p->matching_units;
+      total_count_step+=workers[i].count_step;
+      if (p->hash_cache!=NULL) {
+         p->hash_cache->hits+=workers[i].p->hash_cache->hits;
+         p->hash_cache->misses+=workers[i].p->hash_cache->misses;
+         p->hash_cache->evictions+=workers[i].p->hash_cache->evictions;
+      }
+      merge_elg_call_cache_statistics(p->elg_cache,workers[i].p->elg_cache);
+   }
+   free_Ustring(line);
+}
+for (int i=0;i<n_chunks;i++) {
+   reset_locate_worker(&(workers[i]));
+   free(workers[i].part);
+}
+free(workers_ptr);
+free(workers);
+if (ok) {
+   display_locate_statistics(text_size,total_count_step,info,p);
+} else {
+   u_printf("Using a single thread...\n");
+   launch_locate(out,text_size,info,p);
+}
+}
+
+
+/**
+ * Pushes on 'stack' the destination states of the given transition list
+ * that have not been visited yet.
+ */
+static void push_first_token_states(const Transition* t,struct bit_array* visited,
+                                    int* stack,int* stack_size) {
+while (t!=NULL) {
+   if (!get_value(visited,t->state_number)) {
+      set_value(visited,t->state_number,1);
+      stack[(*stack_size)++]=t->state_number;
+   }
+   t=t->next;
+}
+}
+
+
+/**
+ * Returns 1 if the given list contains a transition to a state
+ * marked in 'nullable'.
+ */
+static int leads_to_nullable_state(const Transition* t,const char* nullable) {
+while (t!=NULL) {
+   if (nullable[t->state_number]) return 1;
+   t=t->next;
+}
+return 0;
+}
+
+
+/**
+ * Returns 1 if the meta can be crossed without consuming any token,
+ * as far as the first token of a match is concerned.
+ */
+static int is_epsilon_meta(enum meta_symbol meta) {
+return meta==META_SHARP || meta==META_EPSILON || meta==META_TEXT_START || meta==META_TEXT_END;
+}
+
+
+/**
+ * Computes for each state of the fst2 whether the end of its graph can be
+ * reached without consuming any token.
+ */
+static char* compute_nullable_states(const struct locate_parameters* p) {
+int n=p->fst2->number_of_states;
+char* nullable=(char*)malloc(n*sizeof(char));
+if (nullable==NULL) {
+   fatal_alloc_error("compute_nullable_states");
+}
+for (int i=0;i<n;i++) {
+   nullable[i]=(char)(p->optimized_states[i]->control & 1);
+}
+int modified;
+do {
+   modified=0;
+   for (int i=0;i<n;i++) {
+      if (nullable[i]) continue;
+      OptimizedFst2State s=p->optimized_states[i];
+      int ok=0;
+      for (struct opt_meta* m=s->metas;m!=NULL && !ok;m=m->next) {
+         ok=is_epsilon_meta(m->meta) && leads_to_nullable_state(m->transition,nullable);
+      }
+      struct opt_variable* v[4]={s->input_variable_starts,s->input_variable_ends,
+                                 s->output_variable_starts,s->output_variable_ends};
+      for (int k=0;k<4 && !ok;k++) {
+         for (struct opt_variable* l=v[k];l!=NULL && !ok;l=l->next) {
+            ok=leads_to_nullable_state(l->transition,nullable);
+         }
+      }
+      for (struct opt_graph_call* g=s->graph_calls;g!=NULL && !ok;g=g->next) {
+         ok=nullable[p->fst2->initial_states[g->graph_number]]
+            && leads_to_nullable_state(g->transition,nullable);
+      }
+      if (ok) {
+         nullable[i]=1;
+         modified=1;
+      }
+   }
+} while (modified);
+return nullable;
+}
+
+
+/**
+ * Computes the set of the tokens that can start a match of the main graph,
+ * by exploring everything that can be reached from its initial state without
+ * consuming any token. Returns NULL when this set cannot be computed statically,
+ * i.e. when the grammar can match the empty word or when the first token may be
+ * tested by something else than a token list or a positive pattern: a meta like
+ * <MOT> or <TOKEN>, a negation, a context or the morphological mode. In that case,
+ * Locate only relies on the fail fast array learned during the run.
+ */
+static struct bit_array* compute_first_tokens(const struct locate_parameters* p,int n_text_tokens) {
+int n=p->fst2->number_of_states;
+char* nullable=compute_nullable_states(p);
+struct bit_array* visited=new_bit_array(n,ONE_BIT);
+int* stack=(int*)malloc(n*sizeof(int));
+if (stack==NULL) {
+   fatal_alloc_error("compute_first_tokens");
+}
+/* skip_impossible_origins may read 4 bytes from the byte of the last token */
+struct bit_array* first=new_bit_array(n_text_tokens+32,ONE_BIT);
+const struct DLC_tree_node* root=(p->DLC_tree!=NULL) ? p->DLC_tree->root : NULL;
+vector_int* patterns=new_vector_int();
+int stack_size=0;
+int ok=1;
+int initial=p->fst2->initial_states[1];
+set_value(visited,initial,1);
+stack[stack_size++]=initial;
+while (ok && stack_size!=0) {
+   int state_number=stack[--stack_size];
+   OptimizedFst2State s=p->optimized_states[state_number];
+   if (s->contexts!=NULL
+       || ((s->control & 1) && s->graph_number==1)) {
+      ok=0;
+      break;
+   }
+   for (int i=0;i<s->number_of_tokens;i++) {
+      if (s->tokens[i]<n_text_tokens) {
+         set_value(first,s->tokens[i],1);
+      }
+   }
+   int compounds=0;
+   for (struct opt_pattern* l=s->patterns;l!=NULL && ok;l=l->next) {
+      if (l->negation) {
+         ok=0;
+         break;
+      }
+      vector_int_add_if_absent(patterns,l->pattern_number);
+      compounds=1;
+   }
+   for (struct opt_pattern* l=s->compound_patterns;l!=NULL;l=l->next) {
+      /* A negative compound pattern can never match */
+      if (!l->negation) compounds=1;
+   }
+   if (compounds && root!=NULL) {
+      for (int i=0;i<root->number_of_transitions;i++) {
+         if (root->destination_tokens[i]<n_text_tokens) {
+            set_value(first,root->destination_tokens[i],1);
+         }
+      }
+   }
+   for (struct opt_meta* m=s->metas;m!=NULL && ok;m=m->next) {
+      if (!is_epsilon_meta(m->meta) || m->negation) {
+         ok=0;
+         break;
+      }
+      push_first_token_states(m->transition,visited,stack,&stack_size);
+   }
+   struct opt_variable* v[4]={s->input_variable_starts,s->input_variable_ends,
+                              s->output_variable_starts,s->output_variable_ends};
+   for (int k=0;k<4;k++) {
+      for (struct opt_variable* l=v[k];l!=NULL;l=l->next) {
+         push_first_token_states(l->transition,visited,stack,&stack_size);
+      }
+   }
+   for (struct opt_graph_call* g=s->graph_calls;g!=NULL;g=g->next) {
+      int sub_initial=p->fst2->initial_states[g->graph_number];
+      if (!get_value(visited,sub_initial)) {
+         set_value(visited,sub_initial,1);
+         stack[stack_size++]=sub_initial;
+      }
+      if (nullable[sub_initial]) {
+         push_first_token_states(g->transition,visited,stack,&stack_size);
+      }
+   }
+}
+free(stack);
+free_bit_array(visited);
+free(nullable);
+if (!ok) {
+   free_vector_int(patterns);
+   free_bit_array(first);
+   return NULL;
+}
+for (int t=0;t<n_text_tokens;t++) {
+   if (p->matching_patterns[t]==NULL) continue;
+   for (int i=0;i<patterns->nbelems;i++) {
+      if (get_value(p->matching_patterns[t],patterns->tab[i])) {
+         set_value(first,t,1);
+         break;
+      }
+   }
+}
+free_vector_int(patterns);
+if (p->space_policy==START_WITH_SPACE && p->SPACE!=-1) {
+   /* A match starting with a space is tested from the token that follows it */
+   set_value(first,p->SPACE,1);
+}
+return first;
+}
+
+
 int locate_pattern(const char* text_cod,const char* tokens,const char* fst2_name,const char* dlf,const char* dlc,const char* err,
                    const char* alphabet,MatchPolicy match_policy,OutputPolicy output_policy,
                    const VersatileEncodingConfig* vec,
@@ -226,7 +734,8 @@ int locate_pattern(const char* text_cod,const char* tokens,const char* fst2_name
                    int is_korean,int max_count_call,int max_count_call_warning,
                    int stack_max, int max_matches_at_token_pos,int max_matches_per_subgraph,int max_errors,
                    char* arabic_rules,int tilde_negation_operator,int useLocateCache,int allow_trace,char* const trace_params[],
-                   vector_ptr* injected_vars,const char* elg_extensions_path,const char* enter_pos) {
+                   vector_ptr* injected_vars,const char* elg_extensions_path,const char* enter_pos,
+                   int n_threads,int locate_cache_size,int elg_cache_size,const char* filter_index) {
 UNITEX_DISCARD_UNUSED_PARAMETER(allow_trace);
 UNITEX_DISCARD_UNUSED_PARAMETER(trace_params);
 u_printf("Initializing the Extend Local Grammars (ELG) Engine...\n");
@@ -295,6 +804,8 @@ long text_size=(long)af_get_mapfile_size(p->text_cod)/sizeof(int);
 p->buffer_size=(int)text_size;
 p->tilde_negation_operator=tilde_negation_operator;
 p->useLocateCache=useLocateCache;
+p->locate_cache_size=locate_cache_size;
+p->elg_cache_size=elg_cache_size;
 if (max_count_call == -1) {
    max_count_call = (int)text_size;
 }
@@ -423,14 +934,17 @@ switch(p->real_output_policy) {
 Abstract_allocator locate_abstract_allocator=create_abstract_allocator("locate_pattern",AllocatorCreationFlagAutoFreePrefered);
 
 
-p->fst2=new_Fst2_clone(fst2load,locate_abstract_allocator);
-free_abstract_Fst2(fst2load,&fst2load_free);
+/* The loaded fst2 (possibly mapped from an image or shared through the
+ * persistence layer) is used in place: only its tags are copied, since
+ * they are the only part of the fst2 that is modified below */
+p->fst2=new_Fst2_view(fst2load,locate_abstract_allocator);
 
 if (is_cancelling_requested() != 0) {
    error("User cancel request..\n");
    free_alphabet(p->alphabet);
    free_string_hash(semantic_codes);
-   free_Fst2(p->fst2,locate_abstract_allocator);
+   free_Fst2_view(p->fst2,locate_abstract_allocator);
+   free_abstract_Fst2(fst2load,&fst2load_free);
    close_abstract_allocator(locate_abstract_allocator);
    af_release_mapfile_pointer(p->text_cod,p->buffer);
    af_close_mapfile(p->text_cod);
@@ -453,7 +967,8 @@ if (p->filters==NULL) {
    error("Cannot compile filter(s)\n");
    free_alphabet(p->alphabet);
    free_string_hash(semantic_codes);
-   free_Fst2(p->fst2,locate_abstract_allocator);
+   free_Fst2_view(p->fst2,locate_abstract_allocator);
+   free_abstract_Fst2(fst2load,&fst2load_free);
    close_abstract_allocator(locate_abstract_allocator);
    free_stack_unichar(p->literal_output);
    free_stack_unichar(p->stack_elg);
@@ -474,7 +989,8 @@ if (p->tokens==NULL) {
    error("Cannot load token list %s\n",tokens);
    free_alphabet(p->alphabet);
    free_string_hash(semantic_codes);
-   free_Fst2(p->fst2,locate_abstract_allocator);
+   free_Fst2_view(p->fst2,locate_abstract_allocator);
+   free_abstract_Fst2(fst2load,&fst2load_free);
    close_abstract_allocator(locate_abstract_allocator);
    free_locate_parameters(p);
    af_release_mapfile_pointer(p->text_cod,p->buffer);
@@ -503,7 +1019,8 @@ if(enter_pos) {
    free_alphabet(p->alphabet);
    free_string_hash(semantic_codes);
    free_string_hash(p->tokens);
-   free_Fst2(p->fst2,locate_abstract_allocator);
+   free_Fst2_view(p->fst2,locate_abstract_allocator);
+   free_abstract_Fst2(fst2load,&fst2load_free);
    close_abstract_allocator(locate_abstract_allocator);
    free_locate_parameters(p);
    af_release_mapfile_pointer(p->text_cod,p->buffer);
@@ -523,14 +1040,22 @@ memset(p->match_cache,0,p->tokens->size * sizeof(LocateCache));
 if (p->match_cache==NULL) {
     fatal_alloc_error("locate_pattern");
 }
+if (p->useLocateCache==HASH_LOCATE_CACHE) {
+    p->hash_cache=new_LocateHashCache(p->tokens->size,(size_t)p->locate_cache_size*1024);
+}
+if (p->elg_cache_size>0) {
+    p->elg_cache=new_elg_call_cache(p->elg_cache_size);
+}
 
 #ifdef REGEX_FACADE_ENGINE
-p->filter_match_index=new_FilterMatchIndex(p->filters,p->tokens);
+p->filter_match_index=new_FilterMatchIndex(p->filters,p->tokens,n_threads,filter_index);
 if (p->filter_match_index==NULL) {
    error("Cannot optimize filter(s)\n");
    free_alphabet(p->alphabet);
    free_string_hash(semantic_codes);
    free_string_hash(p->tokens);
+   free_Fst2_view(p->fst2,locate_abstract_allocator);
+   free_abstract_Fst2(fst2load,&fst2load_free);
    close_abstract_allocator(locate_abstract_allocator);
    free_locate_parameters(p);
    af_release_mapfile_pointer(p->text_cod,p->buffer);
@@ -619,6 +1144,9 @@ if (is_korean) {
     p->jamo_tags=create_jamo_tags(p->korean,p->tokens);
 }
 p->failfast=new_bit_array(n_text_tokens,ONE_BIT);
+if (p->korean==NULL) {
+    p->first_tokens=compute_first_tokens(p,n_text_tokens);
+}
 
 u_printf("Working...\n");
 p->al.prv_alloc_generic=locate_work_abstract_allocator;
@@ -646,7 +1174,12 @@ p->al.prv_alloc_context=locate_recycle_context_abstract_allocator;
 //p->lti->jamo=NULL;
 //p->lti->pos_in_jamo=0;
 
-launch_locate(out,text_size,info,p);
+if (n_threads>1 && search_limit==NO_MATCH_LIMIT) {
+   launch_locate_in_threads(out,text_size,info,concord,vec,real_elg_extensions_path,
+                            injected_vars,n_text_tokens,n_threads,p);
+} else {
+   launch_locate(out,text_size,info,p);
+}
 
 // unload main extension
 p->elg->unload_main_extension();
@@ -655,6 +1188,7 @@ p->elg->unload_main_extension();
 //free_cb(p->lti,p->al.prv_alloc_trace_info_allocator);
 
 free_bit_array(p->failfast);
+free_bit_array(p->first_tokens);
 free_bit_array(p->enter_pos);
 free_Variables(p->input_variables);
 free_OutputVariables(p->output_variables);
@@ -669,6 +1203,7 @@ if (p->match_cache!=NULL) {
     }
     free_cb(p->match_cache,locate_work_abstract_allocator);
 }
+free_LocateHashCache(p->hash_cache,locate_work_abstract_allocator);
 int free_abstract_allocator_item=(get_allocator_cb_flag(locate_abstract_allocator) & AllocatorGetFlagAutoFreePresent) ? 0 : 1;
 
 if (free_abstract_allocator_item) {
@@ -681,9 +1216,10 @@ free_stack_unichar(p->stack_elg);
  */
 if (free_abstract_allocator_item) {
   free_pattern_node(p->pattern_tree_root,locate_abstract_allocator);
-  free_Fst2(p->fst2,locate_abstract_allocator);
+  free_Fst2_view(p->fst2,locate_abstract_allocator);
   free_list_int(p->tag_token_list,locate_abstract_allocator);
 }
+free_abstract_Fst2(fst2load,&fst2load_free);
 close_abstract_allocator(locate_abstract_allocator);
 close_abstract_allocator(locate_work_abstract_allocator_inside_token);
 close_abstract_allocator(locate_recycle_abstract_allocator);
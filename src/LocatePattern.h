@@ -67,6 +67,14 @@ struct counting_step_st
 
 
 struct locate_parameters ;
+struct elg_call_cache ;
+
+/* Default maximum number of memoized results of pure extended functions */
+#define DEFAULT_ELG_CALL_CACHE_SIZE 65536
+
+/* Flags of locate_parameters::range_overflow */
+#define RANGE_OVERFLOW_BEFORE 1
+#define RANGE_OVERFLOW_AFTER 2
 
 struct locate_trace_info
 {
@@ -231,6 +239,13 @@ struct locate_parameters {
    /* Current origin position in the token buffer */
    int last_origin;
 
+   /* Range of the origins explored by launch_locate_on_range. 'range_overflow'
+    * gets RANGE_OVERFLOW_BEFORE if a saved match starts before range_start
+    * and RANGE_OVERFLOW_AFTER if it ends at or after range_end */
+   int range_start;
+   int range_end;
+   int range_overflow;
+
    /* the maximum number of locate call for each token */
    int max_count_call;
    int max_count_call_warning;
@@ -326,7 +341,8 @@ struct locate_parameters {
    /* This information is used to know if we must protect input dots and commas */
    int protect_dic_chars;
 
-   /* to known if we must use Locate Cache feature */
+   /* to known if we must use Locate Cache feature, and which backend
+    * (NO_LOCATE_CACHE, TREE_LOCATE_CACHE or HASH_LOCATE_CACHE) */
    int useLocateCache;
 
 
@@ -353,6 +369,10 @@ struct locate_parameters {
    int last_matched_position;
    /* This structure is used to mark tokens that cannot start any match */
    struct bit_array* failfast;
+   /* This structure, computed once from the grammar before the run, marks the
+    * tokens that can start a match. It is NULL when the grammar can start with
+    * something that is not a token (a context, a meta like <MOT>, etc.) */
+   struct bit_array* first_tokens;
    /* no_fail_fast is used when {^} or {$} have been tested, because those
     * metas lead to contextual failure */
    int no_fail_fast;
@@ -364,6 +384,10 @@ struct locate_parameters {
    struct match_list* match_cache_last;
    /* This is the cache array to store matches */
    LocateCache* match_cache;
+   /* This is the hashed cache used instead of match_cache with HASH_LOCATE_CACHE */
+   LocateHashCache* hash_cache;
+   /* Memory limit of the hashed cache, in kilobytes */
+   int locate_cache_size;
    /* This vector is used to store results obtained from cache consultation */
    vector_ptr* cached_match_vector;
 
@@ -418,6 +442,10 @@ struct locate_parameters {
 
    vm* elg;
    struct stack_unichar* stack_elg;
+   /* Results of the pure extended functions, NULL if they are not memoized */
+   struct elg_call_cache* elg_cache;
+   /* Maximum number of results in elg_cache, 0 to disable it */
+   int elg_cache_size;
    // position in the token buffer, relative to the current origin
    int pos_in_tokens;
    // position in the token in characters
@@ -433,7 +461,9 @@ int locate_pattern(const char*,const char*,const char*,const char*,const char*,c
                    SpacePolicy,int,const char*,AmbiguousOutputPolicy,
                    VariableErrorPolicy,int,int,int,int,
                    int stack_max, int max_matches_at_token_pos,int max_matches_per_subgraph,int max_errors,
-                   char*,int,int,int,char* const [],vector_ptr*,const char* elg_extensions_path = NULL,const char* enter_pos = NULL);
+                   char*,int,int,int,char* const [],vector_ptr*,const char* elg_extensions_path = NULL,const char* enter_pos = NULL,
+                   int n_threads = 1,int locate_cache_size = DEFAULT_LOCATE_HASH_CACHE_SIZE*1024,
+                   int elg_cache_size = DEFAULT_ELG_CALL_CACHE_SIZE,const char* filter_index = NULL);
 
 void numerote_tags(Fst2*,struct string_hash*,int*,struct string_hash*,Alphabet*,int*,int*,int*,int,struct locate_parameters*);
 unsigned char get_control_byte(const unichar*,const Alphabet*,struct string_hash*,TokenizationPolicy);
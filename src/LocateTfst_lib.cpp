@@ -29,6 +29,8 @@
 #include "Korean.h"
 #include "Contexts.h"
 #include "List_int.h"
+#include "logger/SyncLogger.h"
+#include "Ustring.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -62,6 +64,11 @@ void explore_tfst(int* visits,Tfst* tfst,int current_state_in_tfst,
 void init_Korean_stuffs(struct locate_tfst_infos* infos,int is_korean);
 void free_Korean_stuffs(struct locate_tfst_infos* infos);
 void compute_jamo_tfst_tags(struct locate_tfst_infos* infos);
+void compile_grammar_tags(struct locate_tfst_infos* infos,int tilde_negation_operator);
+void free_grammar_tags(struct locate_tfst_infos* infos);
+void compute_text_tags(struct locate_tfst_infos* infos);
+void clear_text_tags(struct locate_tfst_infos* infos);
+void free_text_tags(struct locate_tfst_infos* infos);
 int match_between_text_and_grammar_tags(Tfst* tfst,TfstTag* text_tag,Fst2Tag grammar_tag,
                                         int tfst_tag_index,int fst2_tag_index,
                                         struct locate_tfst_infos* infos,
@@ -70,7 +77,7 @@ int real_match_between_text_and_grammar_tags(Tfst* tfst,TfstTag* text_tag,Fst2Ta
                                         int tfst_tag_index,int fst2_tag_index,
                                         struct locate_tfst_infos* infos,
                                         int *pos_pending_fst2_tag,int *pos_pending_tfst_tag, int tilde_negation_operator);
-struct pattern* tokenize_grammar_tag(unichar* tag,int *negation,int tilde_negation_operator);
+struct pattern* tokenize_grammar_tag(const unichar* tag,int *negation,int tilde_negation_operator);
 int is_space_on_the_left_in_tfst(Tfst* tfst,TfstTag* tag);
 int morphological_filter_is_ok(const unichar* content,Fst2Tag grammar_tag,const struct locate_tfst_infos* infos);
 
@@ -96,15 +103,257 @@ if (l!=NULL) {
         u_strcat(s,tag->content);
     } else {
         /* Real tag ? We only take the inflected form */
-        struct dela_entry* d=tokenize_tag_token(tag->content,1);
-        u_strcat(s,d->inflected);
-        free_dela_entry(d);
+        u_strcat(s,infos->text_tags[l->n].entry->inflected);
     }
 }
 return s;
 }
 
 
+/**
+ * Applies the grammar to the sentences [first;last] of the text automaton
+ * of 'infos', and saves the matches of each sentence in 'infos->output'.
+ */
+static void locate_tfst_on_sentences(struct locate_tfst_infos* infos,int first,int last,
+                                     int tilde_negation_operator,int display_progress) {
+Tfst* tfst=infos->tfst;
+for (int i=first;i<=last && infos->number_of_matches!=infos->search_limit;i++) {
+   if (display_progress && i%100==0) {
+        u_printf("\rSentence %d/%d...",i,tfst->N);
+    }
+   load_sentence(tfst,i);
+    compute_token_contents(tfst);
+    compute_text_tags(infos);
+    if (infos->korean!=NULL) {
+       compute_jamo_tfst_tags(infos);
+    }
+    infos->matches=NULL;
+    prepare_cache_for_new_sentence(infos->cache,tfst->tags->nbelems);
+#ifdef NO_C99_VARIABLE_LENGTH_ARRAY
+    int* visits=(int*)malloc(sizeof(int)*(1+tfst->automaton->number_of_states));
+#else
+    int visits[tfst->automaton->number_of_states];
+#endif
+    /* Within a sentence graph, we try to match from any state */
+    for (int j=0;j<tfst->automaton->number_of_states;j++) {
+       for (int k=0;k<tfst->automaton->number_of_states;k++) {
+          visits[k]=0;
+       }
+       explore_tfst(visits,tfst,j,infos->fst2->initial_states[1],0,NULL,NULL,infos,-1,-1,NULL,NULL,NULL,tilde_negation_operator);
+    }
+#ifdef NO_C99_VARIABLE_LENGTH_ARRAY
+    free(visits);
+#endif
+    save_tfst_matches(infos);
+    clear_dic_variable_list(&(infos->dic_variables));
+    clear_text_tags(infos);
+}
+}
+
+
+/**
+ * This structure describes the work of a LocateTfst thread: the sentences
+ * [first;last] are explored with the worker's own text automaton cursor,
+ * variables and tag matching cache, and the matches are saved in the
+ * worker's own concordance file.
+ */
+struct locate_tfst_worker {
+   struct locate_tfst_infos infos;
+   int first;
+   int last;
+   int tilde_negation_operator;
+};
+
+
+/**
+ * Builds the infos of a LocateTfst thread. The grammar, the alphabet and
+ * the contexts are shared with the main infos 'p'. Returns 0 if the text
+ * automaton or the output cannot be opened.
+ */
+static int init_locate_tfst_worker(struct locate_tfst_worker* w,const struct locate_tfst_infos* p,
+                                   const char* text,const char* output,const VersatileEncodingConfig* vec,
+                                   int is_korean,vector_ptr* injected_vars) {
+w->infos=*p;
+w->infos.tfst=NULL;
+w->infos.output=NULL;
+w->infos.input_variables=NULL;
+w->infos.output_variables=NULL;
+w->infos.korean=NULL;
+w->infos.cache=NULL;
+w->infos.text_tags=NULL;
+w->infos.text_tag_codes=NULL;
+w->infos.text_tags_capacity=0;
+#ifdef REGEX_FACADE_ENGINE
+w->infos.filters=NULL;
+#endif
+w->infos.tfst=open_text_automaton(vec,text);
+if (w->infos.tfst==NULL) {
+   return 0;
+}
+w->infos.output=u_fopen(vec,output,U_WRITE);
+if (w->infos.output==NULL) {
+   error("Cannot write %s\n",output);
+   return 0;
+}
+#ifdef REGEX_FACADE_ENGINE
+w->infos.filters=new_FilterSet(w->infos.fst2,w->infos.alphabet);
+if (w->infos.filters==NULL) {
+   error("Cannot compile filter(s)\n");
+   return 0;
+}
+#endif
+w->infos.number_of_matches=0;
+w->infos.number_of_outputs=0;
+w->infos.matches=NULL;
+w->infos.dic_variables=NULL;
+w->infos.start_position_last_printed_match_token=-1;
+w->infos.end_position_last_printed_match_token=-1;
+w->infos.start_position_last_printed_match_char=-1;
+w->infos.end_position_last_printed_match_char=-1;
+w->infos.start_position_last_printed_match_letter=-1;
+w->infos.end_position_last_printed_match_letter=-1;
+w->infos.input_variables=new_Variables(w->infos.fst2->input_variables);
+w->infos.output_variables=new_OutputVariables(w->infos.fst2->output_variables,NULL,injected_vars);
+init_Korean_stuffs(&(w->infos),is_korean);
+w->infos.cache=new_LocateTfstTagMatchingCache(w->infos.tfst->N,w->infos.fst2->number_of_tags);
+return 1;
+}
+
+
+/**
+ * Frees the infos of a LocateTfst thread, without touching the data shared
+ * with the main infos.
+ */
+static void free_locate_tfst_worker(struct locate_tfst_worker* w) {
+#ifdef REGEX_FACADE_ENGINE
+free_FilterSet(w->infos.filters);
+#endif
+if (w->infos.output!=NULL) {
+   u_fclose(w->infos.output);
+}
+free_Variables(w->infos.input_variables);
+free_OutputVariables(w->infos.output_variables);
+free_Korean_stuffs(&(w->infos));
+free_LocateTfstTagMatchingCache(w->infos.cache);
+free_text_tags(&(w->infos));
+if (w->infos.tfst!=NULL) {
+   close_text_automaton(w->infos.tfst);
+}
+}
+
+
+static void ABSTRACT_CALLBACK_UNITEX locate_tfst_worker_thread(void* private_data,unsigned int /* thread_number */) {
+struct locate_tfst_worker* worker=(struct locate_tfst_worker*)private_data;
+locate_tfst_on_sentences(&(worker->infos),worker->first,worker->last,worker->tilde_negation_operator,0);
+}
+
+
+/**
+ * Splits the sentences of the text automaton into at most 'n' ranges of
+ * consecutive sentences, with about the same size in the .tfst file.
+ * The range #i starts at sentence bounds[i] and ends before bounds[i+1].
+ * Returns the number of ranges.
+ */
+static int split_tfst_on_sentences(Tfst* tfst,int n,int* bounds) {
+long size=get_sentence_offset(tfst,tfst->N);
+int n_ranges=0;
+bounds[0]=1;
+int sentence=1;
+for (int i=1;i<n;i++) {
+   long limit=(long)((double)size*i/n);
+   while (sentence<tfst->N && get_sentence_offset(tfst,sentence)<limit) {
+      sentence++;
+   }
+   if (sentence>bounds[n_ranges]) {
+      bounds[++n_ranges]=sentence;
+   }
+}
+bounds[++n_ranges]=tfst->N+1;
+return n_ranges;
+}
+
+
+/**
+ * Applies the grammar with several threads, each one working on a range of
+ * sentences. Since matches never cross sentences, the per-thread
+ * concordances are just appended to 'infos->output' in sentence order.
+ */
+static void locate_tfst_in_threads(const char* text,const char* output,const VersatileEncodingConfig* vec,
+                                   int is_korean,int tilde_negation_operator,vector_ptr* injected_vars,
+                                   int n_threads,struct locate_tfst_infos* infos) {
+int* bounds=(int*)malloc((n_threads+1)*sizeof(int));
+if (bounds==NULL) {
+   fatal_alloc_error("locate_tfst_in_threads");
+}
+int n_ranges=split_tfst_on_sentences(infos->tfst,n_threads,bounds);
+if (n_ranges==1) {
+   free(bounds);
+   locate_tfst_on_sentences(infos,1,infos->tfst->N,tilde_negation_operator,1);
+   return;
+}
+u_printf("Using %d threads...\n",n_ranges);
+struct locate_tfst_worker* workers=(struct locate_tfst_worker*)malloc(n_ranges*sizeof(struct locate_tfst_worker));
+void** workers_ptr=(void**)malloc(n_ranges*sizeof(void*));
+char** concord_parts=(char**)malloc(n_ranges*sizeof(char*));
+if (workers==NULL || workers_ptr==NULL || concord_parts==NULL) {
+   fatal_alloc_error("locate_tfst_in_threads");
+}
+int ok=1;
+for (int i=0;i<n_ranges;i++) {
+   concord_parts[i]=(char*)malloc(strlen(output)+16);
+   if (concord_parts[i]==NULL) {
+      fatal_alloc_error("locate_tfst_in_threads");
+   }
+   sprintf(concord_parts[i],"%s.thread%d",output,i);
+   if (!init_locate_tfst_worker(&(workers[i]),infos,text,concord_parts[i],vec,is_korean,injected_vars)) {
+      ok=0;
+   }
+   workers[i].first=bounds[i];
+   workers[i].last=bounds[i+1]-1;
+   workers[i].tilde_negation_operator=tilde_negation_operator;
+   workers_ptr[i]=&(workers[i]);
+}
+if (ok) {
+   logger::SyncDoRunThreads((unsigned int)n_ranges,locate_tfst_worker_thread,workers_ptr);
+}
+for (int i=0;i<n_ranges;i++) {
+   if (workers[i].infos.output!=NULL) {
+      u_fclose(workers[i].infos.output);
+      workers[i].infos.output=NULL;
+   }
+}
+if (ok) {
+   Ustring* line=new_Ustring(1024);
+   for (int i=0;i<n_ranges;i++) {
+      U_FILE* f=u_fopen(vec,concord_parts[i],U_READ);
+      if (f==NULL) {
+         fatal_error("Cannot read %s\n",concord_parts[i]);
+      }
+      while (EOF!=readline_keep_CR(line,f)) {
+         u_fputs(line->str,infos->output);
+      }
+      u_fclose(f);
+      infos->number_of_matches+=workers[i].infos.number_of_matches;
+      infos->number_of_outputs+=workers[i].infos.number_of_outputs;
+   }
+   free_Ustring(line);
+}
+for (int i=0;i<n_ranges;i++) {
+   free_locate_tfst_worker(&(workers[i]));
+   af_remove(concord_parts[i]);
+   free(concord_parts[i]);
+}
+free(concord_parts);
+free(workers_ptr);
+free(workers);
+free(bounds);
+if (!ok) {
+   u_printf("Cannot start the threads, using a single thread...\n");
+   locate_tfst_on_sentences(infos,1,infos->tfst->N,tilde_negation_operator,1);
+}
+}
+
+
 /**
  * This function applies the given grammar to the given text automaton.
  * It returns 1 in case of success; 0 otherwise.
@@ -115,7 +364,7 @@ int locate_tfst(const char* text,const char* grammar,const char* alphabet,const
                   OutputPolicy output_policy,AmbiguousOutputPolicy ambiguous_output_policy,
                   VariableErrorPolicy variable_error_policy,int search_limit,int is_korean,
                   int tilde_negation_operator,vector_ptr* injected_vars,int tagging,
-                  int single_tags_only,int match_word_boundaries) {
+                  int single_tags_only,int match_word_boundaries,int n_threads) {
 Tfst* tfst=open_text_automaton(vec,text);
 if (tfst==NULL) {
     return 0;
@@ -209,37 +458,17 @@ infos.end_position_last_printed_match_letter=-1;
 
 infos.search_limit=search_limit;
 init_Korean_stuffs(&infos,is_korean);
+compile_grammar_tags(&infos,tilde_negation_operator);
+infos.text_tags=NULL;
+infos.text_tag_codes=NULL;
+infos.text_tags_capacity=0;
 infos.cache=new_LocateTfstTagMatchingCache(tfst->N,infos.fst2->number_of_tags);
 infos.contexts=compute_contexts(infos.fst2);
 /* We launch the matching for each sentence */
-for (int i=1;i<=tfst->N && infos.number_of_matches!=infos.search_limit;i++) {
-   if (i%100==0) {
-        u_printf("\rSentence %d/%d...",i,tfst->N);
-    }
-   load_sentence(tfst,i);
-    compute_token_contents(tfst);
-    if (infos.korean!=NULL) {
-       compute_jamo_tfst_tags(&infos);
-    }
-    infos.matches=NULL;
-    prepare_cache_for_new_sentence(infos.cache,tfst->tags->nbelems);
-#ifdef NO_C99_VARIABLE_LENGTH_ARRAY
-    int* visits=(int*)malloc(sizeof(int)*(1+tfst->automaton->number_of_states));
-#else
-    int visits[tfst->automaton->number_of_states];
-#endif
-    /* Within a sentence graph, we try to match from any state */
-    for (int j=0;j<tfst->automaton->number_of_states;j++) {
-       for (int k=0;k<tfst->automaton->number_of_states;k++) {
-          visits[k]=0;
-       }
-       explore_tfst(visits,tfst,j,infos.fst2->initial_states[1],0,NULL,NULL,&infos,-1,-1,NULL,NULL,NULL,tilde_negation_operator);
-    }
-#ifdef NO_C99_VARIABLE_LENGTH_ARRAY
-    free(visits);
-#endif
-    save_tfst_matches(&infos);
-    clear_dic_variable_list(&(infos.dic_variables));
+if (n_threads>1 && search_limit==NO_MATCH_LIMIT && tfst->N>1) {
+   locate_tfst_in_threads(text,output,vec,is_korean,tilde_negation_operator,injected_vars,n_threads,&infos);
+} else {
+   locate_tfst_on_sentences(&infos,1,tfst->N,tilde_negation_operator,1);
 }
 u_printf("\rDone.                                    \n");
 /* We save some infos */
@@ -276,6 +505,8 @@ free_Variables(infos.input_variables);
 free_OutputVariables(infos.output_variables);
 free_Korean_stuffs(&infos);
 free_LocateTfstTagMatchingCache(infos.cache);
+free_text_tags(&infos);
+free_grammar_tags(&infos);
 for (int i=0;i<infos.fst2->number_of_states;i++) {
    free_opt_contexts(infos.contexts[i]);
 }
@@ -387,7 +618,7 @@ for (int i=0;i<infos->n_jamo_tfst_tags;i++) {
    if (t->content[0]=='{' && t->content[1]!='\0') {
       /* If we have a tag like {today,.ADV}, we compute the jamo version
        * of its inflected form */
-      struct dela_entry* entry=tokenize_tag_token(t->content,1);
+      const struct dela_entry* entry=infos->text_tags[i].entry;
       if (entry==NULL) {
          fatal_error("NULL dela_entry in compute_jamo_tfst_tags\n");
       }
@@ -398,7 +629,6 @@ for (int i=0;i<infos->n_jamo_tfst_tags;i++) {
       } else {
          Hanguls_to_Jamos(entry->inflected,tmp,infos->korean,0);
       }
-      free_dela_entry(entry);
    } else {
       if (!u_strcmp(t->content,"<E>")) {
          /* <E> is a special tag that should not be used by LocateTfst,
@@ -416,6 +646,285 @@ for (int i=0;i<infos->n_jamo_tfst_tags;i++) {
 }
 
 
+/**
+ * Returns the number of the given meta symbol like <MOT> or <WORD>, or -1
+ * if the tag is not a meta symbol that LocateTfst handles by itself. Note
+ * that '*negation' is only set if the meta symbol is found.
+ */
+static int get_grammar_meta(const unichar* input,int *negation) {
+static const struct {
+   const char* name;
+   enum meta_symbol meta;
+   int negation;
+} metas[]={
+   {"<MOT>",META_MOT,0},{"<WORD>",META_MOT,0},{"<!MOT>",META_MOT,1},{"<!WORD>",META_MOT,1},
+   {"<MIN>",META_MIN,0},{"<LOWER>",META_MIN,0},{"<!MIN>",META_MIN,1},{"<!LOWER>",META_MIN,1},
+   {"<MAJ>",META_MAJ,0},{"<UPPER>",META_MAJ,0},{"<!MAJ>",META_MAJ,1},{"<!UPPER>",META_MAJ,1},
+   {"<PRE>",META_PRE,0},{"<FIRST>",META_PRE,0},{"<!PRE>",META_PRE,1},{"<!FIRST>",META_PRE,1},
+   {"<TOKEN>",META_TOKEN,0},{"<DIC>",META_DIC,0},{"<TDIC>",META_TDIC,0},{"<!DIC>",META_DIC,1},
+   {"<SDIC>",META_SDIC,0},{"<CDIC>",META_CDIC,0},{"<NB>",META_NB,0}
+};
+for (unsigned int i=0;i<sizeof(metas)/sizeof(metas[0]);i++) {
+   if (!u_strcmp(input,metas[i].name)) {
+      (*negation)=metas[i].negation;
+      return metas[i].meta;
+   }
+}
+return -1;
+}
+
+
+/**
+ * Adds the given semantic codes to the bit set 'codes'.
+ */
+static void set_code_bits(unsigned int* codes,struct string_hash* grammar_codes,const struct list_ustring* list) {
+while (list!=NULL) {
+   int n=get_value_index(list->string,grammar_codes,DONT_INSERT);
+   codes[n/32]|=1u<<(n%32);
+   list=list->next;
+}
+}
+
+
+/**
+ * Allocates a zeroed code bit set.
+ */
+static unsigned int* new_code_bits(int n_code_words) {
+unsigned int* codes=(unsigned int*)calloc(n_code_words+1,sizeof(unsigned int));
+if (codes==NULL) {
+   fatal_alloc_error("new_code_bits");
+}
+return codes;
+}
+
+
+/**
+ * Compiles all the fst2 tags once, so that matching a text tag against
+ * a grammar tag does not need to parse the grammar tag anymore.
+ */
+void compile_grammar_tags(struct locate_tfst_infos* infos,int tilde_negation_operator) {
+Fst2* fst2=infos->fst2;
+infos->grammar_tags=(struct tfst_grammar_tag*)malloc(fst2->number_of_tags*sizeof(struct tfst_grammar_tag));
+if (infos->grammar_tags==NULL) {
+   fatal_alloc_error("compile_grammar_tags");
+}
+infos->grammar_codes=new_string_hash(DONT_USE_VALUES);
+for (int i=0;i<fst2->number_of_tags;i++) {
+   Fst2Tag tag=fst2->tags[i];
+   struct tfst_grammar_tag* t=&(infos->grammar_tags[i]);
+   t->kind=GRAMMAR_OTHER_TAG;
+   t->meta=META_TOKEN;
+   t->negation=0;
+   t->starts_with_letter=is_letter(tag->input[0],infos->alphabet);
+   t->entry=NULL;
+   t->pattern=NULL;
+   t->codes=NULL;
+   t->forbidden_codes=NULL;
+   t->lemma_code=-1;
+   /* Tags are classified in the order in which they are tested in
+    * match_between_text_and_grammar_tags */
+   if (tag->type==BEGIN_POSITIVE_CONTEXT_TAG || tag->type==BEGIN_NEGATIVE_CONTEXT_TAG
+      || tag->type==END_CONTEXT_TAG || tag->type==TEXT_START_TAG || tag->type==TEXT_END_TAG) {
+      t->kind=GRAMMAR_CONTEXT_TAG;
+   } else if (tag->type==BEGIN_MORPHO_TAG || tag->type==END_MORPHO_TAG) {
+      t->kind=GRAMMAR_MORPHO_TAG;
+   } else if (tag->type==BEGIN_VAR_TAG || tag->type==END_VAR_TAG
+              || tag->type==BEGIN_OUTPUT_VAR_TAG || tag->type==END_OUTPUT_VAR_TAG
+              || tag->type==LEFT_CONTEXT_TAG || !u_strcmp(tag->input,"<E>")) {
+      t->kind=GRAMMAR_TEXT_INDEPENDENT_TAG;
+   } else if (!u_strcmp(tag->input," ")) {
+      t->kind=GRAMMAR_SPACE_TAG;
+   } else if (!u_strcmp(tag->input,"#")) {
+      t->kind=GRAMMAR_NO_SPACE_TAG;
+   } else if (tag->input[0]!='{' && tag->input[0]!='<') {
+      t->kind=GRAMMAR_TOKEN_TAG;
+   } else if (tag->input[0]=='{' && u_strcmp(tag->input,"{S}")) {
+      t->entry=tokenize_tag_token(tag->input,1);
+      if (t->entry==NULL) {
+         fatal_error("Invalid tag in grammar: %S\n",tag->input);
+      }
+      t->kind=GRAMMAR_LEXICAL_TAG;
+      for (int j=0;j<t->entry->n_semantic_codes;j++) {
+         get_value_index(t->entry->semantic_codes[j],infos->grammar_codes);
+      }
+   } else if (tag->input[0]=='<' && tag->input[1]!='\0') {
+      int meta=get_grammar_meta(tag->input,&(t->negation));
+      if (meta!=-1) {
+         t->kind=GRAMMAR_META_TAG;
+         t->meta=(enum meta_symbol)meta;
+      } else {
+         t->kind=GRAMMAR_PATTERN_TAG;
+         t->pattern=tokenize_grammar_tag(tag->input,&(t->negation),tilde_negation_operator);
+         for (struct list_ustring* l=t->pattern->grammatical_codes;l!=NULL;l=l->next) {
+            get_value_index(l->string,infos->grammar_codes);
+         }
+         for (struct list_ustring* l=t->pattern->forbidden_codes;l!=NULL;l=l->next) {
+            get_value_index(l->string,infos->grammar_codes);
+         }
+         if (t->pattern->type==AMBIGUOUS_PATTERN) {
+            t->lemma_code=get_value_index(t->pattern->lemma,infos->grammar_codes);
+         }
+      }
+   }
+}
+/* Now that we know all the codes, we can compute the bit sets */
+infos->n_code_words=(infos->grammar_codes->size+31)/32;
+for (int i=0;i<fst2->number_of_tags;i++) {
+   struct tfst_grammar_tag* t=&(infos->grammar_tags[i]);
+   if (t->kind==GRAMMAR_LEXICAL_TAG) {
+      t->codes=new_code_bits(infos->n_code_words);
+      for (int j=0;j<t->entry->n_semantic_codes;j++) {
+         int n=get_value_index(t->entry->semantic_codes[j],infos->grammar_codes,DONT_INSERT);
+         t->codes[n/32]|=1u<<(n%32);
+      }
+   } else if (t->kind==GRAMMAR_PATTERN_TAG) {
+      t->codes=new_code_bits(infos->n_code_words);
+      t->forbidden_codes=new_code_bits(infos->n_code_words);
+      set_code_bits(t->codes,infos->grammar_codes,t->pattern->grammatical_codes);
+      set_code_bits(t->forbidden_codes,infos->grammar_codes,t->pattern->forbidden_codes);
+   }
+}
+}
+
+
+/**
+ * Frees the compiled fst2 tags.
+ */
+void free_grammar_tags(struct locate_tfst_infos* infos) {
+for (int i=0;i<infos->fst2->number_of_tags;i++) {
+   struct tfst_grammar_tag* t=&(infos->grammar_tags[i]);
+   free_dela_entry(t->entry);
+   if (t->pattern!=NULL) {
+      free_pattern(t->pattern);
+   }
+   free(t->codes);
+   free(t->forbidden_codes);
+}
+free(infos->grammar_tags);
+free_string_hash(infos->grammar_codes);
+}
+
+
+/**
+ * Parses the tags of the current sentence automaton. Tags like {tutu,toto.XXX}
+ * are tokenized, and their semantic codes are turned into a bit set over the
+ * codes used in the grammar.
+ */
+void compute_text_tags(struct locate_tfst_infos* infos) {
+int n=infos->tfst->tags->nbelems;
+if (n>infos->text_tags_capacity) {
+   free(infos->text_tags);
+   free(infos->text_tag_codes);
+   infos->text_tags_capacity=n;
+   infos->text_tags=(struct tfst_text_tag*)malloc(n*sizeof(struct tfst_text_tag));
+   infos->text_tag_codes=(unsigned int*)malloc(n*(infos->n_code_words+1)*sizeof(unsigned int));
+   if (infos->text_tags==NULL || infos->text_tag_codes==NULL) {
+      fatal_alloc_error("compute_text_tags");
+   }
+}
+for (int i=0;i<n;i++) {
+   TfstTag* tag=(TfstTag*)(infos->tfst->tags->tab[i]);
+   struct tfst_text_tag* t=&(infos->text_tags[i]);
+   t->entry=NULL;
+   t->codes=infos->text_tag_codes+i*(infos->n_code_words+1);
+   t->unknown_codes=0;
+   for (int j=0;j<infos->n_code_words;j++) {
+      t->codes[j]=0;
+   }
+   if (tag->content[0]!='{' || tag->content[1]=='\0') {
+      continue;
+   }
+   t->entry=tokenize_tag_token(tag->content,0);
+   if (t->entry==NULL) {
+      continue;
+   }
+   for (int j=0;j<t->entry->n_semantic_codes;j++) {
+      int code=get_value_index(t->entry->semantic_codes[j],infos->grammar_codes,DONT_INSERT);
+      if (code==NO_VALUE_INDEX) {
+         t->unknown_codes=1;
+      } else {
+         t->codes[code/32]|=1u<<(code%32);
+      }
+   }
+}
+}
+
+
+/**
+ * Frees the entries of the current sentence tags.
+ */
+void clear_text_tags(struct locate_tfst_infos* infos) {
+int n=infos->tfst->tags->nbelems;
+for (int i=0;i<n;i++) {
+   free_dela_entry(infos->text_tags[i].entry);
+   infos->text_tags[i].entry=NULL;
+}
+}
+
+
+/**
+ * Frees the sentence tag arrays.
+ */
+void free_text_tags(struct locate_tfst_infos* infos) {
+free(infos->text_tags);
+free(infos->text_tag_codes);
+infos->text_tags=NULL;
+infos->text_tag_codes=NULL;
+infos->text_tags_capacity=0;
+}
+
+
+/**
+ * Returns 1 if all the codes of 'a' are in 'b'; 0 otherwise.
+ */
+static inline int codes_included(const unsigned int* a,const unsigned int* b,int n_code_words) {
+for (int i=0;i<n_code_words;i++) {
+   if (a[i] & ~b[i]) return 0;
+}
+return 1;
+}
+
+
+/**
+ * Returns 1 if 'a' and 'b' have at least one code in common; 0 otherwise.
+ */
+static inline int codes_intersect(const unsigned int* a,const unsigned int* b,int n_code_words) {
+for (int i=0;i<n_code_words;i++) {
+   if (a[i] & b[i]) return 1;
+}
+return 0;
+}
+
+
+/**
+ * Compiled equivalent of 'is_entry_compatible_with_pattern'.
+ */
+static int is_text_tag_compatible_with_pattern(const struct tfst_text_tag* text_tag,
+                                               const struct tfst_grammar_tag* grammar_tag,int n_code_words) {
+const struct dela_entry* entry=text_tag->entry;
+const struct pattern* pattern=grammar_tag->pattern;
+int codes_ok=0;
+if (pattern->type==CODE_PATTERN || pattern->type==LEMMA_AND_CODE_PATTERN || pattern->type==FULL_PATTERN) {
+   codes_ok=codes_included(grammar_tag->codes,text_tag->codes,n_code_words)
+            && !codes_intersect(grammar_tag->forbidden_codes,text_tag->codes,n_code_words);
+   for (struct list_ustring* l=pattern->inflectional_codes;codes_ok && l!=NULL;l=l->next) {
+      codes_ok=dic_entry_contain_inflectional_code(entry,l->string);
+   }
+}
+switch(pattern->type) {
+   case LEMMA_PATTERN: return (!u_strcmp(entry->lemma,pattern->lemma));
+   case CODE_PATTERN: return codes_ok;
+   case LEMMA_AND_CODE_PATTERN: return codes_ok && (!u_strcmp(entry->lemma,pattern->lemma));
+   case FULL_PATTERN: return codes_ok && (!u_strcmp(entry->inflected,pattern->inflected)) && (!u_strcmp(entry->lemma,pattern->lemma));
+   case AMBIGUOUS_PATTERN: return !u_strcmp(entry->lemma,pattern->lemma)
+                                  || (text_tag->codes[grammar_tag->lemma_code/32] & (1u<<(grammar_tag->lemma_code%32)));
+   case INFLECTED_AND_LEMMA_PATTERN: return (!u_strcmp(entry->inflected,pattern->inflected)) && (!u_strcmp(entry->lemma,pattern->lemma));
+   default: fatal_error("Unexpected case in is_text_tag_compatible_with_pattern\n");
+}
+return 0;
+}
+
+
 /**
  * Explores in parallel the tfst and the fst2.
  */
@@ -844,45 +1353,29 @@ int match_between_text_and_grammar_tags(Tfst* tfst,TfstTag* text_tag,Fst2Tag gra
                                         struct locate_tfst_infos* infos,
                                         int *pos_pending_fst2_tag,int *pos_pending_tfst_tag,
                                         int tilde_negation_operator) {
-if (grammar_tag->type==BEGIN_POSITIVE_CONTEXT_TAG
-   || grammar_tag->type==BEGIN_NEGATIVE_CONTEXT_TAG
-   || grammar_tag->type==END_CONTEXT_TAG
-   || grammar_tag->type==TEXT_START_TAG
-   || grammar_tag->type==TEXT_END_TAG) {
-   /* A context should not start or end within a text tag, so we fail here */
-    return NO_MATCH_STATUS;
-}
-
-/* We start by looking at special fst2 tags */
-if (grammar_tag->type==BEGIN_MORPHO_TAG
-   || grammar_tag->type==END_MORPHO_TAG) {
-   fatal_error("Tag '%S' should not be found in a grammar applied to a text automaton\n",grammar_tag->input);
-}
-/*******************************************************
- * We want to match something that is text independent */
-if (grammar_tag->type==BEGIN_VAR_TAG
-   || grammar_tag->type==END_VAR_TAG
-   || grammar_tag->type==BEGIN_OUTPUT_VAR_TAG
-   || grammar_tag->type==END_OUTPUT_VAR_TAG
-   || grammar_tag->type==LEFT_CONTEXT_TAG
-   || !u_strcmp(grammar_tag->input,"<E>")) {
-   return TEXT_INDEPENDENT_MATCH;
-}
-
-/* Here we test the special case of the " " and # tags that are contextual matches, and
- * for this reason, that cannot be cached */
-if (!u_strcmp(grammar_tag->input," ")) {
-   if ((*pos_pending_tfst_tag)==-1 && is_space_on_the_left_in_tfst(tfst,text_tag)) {
-      //error("space has matched with %S\n",text_tag->content);
-      return TEXT_INDEPENDENT_MATCH;
-   }
-   return NO_MATCH_STATUS;
-}
-if (!u_strcmp(grammar_tag->input,"#")) {
-   if (*pos_pending_tfst_tag>0 || !is_space_on_the_left_in_tfst(tfst,text_tag)) {
+switch (infos->grammar_tags[fst2_tag_index].kind) {
+   case GRAMMAR_CONTEXT_TAG:
+      /* A context should not start or end within a text tag, so we fail here */
+      return NO_MATCH_STATUS;
+   case GRAMMAR_MORPHO_TAG:
+      fatal_error("Tag '%S' should not be found in a grammar applied to a text automaton\n",grammar_tag->input);
+      break;
+   case GRAMMAR_TEXT_INDEPENDENT_TAG:
+      /* We want to match something that is text independent */
       return TEXT_INDEPENDENT_MATCH;
-   }
-   return NO_MATCH_STATUS;
+   /* Here we test the special case of the " " and # tags that are contextual matches, and
+    * for this reason, that cannot be cached */
+   case GRAMMAR_SPACE_TAG:
+      if ((*pos_pending_tfst_tag)==-1 && is_space_on_the_left_in_tfst(tfst,text_tag)) {
+         return TEXT_INDEPENDENT_MATCH;
+      }
+      return NO_MATCH_STATUS;
+   case GRAMMAR_NO_SPACE_TAG:
+      if (*pos_pending_tfst_tag>0 || !is_space_on_the_left_in_tfst(tfst,text_tag)) {
+         return TEXT_INDEPENDENT_MATCH;
+      }
+      return NO_MATCH_STATUS;
+   default: break;
 }
 if (!u_strcmp(text_tag->content,"{STOP}")) {
    /* {STOP} can NEVER be matched */
@@ -908,6 +1401,99 @@ return result;
 }
 
 
+/**
+ * Tests if the text tag matches the given meta symbol like <MOT> or <!MIN>.
+ * 'text_entry' is the parsed text tag if it is of the form {tutu,toto.XXX};
+ * NULL otherwise.
+ */
+static int match_meta(const struct tfst_grammar_tag* grammar_tag,const unichar* content,
+                      const struct dela_entry* text_entry,int pos_in_tfst_input,
+                      int pos_pending_tfst_tag,const Alphabet* alphabet) {
+const unichar* s=content+pos_in_tfst_input;
+const unichar* inflected=(text_entry!=NULL)?text_entry->inflected+pos_in_tfst_input:NULL;
+switch (grammar_tag->meta) {
+   case META_MOT:
+      if (!grammar_tag->negation) {
+         /* <MOT> matches a sequence of letters or a tag like {tutu,toto.XXX}, even
+          * if 'tutu' is not made of characters,
+          * BUT, it matches only if we are not already inside a tfst tag in order
+          * to avoid that a grammar like "pr <MOT>" could match tags like
+          * {préciser,.V:W}
+          * <WORD> can also be used instead of <MOT> */
+         return (is_letter(s[0],alphabet) || text_entry!=NULL) && !(pos_pending_tfst_tag>0);
+      }
+      /* <!MOT> matches the opposite of <MOT>
+       <!WORD> matches the opposite of <WORD>*/
+      return !is_letter(s[0],alphabet) && text_entry==NULL;
+   case META_MIN:
+      if (!grammar_tag->negation) {
+         /* <MIN> or <LOWER> matches a sequence of letters or a tag like {tutu,toto.XXX}
+          * only made of lower case letters */
+         return is_sequence_of_lowercase_letters(s,alphabet) ||
+                (text_entry!=NULL && is_sequence_of_lowercase_letters(inflected,alphabet));
+      }
+      /* <!MIN> or <!LOWER> matches a sequence of letters or a tag like {tutu,toto.XXX}
+       * that is not only made of lower case letters */
+      return (is_letter(s[0],alphabet) && !is_sequence_of_lowercase_letters(s,alphabet))
+             || (text_entry!=NULL && !is_sequence_of_lowercase_letters(inflected,alphabet));
+   case META_MAJ:
+      if (!grammar_tag->negation) {
+         /* <MAJ> or <UPPER> matches a sequence of letters or a tag like {TUTU,toto.XXX}
+          * only made of upper case letters */
+         return is_sequence_of_uppercase_letters(s,alphabet) ||
+                (text_entry!=NULL && is_sequence_of_uppercase_letters(inflected,alphabet));
+      }
+      /* <!MAJ> or <!UPPER> matches a sequence of letters or a tag like {tutu,toto.XXX}
+       * that is not only made of upper case letters */
+      return (is_letter(s[0],alphabet) && !is_sequence_of_uppercase_letters(s,alphabet))
+             || (text_entry!=NULL && !is_sequence_of_uppercase_letters(inflected,alphabet));
+   case META_PRE:
+      if (!grammar_tag->negation) {
+         /* <PRE> or <FIRST> matches a sequence of letters or a tag like {TUTU,toto.XXX}
+          * that begins by an upper case letter */
+         return is_upper(s[0],alphabet) || (text_entry!=NULL && is_upper(inflected[0],alphabet));
+      }
+      /* <!PRE> or <!FIRST> matches a sequence of letters or a tag like {tutu,toto.XXX}
+       * that does not begin by an upper case letter. We test is_letter+!is_upper
+       * instead of is_lower in order to handle cases where there is no difference
+       * between lower and upper case letters (for instance Thai) */
+      return (is_letter(s[0],alphabet) && !is_upper(s[0],alphabet)) ||
+             (text_entry!=NULL && is_letter(inflected[0],alphabet) && !is_upper(inflected[0],alphabet));
+   case META_TOKEN:
+      /* <TOKEN> matches anything but the {STOP} tag, and the {STOP} tag case
+       * has already been dealt with */
+      return 1;
+   case META_DIC:
+      if (!grammar_tag->negation) {
+         /* <DIC> matches any tag like {tutu,toto.XXX} */
+         return text_entry!=NULL;
+      }
+      /* <!DIC> matches any sequence of letters that is not a tag like {tutu,toto.XXX} */
+      return is_letter(content[0],alphabet);
+   case META_TDIC:
+      /* <TDIC> matches any tag like {tutu,toto.XXX} */
+      return text_entry!=NULL;
+   case META_SDIC:
+      /* <SDIC> matches any tag like {tutu,toto.XXX} where tutu is simple word
+       *
+       * NOTE: according to the formal definition of simple words, something like
+       *       {3,.NUMBER} is not considered as a simple word since 3 is not
+       *       a letter. It will be considered as a compound word */
+      return text_entry!=NULL && is_sequence_of_letters(text_entry->inflected,alphabet);
+   case META_CDIC:
+      /* <CDIC> matches any tag like {tutu,toto.XXX} where tutu is a compound word
+       *
+       * NOTE: see <SDIC> note */
+      return text_entry!=NULL && !is_sequence_of_letters(text_entry->inflected,alphabet);
+   case META_NB:
+      /* <NB> matches any tag like 3 or {37,toto.XXX} */
+      return u_are_digits(content) || (text_entry!=NULL && u_are_digits(text_entry->inflected));
+   default: fatal_error("Unexpected meta symbol in match_meta\n");
+}
+return 0;
+}
+
+
 /**
  * This function tests if a text tag can be matched by a grammar tag.
  *
@@ -922,32 +1508,31 @@ int real_match_between_text_and_grammar_tags(Tfst* tfst,TfstTag* text_tag,Fst2Ta
                                         int *pos_pending_fst2_tag,int *pos_pending_tfst_tag,
                                         int tilde_negation_operator) {
 DISCARD_UNUSED_PARAMETER(tfst)
-int ret_value;
+DISCARD_UNUSED_PARAMETER(tilde_negation_operator)
+const struct tfst_grammar_tag* compiled=&(infos->grammar_tags[fst2_tag_index]);
+const struct tfst_text_tag* text=&(infos->text_tags[tfst_tag_index]);
 if (/*infos->korean &&*/ *pos_pending_fst2_tag!=-1 && *pos_pending_tfst_tag!=-1) {
    fatal_error("Internal error in match_between_text_and_grammar_tags: cannot have partial match on both\n"
                "text tag and grammar tag\n");
 }
-//error("ici tag=%S fst2 #%d\n",text_tag->content,fst2_tag_index);
-if (/*infos->korean &&*/ (*pos_pending_fst2_tag!=-1 || (grammar_tag->input[0]!='{' && grammar_tag->input[0]!='<'))) {
+if (/*infos->korean &&*/ (*pos_pending_fst2_tag!=-1 || compiled->kind==GRAMMAR_TOKEN_TAG)) {
    /* If we have an untagged token in the fst2 */
    if (*pos_pending_fst2_tag==-1) {
       /* If we were not in token exploration mode, we turn into this mode now */
       *pos_pending_fst2_tag=0;
    }
-   unichar* jamo_tfst;
-   unichar* jamo_fst2;
-   struct dela_entry* my_entry=NULL;
+   const unichar* jamo_tfst;
+   const unichar* jamo_fst2;
    if (infos->korean) {
        jamo_tfst=infos->jamo_tfst_tags[tfst_tag_index];
        jamo_fst2=infos->jamo_fst2_tags[fst2_tag_index];
    } else {
        if (text_tag->content[0]=='{' && text_tag->content[1]!='\0') {
-             /* text={toto,tutu.XXX} */
-          my_entry=tokenize_tag_token(text_tag->content,1);
-          if (my_entry==NULL) {
+          /* text={toto,tutu.XXX} */
+          if (text->entry==NULL) {
               fatal_error("NULL text_entry error in match_between_text_and_grammar_tags\n");
           }
-          jamo_tfst=my_entry->inflected;
+          jamo_tfst=text->entry->inflected;
        } else {
            jamo_tfst=text_tag->content;
        }
@@ -968,8 +1553,6 @@ if (/*infos->korean &&*/ (*pos_pending_fst2_tag!=-1 || (grammar_tag->input[0]!='
       if ((grammar_tag->control & RESPECT_CASE_TAG_BIT_MASK && jamo_fst2[k]!=jamo_tfst[j])
               || !is_equal_or_uppercase(jamo_fst2[k],jamo_tfst[j],infos->alphabet)) {
          /* If a character doesn't match */
-         //error("match failed between tfst=%S and fst2=%S\n",jamo_tfst,jamo_fst2);
-         if (my_entry!=NULL) free_dela_entry(my_entry);
          return NO_MATCH_STATUS;
       }
       k++;
@@ -978,8 +1561,6 @@ if (/*infos->korean &&*/ (*pos_pending_fst2_tag!=-1 || (grammar_tag->input[0]!='
    if (jamo_fst2[k]=='\0' && jamo_tfst[j]=='\0') {
       /* If we are at both ends of strings, it's a full match */
       (*pos_pending_fst2_tag)=-1;
-      //error("XX full match between tfst=%S and fst2=%S\n",jamo_tfst,jamo_fst2);
-      if (my_entry!=NULL) free_dela_entry(my_entry);
       return OK_MATCH_STATUS;
    }
    if (jamo_fst2[k]=='\0') {
@@ -987,23 +1568,16 @@ if (/*infos->korean &&*/ (*pos_pending_fst2_tag!=-1 || (grammar_tag->input[0]!='
        * it's a partial match */
       (*pos_pending_fst2_tag)=-1;
       (*pos_pending_tfst_tag)=j;
-      //error("ZZ partial match between tfst=%S and fst2=%S\n",jamo_tfst,jamo_fst2);
-      if (my_entry!=NULL) free_dela_entry(my_entry);
       return PARTIAL_MATCH_STATUS;
    }
    /* If we have consumed all the tfst tag, but not all the fst2 one, it's a partial match */
    (*pos_pending_fst2_tag)=k;
    (*pos_pending_tfst_tag)=-1;
-   //error("YY partial match #2 between tfst=%S and fst2=%S\n",jamo_tfst,jamo_fst2);
-   if (my_entry!=NULL) free_dela_entry(my_entry);
    return OK_MATCH_STATUS;
 }
 
-struct dela_entry* grammar_entry=NULL;
-struct dela_entry* text_entry=NULL;
-/**************************************************
- * We want to match a token like "le" */
-
+/* The text entry is only used when the text tag is like {tutu,toto.XXX} */
+const struct dela_entry* text_entry=NULL;
 int pos_in_tfst_input = (*pos_pending_tfst_tag)!=-1 ? (*pos_pending_tfst_tag) : 0;
 if (pos_in_tfst_input!=0 && text_tag->content[0]=='{') {
        /* pos_in_tfst_input contains a value that is relative to the whole tag like {toto,tutu.XXX},
@@ -1012,9 +1586,9 @@ if (pos_in_tfst_input!=0 && text_tag->content[0]=='{') {
        pos_in_tfst_input--;
 }
 
-
-
-if (is_letter(grammar_tag->input[0],infos->alphabet)) {
+/**************************************************
+ * We want to match a token like "le" */
+if (compiled->starts_with_letter) {
    if (is_letter(text_tag->content[0],infos->alphabet)) {
       /* text= "toto" */
       if (grammar_tag->control & RESPECT_CASE_TAG_BIT_MASK) {
@@ -1028,7 +1602,7 @@ if (is_letter(grammar_tag->input[0],infos->alphabet)) {
       }
    } else if (text_tag->content[0]=='{' && text_tag->content[1]!='\0') {
       /* text={toto,tutu.XXX} */
-      text_entry=tokenize_tag_token(text_tag->content,1);
+      text_entry=text->entry;
       if (text_entry==NULL) {
           fatal_error("NULL text_entry error in match_between_text_and_grammar_tags\n");
       }
@@ -1036,205 +1610,80 @@ if (is_letter(grammar_tag->input[0],infos->alphabet)) {
          /* If we must respect case */
          if (!u_strcmp(grammar_tag->input,text_entry->inflected+pos_in_tfst_input)) {
              goto ok_match;
-         } else {
-             goto no_match;
          }
+         return NO_MATCH_STATUS;
       } else {
          /* If case does not matter */
          if (is_equal_or_uppercase(grammar_tag->input,text_entry->inflected+pos_in_tfst_input,infos->alphabet)) {
              goto ok_match;
-         } else {
-             goto no_match;
          }
+         return NO_MATCH_STATUS;
       }
    }
    return NO_MATCH_STATUS;
 }
 
-/**************************************************
- * We want to match a tag like "{tutu,toto.XXX}" */
-if (grammar_tag->input[0]=='{' && u_strcmp(grammar_tag->input,"{S}")) {
-   if (text_tag->content[0]!='{') {
-      /* If the text tag is not of the form "{tutu,toto.XXX}" */
-      return NO_MATCH_STATUS;
-   }
-   grammar_entry=tokenize_tag_token(grammar_tag->input,1);
-   text_entry=tokenize_tag_token(text_tag->content,1);
-   if (!is_equal_or_uppercase(grammar_entry->inflected,text_entry->inflected+pos_in_tfst_input,infos->alphabet)) {
-      /* We allow case variations on the inflected form :
-       * if there is "{tutu,toto.XXX}" in the grammar, we want it
-       * to match "{Tutu,toto.XXX}" in the text automaton */
-      goto no_match;
-   }
-   if (u_strcmp(grammar_entry->lemma,text_entry->lemma)) {
-      /* If lemmas are different,we don't match */
-      goto no_match;
-   }
-   if (!same_codes(grammar_entry,text_entry)) {
-      /* If grammatical, semantical and inflectional informations
-       * are different we don't match*/
-      goto no_match;
-   }
-   goto ok_match;
-}
-
-/**************************************************
- * We want to match something like "<....>". The
- * <E> case has already been handled in text independent matchings */
-if (grammar_tag->input[0]=='<' && grammar_tag->input[1]!='\0') {
-    /* We tokenize the text tag, if we have one */
-    if (text_tag->content[0]=='{' && text_tag->content[1]!='\0') {
-       text_entry=tokenize_tag_token(text_tag->content,1);
-    }
-   if (!u_strcmp(grammar_tag->input,"<MOT>") || !u_strcmp(grammar_tag->input,"<WORD>")) {
-      /* <MOT> matches a sequence of letters or a tag like {tutu,toto.XXX}, even
-       * if 'tutu' is not made of characters,
-       * BUT, it matches only if we are not already inside a tfst tag in order
-       * to avoid that a grammar like "pr <MOT>" could match tags like
-       * {préciser,.V:W}
-       * <WORD> can also be used instead of <MOT> */
-      if ((is_letter(text_tag->content[pos_in_tfst_input],infos->alphabet) || text_entry!=NULL)
-              && !((*pos_pending_tfst_tag)>0)) {
-         goto ok_match;
-      }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<!MOT>") || !u_strcmp(grammar_tag->input,"<!WORD>")) {
-      /* <!MOT> matches the opposite of <MOT>
-       <!WORD> matches the opposite of <WORD>*/
-      if (!is_letter(text_tag->content[pos_in_tfst_input],infos->alphabet)
-          && text_entry==NULL) {
-          goto ok_match;
-      }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<MIN>") || !u_strcmp(grammar_tag->input,"<LOWER>")) {
-      /* <MIN> or <LOWER> matches a sequence of letters or a tag like {tutu,toto.XXX}
-       * only made of lower case letters */
-      if (is_sequence_of_lowercase_letters(text_tag->content+pos_in_tfst_input,infos->alphabet) ||
-          (text_entry!=NULL && is_sequence_of_lowercase_letters(text_entry->inflected+pos_in_tfst_input,infos->alphabet))) {
-         goto ok_match;
-      }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<!MIN>") || !u_strcmp(grammar_tag->input,"<!LOWER>")) {
-      /* <!MIN> or <!LOWER> matches a sequence of letters or a tag like {tutu,toto.XXX}
-       * that is not only made of lower case letters */
-      if ((is_letter(text_tag->content[pos_in_tfst_input],infos->alphabet) && !is_sequence_of_lowercase_letters(text_tag->content+pos_in_tfst_input,infos->alphabet))
-          || (text_entry!=NULL && !is_sequence_of_lowercase_letters(text_entry->inflected+pos_in_tfst_input,infos->alphabet))) {
-         goto ok_match;
-      }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<MAJ>") || !u_strcmp(grammar_tag->input,"<UPPER>")) {
-      /* <MAJ> or <UPPER> matches a sequence of letters or a tag like {TUTU,toto.XXX}
-       * only made of upper case letters */
-      if (is_sequence_of_uppercase_letters(text_tag->content+pos_in_tfst_input,infos->alphabet) ||
-          (text_entry!=NULL && is_sequence_of_uppercase_letters(text_entry->inflected+pos_in_tfst_input,infos->alphabet))) {
-         goto ok_match;
+switch (compiled->kind) {
+   /**************************************************
+    * We want to match a tag like "{tutu,toto.XXX}" */
+   case GRAMMAR_LEXICAL_TAG: {
+      if (text_tag->content[0]!='{' || text->entry==NULL) {
+         /* If the text tag is not of the form "{tutu,toto.XXX}" */
+         return NO_MATCH_STATUS;
       }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<!MAJ>") || !u_strcmp(grammar_tag->input,"<!UPPER>")) {
-      /* <!MAJ> or <!UPPER> matches a sequence of letters or a tag like {tutu,toto.XXX}
-       * that is not only made of upper case letters */
-      if ((is_letter(text_tag->content[pos_in_tfst_input],infos->alphabet) && !is_sequence_of_uppercase_letters(text_tag->content+pos_in_tfst_input,infos->alphabet))
-          || (text_entry!=NULL && !is_sequence_of_uppercase_letters(text_entry->inflected+pos_in_tfst_input,infos->alphabet))) {
-         goto ok_match;
+      text_entry=text->entry;
+      const struct dela_entry* grammar_entry=compiled->entry;
+      if (!is_equal_or_uppercase(grammar_entry->inflected,text_entry->inflected+pos_in_tfst_input,infos->alphabet)) {
+         /* We allow case variations on the inflected form :
+          * if there is "{tutu,toto.XXX}" in the grammar, we want it
+          * to match "{Tutu,toto.XXX}" in the text automaton */
+         return NO_MATCH_STATUS;
       }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<PRE>") || !u_strcmp(grammar_tag->input,"<FIRST>")) {
-      /* <PRE> or <FIRST> matches a sequence of letters or a tag like {TUTU,toto.XXX}
-       * that begins by an upper case letter */
-      if (is_upper(text_tag->content[pos_in_tfst_input],infos->alphabet) ||
-          (text_entry!=NULL && is_upper(text_entry->inflected[pos_in_tfst_input],infos->alphabet))) {
-         goto ok_match;
+      if (u_strcmp(grammar_entry->lemma,text_entry->lemma)) {
+         /* If lemmas are different,we don't match */
+         return NO_MATCH_STATUS;
       }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<!PRE>") || !u_strcmp(grammar_tag->input,"<!FIRST>")) {
-      /* <!PRE> or <!FIRST> matches a sequence of letters or a tag like {tutu,toto.XXX}
-       * that does not begin by an upper case letter */
-      if ((is_letter(text_tag->content[pos_in_tfst_input],infos->alphabet) && !is_upper(text_tag->content[pos_in_tfst_input],infos->alphabet)) ||
-          (text_entry!=NULL && is_letter(text_entry->inflected[pos_in_tfst_input],infos->alphabet) && !is_upper(text_entry->inflected[pos_in_tfst_input],infos->alphabet))) {
-         /* We test is_letter+!is_upper instead of is_lower in order to handle
-          * cases where there is no difference between lower and upper case letters
-          * (for instance Thai) */
-         goto ok_match;
+      /* If grammatical, semantical and inflectional informations
+       * are different we don't match. As all grammar codes have a number, a
+       * text code without number cannot be in the grammar tag */
+      if (grammar_entry->n_semantic_codes!=text_entry->n_semantic_codes
+            || text->unknown_codes
+            || !codes_included(text->codes,compiled->codes,infos->n_code_words)
+            || !same_inflectional_codes(grammar_entry,text_entry)) {
+         return NO_MATCH_STATUS;
       }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<TOKEN>")) {
-      /* <TOKEN> matches anything but the {STOP} tag, and the {STOP} tag case
-       * has already been dealt with */
       goto ok_match;
    }
-   if (!u_strcmp(grammar_tag->input,"<DIC>")) {
-      /* <DIC> matches any tag like {tutu,toto.XXX} */
-      if (text_entry!=NULL) {
-         goto ok_match;
-      }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<TDIC>")) {
-      /* <TDIC> matches any tag like {tutu,toto.XXX} */
-      if (text_entry!=NULL) {
-         goto ok_match;
-      }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<!DIC>")) {
-      /* <!DIC> matches any sequence of letters that is not a tag like {tutu,toto.XXX} */
-      if (is_letter(text_tag->content[0],infos->alphabet)) {
-         goto ok_match;
-      }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<SDIC>")) {
-      /* <SDIC> matches any tag like {tutu,toto.XXX} where tutu is simple word
-       *
-       * NOTE: according to the formal definition of simple words, something like
-       *       {3,.NUMBER} is not considered as a simple word since 3 is not
-       *       a letter. It will be considered as a compound word */
-      if (text_entry!=NULL && is_sequence_of_letters(text_entry->inflected,infos->alphabet)) {
-         goto ok_match;
-      }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<CDIC>")) {
-      /* <CDIC> matches any tag like {tutu,toto.XXX} where tutu is a compound word
-       *
-       * NOTE: see <SDIC> note */
-      if (text_entry!=NULL && !is_sequence_of_letters(text_entry->inflected,infos->alphabet)) {
-         goto ok_match;
+   /**************************************************
+    * We want to match something like "<....>". The
+    * <E> case has already been handled in text independent matchings */
+   case GRAMMAR_META_TAG: {
+      if (text_tag->content[0]=='{' && text_tag->content[1]!='\0') {
+         text_entry=text->entry;
       }
-      goto no_match;
-   }
-   if (!u_strcmp(grammar_tag->input,"<NB>")) {
-      /* <NB> matches any tag like 3 or {37,toto.XXX} */
-      if (u_are_digits(text_tag->content) ||
-          (text_entry!=NULL && u_are_digits(text_entry->inflected))) {
+      int ok=match_meta(compiled,text_tag->content,text_entry,pos_in_tfst_input,
+                        *pos_pending_tfst_tag,infos->alphabet);
+      if (ok) {
          goto ok_match;
       }
-      goto no_match;
+      return NO_MATCH_STATUS;
    }
    /**************************************************************
     * If we arrive here, we are in the case of a pattern.
     * We will handle several cases, but only if the text contains
     * a tag like {tutu,toto.XXX} */
-   if (text_entry==NULL) {
-      goto no_match;
-   }
-   /* First, we tokenize the grammar pattern tag */
-   int negation;
-   struct pattern* pattern=tokenize_grammar_tag(grammar_tag->input,&negation,tilde_negation_operator);
-   int ok=is_entry_compatible_with_pattern(text_entry,pattern);
-   free_pattern(pattern);
-   if ((ok && !negation) || (!ok && negation)) {
-       goto ok_match;
+   case GRAMMAR_PATTERN_TAG: {
+      if (!(text_tag->content[0]=='{' && text_tag->content[1]!='\0') || text->entry==NULL) {
+         return NO_MATCH_STATUS;
+      }
+      text_entry=text->entry;
+      int ok=is_text_tag_compatible_with_pattern(text,compiled,infos->n_code_words);
+      if ((ok && !compiled->negation) || (!ok && compiled->negation)) {
+          goto ok_match;
+      }
+      return NO_MATCH_STATUS;
    }
-   goto no_match;
+   default: break;
 }
 
 /**************************************************
@@ -1245,32 +1694,19 @@ if (!u_strcmp(grammar_tag->input,text_tag->content)) {
 return NO_MATCH_STATUS;
 
 /* We arrive here when we have used dela_entry variables */
-
 ok_match:
 /* We test the morphological filter, if any */
 if (!morphological_filter_is_ok((text_entry!=NULL)?text_entry->inflected:text_tag->content,grammar_tag,infos)) {
-    goto no_match;
+    return NO_MATCH_STATUS;
 }
-ret_value=OK_MATCH_STATUS;
-goto clean;
-
-no_match:
-ret_value=NO_MATCH_STATUS;
-/* This goto is useless, but there because if one day someone inserts something here...
- * Note that our friend compiler certainly removes it */
-goto clean;
-
-clean:
-free_dela_entry(grammar_entry);
-free_dela_entry(text_entry);
-return ret_value;
+return OK_MATCH_STATUS;
 }
 
 
 /**
  * This function takes a tag of the form <.......> and tokenizes it.
  */
-struct pattern* tokenize_grammar_tag(unichar* tag,int *negation,int tilde_negation_operator) {
+struct pattern* tokenize_grammar_tag(const unichar* tag,int *negation,int tilde_negation_operator) {
 (*negation)=0;
 if (tag==NULL) {
    fatal_error("NULL pattern error in tokenize_grammar_tag\n");
@@ -1284,9 +1720,11 @@ if (tag[l-1]!='>') {
 }
 if (tag[1]=='!') {(*negation)=1;}
 else {(*negation)=0;}
-tag[l-1]='\0';
-struct pattern* pattern=build_pattern(&(tag[1+(*negation)]),NULL,tilde_negation_operator);
-tag[l-1]='>';
+/* We work on a copy, so that the grammar tag is never modified */
+unichar* content=u_strdup(&(tag[1+(*negation)]));
+content[l-2-(*negation)]='\0';
+struct pattern* pattern=build_pattern(content,NULL,tilde_negation_operator);
+free(content);
 return pattern;
 }
 
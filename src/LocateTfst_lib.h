@@ -35,6 +35,9 @@
 #include "TransductionVariables.h"
 #include "OutputTransductionVariables.h"
 #include "Vector.h"
+#include "MetaSymbols.h"
+#include "Pattern.h"
+#include "String_hash.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -50,6 +53,65 @@ namespace unitex {
 #define TEXT_INDEPENDENT_MATCH 3
 #define PARTIAL_MATCH_STATUS 4
 
+/**
+ * The different kinds of grammar tags, as seen by LocateTfst. The kind of
+ * each fst2 tag is computed once before the matching, so that we don't have
+ * to compare the tag input with "<E>", " ", "#" or meta symbols each time
+ * we try to match it.
+ */
+typedef enum {
+   GRAMMAR_CONTEXT_TAG,          /* context marks, {^} and {$} */
+   GRAMMAR_MORPHO_TAG,           /* $< and $> */
+   GRAMMAR_TEXT_INDEPENDENT_TAG, /* variables, $* and <E> */
+   GRAMMAR_SPACE_TAG,            /* " " */
+   GRAMMAR_NO_SPACE_TAG,         /* # */
+   GRAMMAR_TOKEN_TAG,            /* untagged token like "le" */
+   GRAMMAR_LEXICAL_TAG,          /* {tutu,toto.XXX} */
+   GRAMMAR_META_TAG,             /* <MOT>, <!DIC>, ... */
+   GRAMMAR_PATTERN_TAG,          /* <V:K>, <!be.V>, ... */
+   GRAMMAR_OTHER_TAG             /* {S} and non alphabetic tokens */
+} GrammarTagKind;
+
+
+/**
+ * This is the compiled version of a fst2 tag. Semantic codes are stored
+ * as bit sets over the codes that appear in the grammar. Compiled tags are
+ * read-only, so that they can be shared by several threads.
+ */
+struct tfst_grammar_tag {
+   GrammarTagKind kind;
+   /* Only used for GRAMMAR_META_TAG; synonyms like <WORD> are
+    * stored as their base meta symbol like <MOT> */
+   enum meta_symbol meta;
+   /* 1 for <!MOT>, <!DIC>, <!N>, ... */
+   int negation;
+   int starts_with_letter;
+   /* For {tutu,toto.XXX} tags */
+   struct dela_entry* entry;
+   /* For patterns */
+   struct pattern* pattern;
+   /* Codes of 'entry', or grammatical codes of 'pattern' */
+   unsigned int* codes;
+   /* Forbidden codes of 'pattern' */
+   unsigned int* forbidden_codes;
+   /* For ambiguous patterns like <be>, the code number of 'be'
+    * if it is a code used in the grammar; -1 otherwise */
+   int lemma_code;
+};
+
+
+/**
+ * This is a text automaton tag, parsed once per sentence.
+ */
+struct tfst_text_tag {
+   /* NULL for untagged tokens */
+   struct dela_entry* entry;
+   unsigned int* codes;
+   /* 1 if the entry has a semantic code that is not used in the grammar */
+   int unknown_codes;
+};
+
+
 /**
  * This structure is used to wrap many information needed to perform the locate
  * operation on a text automaton.
@@ -111,6 +173,18 @@ struct locate_tfst_infos {
     int n_jamo_tfst_tags;
     unichar** jamo_tfst_tags;
 
+    /* Compiled fst2 tags, and the semantic codes they use. Both
+     * are shared by all the threads */
+    struct tfst_grammar_tag* grammar_tags;
+    struct string_hash* grammar_codes;
+    /* Number of unsigned int in each code bit set */
+    int n_code_words;
+
+    /* Parsed tags of the current sentence */
+    struct tfst_text_tag* text_tags;
+    unsigned int* text_tag_codes;
+    int text_tags_capacity;
+
     LocateTfstTagMatchingCache* cache;
     struct opt_contexts** contexts;
 
@@ -122,7 +196,7 @@ struct locate_tfst_infos {
 
 
 int locate_tfst(const char*,const char*,const char*,const char*, const VersatileEncodingConfig*,MatchPolicy,OutputPolicy,AmbiguousOutputPolicy,
-                VariableErrorPolicy,int,int,int,vector_ptr*,int,int,int);
+                VariableErrorPolicy,int,int,int,vector_ptr*,int,int,int,int n_threads=1);
 
 } // namespace unitex
 
@@ -22,6 +22,10 @@
 #include "MorphologicalFilters.h"
 #include "Error.h"
 #include "DELA.h"
+#include "File.h"
+#include "logger/SyncLogger.h"
+#include "HashTable.h"
+#include <limits.h>
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -33,10 +37,837 @@ namespace unitex {
 
 #define HASH_FILTERS_DIM 1024
 
+/* Limits beyond which a filter is left to TRE rather than compiled into a DFA */
+#define FILTER_MAX_NFA_STATES 4096
+#define FILTER_MAX_DFA_STATES 2048
+#define FILTER_MAX_DFA_TRANSITIONS (1<<20)
+#define FILTER_MAX_REPETITION 255
+
+/* Characters below this value get their class without a binary search */
+#define FILTER_DFA_DIRECT_CLASSES 256
+#define FILTER_MAX_PREFIX 32
+
+/* Types of the states of the non deterministic automaton built from a filter */
+#define FNFA_CHARS 0
+#define FNFA_EPSILON 1
+#define FNFA_SPLIT 2
+#define FNFA_BOL 3
+#define FNFA_EOL 4
+#define FNFA_MATCH 5
+
+
+/**
+ * A state of the non deterministic automaton built from a filter. 'set' is
+ * only used by FNFA_CHARS states and 'out1' by FNFA_SPLIT ones.
+ */
+struct filter_nfa_state {
+   int type;
+   int set;
+   int out;
+   int out1;
+};
+
+
+/**
+ * A set of characters, represented by sorted disjoint ranges
+ * [ranges[2*i];ranges[2*i+1]].
+ */
+struct filter_char_set {
+   int n_ranges;
+   int* ranges;
+};
+
+
+struct filter_nfa {
+   int n_states;
+   int capacity;
+   struct filter_nfa_state* states;
+   int n_sets;
+   int sets_capacity;
+   struct filter_char_set* sets;
+};
+
+
+/**
+ * The parser that turns a POSIX extended regular expression into a filter_nfa.
+ * 'ok' is set to 0 as soon as an unsupported or invalid construct is found.
+ */
+struct filter_parser {
+   const unichar* re;
+   int pos;
+   struct filter_nfa* nfa;
+   int ok;
+};
+
+
+/**
+ * The deterministic automaton of a filter. Characters are grouped into
+ * classes that have the same transitions: class #k contains the characters
+ * in [bounds[k];bounds[k+1][. The transition of the state s with
+ * the class k is next[s*n_classes+k]. The state #0 is the initial one.
+ */
+struct filter_dfa {
+   int n_classes;
+   int* bounds;
+   int direct_class[FILTER_DFA_DIRECT_CLASSES];
+   int n_states;
+   int* next;
+   /* accept[s]=1 if a match ends as soon as s is reached; end_accept[s]=1 if
+    * a match ends when s is reached at the end of the string */
+   char* accept;
+   char* end_accept;
+   /* The state from which no match is possible anymore, or -1 */
+   int dead;
+   /* Prefilter: any string matched by the filter starts with 'prefix' and
+    * is at least 'min_length' characters long */
+   unichar prefix[FILTER_MAX_PREFIX];
+   int prefix_length;
+   int min_length;
+};
+
 
 static void free_FilterSet(FilterSet*,int);
-static void w_extract_inflected(const unichar* tag_token, unichar_regex** inflected, size_t *buffer_size);
 static void split_filter(const unichar*,unichar*,char*);
+static void free_filter_dfa(struct filter_dfa*);
+
+
+static int new_nfa_state(struct filter_nfa* nfa,int type,int set,int out,int out1) {
+if (nfa->n_states==nfa->capacity) {
+   nfa->capacity=(nfa->capacity==0) ? 64 : 2*nfa->capacity;
+   nfa->states=(struct filter_nfa_state*)realloc(nfa->states,nfa->capacity*sizeof(struct filter_nfa_state));
+   if (nfa->states==NULL) {
+      fatal_alloc_error("new_nfa_state");
+   }
+}
+struct filter_nfa_state* s=&(nfa->states[nfa->n_states]);
+s->type=type;
+s->set=set;
+s->out=out;
+s->out1=out1;
+return nfa->n_states++;
+}
+
+
+static int compare_ranges(const void* a,const void* b) {
+return ((const int*)a)[0]-((const int*)b)[0];
+}
+
+
+/**
+ * Adds to the automaton the set made of the given 'n' ranges, or of their
+ * complement if 'negate' is set, and returns its number.
+ */
+static int new_nfa_char_set(struct filter_nfa* nfa,int* ranges,int n,int negate) {
+if (nfa->n_sets==nfa->sets_capacity) {
+   nfa->sets_capacity=(nfa->sets_capacity==0) ? 16 : 2*nfa->sets_capacity;
+   nfa->sets=(struct filter_char_set*)realloc(nfa->sets,nfa->sets_capacity*sizeof(struct filter_char_set));
+   if (nfa->sets==NULL) {
+      fatal_alloc_error("new_nfa_char_set");
+   }
+}
+/* We sort and merge the ranges */
+qsort(ranges,n,2*sizeof(int),compare_ranges);
+int m=0;
+for (int i=0;i<n;i++) {
+   if (m>0 && ranges[2*i]<=ranges[2*m-1]+1) {
+      if (ranges[2*i+1]>ranges[2*m-1]) ranges[2*m-1]=ranges[2*i+1];
+   } else {
+      ranges[2*m]=ranges[2*i];
+      ranges[2*m+1]=ranges[2*i+1];
+      m++;
+   }
+}
+struct filter_char_set* set=&(nfa->sets[nfa->n_sets]);
+set->ranges=(int*)malloc((2*m+2)*sizeof(int));
+if (set->ranges==NULL) {
+   fatal_alloc_error("new_nfa_char_set");
+}
+set->n_ranges=0;
+if (!negate) {
+   memcpy(set->ranges,ranges,2*m*sizeof(int));
+   set->n_ranges=m;
+} else {
+   int lo=0;
+   for (int i=0;i<m;i++) {
+      if (ranges[2*i]>lo) {
+         set->ranges[2*set->n_ranges]=lo;
+         set->ranges[2*set->n_ranges+1]=ranges[2*i]-1;
+         set->n_ranges++;
+      }
+      lo=ranges[2*i+1]+1;
+   }
+   if (lo<=0xFFFF) {
+      set->ranges[2*set->n_ranges]=lo;
+      set->ranges[2*set->n_ranges+1]=0xFFFF;
+      set->n_ranges++;
+   }
+}
+return nfa->n_sets++;
+}
+
+
+static int new_nfa_range_set(struct filter_nfa* nfa,int lo,int hi) {
+int range[2]={lo,hi};
+return new_nfa_char_set(nfa,range,1,0);
+}
+
+
+static void free_filter_nfa(struct filter_nfa* nfa) {
+for (int i=0;i<nfa->n_sets;i++) {
+   free(nfa->sets[i].ranges);
+}
+free(nfa->sets);
+free(nfa->states);
+}
+
+
+static int is_filter_quantifier(unichar c) {
+return c=='*' || c=='+' || c=='?' || c=='{';
+}
+
+
+/**
+ * Parses a bracket expression like "[^a-z_]" and returns the number of its set.
+ * Character classes like [:alpha:], equivalence classes and collating
+ * elements are not supported.
+ */
+static int parse_filter_bracket(struct filter_parser* p) {
+const unichar* re=p->re;
+int pos=p->pos+1;
+int negate=0;
+if (re[pos]=='^') {
+   negate=1;
+   pos++;
+}
+int n=0;
+int capacity=16;
+int* ranges=(int*)malloc(2*capacity*sizeof(int));
+if (ranges==NULL) {
+   fatal_alloc_error("parse_filter_bracket");
+}
+/* A ']' that comes first is a plain character */
+int first=1;
+while (first || re[pos]!=']') {
+   int lo=re[pos];
+   if (lo=='\0' || lo=='\\' || (lo=='[' && (re[pos+1]==':' || re[pos+1]=='=' || re[pos+1]=='.'))
+       || (lo=='-' && !first && re[pos+1]!=']')) {
+      free(ranges);
+      p->ok=0;
+      return -1;
+   }
+   int hi=lo;
+   pos++;
+   if (re[pos]=='-' && re[pos+1]!=']' && re[pos+1]!='\0') {
+      hi=re[pos+1];
+      if (hi=='\\' || hi=='[' || hi<lo) {
+         free(ranges);
+         p->ok=0;
+         return -1;
+      }
+      pos=pos+2;
+   }
+   if (n==capacity) {
+      capacity=2*capacity;
+      ranges=(int*)realloc(ranges,2*capacity*sizeof(int));
+      if (ranges==NULL) {
+         fatal_alloc_error("parse_filter_bracket");
+      }
+   }
+   ranges[2*n]=lo;
+   ranges[2*n+1]=hi;
+   n++;
+   first=0;
+}
+p->pos=pos+1;
+int set=new_nfa_char_set(p->nfa,ranges,n,negate);
+free(ranges);
+return set;
+}
+
+
+/**
+ * Parses a bound like "{2,5}", "{2,}" or "{2}". Returns 0 if the bound is not
+ * valid; 1 otherwise. An unlimited upper bound is represented by -1.
+ */
+static int parse_filter_bound(struct filter_parser* p,int* min,int* max) {
+const unichar* re=p->re;
+int pos=p->pos+1;
+if (re[pos]<'0' || re[pos]>'9') return 0;
+*min=0;
+while (re[pos]>='0' && re[pos]<='9') {
+   *min=(*min)*10+(re[pos++]-'0');
+   if (*min>FILTER_MAX_REPETITION) return 0;
+}
+*max=*min;
+if (re[pos]==',') {
+   pos++;
+   if (re[pos]=='}') {
+      *max=-1;
+   } else {
+      if (re[pos]<'0' || re[pos]>'9') return 0;
+      *max=0;
+      while (re[pos]>='0' && re[pos]<='9') {
+         *max=(*max)*10+(re[pos++]-'0');
+         if (*max>FILTER_MAX_REPETITION) return 0;
+      }
+      if (*max<*min) return 0;
+   }
+}
+if (re[pos]!='}') return 0;
+p->pos=pos+1;
+return 1;
+}
+
+
+static void parse_filter_regex(struct filter_parser*,int*,int*);
+
+
+/**
+ * Parses an atom and builds its fragment of automaton [start;end]. Returns 1
+ * if the atom can be followed by a quantifier; 0 otherwise.
+ */
+static int parse_filter_atom(struct filter_parser* p,int* start,int* end) {
+const unichar* re=p->re;
+unichar c=re[p->pos];
+int set;
+switch (c) {
+   case '(':
+      p->pos++;
+      if (re[p->pos]==')') {
+         p->ok=0;
+         return 0;
+      }
+      parse_filter_regex(p,start,end);
+      if (!p->ok) return 0;
+      if (re[p->pos]!=')') {
+         p->ok=0;
+         return 0;
+      }
+      p->pos++;
+      return 1;
+   case '^':
+   case '$':
+      *start=*end=new_nfa_state(p->nfa,(c=='^') ? FNFA_BOL : FNFA_EOL,-1,-1,-1);
+      p->pos++;
+      return 0;
+   case '[':
+      set=parse_filter_bracket(p);
+      if (!p->ok) return 0;
+      break;
+   case '.':
+      set=new_nfa_range_set(p->nfa,0,0xFFFF);
+      p->pos++;
+      break;
+   case '\\':
+      /* We only handle escaped special characters; things like \w or \1 are left to TRE */
+      c=re[p->pos+1];
+      if (c=='\0' || u_strchr(".[]()*+?{}|^$\\",c)==NULL) {
+         p->ok=0;
+         return 0;
+      }
+      set=new_nfa_range_set(p->nfa,c,c);
+      p->pos=p->pos+2;
+      break;
+   case '*': case '+': case '?': case '{': case '}':
+      p->ok=0;
+      return 0;
+   default:
+      set=new_nfa_range_set(p->nfa,c,c);
+      p->pos++;
+      break;
+}
+*start=*end=new_nfa_state(p->nfa,FNFA_CHARS,set,-1,-1);
+return 1;
+}
+
+
+/**
+ * Turns the fragment [start;end] built from the atom at position 'atom_pos'
+ * into the fragment of atom{min,max}, max=-1 meaning no upper bound. The
+ * other copies of the atom are obtained by parsing it again.
+ */
+static void repeat_filter_fragment(struct filter_parser* p,int atom_pos,int min,int max,int* start,int* end) {
+struct filter_nfa* nfa=p->nfa;
+int after=p->pos;
+int copies=(max==-1) ? ((min==0) ? 1 : min) : max;
+int result_start=-1,result_end=-1;
+for (int i=0;i<copies;i++) {
+   int s,e;
+   if (i==0) {
+      s=*start;
+      e=*end;
+   } else {
+      if (nfa->n_states>FILTER_MAX_NFA_STATES) {
+         p->ok=0;
+         return;
+      }
+      p->pos=atom_pos;
+      parse_filter_atom(p,&s,&e);
+      if (!p->ok) return;
+   }
+   int optional=(i>=min);
+   if (max==-1 && i==copies-1) {
+      /* The last copy loops */
+      int join=new_nfa_state(nfa,FNFA_EPSILON,-1,-1,-1);
+      int split=new_nfa_state(nfa,FNFA_SPLIT,-1,s,join);
+      nfa->states[e].out=split;
+      if (optional) s=split;
+      e=join;
+   } else if (optional) {
+      int join=new_nfa_state(nfa,FNFA_EPSILON,-1,-1,-1);
+      int split=new_nfa_state(nfa,FNFA_SPLIT,-1,s,join);
+      nfa->states[e].out=join;
+      s=split;
+      e=join;
+   }
+   if (result_start==-1) {
+      result_start=s;
+   } else {
+      nfa->states[result_end].out=s;
+   }
+   result_end=e;
+}
+if (copies==0) {
+   result_start=result_end=new_nfa_state(nfa,FNFA_EPSILON,-1,-1,-1);
+}
+p->pos=after;
+*start=result_start;
+*end=result_end;
+}
+
+
+static void parse_filter_piece(struct filter_parser* p,int* start,int* end) {
+int atom_pos=p->pos;
+int repeatable=parse_filter_atom(p,start,end);
+if (!p->ok) return;
+unichar c=p->re[p->pos];
+if (!is_filter_quantifier(c)) return;
+int min,max;
+if (!repeatable) {
+   p->ok=0;
+   return;
+}
+if (c=='{') {
+   if (!parse_filter_bound(p,&min,&max)) {
+      p->ok=0;
+      return;
+   }
+} else {
+   p->pos++;
+   min=(c=='+');
+   max=(c=='?') ? 1 : -1;
+}
+if (is_filter_quantifier(p->re[p->pos])) {
+   /* Things like "a*?" are left to TRE */
+   p->ok=0;
+   return;
+}
+repeat_filter_fragment(p,atom_pos,min,max,start,end);
+}
+
+
+static void parse_filter_branch(struct filter_parser* p,int* start,int* end) {
+*start=-1;
+for (;;) {
+   unichar c=p->re[p->pos];
+   if (c=='\0' || c=='|' || c==')') break;
+   int s,e;
+   parse_filter_piece(p,&s,&e);
+   if (!p->ok) return;
+   if (*start==-1) {
+      *start=s;
+   } else {
+      p->nfa->states[*end].out=s;
+   }
+   *end=e;
+}
+if (*start==-1) {
+   /* Empty branch like in "a||b" */
+   p->ok=0;
+}
+}
+
+
+static void parse_filter_regex(struct filter_parser* p,int* start,int* end) {
+parse_filter_branch(p,start,end);
+while (p->ok && p->re[p->pos]=='|') {
+   p->pos++;
+   int s,e;
+   parse_filter_branch(p,&s,&e);
+   if (!p->ok) return;
+   int join=new_nfa_state(p->nfa,FNFA_EPSILON,-1,-1,-1);
+   int split=new_nfa_state(p->nfa,FNFA_SPLIT,-1,*start,s);
+   p->nfa->states[*end].out=join;
+   p->nfa->states[e].out=join;
+   *start=split;
+   *end=join;
+}
+}
+
+
+static int compare_ints(const void* a,const void* b) {
+return *((const int*)a)-*((const int*)b);
+}
+
+
+/**
+ * Computes the epsilon closure of the given states and stores in 'result'
+ * the sorted states that matter for the determinization: the ones that
+ * consume a character, the final one and the '$' ones that were not crossed.
+ * '^' is only crossed if 'at_start' is set, and '$' if 'at_end' is set.
+ * Returns the number of states stored in 'result'.
+ */
+static int filter_nfa_closure(const struct filter_nfa* nfa,const int* seeds,int n_seeds,int at_start,int at_end,
+                              int* stack,int* mark,int generation,int* result) {
+int n=0,top=0;
+for (int i=0;i<n_seeds;i++) {
+   if (mark[seeds[i]]!=generation) {
+      mark[seeds[i]]=generation;
+      stack[top++]=seeds[i];
+   }
+}
+while (top>0) {
+   int s=stack[--top];
+   const struct filter_nfa_state* state=&(nfa->states[s]);
+   int follow=-1,follow1=-1;
+   switch (state->type) {
+      case FNFA_CHARS:
+      case FNFA_MATCH: result[n++]=s; break;
+      case FNFA_EPSILON: follow=state->out; break;
+      case FNFA_SPLIT: follow=state->out; follow1=state->out1; break;
+      case FNFA_BOL: if (at_start) follow=state->out; break;
+      case FNFA_EOL: if (at_end) follow=state->out; else result[n++]=s; break;
+   }
+   if (follow!=-1 && mark[follow]!=generation) {
+      mark[follow]=generation;
+      stack[top++]=follow;
+   }
+   if (follow1!=-1 && mark[follow1]!=generation) {
+      mark[follow1]=generation;
+      stack[top++]=follow1;
+   }
+}
+qsort(result,n,sizeof(int),compare_ints);
+return n;
+}
+
+
+/**
+ * Returns the number of the DFA state made of the given NFA states, creating
+ * it if needed. The initial state is kept apart, since '^' can only be
+ * crossed from it.
+ */
+static int get_filter_dfa_state(struct hash_table* numbers,unichar* key,const int* set,int n,int initial,
+                                unichar*** sets,int* n_sets,int* capacity) {
+key[0]=initial ? 1 : 2;
+for (int i=0;i<n;i++) {
+   key[i+1]=(unichar)(set[i]+1);
+}
+key[n+1]='\0';
+int ret;
+struct any* value=get_value(numbers,key,HT_INSERT_IF_NEEDED,&ret);
+if (ret==HT_KEY_ALREADY_THERE) {
+   return value->_int;
+}
+if (*n_sets==*capacity) {
+   *capacity=2*(*capacity);
+   *sets=(unichar**)realloc(*sets,(*capacity)*sizeof(unichar*));
+   if (*sets==NULL) {
+      fatal_alloc_error("get_filter_dfa_state");
+   }
+}
+(*sets)[*n_sets]=u_strdup(key);
+value->_int=*n_sets;
+return (*n_sets)++;
+}
+
+
+/**
+ * Returns the class of the character c, the classes being delimited by the
+ * 'n' sorted values of 'bounds'.
+ */
+static int find_filter_class(const int* bounds,int n,int c) {
+int lo=0,hi=n-1;
+while (lo<hi) {
+   int mid=(lo+hi+1)/2;
+   if (bounds[mid]<=c) lo=mid;
+   else hi=mid-1;
+}
+return lo;
+}
+
+
+static inline int get_filter_class(const struct filter_dfa* dfa,unichar c) {
+if (c<FILTER_DFA_DIRECT_CLASSES) {
+   return dfa->direct_class[c];
+}
+return find_filter_class(dfa->bounds,dfa->n_classes,c);
+}
+
+
+/**
+ * Computes the prefilter of the given DFA: the prefix shared by all the
+ * matched strings, and their minimal length.
+ */
+static void compute_filter_prefilter(struct filter_dfa* dfa) {
+int nc=dfa->n_classes;
+dfa->prefix_length=0;
+if (dfa->dead!=-1) {
+   /* While there is only one way to avoid the dead state, it is a prefix */
+   int s=0;
+   while (dfa->prefix_length<FILTER_MAX_PREFIX && !dfa->accept[s] && !dfa->end_accept[s]) {
+      int only=-1,n=0;
+      for (int k=0;k<nc && n<2;k++) {
+         if (dfa->next[s*nc+k]!=dfa->dead) {
+            only=k;
+            n++;
+         }
+      }
+      int upper=(only+1<nc) ? dfa->bounds[only+1] : 0x10000;
+      if (n!=1 || upper-dfa->bounds[only]!=1 || dfa->bounds[only]==0) break;
+      dfa->prefix[dfa->prefix_length++]=(unichar)dfa->bounds[only];
+      s=dfa->next[s*nc+only];
+   }
+}
+/* The minimal length is the distance to the nearest final state */
+int* distance=(int*)malloc(2*dfa->n_states*sizeof(int));
+if (distance==NULL) {
+   fatal_alloc_error("compute_filter_prefilter");
+}
+int* queue=distance+dfa->n_states;
+for (int i=0;i<dfa->n_states;i++) {
+   distance[i]=-1;
+}
+int head=0,tail=0;
+distance[0]=0;
+queue[tail++]=0;
+dfa->min_length=INT_MAX;
+while (head<tail) {
+   int s=queue[head++];
+   if (dfa->accept[s] || dfa->end_accept[s]) {
+      dfa->min_length=distance[s];
+      break;
+   }
+   for (int k=0;k<nc;k++) {
+      int t=dfa->next[s*nc+k];
+      if (distance[t]==-1) {
+         distance[t]=distance[s]+1;
+         queue[tail++]=t;
+      }
+   }
+}
+free(distance);
+}
+
+
+/**
+ * Builds the DFA of the given automaton by the subset construction. The DFA
+ * looks for a match anywhere in the string, like regexec does. Returns NULL
+ * if the DFA would be too big.
+ */
+static struct filter_dfa* determinize_filter_nfa(const struct filter_nfa* nfa,int start) {
+/* First, we split the characters into classes */
+int n_bounds=1;
+for (int i=0;i<nfa->n_sets;i++) {
+   n_bounds=n_bounds+2*nfa->sets[i].n_ranges;
+}
+int* bounds=(int*)malloc(n_bounds*sizeof(int));
+if (bounds==NULL) {
+   fatal_alloc_error("determinize_filter_nfa");
+}
+n_bounds=0;
+bounds[n_bounds++]=0;
+for (int i=0;i<nfa->n_sets;i++) {
+   for (int j=0;j<nfa->sets[i].n_ranges;j++) {
+      bounds[n_bounds++]=nfa->sets[i].ranges[2*j];
+      if (nfa->sets[i].ranges[2*j+1]<0xFFFF) {
+         bounds[n_bounds++]=nfa->sets[i].ranges[2*j+1]+1;
+      }
+   }
+}
+qsort(bounds,n_bounds,sizeof(int),compare_ints);
+int nc=0;
+for (int i=0;i<n_bounds;i++) {
+   if (nc==0 || bounds[i]!=bounds[nc-1]) bounds[nc++]=bounds[i];
+}
+struct filter_dfa* dfa=(struct filter_dfa*)malloc(sizeof(struct filter_dfa));
+if (dfa==NULL) {
+   fatal_alloc_error("determinize_filter_nfa");
+}
+dfa->n_classes=nc;
+dfa->bounds=bounds;
+for (int c=0;c<FILTER_DFA_DIRECT_CLASSES;c++) {
+   dfa->direct_class[c]=find_filter_class(bounds,nc,c);
+}
+/* in_set[i*nc+k]=1 if the class k is included in the set i */
+char* in_set=(char*)calloc(nfa->n_sets*nc+1,sizeof(char));
+if (in_set==NULL) {
+   fatal_alloc_error("determinize_filter_nfa");
+}
+for (int i=0;i<nfa->n_sets;i++) {
+   for (int j=0;j<nfa->sets[i].n_ranges;j++) {
+      for (int k=find_filter_class(bounds,nc,nfa->sets[i].ranges[2*j]);
+           k<nc && bounds[k]<=nfa->sets[i].ranges[2*j+1];k++) {
+         in_set[i*nc+k]=1;
+      }
+   }
+}
+/* Then, we build the DFA states */
+int n=nfa->n_states;
+int* buffers=(int*)malloc(5*(n+1)*sizeof(int));
+unichar* key=(unichar*)malloc((n+2)*sizeof(unichar));
+if (buffers==NULL || key==NULL) {
+   fatal_alloc_error("determinize_filter_nfa");
+}
+int* stack=buffers;
+int* mark=buffers+(n+1);
+int* result=buffers+2*(n+1);
+int* seeds=buffers+3*(n+1);
+int* set=buffers+4*(n+1);
+int generation=0;
+for (int i=0;i<n;i++) {
+   mark[i]=0;
+}
+struct hash_table* numbers=new_hash_table((HASH_FUNCTION)hash_unichar,(EQUAL_FUNCTION)((EQUAL_UNICHAR_FUNCTION)u_equal),
+                                          (FREE_FUNCTION)free,NULL,(KEYCOPY_FUNCTION)keycopy);
+int capacity=16;
+int n_sets=0;
+unichar** sets=(unichar**)malloc(capacity*sizeof(unichar*));
+int transitions_capacity=capacity;
+dfa->next=(int*)malloc(transitions_capacity*nc*sizeof(int));
+dfa->accept=(char*)malloc(transitions_capacity*sizeof(char));
+dfa->end_accept=(char*)malloc(transitions_capacity*sizeof(char));
+if (sets==NULL || dfa->next==NULL || dfa->accept==NULL || dfa->end_accept==NULL) {
+   fatal_alloc_error("determinize_filter_nfa");
+}
+int r=filter_nfa_closure(nfa,&start,1,1,0,stack,mark,++generation,result);
+get_filter_dfa_state(numbers,key,result,r,1,&sets,&n_sets,&capacity);
+/* The state we go to when no match is in progress, since a match can start anywhere */
+r=filter_nfa_closure(nfa,&start,1,0,0,stack,mark,++generation,result);
+int restart=get_filter_dfa_state(numbers,key,result,r,0,&sets,&n_sets,&capacity);
+int ok=1;
+for (int d=0;ok && d<n_sets;d++) {
+   if (n_sets>FILTER_MAX_DFA_STATES || (long)n_sets*nc>FILTER_MAX_DFA_TRANSITIONS) {
+      ok=0;
+      break;
+   }
+   if (n_sets>transitions_capacity) {
+      while (n_sets>transitions_capacity) transitions_capacity=2*transitions_capacity;
+      dfa->next=(int*)realloc(dfa->next,transitions_capacity*nc*sizeof(int));
+      dfa->accept=(char*)realloc(dfa->accept,transitions_capacity*sizeof(char));
+      dfa->end_accept=(char*)realloc(dfa->end_accept,transitions_capacity*sizeof(char));
+      if (dfa->next==NULL || dfa->accept==NULL || dfa->end_accept==NULL) {
+         fatal_alloc_error("determinize_filter_nfa");
+      }
+   }
+   int size=0;
+   dfa->accept[d]=0;
+   for (int i=1;sets[d][i]!='\0';i++) {
+      set[size]=sets[d][i]-1;
+      if (nfa->states[set[size]].type==FNFA_MATCH) dfa->accept[d]=1;
+      size++;
+   }
+   r=filter_nfa_closure(nfa,set,size,(d==0),1,stack,mark,++generation,result);
+   dfa->end_accept[d]=0;
+   for (int i=0;i<r;i++) {
+      if (nfa->states[result[i]].type==FNFA_MATCH) dfa->end_accept[d]=1;
+   }
+   int* next=dfa->next+d*nc;
+   if (dfa->accept[d]) {
+      /* The matching stops as soon as this state is reached */
+      for (int k=0;k<nc;k++) next[k]=d;
+      continue;
+   }
+   for (int k=0;k<nc;k++) {
+      int n_seeds=0;
+      for (int i=0;i<size;i++) {
+         if (nfa->states[set[i]].type==FNFA_CHARS && in_set[nfa->states[set[i]].set*nc+k]) {
+            seeds[n_seeds++]=nfa->states[set[i]].out;
+         }
+      }
+      if (n_seeds==0) {
+         next[k]=restart;
+         continue;
+      }
+      seeds[n_seeds++]=start;
+      r=filter_nfa_closure(nfa,seeds,n_seeds,0,0,stack,mark,++generation,result);
+      next[k]=get_filter_dfa_state(numbers,key,result,r,0,&sets,&n_sets,&capacity);
+   }
+}
+dfa->n_states=n_sets;
+/* If no match can start outside the initial state, the restart state is a dead end */
+dfa->dead=(sets[restart][1]=='\0') ? restart : -1;
+for (int i=0;i<n_sets;i++) {
+   free(sets[i]);
+}
+free(sets);
+free_hash_table(numbers);
+free(key);
+free(buffers);
+free(in_set);
+if (!ok) {
+   free_filter_dfa(dfa);
+   return NULL;
+}
+compute_filter_prefilter(dfa);
+return dfa;
+}
+
+
+/**
+ * Compiles the given POSIX extended regular expression into a DFA. Returns
+ * NULL if the expression uses a construct that is not supported.
+ */
+static struct filter_dfa* compile_filter_dfa(const unichar* re) {
+struct filter_nfa nfa;
+memset(&nfa,0,sizeof(struct filter_nfa));
+struct filter_parser p={re,0,&nfa,1};
+int start=-1,end=-1;
+parse_filter_regex(&p,&start,&end);
+if (p.ok && (re[p.pos]!='\0' || nfa.n_states>FILTER_MAX_NFA_STATES)) {
+   p.ok=0;
+}
+struct filter_dfa* dfa=NULL;
+if (p.ok) {
+   int final_state=new_nfa_state(&nfa,FNFA_MATCH,-1,-1,-1);
+   nfa.states[end].out=final_state;
+   dfa=determinize_filter_nfa(&nfa,start);
+}
+free_filter_nfa(&nfa);
+return dfa;
+}
+
+
+static void free_filter_dfa(struct filter_dfa* dfa) {
+if (dfa==NULL) return;
+free(dfa->bounds);
+free(dfa->next);
+free(dfa->accept);
+free(dfa->end_accept);
+free(dfa);
+}
+
+
+/**
+ * Returns 1 if the given string matches the given DFA. 'length' is the length
+ * of the string, or -1 if it is unknown.
+ */
+static int filter_dfa_match(const struct filter_dfa* dfa,const unichar* s,int length) {
+if (length!=-1 && length<dfa->min_length) return 0;
+for (int i=0;i<dfa->prefix_length;i++) {
+   if (s[i]!=dfa->prefix[i]) return 0;
+}
+if (dfa->accept[0]) return 1;
+const int* next=dfa->next;
+int nc=dfa->n_classes;
+int state=0;
+for (int i=0;s[i]!='\0';i++) {
+   state=next[state*nc+get_filter_class(dfa,s[i])];
+   if (dfa->accept[state]) return 1;
+   if (state==dfa->dead) return 0;
+}
+return dfa->end_accept[state];
+}
 
 
 /**
@@ -75,6 +906,7 @@ if (filters->size>0) {
       filter_set->filter[i].content=NULL;
       filter_set->filter[i].options=NULL;
       filter_set->filter[i].matcher=NULL;
+      filter_set->filter[i].dfa=NULL;
       /* We split the filter into a regular and the options, if any. For instance,
        * "<<able$>>_f_" will be turned into "able$" and "f". */
       split_filter(filters->value[i],filterContent,filterOptions);
@@ -139,6 +971,10 @@ if (filters->size>0) {
          free_FilterSet(filter_set,i);
          return NULL;
       }
+      if (!regBasic) {
+         /* We also try to get a DFA, that matches unichar strings much faster */
+         filter_set->filter[i].dfa=compile_filter_dfa(filter_set->filter[i].content);
+      }
    }
 } else {
    /* No need to allocate an array if there is no filter */
@@ -168,6 +1004,7 @@ for (int i=0;i<n;i++) {
        regex_facade_regfree(filters->filter[i].matcher);
        free(filters->filter[i].matcher);
    }
+   free_filter_dfa(filters->filter[i].dfa);
 }
 free(filters->filter);
 free(filters);
@@ -184,59 +1021,377 @@ free_FilterSet(filters,filters->size);
 
 
 /**
- * Allocates, initializes and returns a structure that indicates for each token
- * which of the given filters it matches.
+ * Returns 1 if the given string matches the given filter. 'length' is the
+ * length of the string, or -1 if it is unknown. If TRE must be used, the
+ * string is converted into 'temp' if it is not already done, that is if
+ * *converted is 0.
  */
-FilterMatchIndex* new_FilterMatchIndex(FilterSet* filters,struct string_hash* tokens) {
-int i,k;
-unichar_regex *inflected=NULL;
-size_t inflected_buffer_size = 0;
-unichar* current_token;
-FilterMatchIndex* index=(FilterMatchIndex*)malloc(sizeof(FilterMatchIndex));
-if (index==NULL) {
-   fatal_alloc_error("new_FilterMatchIndex");
+static int match_filter(const MorphoFilter* filter,const unichar* s,int length,
+                        unichar_regex** temp,size_t* temp_size,int* converted) {
+if (filter->dfa!=NULL) {
+   return filter_dfa_match(filter->dfa,s,length);
 }
-if (filters->size>0) {
-   index->size=filters->size;
-   index->matching_tokens=(struct bit_array**)malloc(sizeof(struct bit_array*)*index->size);
-   if (index->matching_tokens==NULL) {
-      fatal_alloc_error("new_FilterMatchIndex");
+if (!(*converted)) {
+   w_strcpy(temp,temp_size,s);
+   *converted=1;
+}
+return regex_facade_regexec(filter->matcher,*temp,0,NULL,0)==0;
+}
+
+
+/**
+ * The range of tokens [start;end[ to be matched by a thread against the
+ * filters k such that to_compute[k] is set.
+ */
+struct filter_index_worker {
+   const FilterSet* filters;
+   const struct string_hash* tokens;
+   FilterMatchIndex* index;
+   const char* to_compute;
+   int start;
+   int end;
+};
+
+
+static void ABSTRACT_CALLBACK_UNITEX filter_index_worker_thread(void* private_data,unsigned int /* thread_number */) {
+struct filter_index_worker* w=(struct filter_index_worker*)private_data;
+unichar_regex* temp=NULL;
+size_t temp_size=0;
+for (int i=w->start;i<w->end;i++) {
+   const unichar* token=w->tokens->value[i];
+   struct dela_entry* entry=NULL;
+   if (token[0]=='{' && u_strcmp(token,"{S}") && u_strcmp(token,"{STOP}")) {
+      /* If we have a tag token like "{today,.ADV}", we use its inflected form */
+      entry=tokenize_tag_token(token,1);
+      if (entry==NULL) {
+         fatal_error("Invalid tag token in new_FilterMatchIndex\n");
+      }
+      token=entry->inflected;
    }
-   /* We initialize the bit arrays */
-   for (i=0;i<index->size;i++) {
-      index->matching_tokens[i]=NULL;
-   }
-   /* Then, we look all the tokens */
-   for (i=0;i<tokens->size;i++) {
-      current_token=tokens->value[i];
-      if (current_token[0]=='{' && u_strcmp(current_token,"{S}")
-          && u_strcmp(current_token,"{STOP}")) {
-         /* If we have a tag token like "{today,.ADV}", we extract its inflected form */
-         w_extract_inflected(current_token,&inflected,&inflected_buffer_size);
-      } else {
-         /* Otherwise, we just convert the unichar* token into a unichar_regex* string */
-         w_strcpy(&inflected, &inflected_buffer_size, current_token);
+   int length=u_strlen(token);
+   int converted=0;
+   for (int k=0;k<w->filters->size;k++) {
+      if (w->to_compute[k] && match_filter(&(w->filters->filter[k]),token,length,&temp,&temp_size,&converted)) {
+         set_value(w->index->matching_tokens[k],i,1);
       }
-      for (k=0;k<filters->size;k++) {
-         if (regex_facade_regexec(filters->filter[k].matcher,inflected,0,NULL,0)==0) {
-            /* If the current token matches the filter k */
-            if (index->matching_tokens[k]==NULL) {
-               /* If necessary, we allocate the bit array of the filter k */
-               index->matching_tokens[k]=new_bit_array(tokens->size,ONE_BIT);
-            }
-            /* Then, we mark the token as being matched by the filter */
-            set_value(index->matching_tokens[k],i,1);
+   }
+   free_dela_entry(entry);
+}
+free(temp);
+}
+
+
+#define FILTER_INDEX_MAGIC 0x3149464D   /* "MFI1" */
+#define FILTER_INDEX_FNV_BASIS 14695981039346656037ULL
+#define FILTER_INDEX_FNV_PRIME 1099511628211ULL
+/* Maximum number of filters kept in an index file; the least recently
+ * computed ones are dropped first */
+#define FILTER_INDEX_MAX_ENTRIES 4096
+
+
+/**
+ * Returns a hash of the token list, so that an index file built for
+ * another token list is ignored.
+ */
+static uint64_t hash_filter_tokens(const struct string_hash* tokens) {
+uint64_t h=FILTER_INDEX_FNV_BASIS;
+for (int i=0;i<tokens->size;i++) {
+   const unichar* s=tokens->value[i];
+   do {
+      h=(h^(*s & 0xFF))*FILTER_INDEX_FNV_PRIME;
+      h=(h^(*s >> 8))*FILTER_INDEX_FNV_PRIME;
+   } while (*(s++)!='\0');
+}
+return h;
+}
+
+
+/**
+ * A cursor on the content of an index file, whose entries are made of:
+ * the length of the options and the options, the length of the filter and
+ * the filter, then the size of the bit array and its bytes, -1 meaning that
+ * the filter matches no token.
+ */
+struct filter_index_reader {
+   const char* pos;
+   const char* end;
+};
+
+
+struct filter_index_entry {
+   const char* start;
+   int options_length;
+   const char* options;
+   int content_length;
+   const unichar* content;
+   int n_bytes;
+   const unsigned char* bytes;
+   const char* end;
+};
+
+
+static int read_filter_index_int(struct filter_index_reader* r,int* value) {
+if ((size_t)(r->end-r->pos)<sizeof(int)) return 0;
+memcpy(value,r->pos,sizeof(int));
+r->pos+=sizeof(int);
+return 1;
+}
+
+
+/**
+ * Reads the next entry. Returns 0 if the file is too short.
+ */
+static int read_filter_index_entry(struct filter_index_reader* r,struct filter_index_entry* e) {
+e->start=r->pos;
+if (!read_filter_index_int(r,&(e->options_length)) || e->options_length<0
+    || r->end-r->pos<e->options_length) return 0;
+e->options=r->pos;
+r->pos+=e->options_length;
+if (!read_filter_index_int(r,&(e->content_length)) || e->content_length<0
+    || (size_t)(r->end-r->pos)/sizeof(unichar)<(size_t)e->content_length) return 0;
+/* The content is not aligned, so it must be compared with memcmp */
+e->content=(const unichar*)r->pos;
+r->pos+=e->content_length*sizeof(unichar);
+if (!read_filter_index_int(r,&(e->n_bytes)) || e->n_bytes<-1 || r->end-r->pos<e->n_bytes) return 0;
+e->bytes=(const unsigned char*)r->pos;
+if (e->n_bytes>0) r->pos+=e->n_bytes;
+e->end=r->pos;
+return 1;
+}
+
+
+/**
+ * Returns 1 if the given entry describes the given filter.
+ */
+static int is_filter_index_entry(const struct filter_index_entry* e,const MorphoFilter* filter) {
+return e->options_length==(int)strlen(filter->options) && !memcmp(e->options,filter->options,e->options_length)
+       && e->content_length==(int)u_strlen(filter->content)
+       && !memcmp(e->content,filter->content,e->content_length*sizeof(unichar));
+}
+
+
+/**
+ * Opens the given index file and checks that it was built for the given
+ * token list. Returns NULL if the file cannot be used. Otherwise, the
+ * reader is positioned on the first entry and *n_entries is set.
+ */
+static ABSTRACTMAPFILE* open_filter_index(const char* name,uint64_t key,int n_tokens,
+                                          struct filter_index_reader* r,const char** buffer,int* n_entries) {
+if (!fexists(name)) return NULL;
+ABSTRACTMAPFILE* amf=af_open_mapfile(name,MAPFILE_OPTION_READ,0);
+if (amf==NULL) return NULL;
+size_t size=af_get_mapfile_size(amf);
+*buffer=(size>0) ? (const char*)af_get_mapfile_pointer(amf,0,size) : NULL;
+if (*buffer==NULL) {
+   af_close_mapfile(amf);
+   return NULL;
+}
+r->pos=*buffer;
+r->end=*buffer+size;
+int header[4];
+int ok=1;
+for (int i=0;ok && i<4;i++) {
+   ok=read_filter_index_int(r,&(header[i]));
+}
+ok=ok && read_filter_index_int(r,n_entries);
+if (!ok || header[0]!=FILTER_INDEX_MAGIC || header[1]!=n_tokens || header[2]!=(int)(key>>32)
+    || header[3]!=(int)(key&0xFFFFFFFF) || *n_entries<0) {
+   af_release_mapfile_pointer(amf,*buffer,size);
+   af_close_mapfile(amf);
+   return NULL;
+}
+return amf;
+}
+
+
+static void close_filter_index(ABSTRACTMAPFILE* amf,const char* buffer) {
+af_release_mapfile_pointer(amf,buffer,af_get_mapfile_size(amf));
+af_close_mapfile(amf);
+}
+
+
+/**
+ * Loads from the given index file the bit arrays of the filters that it
+ * contains, and clears their to_compute flags. Returns the number of
+ * filters loaded.
+ */
+static int load_filter_index(const char* name,uint64_t key,int n_tokens,const FilterSet* filters,
+                             FilterMatchIndex* index,char* to_compute) {
+struct filter_index_reader r;
+const char* buffer;
+int n_entries;
+ABSTRACTMAPFILE* amf=open_filter_index(name,key,n_tokens,&r,&buffer,&n_entries);
+if (amf==NULL) return 0;
+int n_loaded=0;
+struct filter_index_entry e;
+int expected_bytes=(n_tokens/8)+1;
+for (int i=0;i<n_entries && read_filter_index_entry(&r,&e);i++) {
+   if (e.n_bytes!=-1 && e.n_bytes!=expected_bytes) continue;
+   for (int k=0;k<filters->size;k++) {
+      if (to_compute[k] && is_filter_index_entry(&e,&(filters->filter[k]))) {
+         if (e.n_bytes!=-1) {
+            index->matching_tokens[k]=new_bit_array(n_tokens,ONE_BIT);
+            memcpy(index->matching_tokens[k]->array,e.bytes,e.n_bytes);
          }
+         to_compute[k]=0;
+         n_loaded++;
       }
    }
-} else {
+}
+close_filter_index(amf,buffer);
+return n_loaded;
+}
+
+
+static void write_filter_index_entry(ABSTRACTFILE* f,const MorphoFilter* filter,const struct bit_array* bits) {
+int length=(int)strlen(filter->options);
+af_fwrite(&length,sizeof(int),1,f);
+af_fwrite(filter->options,sizeof(char),length,f);
+length=u_strlen(filter->content);
+af_fwrite(&length,sizeof(int),1,f);
+af_fwrite(filter->content,sizeof(unichar),length,f);
+length=(bits==NULL) ? -1 : bits->size_in_bytes;
+af_fwrite(&length,sizeof(int),1,f);
+if (bits!=NULL) af_fwrite(bits->array,sizeof(unsigned char),length,f);
+}
+
+
+/**
+ * Saves the given index in the given file. The entries of the file that
+ * concern other filters are kept after the ones of the given filters. The
+ * file is written under a temporary name and then renamed, so that a
+ * concurrent Locate never reads a partial file.
+ */
+static void save_filter_index(const char* name,uint64_t key,int n_tokens,const FilterSet* filters,
+                              const FilterMatchIndex* index) {
+char tmp_name[FILENAME_MAX+64];
+sprintf(tmp_name,"%s.%p.tmp",name,(const void*)index);
+ABSTRACTFILE* f=af_fopen(tmp_name,"wb");
+if (f==NULL) return;
+struct filter_index_reader r;
+const char* buffer=NULL;
+int n_old_entries=0;
+ABSTRACTMAPFILE* amf=open_filter_index(name,key,n_tokens,&r,&buffer,&n_old_entries);
+/* We first look for the old entries to keep */
+struct filter_index_entry* kept=NULL;
+int n_kept=0;
+if (amf!=NULL) {
+   kept=(struct filter_index_entry*)malloc((n_old_entries+1)*sizeof(struct filter_index_entry));
+   if (kept==NULL) {
+      fatal_alloc_error("save_filter_index");
+   }
+   for (int i=0;i<n_old_entries && filters->size+n_kept<FILTER_INDEX_MAX_ENTRIES
+               && read_filter_index_entry(&r,&(kept[n_kept]));i++) {
+      int k;
+      for (k=0;k<filters->size && !is_filter_index_entry(&(kept[n_kept]),&(filters->filter[k]));k++) {}
+      if (k==filters->size) n_kept++;
+   }
+}
+int header[5]={FILTER_INDEX_MAGIC,n_tokens,(int)(key>>32),(int)(key&0xFFFFFFFF),filters->size+n_kept};
+af_fwrite(header,sizeof(int),5,f);
+for (int k=0;k<filters->size;k++) {
+   write_filter_index_entry(f,&(filters->filter[k]),index->matching_tokens[k]);
+}
+for (int i=0;i<n_kept;i++) {
+   af_fwrite(kept[i].start,sizeof(char),kept[i].end-kept[i].start,f);
+}
+free(kept);
+if (amf!=NULL) {
+   close_filter_index(amf,buffer);
+}
+int ok=(af_fclose(f)==0);
+if (!ok || af_rename(tmp_name,name)!=0) {
+   af_remove(tmp_name);
+}
+}
+
+
+/**
+ * Allocates, initializes and returns a structure that indicates for each token
+ * which of the given filters it matches. The tokens are split into 'n_threads'
+ * ranges matched in parallel. If 'index_file' is not NULL, the filters already
+ * saved in this file for the same token list are not matched again, and the
+ * file is updated with the new ones.
+ */
+FilterMatchIndex* new_FilterMatchIndex(FilterSet* filters,struct string_hash* tokens,int n_threads,const char* index_file) {
+FilterMatchIndex* index=(FilterMatchIndex*)malloc(sizeof(FilterMatchIndex));
+if (index==NULL) {
+   fatal_alloc_error("new_FilterMatchIndex");
+}
+if (filters->size==0) {
    /* If there is no filter */
    index->size=0;
    index->matching_tokens=NULL;
+   return index;
+}
+index->size=filters->size;
+index->matching_tokens=(struct bit_array**)malloc(sizeof(struct bit_array*)*index->size);
+char* to_compute=(char*)malloc(sizeof(char)*index->size);
+if (index->matching_tokens==NULL || to_compute==NULL) {
+   fatal_alloc_error("new_FilterMatchIndex");
 }
-if (inflected != NULL) {
-  free(inflected);
+for (int k=0;k<index->size;k++) {
+   index->matching_tokens[k]=NULL;
+   to_compute[k]=1;
 }
+uint64_t key=0;
+int n_loaded=0;
+if (index_file!=NULL) {
+   key=hash_filter_tokens(tokens);
+   n_loaded=load_filter_index(index_file,key,tokens->size,filters,index,to_compute);
+}
+if (n_loaded<index->size) {
+   for (int k=0;k<index->size;k++) {
+      if (to_compute[k]) index->matching_tokens[k]=new_bit_array(tokens->size,ONE_BIT);
+   }
+   /* Each thread handles a range of tokens that starts on a byte of the
+    * bit arrays, so that two threads never modify the same byte */
+   if (n_threads<1) n_threads=1;
+   int chunk=(tokens->size+n_threads-1)/n_threads;
+   chunk=((chunk+7)/8)*8;
+   if (chunk==0) chunk=8;
+   int n_chunks=(tokens->size+chunk-1)/chunk;
+   if (n_chunks==0) n_chunks=1;
+   struct filter_index_worker* workers=(struct filter_index_worker*)malloc(n_chunks*sizeof(struct filter_index_worker));
+   void** workers_ptr=(void**)malloc(n_chunks*sizeof(void*));
+   if (workers==NULL || workers_ptr==NULL) {
+      fatal_alloc_error("new_FilterMatchIndex");
+   }
+   for (int i=0;i<n_chunks;i++) {
+      workers[i].filters=filters;
+      workers[i].tokens=tokens;
+      workers[i].index=index;
+      workers[i].to_compute=to_compute;
+      workers[i].start=i*chunk;
+      workers[i].end=(i==n_chunks-1) ? tokens->size : (i+1)*chunk;
+      workers_ptr[i]=&(workers[i]);
+   }
+   if (n_chunks==1) {
+      filter_index_worker_thread(workers_ptr[0],0);
+   } else {
+      logger::SyncDoRunThreads((unsigned int)n_chunks,filter_index_worker_thread,workers_ptr);
+   }
+   free(workers_ptr);
+   free(workers);
+   /* A filter that matches no token has no bit array */
+   for (int k=0;k<index->size;k++) {
+      struct bit_array* bits=index->matching_tokens[k];
+      if (!to_compute[k]) continue;
+      int i;
+      for (i=0;i<bits->size_in_bytes && bits->array[i]==0;i++) {}
+      if (i==bits->size_in_bytes) {
+         free_bit_array(bits);
+         index->matching_tokens[k]=NULL;
+      }
+   }
+   if (index_file!=NULL) {
+      save_filter_index(index_file,key,tokens->size,filters,index);
+   }
+}
+if (index_file!=NULL) {
+   u_printf("Morphological filters: %d reused from %s, %d matched\n",n_loaded,index_file,index->size-n_loaded);
+}
+free(to_compute);
 return index;
 }
 
@@ -259,6 +1414,10 @@ free(index);
  * with a user provided buffer
  */
 int string_match_filter(const FilterSet* filters, const unichar* s, int filter_number, unichar_regex* original_temp, size_t size_temp) {
+const MorphoFilter* filter=&(filters->filter[filter_number]);
+if (filter->dfa!=NULL) {
+   return filter_dfa_match(filter->dfa,s,-1);
+}
 unichar_regex* allocated_temp = NULL; const unichar_regex* temp;
 temp = w_strcpy_optional_buffer(original_temp, size_temp, &allocated_temp, s, NULL, NULL);
 int ret_value = !regex_facade_regexec(filters->filter[filter_number].matcher,temp,0,NULL,0);
@@ -272,6 +1431,10 @@ return ret_value;
  */
 int string_match_filter(const FilterSet* filters,const unichar* s,int filter_number) {
 #define STRING_MATCH_STRING_BUFFER_SIZE 8
+const MorphoFilter* filter=&(filters->filter[filter_number]);
+if (filter->dfa!=NULL) {
+   return filter_dfa_match(filter->dfa,s,-1);
+}
 unichar_regex original_temp[STRING_MATCH_STRING_BUFFER_SIZE]; unichar_regex* allocated_temp = NULL; const unichar_regex* temp;
 temp = w_strcpy_optional_buffer(original_temp, STRING_MATCH_STRING_BUFFER_SIZE, &allocated_temp, s, NULL, NULL);
 int ret_value = !regex_facade_regexec(filters->filter[filter_number].matcher,temp,0,NULL,0);
@@ -296,20 +1459,6 @@ return get_value(index->matching_tokens[filter_number],token);
 }
 
 
-/**
- * This function extracts the inflected form of the given tag token and
- * stores it in the given unichar_regex* string.
- */
-static void w_extract_inflected(const unichar* tag_token,unichar_regex** inflected, size_t *buffer_size) {
-struct dela_entry* entry=tokenize_tag_token(tag_token,1);
-if (entry==NULL) {
-   fatal_error("Invalid tag token in w_extract_inflected\n");
-}
-w_strcpy(inflected, buffer_size, entry->inflected);
-free_dela_entry(entry);
-}
-
-
 /**
  * Splits a filter like "<<able$>>_f_" into its content "able$" and its options "f".
  */
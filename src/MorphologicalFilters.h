@@ -30,6 +30,9 @@
  *
  * http://laurikari.net/tre/
  *
+ * Filters that only use the common constructs of extended regular expressions
+ * are also compiled into DFAs over unichar, which are used instead of TRE.
+ *
  * The integration of these filters in Unitex has been made by
  * Claude Devis (devis@tedm.ucl.ac.be).
  */
@@ -50,6 +53,9 @@
 namespace unitex {
 
 
+struct filter_dfa;
+
+
 /**
  * This structure defines a morphological filter.
  */
@@ -62,6 +68,11 @@ typedef struct {
    /* 'matcher' is a TRE object that represents an automaton that can match the same
     * things that the given regular expression. */
    regex_facade_regex_t* matcher;
+   /* 'dfa' is a deterministic automaton over unichar equivalent to 'matcher'. It is
+    * NULL if the filter uses a construct that is not supported by our compiler
+    * (back references, character classes like [:alpha:], basic syntax, ...). In
+    * such a case, 'matcher' is used instead. */
+   struct filter_dfa* dfa;
 } MorphoFilter;
 
 
@@ -92,7 +103,7 @@ typedef struct {
 FilterSet* new_FilterSet(Fst2*,Alphabet*);
 void free_FilterSet(FilterSet*);
 
-FilterMatchIndex* new_FilterMatchIndex(FilterSet*,struct string_hash*);
+FilterMatchIndex* new_FilterMatchIndex(FilterSet*,struct string_hash*,int n_threads=1,const char* index_file=NULL);
 void free_FilterMatchIndex(FilterMatchIndex*);
 
 int string_match_filter(const FilterSet*,const unichar*,int);
@@ -228,56 +228,19 @@ while (list!=NULL) {
 
 
 /**
- * This function add the given token in the given 'token_list', if not already present.
- * '*number_of_tokens' is increased of 1 if the token was not present.
- *
- * Note that this function must perform a sorted insert, since the resulting
- * list will be supposed to be sorted at the time of converting it into an array
- * in 'token_list_2_token_array'.
+ * This function adds the given token to the given 'token_list'. The token is
+ * just pushed at the head of the list, even if it is already present: duplicates
+ * are merged and the list is sorted in 'token_list_2_token_array'. This avoids a
+ * quadratic sorted insert for states with thousands of token transitions.
+ * '*number_of_tokens' is the number of elements of the list.
  */
 static void add_token(int token_number,Transition* transition,struct opt_token** token_list,
                int *number_of_tokens,Abstract_allocator prv_alloc) {
-struct opt_token* ptr;
-if (*token_list==NULL) {
-   /* If the list is empty, we add the token */
-   (*token_list)=new_opt_token(token_number,prv_alloc);
-   add_transition_if_not_present(&((*token_list)->transition),transition->tag_number,transition->state_number,prv_alloc);
-   (*number_of_tokens)++;
-   return;
-}
-/* If we must insert before the head of the list */
-if (token_number<(*token_list)->token_number) {
-   /* If the list is empty, we add the token */
-   ptr=new_opt_token(token_number,prv_alloc);
-   add_transition_if_not_present(&(ptr->transition),transition->tag_number,transition->state_number,prv_alloc);
-   ptr->next=(*token_list);
-   (*token_list)=ptr;
-   (*number_of_tokens)++;
-   return;
-}
-/* If we must update the head of the list */
-if (token_number==(*token_list)->token_number) {
-   add_transition_if_not_present(&((*token_list)->transition),transition->tag_number,transition->state_number,prv_alloc);
-   return;
-}
-/* Otherwise, we look for the exact token, or the last token that is lower than
- * the one we look for */
-ptr=(*token_list);
-while (ptr->next!=NULL && (ptr->next->token_number<token_number)) {
-   ptr=ptr->next;
-}
-if (ptr->next==NULL || ptr->next->token_number>token_number) {
-   /* If we are at the end of list or before a greater token, then we must create the
-    * token and insert it after 'ptr'. */
-   struct opt_token* tmp=new_opt_token(token_number,prv_alloc);
-   add_transition_if_not_present(&(tmp->transition),transition->tag_number,transition->state_number,prv_alloc);
-   tmp->next=ptr->next;
-   ptr->next=tmp;
-   (*number_of_tokens)++;
-   return;
-}
-/* Otherwise, 'ptr->next' points on the token we look for */
-add_transition_if_not_present(&(ptr->next->transition),transition->tag_number,transition->state_number,prv_alloc);
+struct opt_token* ptr=new_opt_token(token_number,prv_alloc);
+add_transition_if_not_present(&(ptr->transition),transition->tag_number,transition->state_number,prv_alloc);
+ptr->next=(*token_list);
+(*token_list)=ptr;
+(*number_of_tokens)++;
 }
 
 
@@ -581,42 +544,92 @@ switch (tag->type) {
 
 
 /**
- * This function builds an array containing the token numbers stored
- * in the token list of the given state. As the token list is supposed
- * to be sorted, the array will be sorted. The function frees the token
- * list.
+ * Elements of the token list, with their insertion rank, used to sort them.
+ */
+struct opt_token_rank {
+   struct opt_token* token;
+   int rank;
+};
+
+
+/**
+ * Compares two token list elements by token number and then by insertion rank.
+ */
+static int compare_opt_token_ranks(const void* a,const void* b) {
+const struct opt_token_rank* x=(const struct opt_token_rank*)a;
+const struct opt_token_rank* y=(const struct opt_token_rank*)b;
+if (x->token->token_number!=y->token->token_number) {
+   return (x->token->token_number<y->token->token_number)?-1:1;
+}
+return x->rank-y->rank;
+}
+
+
+/**
+ * This function builds an array containing the sorted token numbers stored
+ * in the token list of the given state. If a token appears several times
+ * in the list, its transitions are merged in the same order as if they had
+ * been added one by one to a single transition list. The function frees the
+ * token list.
  */
 static void token_list_2_token_array(OptimizedFst2State state,Abstract_allocator prv_alloc) {
-int i;
+int i,n;
 struct opt_token* l;
-struct opt_token* tmp;
 if (state->number_of_tokens==0) {
    /* Nothing to do if there is no token in the list */
    return;
 }
-state->tokens=(int*)malloc_cb(sizeof(int)*state->number_of_tokens,prv_alloc);
+struct opt_token_rank* sorted=(struct opt_token_rank*)malloc(sizeof(struct opt_token_rank)*state->number_of_tokens);
+if (sorted==NULL) {
+   fatal_alloc_error("token_list_2_token_array");
+}
+/* The list is in reverse insertion order */
+n=0;
+for (l=state->token_list;l!=NULL;l=l->next) {
+   if (n==state->number_of_tokens) {
+      fatal_error("Internal error in token_list_2_token_array\n");
+   }
+   sorted[n].token=l;
+   sorted[n].rank=state->number_of_tokens-1-n;
+   n++;
+}
+if (n!=state->number_of_tokens) {
+   fatal_error("Internal error in token_list_2_token_array\n");
+}
+qsort(sorted,n,sizeof(struct opt_token_rank),compare_opt_token_ranks);
+int n_distinct=0;
+for (i=0;i<n;i++) {
+   if (i==0 || sorted[i].token->token_number!=sorted[i-1].token->token_number) {
+      n_distinct++;
+   }
+}
+state->tokens=(int*)malloc_cb(sizeof(int)*n_distinct,prv_alloc);
 if (state->tokens==NULL) {
    fatal_alloc_error("token_list_2_token_array");
 }
-state->token_transitions=(Transition**)malloc_cb(sizeof(Transition*)*state->number_of_tokens,prv_alloc);
+state->token_transitions=(Transition**)malloc_cb(sizeof(Transition*)*n_distinct,prv_alloc);
 if (state->token_transitions==NULL) {
    fatal_alloc_error("token_list_2_token_array");
 }
-i=0;
-l=state->token_list;
-while (l!=NULL) {
-   state->tokens[i]=l->token_number;
-   state->token_transitions[i]=l->transition;
-   i++;
-   tmp=l;
-   l=l->next;
-   /* We must NOT free 'tmp->transition' since it is referenced now
-    * in 'state->token_transitions[i]' */
+int current=-1;
+for (i=0;i<n;i++) {
+   struct opt_token* tmp=sorted[i].token;
+   if (current==-1 || tmp->token_number!=state->tokens[current]) {
+      /* We must NOT free 'tmp->transition' since it is referenced now
+       * in 'state->token_transitions[current]' */
+      current++;
+      state->tokens[current]=tmp->token_number;
+      state->token_transitions[current]=tmp->transition;
+   } else {
+      for (Transition* t=tmp->transition;t!=NULL;t=t->next) {
+         add_transition_if_not_present(&(state->token_transitions[current]),t->tag_number,t->state_number,prv_alloc);
+      }
+      free_Transition_list(tmp->transition,prv_alloc);
+   }
    free_cb(tmp,prv_alloc);
 }
-if (i!=state->number_of_tokens) {
-   fatal_error("Internal error in token_list_2_token_array\n");
-}
+free(sorted);
+state->number_of_tokens=n_distinct;
 state->token_list=NULL;
 }
 
@@ -999,13 +1012,73 @@ return remove_useless_graph_calls(&(s->graph_calls),optimized_states,fst2,prv_al
 }
 
 
+/**
+ * Predecessors of the fst2 states, built from the raw fst2 transitions, so
+ * that the pruning below only revisits the states that may have been affected
+ * by a state becoming useless, instead of rescanning the whole graph.
+ */
+struct state_predecessors {
+   /* The predecessors of state i are pred[start[i]] .. pred[start[i+1]-1] */
+   int* start;
+   int* pred;
+   /* Work stack and the flags telling which states are already in it */
+   int* stack;
+   char* queued;
+};
+
+
+static void build_state_predecessors(Fst2* fst2,struct state_predecessors* p) {
+int n=fst2->number_of_states;
+p->start=(int*)calloc(n+1,sizeof(int));
+p->stack=(int*)malloc(n*sizeof(int));
+p->queued=(char*)calloc(n,sizeof(char));
+if (p->start==NULL || p->stack==NULL || p->queued==NULL) {
+   fatal_alloc_error("build_state_predecessors");
+}
+for (int i=0;i<n;i++) {
+   for (Transition* t=fst2->states[i]->transitions;t!=NULL;t=t->next) {
+      p->start[t->state_number+1]++;
+   }
+}
+for (int i=0;i<n;i++) {
+   p->start[i+1]+=p->start[i];
+}
+p->pred=(int*)malloc((p->start[n]+1)*sizeof(int));
+if (p->pred==NULL) {
+   fatal_alloc_error("build_state_predecessors");
+}
+/* We use the stack as a temporary array of insertion positions */
+for (int i=0;i<n;i++) {
+   p->stack[i]=p->start[i];
+}
+for (int i=0;i<n;i++) {
+   for (Transition* t=fst2->states[i]->transitions;t!=NULL;t=t->next) {
+      p->pred[p->stack[t->state_number]++]=i;
+   }
+}
+}
+
+
+static void free_state_predecessors(struct state_predecessors* p) {
+free(p->start);
+free(p->pred);
+free(p->stack);
+free(p->queued);
+}
+
+
 /**
  * This function removes all useless transitions from the given graph. A useless
  * transitions is a transition to a state that has no transition.
  * Returns 1 the graph becomes empty; 0 otherwise.
+ *
+ * Each round visits all the states of the graph once, and then, whenever a state
+ * becomes useless, only its predecessors. Some dependencies do not follow the
+ * fst2 transitions (context ends, morphological mode ends), so we do another
+ * round as long as a state became useless, exactly like a plain rescan would.
  */
 static int remove_useless_lexical_transitions(Fst2* fst2,int graph,OptimizedFst2State* optimized_states,
-                            Abstract_allocator prv_alloc) {
+                            struct state_predecessors* p,Abstract_allocator prv_alloc) {
 int initial=fst2->initial_states[graph];
 int last=initial+fst2->number_of_states_per_graphs[graph]-1;
 int cleaning_to_do=1;
@@ -1015,14 +1088,28 @@ if (empty_graph(graph,optimized_states,fst2)) {
 }
 while (cleaning_to_do) {
     cleaning_to_do=0;
+    int top=0;
     for (int i=initial;i<=last;i++) {
+        p->stack[top++]=i;
+        p->queued[i]=1;
+    }
+    while (top!=0) {
+        int i=p->stack[--top];
+        p->queued[i]=0;
         OptimizedFst2State s=optimized_states[i];
-        int removed=remove_useless_transitions(s,optimized_states,fst2,prv_alloc);
-        if (removed && !cleaning_to_do) {
-            /* This state may now be useless */
-            if (is_useless_state(s)) {
-                /* If this is the case, we will have another round to do on this graph */
-                cleaning_to_do=1;
+        if (is_useless_state(s)) {
+            /* Nothing left to remove */
+            continue;
+        }
+        if (remove_useless_transitions(s,optimized_states,fst2,prv_alloc) && is_useless_state(s)) {
+            /* This state is now useless, so its predecessors must be visited again */
+            cleaning_to_do=1;
+            for (int j=p->start[i];j<p->start[i+1];j++) {
+                int k=p->pred[j];
+                if (!p->queued[k]) {
+                    p->stack[top++]=k;
+                    p->queued[k]=1;
+                }
             }
         }
     }
@@ -1060,13 +1147,16 @@ for (int i=0;i<fst2->number_of_states;i++) {
 }
 
 #ifdef AGGRESSIVE_OPTIMIZATION
+struct state_predecessors predecessors;
+build_state_predecessors(fst2,&predecessors);
 int n_graphs_emptied;
 do {
     n_graphs_emptied=0;
     for (int i=1;i<=fst2->number_of_graphs;i++) {
-        n_graphs_emptied+=remove_useless_lexical_transitions(fst2,i,optimized_states,prv_alloc);
+        n_graphs_emptied+=remove_useless_lexical_transitions(fst2,i,optimized_states,&predecessors,prv_alloc);
     }
 } while (n_graphs_emptied!=0);
+free_state_predecessors(&predecessors);
 /* Finally, we convert token lists to sorted array suitable for binary search */
 for (int i=0;i<fst2->number_of_states;i++) {
     token_list_2_token_array(optimized_states[i],prv_alloc);
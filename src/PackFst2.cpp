@@ -30,7 +30,13 @@
 
 #include "PackFst2.h"
 #include "AbstractAllocatorPlugCallback.h" 
+#include "AbstractFst2PlugCallback.h"
+#include "Af_stdio.h"
+#include "List_int.h"
+#include "List_ustring.h"
+#include "Pattern.h"
 #include "Persistence.h"
+#include "SyncTool.h"
 #include "UnusedParameter.h"
 
 
@@ -41,25 +47,138 @@
 namespace unitex {
 
 
-int load_persistent_fst2(const char* name) {
+/**
+ * Persistent fst2 that are read-only views of a mapped image of the
+ * persistence cache directory, with what is needed to free them.
+ */
+struct mapped_persistent_fst2 {
+  Fst2* fst2;
+  struct FST2_free_info free_info;
+  struct mapped_persistent_fst2* next;
+};
+
+
+class MappedFst2MutexContainer {
+ public:
+  MappedFst2MutexContainer() : mutex(SyncBuildMutex()) {}
+  ~MappedFst2MutexContainer() { SyncDeleteMutex(mutex); }
+  inline SYNC_Mutex_OBJECT getMutex() { return mutex; }
+ private:
+  SYNC_Mutex_OBJECT mutex;
+};
+
+static MappedFst2MutexContainer MappedFst2MutexContainerInstance;
+static struct mapped_persistent_fst2* mapped_persistent_fst2_list = NULL;
+
+
+static int build_fst2_image_cache_file(const char* fst2, const char* image) {
+  return convert_fst2_to_fst2_image_file(fst2, image, false) ? 1 : 0;
+}
+
+
+/**
+ * Loads the given fst2 image as a read-only view of its mapping, that is
+ * kept until the fst2 is freed. Returns NULL if it is not a valid image.
+ */
+static Fst2* map_persistent_fst2_image(const char* image) {
+  struct mapped_persistent_fst2* m =
+      (struct mapped_persistent_fst2*)malloc(sizeof(struct mapped_persistent_fst2));
+  if (m == NULL) {
+    fatal_alloc_error("load_mapped_persistent_fst2");
+  }
+  m->free_info = FST2_free_info_init;
+  m->fst2 = read_fst2_image_from_file(image, 1, &(m->free_info));
+  if (m->fst2 == NULL) {
+    free(m);
+    return NULL;
+  }
+  SyncGetMutex(MappedFst2MutexContainerInstance.getMutex());
+  m->next = mapped_persistent_fst2_list;
+  mapped_persistent_fst2_list = m;
+  SyncReleaseMutex(MappedFst2MutexContainerInstance.getMutex());
+  return m->fst2;
+}
+
+
+/**
+ * If a persistence cache directory is set, loads the given fst2 from an
+ * image of this directory, building it first if needed. The fst2 is then a
+ * view of the mapped image, shared by all the processes that use the same
+ * cache directory. Returns NULL if there is no usable image.
+ */
+static Fst2* load_mapped_persistent_fst2(const char* name) {
+  char image[FILENAME_MAX];
+  if (!get_persistence_cache_filename(name, ".fst2img", image)
+      || !update_persistence_cache_file(name, image, build_fst2_image_cache_file)) {
+    return NULL;
+  }
+  Fst2* fst2 = map_persistent_fst2_image(image);
+  if (fst2 == NULL) {
+    /* The cached image may have been written with an older image version,
+     * so we build it again */
+    af_remove(image);
+    if (update_persistence_cache_file(name, image, build_fst2_image_cache_file)) {
+      fst2 = map_persistent_fst2_image(image);
+    }
+  }
+  return fst2;
+}
+
+
+static void free_persistent_fst2_ptr(void* ptr);
+
+
+/**
+ * Loads the given fst2 as a persistent one, registered under
+ * 'persistent_name' if not NULL, or under its file name otherwise.
+ */
+int load_persistent_fst2(const char* name, const char* persistent_name) {
   VersatileEncodingConfig vec = VEC_DEFAULT;
 
   Fst2* f;
-  f = read_pack_fst2_from_file(name, NULL);
+  f = load_mapped_persistent_fst2(name);
+  if (f == NULL) {
+    f = map_persistent_fst2_image(name);
+  }
+  if (f == NULL) {
+    f = read_pack_fst2_from_file(name, NULL);
+  }
   if (f == NULL) {
     f = load_fst2(&vec, name, 1, NULL);
   }
   if (f == NULL)
     return 0;
-  set_persistent_structure(name, f);
+  if (set_persistent_structure((persistent_name != NULL) ? persistent_name : name, f) != NULL) {
+    /* Another thread persisted this fst2 first */
+    free_persistent_fst2_ptr(f);
+  }
   return 1;
 }
 
 
+static void free_persistent_fst2_ptr(void* ptr) {
+  struct mapped_persistent_fst2* m = NULL;
+  SyncGetMutex(MappedFst2MutexContainerInstance.getMutex());
+  for (struct mapped_persistent_fst2** tmp = &mapped_persistent_fst2_list; *tmp != NULL;
+       tmp = &((*tmp)->next)) {
+    if ((*tmp)->fst2 == ptr) {
+      m = *tmp;
+      *tmp = m->next;
+      break;
+    }
+  }
+  SyncReleaseMutex(MappedFst2MutexContainerInstance.getMutex());
+  if (m == NULL) {
+    free_Fst2((Fst2*)ptr);
+    return;
+  }
+  free_abstract_Fst2(m->fst2, &(m->free_info));
+  free(m);
+}
+
+
 void free_persistent_fst2(const char* name) {
-  Fst2* f = (Fst2*)get_persistent_structure(name);
-  set_persistent_structure(name, NULL);
-  free_Fst2(f);
+  remove_persistent_structure(name, free_persistent_fst2_ptr);
 }
 
 /**********************************************************************************/
@@ -1519,6 +1638,626 @@ void free_pack_fst2(Fst2* fst2, Abstract_allocator prv_alloc)
 }
 
 
+/*
+ * Memory-mappable fst2 image.
+ *
+ * Unlike the packed format, an image is made of fixed size native integers
+ * and of a pool of null-terminated unichar strings, so that it can be used
+ * right from the af_open_mapfile mapping: states and transitions are created
+ * in two contiguous blocks, while the tag strings, the graph names and the
+ * per-graph arrays point into the mapping. Tags are stored already decomposed
+ * by 'create_tag' (type, input, output, morphological filter, variable...),
+ * so that no tag line has to be parsed at loading time. Since version 2, the
+ * image also stores for each tag the analysis of its input that Locate would
+ * do before looking at the text (see analyze_locate_tag): metas and patterns
+ * like <be.V> or <V:K> are stored already decomposed, with their sorted code
+ * lists, for the tilde negation operator given in the header.
+ *
+ * Layout, all integers being 32 bits in the byte order of the machine that
+ * wrote the image:
+ *   header[FST2_IMAGE_HEADER_SIZE]
+ *   initial_states[number_of_graphs+1]
+ *   number_of_states_per_graphs[number_of_graphs+1]
+ *   graph_names[number_of_graphs+1]          (string offsets)
+ *   states[number_of_states][3]              (control, first transition, number of transitions)
+ *   transitions[number_of_transitions][2]    (tag number, state number)
+ *   tags[number_of_tags][FST2_IMAGE_TAG_SIZE]
+ *   locate_tags[number_of_tags][FST2_IMAGE_LOCATE_TAG_SIZE]
+ *                                            (kind, meta, negation, pattern type,
+ *                                             inflected, lemma, first code)
+ *   codes[]                                  (for each pattern with codes: the number
+ *                                             of grammatical, forbidden and inflectional
+ *                                             codes, followed by their string offsets)
+ *   input_variables[], output_variables[]    (string offsets)
+ *   string pool
+ * String offsets are counted in unichars from the start of the pool, and
+ * FST2_IMAGE_NULL stands for NULL. A state with -1 transitions is a NULL state.
+ */
+
+#define FST2_IMAGE_VERSION 2
+#define FST2_IMAGE_BYTE_ORDER 0x01020304
+#define FST2_IMAGE_HEADER_SIZE 18
+#define FST2_IMAGE_TAG_SIZE 11
+#define FST2_IMAGE_LOCATE_TAG_SIZE 7
+#define FST2_IMAGE_TILDE_NEGATION_OPERATOR 1
+#define FST2_IMAGE_NULL 0xFFFFFFFF
+
+enum {
+  FST2_IMAGE_H_VERSION = 2,
+  FST2_IMAGE_H_BYTE_ORDER,
+  FST2_IMAGE_H_UNICHAR_SIZE,
+  FST2_IMAGE_H_GRAPHS,
+  FST2_IMAGE_H_STATES,
+  FST2_IMAGE_H_TAGS,
+  FST2_IMAGE_H_TRANSITIONS,
+  FST2_IMAGE_H_DEBUG,
+  FST2_IMAGE_H_GRAPH_NAMES,
+  FST2_IMAGE_H_INPUT_VARIABLES,
+  FST2_IMAGE_H_OUTPUT_VARIABLES,
+  FST2_IMAGE_H_POOL_SIZE,
+  FST2_IMAGE_H_FILE_SIZE,
+  FST2_IMAGE_H_TILDE_NEGATION_OPERATOR,
+  FST2_IMAGE_H_CODES
+};
+
+static const char fst2_image_magic[8] = {'F', 'S', 'T', '2', 'i', 'm', 'g', 0};
+
+
+/**
+ * Growing arrays used to build an image.
+ */
+struct fst2_image_builder {
+  unsigned int* ints;
+  size_t n_ints;
+  size_t capacity_ints;
+  unichar* pool;
+  size_t n_pool;
+  size_t capacity_pool;
+};
+
+
+static void image_add_int(struct fst2_image_builder* b, unsigned int value) {
+  if (b->n_ints == b->capacity_ints) {
+    b->capacity_ints = (b->capacity_ints == 0) ? 1024 : 2 * b->capacity_ints;
+    b->ints = (unsigned int*)realloc(b->ints, b->capacity_ints * sizeof(unsigned int));
+    if (b->ints == NULL) {
+      fatal_alloc_error("image_add_int");
+    }
+  }
+  b->ints[b->n_ints++] = value;
+}
+
+
+/**
+ * Copies the given string into the pool and returns its offset.
+ */
+static unsigned int image_add_string(struct fst2_image_builder* b, const unichar* str) {
+  if (str == NULL) {
+    return FST2_IMAGE_NULL;
+  }
+  size_t length = u_strlen(str) + 1;
+  while (b->n_pool + length > b->capacity_pool) {
+    b->capacity_pool = (b->capacity_pool == 0) ? 4096 : 2 * b->capacity_pool;
+    b->pool = (unichar*)realloc(b->pool, b->capacity_pool * sizeof(unichar));
+    if (b->pool == NULL) {
+      fatal_alloc_error("image_add_string");
+    }
+  }
+  unsigned int offset = (unsigned int)b->n_pool;
+  memcpy(b->pool + b->n_pool, str, length * sizeof(unichar));
+  b->n_pool += length;
+  return offset;
+}
+
+
+static int count_list_ustring(const struct list_ustring* l) {
+  int n = 0;
+  for (; l != NULL; l = l->next) {
+    n++;
+  }
+  return n;
+}
+
+
+/**
+ * Adds to the image the Locate analysis of the given tag, its code lists
+ * going to 'codes'.
+ */
+static void image_add_locate_tag(struct fst2_image_builder* b, struct fst2_image_builder* codes,
+                                 const struct fst2Tag* tag) {
+  struct fst2_locate_tag analysis;
+  analysis.kind = LOCATE_TAG_NOT_ANALYZED;
+  analysis.pattern = NULL;
+  /* Variables, contexts, etc. are typed at loading time and are not
+   * analysed by Locate, and neither are "#" and "<E>" */
+  if (tag->type == UNDEFINED_TAG && tag->input != NULL) {
+    analyze_locate_tag(tag->input, NULL, FST2_IMAGE_TILDE_NEGATION_OPERATOR, &analysis, STANDARD_ALLOCATOR);
+  }
+  struct pattern* p = analysis.pattern;
+  if (p != NULL && p->type == AMBIGUOUS_PATTERN) {
+    /* <XXX> depends on the codes of the dictionaries */
+    analysis.kind = LOCATE_TAG_NOT_ANALYZED;
+  }
+  if (analysis.kind == LOCATE_TAG_NOT_ANALYZED) {
+    free_pattern(p);
+    p = NULL;
+    analysis.meta = (enum meta_symbol)(-1);
+    analysis.negation = 0;
+  }
+  image_add_int(b, (unsigned int)analysis.kind);
+  image_add_int(b, (unsigned int)analysis.meta);
+  image_add_int(b, (unsigned int)analysis.negation);
+  if (p == NULL) {
+    image_add_int(b, FST2_IMAGE_NULL);
+    image_add_int(b, FST2_IMAGE_NULL);
+    image_add_int(b, FST2_IMAGE_NULL);
+    image_add_int(b, FST2_IMAGE_NULL);
+    return;
+  }
+  image_add_int(b, (unsigned int)p->type);
+  image_add_int(b, image_add_string(b, p->inflected));
+  image_add_int(b, image_add_string(b, p->lemma));
+  image_add_int(b, (unsigned int)codes->n_ints);
+  const struct list_ustring* lists[3] = {p->grammatical_codes, p->forbidden_codes, p->inflectional_codes};
+  int j;
+  for (j = 0; j < 3; j++) {
+    image_add_int(codes, (unsigned int)count_list_ustring(lists[j]));
+  }
+  for (j = 0; j < 3; j++) {
+    for (const struct list_ustring* l = lists[j]; l != NULL; l = l->next) {
+      image_add_int(codes, image_add_string(b, l->string));
+    }
+  }
+  free_pattern(p);
+}
+
+
+/**
+ * Saves the given fst2 as a memory-mappable image. Returns true on success.
+ */
+bool write_fst2_image(const Fst2* fst2, const char* image_name) {
+  struct fst2_image_builder b;
+  memset(&b, 0, sizeof(b));
+  struct fst2_image_builder codes;
+  memset(&codes, 0, sizeof(codes));
+  int i;
+  int n_transitions = 0;
+  for (i = 0; i < fst2->number_of_states; i++) {
+    if (fst2->states[i] == NULL) continue;
+    for (const Transition* t = fst2->states[i]->transitions; t != NULL; t = t->next) {
+      n_transitions++;
+    }
+  }
+  int n_input_variables = count_list_ustring(fst2->input_variables);
+  int n_output_variables = count_list_ustring(fst2->output_variables);
+  for (i = 0; i < FST2_IMAGE_HEADER_SIZE; i++) {
+    image_add_int(&b, 0);
+  }
+  memcpy(b.ints, fst2_image_magic, sizeof(fst2_image_magic));
+  b.ints[FST2_IMAGE_H_VERSION] = FST2_IMAGE_VERSION;
+  b.ints[FST2_IMAGE_H_BYTE_ORDER] = FST2_IMAGE_BYTE_ORDER;
+  b.ints[FST2_IMAGE_H_UNICHAR_SIZE] = (unsigned int)sizeof(unichar);
+  b.ints[FST2_IMAGE_H_GRAPHS] = (unsigned int)fst2->number_of_graphs;
+  b.ints[FST2_IMAGE_H_STATES] = (unsigned int)fst2->number_of_states;
+  b.ints[FST2_IMAGE_H_TAGS] = (unsigned int)fst2->number_of_tags;
+  b.ints[FST2_IMAGE_H_TRANSITIONS] = (unsigned int)n_transitions;
+  b.ints[FST2_IMAGE_H_DEBUG] = (unsigned int)fst2->debug;
+  b.ints[FST2_IMAGE_H_GRAPH_NAMES] = (fst2->graph_names != NULL) ? 1 : 0;
+  b.ints[FST2_IMAGE_H_INPUT_VARIABLES] = (unsigned int)n_input_variables;
+  b.ints[FST2_IMAGE_H_OUTPUT_VARIABLES] = (unsigned int)n_output_variables;
+  b.ints[FST2_IMAGE_H_TILDE_NEGATION_OPERATOR] = FST2_IMAGE_TILDE_NEGATION_OPERATOR;
+  for (i = 0; i <= fst2->number_of_graphs; i++) {
+    image_add_int(&b, (unsigned int)fst2->initial_states[i]);
+  }
+  for (i = 0; i <= fst2->number_of_graphs; i++) {
+    image_add_int(&b, (unsigned int)fst2->number_of_states_per_graphs[i]);
+  }
+  for (i = 0; i <= fst2->number_of_graphs; i++) {
+    const unichar* name = (fst2->graph_names != NULL && i != 0) ? fst2->graph_names[i] : NULL;
+    image_add_int(&b, image_add_string(&b, name));
+  }
+  int first = 0;
+  for (i = 0; i < fst2->number_of_states; i++) {
+    Fst2State state = fst2->states[i];
+    int n = 0;
+    if (state != NULL) {
+      for (const Transition* t = state->transitions; t != NULL; t = t->next) {
+        n++;
+      }
+    }
+    image_add_int(&b, (state != NULL) ? state->control : 0);
+    image_add_int(&b, (unsigned int)first);
+    image_add_int(&b, (state != NULL) ? (unsigned int)n : (unsigned int)-1);
+    first += n;
+  }
+  for (i = 0; i < fst2->number_of_states; i++) {
+    if (fst2->states[i] == NULL) continue;
+    for (const Transition* t = fst2->states[i]->transitions; t != NULL; t = t->next) {
+      image_add_int(&b, (unsigned int)t->tag_number);
+      image_add_int(&b, (unsigned int)t->state_number);
+    }
+  }
+  for (i = 0; i < fst2->number_of_tags; i++) {
+    const struct fst2Tag* tag = fst2->tags[i];
+    image_add_int(&b, (unsigned int)tag->type);
+    image_add_int(&b, tag->control);
+    image_add_int(&b, (unsigned int)tag->meta);
+    image_add_int(&b, (unsigned int)tag->pattern_number);
+    image_add_int(&b, (unsigned int)tag->preferred);
+    image_add_int(&b, (unsigned int)tag->compound_pattern);
+    image_add_int(&b, (unsigned int)tag->filter_number);
+    image_add_int(&b, image_add_string(&b, tag->input));
+    image_add_int(&b, image_add_string(&b, tag->output));
+    image_add_int(&b, image_add_string(&b, tag->morphological_filter));
+    image_add_int(&b, image_add_string(&b, tag->variable));
+  }
+  for (i = 0; i < fst2->number_of_tags; i++) {
+    image_add_locate_tag(&b, &codes, fst2->tags[i]);
+  }
+  b.ints[FST2_IMAGE_H_CODES] = (unsigned int)codes.n_ints;
+  for (size_t k = 0; k < codes.n_ints; k++) {
+    image_add_int(&b, codes.ints[k]);
+  }
+  free(codes.ints);
+  for (const struct list_ustring* l = fst2->input_variables; l != NULL; l = l->next) {
+    image_add_int(&b, image_add_string(&b, l->string));
+  }
+  for (const struct list_ustring* l = fst2->output_variables; l != NULL; l = l->next) {
+    image_add_int(&b, image_add_string(&b, l->string));
+  }
+  /* We keep the file size a multiple of 4 */
+  if (b.n_pool % 2) {
+    image_add_string(&b, U_EMPTY);
+  }
+  size_t size_ints = b.n_ints * sizeof(unsigned int);
+  size_t size_pool = b.n_pool * sizeof(unichar);
+  b.ints[FST2_IMAGE_H_POOL_SIZE] = (unsigned int)b.n_pool;
+  b.ints[FST2_IMAGE_H_FILE_SIZE] = (unsigned int)(size_ints + size_pool);
+
+  bool fRet = true;
+  ABSTRACTFILE* f = af_fopen(image_name, "wb");
+  if (f == NULL) {
+    fRet = false;
+  } else {
+    if ((size_t)af_fwrite(b.ints, 1, size_ints, f) != size_ints)
+      fRet = false;
+    if ((size_pool != 0) && ((size_t)af_fwrite(b.pool, 1, size_pool, f) != size_pool))
+      fRet = false;
+    af_fclose(f);
+  }
+  free(b.ints);
+  free(b.pool);
+  return fRet;
+}
+
+
+bool convert_fst2_to_fst2_image_file(const char* fst2_name, const char* image_name,
+                                     bool fVerbose) {
+  const VersatileEncodingConfig vecDefault = {
+      DEFAULT_MASK_ENCODING_COMPATIBILITY_INPUT, DEFAULT_ENCODING_OUTPUT,
+      DEFAULT_BOM_OUTPUT};
+  struct FST2_free_info fst2load_free;
+  Fst2* fst2load = load_abstract_fst2(&vecDefault, fst2_name, 1, &fst2load_free);
+  if (fst2load == NULL)
+    return false;
+  if (fVerbose)
+    u_printf("\n\nload %s and save image %s\n", fst2_name, image_name);
+  bool fRet = write_fst2_image(fst2load, image_name);
+  free_abstract_Fst2(fst2load, &fst2load_free);
+  return fRet;
+}
+
+
+/**
+ * What must be released when an fst2 loaded from an image is freed.
+ */
+struct fst2_image_mapping {
+  ABSTRACTMAPFILE* amf;
+  const void* buf;
+  struct fst2State* states;
+  Transition* transitions;
+  struct fst2Tag* tags;
+  struct fst2_locate_tag* locate_tags;
+};
+
+
+static void free_fst2_image(Fst2* fst2, struct fst2_image_mapping* m) {
+  for (int i = 0; i < fst2->number_of_tags; i++) {
+    /* Those fields are not stored in the image, but a user may have set them */
+    if (m->tags[i].pattern != NULL) free_pattern(m->tags[i].pattern);
+    free_list_int(m->tags[i].matching_tokens);
+    free_pattern(m->locate_tags[i].pattern);
+  }
+  free_list_ustring(fst2->input_variables);
+  free_list_ustring(fst2->output_variables);
+  free(fst2->graph_names);
+  free(fst2->states);
+  free(fst2->tags);
+  free(fst2);
+  free(m->states);
+  free(m->transitions);
+  free(m->tags);
+  free(m->locate_tags);
+  af_release_mapfile_pointer(m->amf, m->buf);
+  af_close_mapfile(m->amf);
+  free(m);
+}
+
+
+static void ABSTRACT_CALLBACK_UNITEX free_fst2_image_abstract(
+Fst2* fst2, struct FST2_free_info* p_inf_free_info, void* privateSpacePtr) {
+  DISCARD_UNUSED_PARAMETER(privateSpacePtr);
+  free_fst2_image(fst2, (struct fst2_image_mapping*)p_inf_free_info->private_ptr);
+}
+
+
+/**
+ * Returns the string at the given offset of the pool, or NULL.
+ */
+static inline unichar* image_string(const unichar* pool, unsigned int offset) {
+  return (offset == FST2_IMAGE_NULL) ? NULL : (unichar*)(pool + offset);
+}
+
+
+/**
+ * Checks that all the string offsets of the given array are valid.
+ */
+static bool check_image_strings(const unsigned int* offsets, size_t n, const unichar* pool,
+                                unsigned int pool_size) {
+  for (size_t i = 0; i < n; i++) {
+    if (offsets[i] != FST2_IMAGE_NULL && offsets[i] >= pool_size) return false;
+  }
+  return (pool_size == 0) || (pool[pool_size - 1] == '\0');
+}
+
+
+/**
+ * Returns true if the given image value is a meta symbol, or -1 for no meta.
+ */
+static inline bool check_image_meta(unsigned int meta) {
+  return ((int)meta == -1) || (meta <= (unsigned int)META_LOWER);
+}
+
+
+/**
+ * Rebuilds the Locate analysis of a tag from its image record. Patterns are
+ * rebuilt from their stored parts, without parsing the tag input again.
+ */
+static void read_image_locate_tag(struct fst2_locate_tag* res, const unsigned int* t,
+                                  const unsigned int* codes, const unichar* pool) {
+  res->kind = (enum locate_tag_kind)t[0];
+  res->meta = (enum meta_symbol)(int)t[1];
+  res->negation = (int)t[2];
+  res->pattern = NULL;
+  if (res->kind != LOCATE_TAG_PATTERN) {
+    return;
+  }
+  struct pattern* p = new_pattern();
+  p->type = (enum pattern_type)t[3];
+  p->inflected = u_strdup(image_string(pool, t[4]));
+  p->lemma = u_strdup(image_string(pool, t[5]));
+  const unsigned int* c = codes + t[6];
+  const unsigned int* strings = c + 3;
+  struct list_ustring** lists[3] = {&(p->grammatical_codes), &(p->forbidden_codes), &(p->inflectional_codes)};
+  for (int j = 0; j < 3; j++) {
+    /* Lists are rebuilt in reverse order, since they are pushed at the head */
+    for (unsigned int k = c[j]; k > 0; k--) {
+      *(lists[j]) = new_list_ustring(image_string(pool, strings[k - 1]), *(lists[j]));
+    }
+    strings += c[j];
+  }
+  res->pattern = p;
+}
+
+
+/**
+ * Builds an fst2 from the given image mapping. Returns NULL if the image is
+ * not valid.
+ */
+static Fst2* read_fst2_image_from_memory(struct fst2_image_mapping* m, size_t size_buf, int read_names) {
+  const unsigned int* h = (const unsigned int*)m->buf;
+  if (size_buf < FST2_IMAGE_HEADER_SIZE * sizeof(unsigned int)
+      || memcmp(h, fst2_image_magic, sizeof(fst2_image_magic))
+      || h[FST2_IMAGE_H_VERSION] != FST2_IMAGE_VERSION
+      || h[FST2_IMAGE_H_BYTE_ORDER] != FST2_IMAGE_BYTE_ORDER
+      || h[FST2_IMAGE_H_UNICHAR_SIZE] != sizeof(unichar)
+      || h[FST2_IMAGE_H_FILE_SIZE] != size_buf) {
+    return NULL;
+  }
+  size_t n_graphs = h[FST2_IMAGE_H_GRAPHS];
+  size_t n_states = h[FST2_IMAGE_H_STATES];
+  size_t n_tags = h[FST2_IMAGE_H_TAGS];
+  size_t n_transitions = h[FST2_IMAGE_H_TRANSITIONS];
+  size_t n_input_variables = h[FST2_IMAGE_H_INPUT_VARIABLES];
+  size_t n_output_variables = h[FST2_IMAGE_H_OUTPUT_VARIABLES];
+  size_t n_codes = h[FST2_IMAGE_H_CODES];
+  unsigned int pool_size = h[FST2_IMAGE_H_POOL_SIZE];
+  size_t n_ints = FST2_IMAGE_HEADER_SIZE + 3 * (n_graphs + 1) + 3 * n_states + 2 * n_transitions
+                  + (FST2_IMAGE_TAG_SIZE + FST2_IMAGE_LOCATE_TAG_SIZE) * n_tags + n_codes
+                  + n_input_variables + n_output_variables;
+  if (n_ints * sizeof(unsigned int) + pool_size * sizeof(unichar) != size_buf) {
+    return NULL;
+  }
+  const int* initial_states = (const int*)(h + FST2_IMAGE_HEADER_SIZE);
+  const int* states_per_graph = initial_states + n_graphs + 1;
+  const unsigned int* graph_names = (const unsigned int*)(states_per_graph + n_graphs + 1);
+  const int* states = (const int*)(graph_names + n_graphs + 1);
+  const int* transitions = states + 3 * n_states;
+  const unsigned int* tags = (const unsigned int*)(transitions + 2 * n_transitions);
+  const unsigned int* locate_tags = tags + FST2_IMAGE_TAG_SIZE * n_tags;
+  const unsigned int* codes = locate_tags + FST2_IMAGE_LOCATE_TAG_SIZE * n_tags;
+  const unsigned int* variables = codes + n_codes;
+  const unichar* pool = (const unichar*)(h + n_ints);
+  if (!check_image_strings(graph_names, n_graphs + 1, pool, pool_size)
+      || !check_image_strings(variables, n_input_variables + n_output_variables, pool, pool_size)) {
+    return NULL;
+  }
+  for (size_t i = 0; i < n_tags; i++) {
+    const unsigned int* tag = tags + FST2_IMAGE_TAG_SIZE * i;
+    if (tag[0] > (unsigned int)TEXT_END_TAG || !check_image_meta(tag[2])
+        || !check_image_strings(tag + 7, 4, pool, pool_size)) {
+      return NULL;
+    }
+    const unsigned int* t = locate_tags + FST2_IMAGE_LOCATE_TAG_SIZE * i;
+    if (t[0] > (unsigned int)LOCATE_TAG_PATTERN || !check_image_meta(t[1]) || t[2] > 1) {
+      return NULL;
+    }
+    if (t[0] != LOCATE_TAG_PATTERN) continue;
+    if (t[3] > (unsigned int)INFLECTED_AND_LEMMA_PATTERN
+        || !check_image_strings(t + 4, 2, pool, pool_size)
+        || t[6] > n_codes || n_codes - t[6] < 3
+        || n_codes - t[6] - 3 < (size_t)codes[t[6]] + codes[t[6] + 1] + codes[t[6] + 2]
+        || !check_image_strings(codes + t[6] + 3, codes[t[6]] + codes[t[6] + 1] + codes[t[6] + 2],
+                                pool, pool_size)) {
+      return NULL;
+    }
+  }
+  for (size_t i = 0; i < n_states; i++) {
+    const int* s = states + 3 * i;
+    if (s[2] != -1 && (s[1] < 0 || s[2] < 0 || (size_t)s[1] + (size_t)s[2] > n_transitions)) {
+      return NULL;
+    }
+  }
+  /* A transition tag is either a tag number, or -n for a call to the graph n */
+  for (size_t i = 0; i < n_transitions; i++) {
+    int tag_number = transitions[2 * i];
+    int state_number = transitions[2 * i + 1];
+    if ((tag_number >= 0 && (size_t)tag_number >= n_tags)
+        || (tag_number < 0 && (size_t)(-(long long)tag_number) > n_graphs)
+        || state_number < 0 || (size_t)state_number >= n_states
+        || states[3 * state_number + 2] == -1) {
+      return NULL;
+    }
+  }
+  for (size_t i = 1; i <= n_graphs; i++) {
+    if (initial_states[i] < 0 || states_per_graph[i] < 0
+        || (size_t)initial_states[i] + (size_t)states_per_graph[i] > n_states
+        || (size_t)initial_states[i] >= n_states
+        || states[3 * initial_states[i] + 2] == -1) {
+      return NULL;
+    }
+  }
+
+  Fst2* fst2 = new_Fst2(NULL);
+  fst2->number_of_graphs = (int)n_graphs;
+  fst2->number_of_states = (int)n_states;
+  fst2->number_of_tags = (int)n_tags;
+  fst2->debug = (int)h[FST2_IMAGE_H_DEBUG];
+  /* Those arrays are used as they are in the mapping */
+  fst2->initial_states = (int*)initial_states;
+  fst2->number_of_states_per_graphs = (int*)states_per_graph;
+  if (read_names && h[FST2_IMAGE_H_GRAPH_NAMES]) {
+    fst2->graph_names = (unichar**)malloc((n_graphs + 1) * sizeof(unichar*));
+    if (fst2->graph_names == NULL) {
+      fatal_alloc_error("read_fst2_image_from_memory");
+    }
+    for (size_t i = 0; i <= n_graphs; i++) {
+      fst2->graph_names[i] = image_string(pool, graph_names[i]);
+    }
+  }
+  fst2->states = (Fst2State*)malloc((n_states ? n_states : 1) * sizeof(Fst2State));
+  m->states = (struct fst2State*)malloc((n_states ? n_states : 1) * sizeof(struct fst2State));
+  m->transitions = (Transition*)malloc((n_transitions ? n_transitions : 1) * sizeof(Transition));
+  fst2->tags = (Fst2Tag*)malloc((n_tags ? n_tags : 1) * sizeof(Fst2Tag));
+  m->tags = (struct fst2Tag*)malloc((n_tags ? n_tags : 1) * sizeof(struct fst2Tag));
+  m->locate_tags = (struct fst2_locate_tag*)malloc((n_tags ? n_tags : 1) * sizeof(struct fst2_locate_tag));
+  if (fst2->states == NULL || m->states == NULL || m->transitions == NULL
+      || fst2->tags == NULL || m->tags == NULL || m->locate_tags == NULL) {
+    fatal_alloc_error("read_fst2_image_from_memory");
+  }
+  for (size_t i = 0; i < n_transitions; i++) {
+    m->transitions[i].tag_number = transitions[2 * i];
+    m->transitions[i].state_number = transitions[2 * i + 1];
+    m->transitions[i].next = NULL;
+  }
+  for (size_t i = 0; i < n_states; i++) {
+    const int* s = states + 3 * i;
+    if (s[2] == -1) {
+      fst2->states[i] = NULL;
+      continue;
+    }
+    struct fst2State* state = &(m->states[i]);
+    state->control = (unsigned char)s[0];
+    state->transitions = (s[2] == 0) ? NULL : &(m->transitions[s[1]]);
+    for (int j = 1; j < s[2]; j++) {
+      m->transitions[s[1] + j - 1].next = &(m->transitions[s[1] + j]);
+    }
+    fst2->states[i] = state;
+  }
+  for (size_t i = 0; i < n_tags; i++) {
+    const unsigned int* t = tags + FST2_IMAGE_TAG_SIZE * i;
+    struct fst2Tag* tag = &(m->tags[i]);
+    tag->type = (enum tag_type)t[0];
+    tag->control = (unsigned char)t[1];
+    tag->meta = (enum meta_symbol)(int)t[2];
+    tag->pattern_number = (int)t[3];
+    tag->preferred = (int)t[4];
+    tag->compound_pattern = (int)t[5];
+    tag->filter_number = (int)t[6];
+    tag->input = image_string(pool, t[7]);
+    tag->output = image_string(pool, t[8]);
+    tag->morphological_filter = image_string(pool, t[9]);
+    tag->variable = image_string(pool, t[10]);
+    tag->pattern = NULL;
+    tag->matching_tokens = NULL;
+    fst2->tags[i] = tag;
+    read_image_locate_tag(&(m->locate_tags[i]), locate_tags + FST2_IMAGE_LOCATE_TAG_SIZE * i, codes, pool);
+  }
+  fst2->locate_tags = m->locate_tags;
+  fst2->locate_tags_tilde_negation_operator = (int)h[FST2_IMAGE_H_TILDE_NEGATION_OPERATOR];
+  /* Variable lists are rebuilt in reverse order, since they are pushed at the head */
+  for (size_t i = n_input_variables; i > 0; i--) {
+    fst2->input_variables = new_list_ustring(image_string(pool, variables[i - 1]), fst2->input_variables);
+  }
+  for (size_t i = n_output_variables; i > 0; i--) {
+    fst2->output_variables = new_list_ustring(image_string(pool, variables[n_input_variables + i - 1]),
+                                              fst2->output_variables);
+  }
+  return fst2;
+}
+
+
+/**
+ * Loads an fst2 image. The returned fst2 is a read-only view of the mapping:
+ * it must be freed with free_abstract_Fst2 and the given 'p_fst2_free_info'.
+ * If 'p_fst2_free_info' is NULL, a regular copy of the fst2 is returned.
+ * Returns NULL if the file is not a valid image.
+ */
+Fst2* read_fst2_image_from_file(const char* filename, int read_names,
+                                struct FST2_free_info* p_fst2_free_info) {
+  ABSTRACTMAPFILE* amf = af_open_mapfile(filename, MAPFILE_OPTION_READ, 0);
+  if (amf == NULL) {
+    return NULL;
+  }
+  struct fst2_image_mapping* m = (struct fst2_image_mapping*)malloc(sizeof(struct fst2_image_mapping));
+  if (m == NULL) {
+    fatal_alloc_error("read_fst2_image_from_file");
+  }
+  memset(m, 0, sizeof(struct fst2_image_mapping));
+  m->amf = amf;
+  m->buf = af_get_mapfile_pointer(amf);
+  Fst2* fst2 = NULL;
+  if (m->buf != NULL) {
+    fst2 = read_fst2_image_from_memory(m, af_get_mapfile_size(amf), read_names);
+  }
+  if (fst2 == NULL) {
+    if (m->buf != NULL) af_release_mapfile_pointer(amf, m->buf);
+    af_close_mapfile(amf);
+    free(m);
+    return NULL;
+  }
+  if (p_fst2_free_info == NULL) {
+    Fst2* copy = new_Fst2_clone(fst2);
+    free_fst2_image(fst2, m);
+    return copy;
+  }
+  p_fst2_free_info->must_be_free = 1;
+  p_fst2_free_info->func_free_fst2 = (void*)&free_fst2_image_abstract;
+  p_fst2_free_info->private_ptr = m;
+  return fst2;
+}
+
+
 #ifdef _DEBUG
 
 bool do_test_pack_int_array(const int* iArray, int nb_item) {
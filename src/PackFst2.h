@@ -56,6 +56,14 @@ Fst2* read_pack_fst2_from_file(const char* filename,
                                Abstract_allocator prv_alloc);
 
 void free_pack_fst2(Fst2* fst2,Abstract_allocator prv_alloc);
+
+bool write_fst2_image(const Fst2* fst2, const char* image_name);
+
+bool convert_fst2_to_fst2_image_file(const char* fst2_name,
+                                     const char* image_name, bool fVerbose);
+
+Fst2* read_fst2_image_from_file(const char* filename, int read_names,
+                                struct FST2_free_info* p_fst2_free_info);
 }
 
 #endif
@@ -29,6 +29,8 @@
  */
  //
 #include "PackFst2.h"
+#include "PackInf.h"
+#include "Af_stdio.h"
 #include "UnusedParameter.h"
 
 
@@ -609,6 +611,49 @@ static void free_packed_INF_codes(struct INF_codes* INF)
     INF_codes_monopack* inf_code_monopack = (INF_codes_monopack*)INF;
     free(inf_code_monopack);
 }
+
+
+static void ABSTRACT_CALLBACK_UNITEX free_mapped_inp(struct INF_codes* INF,
+                   struct INF_free_info* p_inf_free_info,void* privateSpacePtr)
+{
+    /* privateSpacePtr is the mapped buffer */
+    ABSTRACTMAPFILE *amf = (ABSTRACTMAPFILE *)p_inf_free_info->private_ptr;
+    free_packed_INF_codes(INF);
+    af_release_mapfile_pointer(amf,privateSpacePtr);
+    af_close_mapfile(amf);
+}
+
+
+/**
+ * Loads a .inp file by mapping it. When the file was written with the native
+ * byte order, the codes point directly into the mapping, so that all the
+ * processes that map the same file share the same pages; only the line and
+ * list arrays are private. The result must be freed with free_abstract_INF.
+ * Returns NULL if the file cannot be mapped or is not a valid .inp file.
+ */
+const struct INF_codes* load_mapped_inp_file(const char* filename,
+                                             struct INF_free_info* p_inf_free_info)
+{
+    ABSTRACTMAPFILE* amf=af_open_mapfile(filename,MAPFILE_OPTION_READ,0);
+    if (amf==NULL)
+        return NULL;
+    const void* buf=af_get_mapfile_pointer(amf);
+    struct INF_codes* res=NULL;
+    if (buf!=NULL)
+        res=build_inf_structure_from_inp_file(buf,(int)af_get_mapfile_size(amf),NULL,0,true);
+    if (res==NULL)
+    {
+        if (buf!=NULL)
+            af_release_mapfile_pointer(amf,buf);
+        af_close_mapfile(amf);
+        return NULL;
+    }
+    p_inf_free_info->must_be_free=1;
+    p_inf_free_info->func_free_inf=(void*)free_mapped_inp;
+    p_inf_free_info->private_ptr=amf;
+    p_inf_free_info->privateSpacePtr=(void*)buf;
+    return res;
+}
  
 
 }
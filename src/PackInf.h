@@ -72,5 +72,8 @@ struct INF_codes* read_pack_inf_from_file(const char* filename,
 
 void free_pack_inf(struct INF_codes*, Abstract_allocator prv_alloc);
 
+const struct INF_codes* load_mapped_inp_file(const char* filename,
+                                             struct INF_free_info* p_inf_free_info);
+
 }
 #endif
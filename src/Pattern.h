@@ -97,6 +97,7 @@ struct pattern {
 };
 
 
+struct pattern* new_pattern(Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 struct pattern* build_pattern(const unichar*,struct string_hash*,int tilde_negation_operator,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 struct pattern* build_token_pattern(const unichar*,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
 void free_pattern(struct pattern*,Abstract_allocator prv_alloc=STANDARD_ALLOCATOR);
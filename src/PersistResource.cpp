@@ -52,6 +52,9 @@ const char* usage_PersistResource =
          "  -d/--dictionary: to persist a compiled dictionary resource\n"
          "  -a/--alphabet: to persist an alphabet resource\n"
          "  -u/--unpersist: to unpersist the resource\n"
+         "  -c DIR/--cache_directory=DIR: load the resource from mappable images\n"
+         "                 stored in DIR, building them if needed, so that the\n"
+         "                 processes using the same DIR share the same memory\n"
          "  -o OUTFILE/--output=OUTFILE: path to output file to create\n"
          "                 with persisted filename. Incompatible with -u/--unpersist\n"
          "  -v/--verbose: emit message when running\n"
@@ -65,13 +68,14 @@ static void usage() {
   u_printf(usage_PersistResource);
 }
 
-const char* optstring_PersistResource=":Vhvgdauo:k:q:";
+const char* optstring_PersistResource=":Vhvgdauo:c:k:q:";
 const struct option_TS lopts_PersistResource[]= {
   {"graph", no_argument_TS,NULL,'g'},
   {"dictionary", no_argument_TS,NULL,'d'},
   {"alphabet", no_argument_TS,NULL,'a'},
   {"unpersist", no_argument_TS,NULL,'u' },
   {"output",required_argument_TS,NULL,'o' },
+  {"cache_directory",required_argument_TS,NULL,'c' },
   {"input_encoding",required_argument_TS,NULL,'k'},
   {"output_encoding",required_argument_TS,NULL,'q'},
   {"only_verify_arguments",no_argument_TS,NULL,'V'},
@@ -99,6 +103,7 @@ VersatileEncodingConfig vec = VEC_DEFAULT;
 int val,index=-1;
 bool only_verify_arguments = false;
 const char*output_file = NULL;
+const char*cache_directory = NULL;
 const char*resource_type = NULL;
 UnitexGetOpt options;
 
@@ -115,6 +120,12 @@ while (EOF!=(val=options.parse_long(argc,argv,optstring_PersistResource,lopts_Pe
              }
              output_file = options.vars()->optarg; // FIXME(gvollant)
              break;
+   case 'c': if (options.vars()->optarg[0]=='\0') {
+                error("Empty cache directory argument\n");
+                return USAGE_ERROR_CODE;
+             }
+             cache_directory = options.vars()->optarg;
+             break;
    case 'V': only_verify_arguments = true;
              break;
    case 'h': usage();
@@ -162,6 +173,8 @@ if (buf_persisted_filename == NULL) {
 *buf_persisted_filename='\0';
 if (unpersist == 0) {
     int result = 0;
+    if (cache_directory != NULL)
+        persistence_public_set_cache_directory(cache_directory);
     if (res_alphabet)
         result = standard_load_persistence_alphabet(resource_file, buf_persisted_filename, size_buf_persisted_filename);
     if (res_graph)
@@ -19,10 +19,14 @@
  *
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "Persistence.h"
 #include "Error.h"
+#include "File.h"
+#include "Af_stdio.h"
 #include "AbstractCallbackFuncModifier.h"
 #include "SyncTool.h"
 #include "VirtualFiles.h"
@@ -35,13 +39,55 @@
 
 namespace unitex {
 
+/**
+ * A registered structure. 'users', 'removed' and 'freed' are only accessed
+ * with atomic operations; the other fields are only modified under
+ * Persistence_Mutex.
+ */
 typedef struct PS_ {
     char* name;
+    unsigned int hash;
     void* ptr;
+    /* Number of users that acquired 'ptr' and have not released it yet */
+    volatile long users;
+    /* Set to 1 when the structure can no longer be acquired */
+    volatile long removed;
+    /* Set to 1 by the only thread that is allowed to free the structure */
+    volatile long freed;
+    t_free_persistent_structure free_func;
+    /* Set to 1 when the entry has been taken out of 'by_ptr' */
+    int unregistered;
     struct PS_* next;
 } PersistentStructure;
 
 
+/**
+ * The registry. 'by_name' and 'by_ptr' are two open addressing hash tables of
+ * size mask+1, that are updated in place. 'by_name' only contains the
+ * structures that can be acquired, while 'by_ptr' also contains the removed
+ * ones that are still in use, so that their users can release them. Deleted
+ * slots are marked with DELETED_ENTRY, so that the probe sequences of the
+ * other entries are not broken; 'used' counts the slots that are not NULL.
+ */
+typedef struct PT_ {
+    unsigned int mask;
+    unsigned int used_by_name;
+    unsigned int used_by_ptr;
+    PersistentStructure* volatile* by_name;
+    PersistentStructure* volatile* by_ptr;
+    struct PT_* next;
+} PersistentTable;
+
+
+#define PERSISTENCE_MIN_TABLE_SIZE 16
+
+static PersistentStructure deleted_entry;
+#define DELETED_ENTRY (&deleted_entry)
+
+
+static void free_persistence_registry();
+
+
 class PersistenceMutexContainer
 {
 public:
@@ -59,98 +105,458 @@ PersistenceMutexContainer::PersistenceMutexContainer() :
 
 PersistenceMutexContainer::~PersistenceMutexContainer()
 {
+    free_persistence_registry();
     SyncDeleteMutex(mutex);
     mutex = NULL;
 }
 
 static PersistenceMutexContainer PersistenceMutexContainerInstance;
 
-static PersistentStructure* list=NULL;
-
 #define Persistence_Mutex (PersistenceMutexContainerInstance.getMutex())
 
-/**
- * Returns the persistent pointer associated to the given file name,
- * if any; NULL otherwise.
+/*
+ * Lookups read the current table without any lock, inside a read section
+ * (see enter_persistence_lookup). Modifications are done under
+ * Persistence_Mutex. They update the table in place, and only copy it
+ * when it must grow or be cleaned of its deleted slots. A replaced table or an
+ * unregistered entry is retired, and freed once all the read sections that
+ * could still see it are over.
  */
-void* get_persistent_structure(const char* filename) {
-SyncGetMutex(Persistence_Mutex);
+static PersistentTable* volatile current_table=NULL;
+static PersistentTable* retired_tables=NULL;
+static PersistentStructure* retired_entries=NULL;
+/*
+ * Epoch of the read sections. A lookup counts itself in the counter of the
+ * parity of the current epoch. To reclaim the retired objects, a writer moves
+ * to the next epoch and waits for the counter of the previous one to drop to
+ * zero.
+ */
+static volatile long lookup_epoch=0;
+static volatile long lookup_counters[2]={0,0};
+/* Directory where the mappable images of the resources are stored, or "" */
+static char cache_directory[FILENAME_MAX]="";
+/* Used to give a distinct name to each temporary cache file */
+static volatile long cache_file_counter=0;
+
+
+static const char* get_persistent_name(const char* filename) {
 if (strstr(filename,VIRTUAL_FILE_PFX)==filename) {
     filename=filename+strlen(VIRTUAL_FILE_PFX);
 }
-PersistentStructure* tmp=list;
-void* res=NULL;
-while (tmp!=NULL) {
-    if (!strcmp(tmp->name,filename)) {
-        res=tmp->ptr;
-        break;
+return filename;
+}
+
+
+static unsigned int hash_persistent_name(const char* name) {
+unsigned int h=2166136261u;
+while (*name!='\0') {
+    h=(h^(unsigned char)(*name))*16777619u;
+    name++;
+}
+return h;
+}
+
+
+static unsigned int hash_persistent_ptr(const void* ptr) {
+size_t v=(size_t)ptr;
+return (unsigned int)((v>>4)^(v>>20))*2654435761u;
+}
+
+
+static PersistentTable* get_current_table() {
+return (PersistentTable*)SyncAtomicLoadPointer((void* volatile*)&current_table);
+}
+
+
+/**
+ * Starts a read section and returns its epoch, that must be given to
+ * leave_persistence_lookup. The tables and entries seen in a read section
+ * are not freed before it is over.
+ */
+static long enter_persistence_lookup() {
+for (;;) {
+    long epoch=SyncAtomicCompareExchange(&lookup_epoch,0,0);
+    SyncAtomicIncrement(&(lookup_counters[epoch&1]));
+    if (SyncAtomicCompareExchange(&lookup_epoch,0,0)==epoch) {
+        return epoch;
     }
-    tmp=tmp->next;
+    /* A writer moved to the next epoch in the meantime */
+    SyncAtomicDecrement(&(lookup_counters[epoch&1]));
 }
-SyncReleaseMutex(Persistence_Mutex);
-return res;
 }
 
 
-static PersistentStructure* remove_filename(PersistentStructure* l,const char* filename) {
-if (l==NULL) return NULL;
-if (strstr(filename,VIRTUAL_FILE_PFX)==filename) {
-    filename=filename+strlen(VIRTUAL_FILE_PFX);
+static void leave_persistence_lookup(long epoch) {
+SyncAtomicDecrement(&(lookup_counters[epoch&1]));
 }
-if (!strcmp(l->name,filename)) {
-    PersistentStructure* next=l->next;
-    free(l->name);
-    free(l);
-    return next;
+
+
+static PersistentStructure* find_by_name(const PersistentTable* t,const char* name) {
+if (t==NULL) return NULL;
+unsigned int h=hash_persistent_name(name);
+PersistentStructure* e;
+for (unsigned int i=h&t->mask;(e=t->by_name[i])!=NULL;i=(i+1)&t->mask) {
+    if (e!=DELETED_ENTRY && e->hash==h && !strcmp(e->name,name)) {
+        return e;
+    }
 }
-l->next=remove_filename(l->next,filename);
-return l;
+return NULL;
+}
+
+
+static PersistentStructure* find_by_ptr(const PersistentTable* t,const void* ptr) {
+if (t==NULL) return NULL;
+PersistentStructure* e;
+for (unsigned int i=hash_persistent_ptr(ptr)&t->mask;(e=t->by_ptr[i])!=NULL;i=(i+1)&t->mask) {
+    if (e!=DELETED_ENTRY && e->ptr==ptr) {
+        return e;
+    }
+}
+return NULL;
 }
 
 
 /**
- * Associates the given pointer to the given file name if ptr is not NULL.
- * If ptr is NULL, then the pointer is removed from the list.
+ * Stores e in the first free slot of its probe sequence. Returns 1 if a NULL
+ * slot was used; 0 if a deleted one was reused.
  */
-void set_persistent_structure(const char* filename,void* ptr) {
-SyncGetMutex(Persistence_Mutex);
-if (strstr(filename,VIRTUAL_FILE_PFX)==filename) {
-    filename=filename+strlen(VIRTUAL_FILE_PFX);
+static int insert_slot(PersistentStructure* volatile* slots,unsigned int mask,unsigned int h,PersistentStructure* e) {
+unsigned int i;
+for (i=h&mask;slots[i]!=NULL && slots[i]!=DELETED_ENTRY;i=(i+1)&mask) {}
+int was_null=(slots[i]==NULL);
+SyncAtomicStorePointer((void* volatile*)&(slots[i]),e);
+return was_null;
+}
+
+
+static void delete_slot(PersistentStructure* volatile* slots,unsigned int mask,unsigned int h,PersistentStructure* e) {
+for (unsigned int i=h&mask;slots[i]!=NULL;i=(i+1)&mask) {
+    if (slots[i]==e) {
+        SyncAtomicStorePointer((void* volatile*)&(slots[i]),DELETED_ENTRY);
+        return;
+    }
+}
+}
+
+
+static PersistentTable* new_PersistentTable(unsigned int size) {
+PersistentTable* t=(PersistentTable*)malloc(sizeof(PersistentTable));
+if (t==NULL) {
+    fatal_alloc_error("new_PersistentTable");
+}
+t->mask=size-1;
+t->used_by_name=0;
+t->used_by_ptr=0;
+t->by_name=(PersistentStructure* volatile*)calloc(size,sizeof(PersistentStructure*));
+t->by_ptr=(PersistentStructure* volatile*)calloc(size,sizeof(PersistentStructure*));
+if (t->by_name==NULL || t->by_ptr==NULL) {
+    fatal_alloc_error("new_PersistentTable");
+}
+t->next=NULL;
+return t;
+}
+
+
+static void free_PersistentTable(PersistentTable* t) {
+free((void*)t->by_name);
+free((void*)t->by_ptr);
+free(t);
+}
+
+
+/**
+ * Makes sure that one more entry can be inserted in the current table. If
+ * more than half of the slots are not NULL, the live entries are copied into a
+ * new table that replaces the current one, which is retired. Must be called
+ * with Persistence_Mutex.
+ */
+static PersistentTable* reserve_table_slot() {
+PersistentTable* old=current_table;
+if (old!=NULL && 2*(old->used_by_name+1)<=old->mask+1 && 2*(old->used_by_ptr+1)<=old->mask+1) {
+    return old;
+}
+unsigned int n=1;
+if (old!=NULL) {
+    for (unsigned int i=0;i<=old->mask;i++) {
+        if (old->by_ptr[i]!=NULL && old->by_ptr[i]!=DELETED_ENTRY) n++;
+    }
+}
+unsigned int size=PERSISTENCE_MIN_TABLE_SIZE;
+while (size<4*n) {
+    size=size*2;
+}
+PersistentTable* t=new_PersistentTable(size);
+if (old!=NULL) {
+    for (unsigned int i=0;i<=old->mask;i++) {
+        PersistentStructure* e=old->by_ptr[i];
+        if (e==NULL || e==DELETED_ENTRY) continue;
+        t->used_by_ptr+=insert_slot(t->by_ptr,t->mask,hash_persistent_ptr(e->ptr),e);
+        if (!e->removed) {
+            t->used_by_name+=insert_slot(t->by_name,t->mask,e->hash,e);
+        }
+    }
+    old->next=retired_tables;
+    retired_tables=old;
+}
+SyncAtomicStorePointer((void* volatile*)&current_table,t);
+return t;
+}
+
+
+/**
+ * Takes the given removed entry out of 'by_ptr' and retires it. Must be
+ * called with Persistence_Mutex.
+ */
+static void unregister_entry(PersistentStructure* e) {
+if (e->unregistered) return;
+e->unregistered=1;
+delete_slot(current_table->by_ptr,current_table->mask,hash_persistent_ptr(e->ptr),e);
+e->next=retired_entries;
+retired_entries=e;
 }
-if (ptr==NULL) {
-    list=remove_filename(list,filename);
-    SyncReleaseMutex(Persistence_Mutex);
-    return;
+
+
+/**
+ * Frees the retired tables and entries, after waiting for the end of the read
+ * sections that may still see them. Must be called with Persistence_Mutex.
+ */
+static void reclaim_retired() {
+if (retired_tables==NULL && retired_entries==NULL) return;
+long epoch=SyncAtomicCompareExchange(&lookup_epoch,0,0);
+SyncAtomicIncrement(&lookup_epoch);
+/* New read sections count themselves in the other counter; the ones of the
+ * previous epoch only do a few probes, but their thread may have been
+ * preempted, so we let it run */
+while (SyncAtomicCompareExchange(&(lookup_counters[epoch&1]),0,0)!=0) {
+    SyncYield();
+}
+while (retired_tables!=NULL) {
+    PersistentTable* t=retired_tables;
+    retired_tables=t->next;
+    free_PersistentTable(t);
+}
+while (retired_entries!=NULL) {
+    PersistentStructure* e=retired_entries;
+    retired_entries=e->next;
+    free(e->name);
+    free(e);
 }
-PersistentStructure* tmp=(PersistentStructure*)malloc(sizeof(PersistentStructure));
-if (tmp==NULL) {
-    fatal_alloc_error("set_persistent_structure");
 }
-tmp->name=strdup(filename);
-if (tmp->name==NULL) {
-    fatal_alloc_error("set_persistent_structure");
+
+
+/**
+ * Marks the given entry as removed and takes it out of 'by_name'. If it has
+ * no user, it is also unregistered, and 1 is returned to indicate that the
+ * caller must free its pointer; otherwise, this is done by the last user
+ * that releases it. Must be called with Persistence_Mutex.
+ */
+static int remove_entry(PersistentStructure* e,t_free_persistent_structure free_func) {
+e->free_func=free_func;
+SyncAtomicCompareExchange(&(e->removed),1,0);
+delete_slot(current_table->by_name,current_table->mask,e->hash,e);
+if (SyncAtomicCompareExchange(&(e->users),0,0)==0
+        && SyncAtomicCompareExchange(&(e->freed),1,0)==0) {
+    unregister_entry(e);
+    return 1;
+}
+return 0;
 }
-tmp->ptr=ptr;
-tmp->next=list;
-list=tmp;
+
+
+/**
+ * Unregisters a removed entry whose last user has just released it,
+ * and frees its pointer. Must be called outside of any read section.
+ */
+static void free_entry(PersistentStructure* e) {
+SyncGetMutex(Persistence_Mutex);
+void* ptr=e->ptr;
+t_free_persistent_structure free_func=e->free_func;
+unregister_entry(e);
+reclaim_retired();
 SyncReleaseMutex(Persistence_Mutex);
+if (free_func!=NULL) {
+    (*free_func)(ptr);
+}
 }
 
+
 /**
- * Returns 1 if the given pointer is a persistent one; 0 otherwise.
+ * Decrements the users of the given entry. Returns 1 if the entry was
+ * removed and the caller is the one that must call free_entry on it, once
+ * its read section is over; -1 if the entry had no user to release;
+ * 0 otherwise.
  */
-int is_persistent_structure(void* ptr) {
+static int release_entry(PersistentStructure* e) {
+long users=SyncAtomicDecrement(&(e->users));
+if (users<0) {
+    return -1;
+}
+return users==0
+        && SyncAtomicCompareExchange(&(e->removed),1,1)==1
+        && SyncAtomicCompareExchange(&(e->freed),1,0)==0;
+}
+
+
+static void free_persistence_registry() {
+if (current_table!=NULL) {
+    for (unsigned int i=0;i<=current_table->mask;i++) {
+        PersistentStructure* e=current_table->by_ptr[i];
+        if (e!=NULL && e!=DELETED_ENTRY) {
+            free(e->name);
+            free(e);
+        }
+    }
+    current_table->next=retired_tables;
+    retired_tables=current_table;
+    current_table=NULL;
+}
+reclaim_retired();
+}
+
+
+/**
+ * Returns the persistent pointer associated to the given file name,
+ * if any; NULL otherwise. This function does not take any lock.
+ */
+void* get_persistent_structure(const char* filename) {
+long epoch=enter_persistence_lookup();
+PersistentStructure* e=find_by_name(get_current_table(),get_persistent_name(filename));
+void* ptr=(e==NULL || e->removed) ? NULL : e->ptr;
+leave_persistence_lookup(epoch);
+return ptr;
+}
+
+
+/**
+ * Like get_persistent_structure, but the returned pointer cannot be freed
+ * by remove_persistent_structure until release_persistent_structure
+ * is called on it.
+ */
+void* acquire_persistent_structure(const char* filename) {
+void* ptr=NULL;
+PersistentStructure* to_free=NULL;
+long epoch=enter_persistence_lookup();
+PersistentStructure* e=find_by_name(get_current_table(),get_persistent_name(filename));
+if (e!=NULL) {
+    SyncAtomicIncrement(&(e->users));
+    if (SyncAtomicCompareExchange(&(e->removed),1,1)==1) {
+        /* The structure has been removed in the meantime */
+        if (release_entry(e)==1) to_free=e;
+    } else {
+        ptr=e->ptr;
+    }
+}
+leave_persistence_lookup(epoch);
+if (to_free!=NULL) {
+    free_entry(to_free);
+}
+return ptr;
+}
+
+
+/**
+ * Releases a pointer obtained with acquire_persistent_structure. Returns 1
+ * if the given pointer is a persistent one, which means that the caller
+ * must not free it; 0 otherwise. Each call must match exactly one
+ * acquisition.
+ */
+int release_persistent_structure(void* ptr) {
+PersistentStructure* to_free=NULL;
+int released=0;
+long epoch=enter_persistence_lookup();
+PersistentStructure* e=find_by_ptr(get_current_table(),ptr);
+if (e!=NULL) {
+    released=release_entry(e);
+    if (released==1) to_free=e;
+}
+leave_persistence_lookup(epoch);
+if (released==-1) {
+    /* Going on could let the structure be freed while a user still holds it */
+    fatal_error("release_persistent_structure: %p was released more times than acquired\n",ptr);
+}
+if (to_free!=NULL) {
+    free_entry(to_free);
+}
+return e!=NULL;
+}
+
+
+/**
+ * Associates the given pointer to the given file name, unless a pointer is
+ * already associated to it. In that case, nothing is changed and the
+ * existing pointer is returned, so that the caller can free its own copy;
+ * NULL is returned otherwise.
+ * If ptr is NULL, then the pointer associated to the file name is removed
+ * from the registry without being freed, and returned to the caller; use
+ * remove_persistent_structure to free it safely.
+ */
+void* set_persistent_structure(const char* filename,void* ptr) {
+filename=get_persistent_name(filename);
+void* res=NULL;
 SyncGetMutex(Persistence_Mutex);
-int res=0;
-PersistentStructure* tmp=list;
-while (tmp!=NULL) {
-    if (tmp->ptr==ptr) {
-        res=1;
-        break;
+PersistentStructure* old=find_by_name(current_table,filename);
+if (old!=NULL) {
+    res=old->ptr;
+    if (ptr==NULL) {
+        remove_entry(old,NULL);
     }
-    tmp=tmp->next;
+} else if (ptr!=NULL) {
+    PersistentStructure* tmp=(PersistentStructure*)malloc(sizeof(PersistentStructure));
+    if (tmp==NULL) {
+        fatal_alloc_error("set_persistent_structure");
+    }
+    tmp->name=strdup(filename);
+    if (tmp->name==NULL) {
+        fatal_alloc_error("set_persistent_structure");
+    }
+    tmp->hash=hash_persistent_name(tmp->name);
+    tmp->ptr=ptr;
+    tmp->users=0;
+    tmp->removed=0;
+    tmp->freed=0;
+    tmp->free_func=NULL;
+    tmp->unregistered=0;
+    tmp->next=NULL;
+    PersistentTable* t=reserve_table_slot();
+    t->used_by_ptr+=insert_slot(t->by_ptr,t->mask,hash_persistent_ptr(ptr),tmp);
+    t->used_by_name+=insert_slot(t->by_name,t->mask,tmp->hash,tmp);
+}
+reclaim_retired();
+SyncReleaseMutex(Persistence_Mutex);
+return res;
+}
+
+
+/**
+ * Removes the pointer associated to the given file name, so that it cannot
+ * be acquired anymore, and frees it with 'free_func' as soon as all its
+ * users have released it.
+ */
+void remove_persistent_structure(const char* filename,t_free_persistent_structure free_func) {
+filename=get_persistent_name(filename);
+void* ptr=NULL;
+int must_free=0;
+SyncGetMutex(Persistence_Mutex);
+PersistentStructure* e=find_by_name(current_table,filename);
+if (e!=NULL) {
+    ptr=e->ptr;
+    must_free=remove_entry(e,free_func);
 }
+reclaim_retired();
 SyncReleaseMutex(Persistence_Mutex);
+if (must_free && free_func!=NULL) {
+    (*free_func)(ptr);
+}
+}
+
+
+/**
+ * Returns 1 if the given pointer is a persistent one; 0 otherwise.
+ */
+int is_persistent_structure(void* ptr) {
+long epoch=enter_persistence_lookup();
+int res=(find_by_ptr(get_current_table(),ptr)!=NULL);
+leave_persistence_lookup(epoch);
 return res;
 }
 
@@ -162,4 +568,70 @@ int is_persistent_filename(const char* filename) {
 	return (get_persistent_structure(filename) != NULL);
 }
 
+
+
+/**
+ * Sets the directory where load_persistent_XXX functions store mappable
+ * images of the resources they load, and load them from. All the processes
+ * that use the same directory map the same files, so that the system keeps
+ * a single copy of their pages. NULL or "" disables this cache. This must be
+ * called before the resources are loaded.
+ */
+void set_persistence_cache_directory(const char* dir) {
+SyncGetMutex(Persistence_Mutex);
+if (dir==NULL || dir[0]=='\0' || strlen(dir)>=FILENAME_MAX-64) {
+    cache_directory[0]='\0';
+} else {
+    strcpy(cache_directory,dir);
+    add_path_separator(cache_directory);
+}
+SyncReleaseMutex(Persistence_Mutex);
+}
+
+
+/**
+ * Builds in 'result' the name of the cache file of the given resource,
+ * made of its base name, a hash of its full name and the given extension.
+ * Returns 0 if there is no cache directory; 1 otherwise.
+ */
+int get_persistence_cache_filename(const char* filename,const char* extension,char* result) {
+if (cache_directory[0]=='\0') return 0;
+filename=get_persistent_name(filename);
+char name[FILENAME_MAX];
+char base[FILENAME_MAX];
+remove_path(filename,name);
+remove_extension(name,base);
+if (strlen(cache_directory)+strlen(base)+strlen(extension)+10>=FILENAME_MAX) return 0;
+sprintf(result,"%s%s-%08x%s",cache_directory,base,hash_persistent_name(filename),extension);
+return 1;
+}
+
+
+/**
+ * Makes sure that 'cache' is not older than 'source', rebuilding it with
+ * 'build' if needed. The file is built under a temporary name and then
+ * renamed, so that other processes never map a partial file. Returns 1 if
+ * 'cache' can be used; 0 otherwise.
+ */
+int update_persistence_cache_file(const char* source,const char* cache,t_build_persistence_cache_file build) {
+if (!fexists(source)) return 0;
+if (fexists(cache) && get_file_date(cache)>=get_file_date(source)) {
+    return 1;
+}
+char tmp[FILENAME_MAX+64];
+unsigned long id=(unsigned long)SyncAtomicIncrement(&cache_file_counter);
+id=id^((unsigned long)time(NULL)<<8)^(unsigned long)(size_t)&id^(unsigned long)clock();
+sprintf(tmp,"%s.%lx.tmp",cache,id);
+if (!(*build)(source,tmp)) {
+    af_remove(tmp);
+    return 0;
+}
+if (af_rename(tmp,cache)!=0) {
+    /* Another process may have renamed its own copy first */
+    af_remove(tmp);
+    return fexists(cache);
+}
+return 1;
+}
+
 } // namespace unitex
@@ -35,13 +35,32 @@ namespace unitex {
  *
  * NOTE: persistence features are not activated if Unitex is not built
  *       as a library (either normal or JNI)
+ *
+ * Lookups do not take any lock. A structure obtained with
+ * acquire_persistent_structure must be given back with
+ * release_persistent_structure; remove_persistent_structure waits for
+ * this before freeing it.
+ *
+ * When a cache directory is set, resources are loaded from mappable images
+ * stored in it, so that several processes can share them.
  */
 
+typedef void (*t_free_persistent_structure)(void* ptr);
+
 void* get_persistent_structure(const char* filename);
-void set_persistent_structure(const char* filename,void* ptr);
+void* acquire_persistent_structure(const char* filename);
+int release_persistent_structure(void* ptr);
+void* set_persistent_structure(const char* filename,void* ptr);
+void remove_persistent_structure(const char* filename,t_free_persistent_structure free_func);
 int is_persistent_structure(void* ptr);
 int is_persistent_filename(const char* filename);
 
+typedef int (*t_build_persistence_cache_file)(const char* source,const char* dest);
+
+void set_persistence_cache_directory(const char* dir);
+int get_persistence_cache_filename(const char* filename,const char* extension,char* result);
+int update_persistence_cache_file(const char* source,const char* cache,t_build_persistence_cache_file build);
+
 } // namespace unitex
 
 #endif
@@ -27,6 +27,7 @@
 #include "AbstractDelaLoad.h"
 #include "AbstractFst2Load.h"
 #include "Alphabet.h"
+#include "Persistence.h"
 
 #include "PersistenceInterface.h"
 #include "Error.h"
@@ -81,6 +82,11 @@ void standard_unload_persistence_alphabet(const char*filename)
 
 #endif
 
+UNITEX_FUNC void UNITEX_CALL persistence_public_set_cache_directory(const char*dir)
+{
+    set_persistence_cache_directory(dir);
+}
+
 UNITEX_FUNC int UNITEX_CALL persistence_public_load_dictionary(const char*filename,char* persistent_filename_buffer,size_t buffer_size)
 {
     return standard_load_persistence_dictionary(filename, persistent_filename_buffer, buffer_size);
@@ -71,6 +71,16 @@ void standard_unload_persistence_alphabet(const char*filename);
         persistence_public_unload_fst2(PersistedFileName);
    */
 
+/* persistence_public_set_cache_directory : when dir is not NULL, the
+   persistence_public_load_XXX functions build (once) mappable images of
+   the .inf part of dictionaries and of fst2 in this directory, and map them
+   instead of reading the resources in private memory. .bin files are always
+   mapped. Several processes (for instance several JNI workers) that use the
+   same directory then share the same physical pages for these resources.
+   NULL disables it. Call it before loading the resources.
+*/
+UNITEX_FUNC void UNITEX_CALL persistence_public_set_cache_directory(const char*dir);
+
 UNITEX_FUNC int UNITEX_CALL persistence_public_load_dictionary(const char*filename,char* persistent_filename_buffer,size_t buffer_size);
 UNITEX_FUNC void UNITEX_CALL persistence_public_unload_dictionary(const char*filename);
 
@@ -30,6 +30,7 @@
 #include "SortTxt.h"
 #include "ProgramInvoker.h"
 #include "DELA.h"
+#include "logger/SyncLogger.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -43,6 +44,10 @@ namespace unitex {
 /* Maximum length of a line in the text file to be sorted */
 #define LINE_LENGTH 10000
 
+/* Default number of megabytes of lines kept in memory when sorting with
+ * several threads */
+#define DEFAULT_SORT_MEMORY 1024
+
 /**
  * This structure defines a list of couples (string,int). The integer
  * represents the number of occurrences of the string, so that the list
@@ -120,6 +125,7 @@ struct sort_infos {
 
 void sort(struct sort_infos*);
 void sort_thai(struct sort_infos*);
+static void sort_in_external_memory(struct sort_infos*, const char*, size_t, int);
 int read_line(struct sort_infos* inf);
 int read_line_thai(struct sort_infos* inf);
 void save(struct sort_infos* inf);
@@ -224,6 +230,11 @@ const char* usage_SortTxt =
         "  -t/--thai: sorts thai text\n"
         "  -f/--factorize_inflectional_codes: makes two entries XXX,YYY.ZZZ:A and XXX,YYY.ZZZ:B\n"
         "                                   become a single entry XXX,YYY.ZZZ:A:B\n"
+        "  -m N/--memory=N: sorts with at most about N megabytes of lines in memory. Sorted\n"
+        "                   runs are saved in temporary files and merged at the end, so that\n"
+        "                   files larger than the memory can be sorted\n"
+        "  -j N/--threads=N: sorts the lines in memory with N threads (default: 1). This\n"
+        "                    option and -m are ignored with -t\n"
         "  -V/--only-verify-arguments: only verify arguments syntax and exit\n"
         "  -h/--help: this help\n"
         "\n"
@@ -284,7 +295,7 @@ int pseudo_main_SortTxt(const VersatileEncodingConfig* vec, int duplicates,
   return ret;
 }
 
-const char* optstring_SortTxt = ":ndr:o:l:tfVhk:q:";
+const char* optstring_SortTxt = ":ndr:o:l:tfm:j:Vhk:q:";
 const struct option_TS lopts_SortTxt[] = {
   { "no_duplicates", no_argument_TS, NULL, 'n' },
   { "duplicates", no_argument_TS, NULL, 'd' },
@@ -293,6 +304,8 @@ const struct option_TS lopts_SortTxt[] = {
   { "line_info", required_argument_TS, NULL, 'l' },
   { "thai", no_argument_TS, NULL, 't' },
   { "factorize_inflectional_codes", no_argument_TS, NULL, 'f' },
+  { "memory", required_argument_TS, NULL, 'm' },
+  { "threads", required_argument_TS, NULL, 'j' },
   { "input_encoding", required_argument_TS, NULL, 'k' },
   { "output_encoding", required_argument_TS, NULL, 'q' },
   { "only_verify_arguments",no_argument_TS,NULL,'V'},
@@ -311,6 +324,9 @@ int main_SortTxt(int argc, char* const argv[]) {
   }
 
   int mode = DEFAULT;
+  int memory = 0;
+  int n_threads = 1;
+  char foo;
   char line_info[FILENAME_MAX] = "";
   char sort_order[FILENAME_MAX] = "";
   VersatileEncodingConfig vec = { DEFAULT_MASK_ENCODING_COMPATIBILITY_INPUT,
@@ -352,6 +368,20 @@ int main_SortTxt(int argc, char* const argv[]) {
     case 'f':
       inf->factorize_inflectional_codes = 1;
       break;
+    case 'm':
+      if (1 != sscanf(options.vars()->optarg, "%d%c", &memory, &foo) || memory <= 0) {
+        error("Invalid memory size: %s\n", options.vars()->optarg);
+        free_sort_infos(inf);
+        return USAGE_ERROR_CODE;
+      }
+      break;
+    case 'j':
+      if (1 != sscanf(options.vars()->optarg, "%d%c", &n_threads, &foo) || n_threads <= 0) {
+        error("Invalid number of threads: %s\n", options.vars()->optarg);
+        free_sort_infos(inf);
+        return USAGE_ERROR_CODE;
+      }
+      break;
     case 'V': only_verify_arguments = true;
       break;
     case 'h':
@@ -427,7 +457,12 @@ int main_SortTxt(int argc, char* const argv[]) {
 
   switch (mode) {
   case DEFAULT:
-    sort(inf);
+    if (memory > 0 || n_threads > 1) {
+      size_t memory_size = (size_t) ((memory > 0) ? memory : DEFAULT_SORT_MEMORY) * 1024 * 1024;
+      sort_in_external_memory(inf, new_name, memory_size, n_threads);
+    } else {
+      sort(inf);
+    }
     break;
   case THAI:
     sort_thai(inf);
@@ -513,11 +548,12 @@ void sort_thai(struct sort_infos* inf) {
 }
 
 /**
- * Reads and processes a line of the text file.
+ * Reads a line of the text file into 'line', that must be able to hold
+ * LINE_LENGTH+1 characters. '*length' is set to the length of the line, or
+ * to 0 if the line must be ignored, either because it is empty or too long.
  * Returns 0 if the end of file has been reached; 1 otherwise.
  */
-int read_line(struct sort_infos* inf) {
-  unichar line[LINE_LENGTH];
+static int get_line(struct sort_infos* inf, unichar* line, int* length) {
   int c;
   int ret = 1;
   int i = 0;
@@ -529,19 +565,42 @@ int read_line(struct sort_infos* inf) {
     ret = 0;
   else
     (inf->number_of_lines)++;
-  if (i == 0) {
-    /* We ignore the empty line */
-    return ret;
-  }
+  *length = i;
   if (i == LINE_LENGTH) {
     /* Too long lines are not taken into account */
     error("Line %d: line too long\n", inf->number_of_lines);
+    *length = 0;
+  }
+  return ret;
+}
+
+/**
+ * Reads and processes a line of the text file.
+ * Returns 0 if the end of file has been reached; 1 otherwise.
+ */
+int read_line(struct sort_infos* inf) {
+  unichar line[LINE_LENGTH + 1];
+  int length;
+  int ret = get_line(inf, line, &length);
+  if (length == 0) {
+    /* We ignore empty and too long lines */
     return ret;
   }
   get_node(line, 0, inf->root, inf);
   return ret;
 }
 
+/**
+ * Prints the \n that the last printed line may still wait for when
+ * inflectional codes are factorized.
+ */
+static void end_output(struct sort_infos* inf, struct dela_entry* last) {
+  if (last != NULL && last != (struct dela_entry*)-1) {
+    u_fprintf(inf->f_out, "\n");
+    free_dela_entry(last);
+  }
+}
+
 /**
  * Saves the lines.
  */
@@ -550,9 +609,8 @@ void save(struct sort_infos* inf) {
   /* -1 means that no line at all was already printed */
   struct dela_entry* last = (struct dela_entry*)-1;
   int return_value = explore_node(inf->root, inf, &last);
-  if (return_value == SUCCESS_RETURN_CODE && last != NULL && last!=(struct dela_entry*)-1) {
-    u_fprintf(inf->f_out, "\n");
-    free_dela_entry(last);
+  if (return_value == SUCCESS_RETURN_CODE) {
+    end_output(inf, last);
   }
 }
 
@@ -727,13 +785,82 @@ return !u_strcmp(a->inflected,b->inflected)
 }
 
 
+/**
+ * Prints the line 's' that occurs 'n' times in the sorted output. '*last' is
+ * used to factorize inflectional codes; it is -1 if no line at all was
+ * already printed.
+ */
+static void output_line(unichar* s, int n, struct sort_infos* inf,
+    struct dela_entry* *last) {
+  int i;
+  if (inf->factorize_inflectional_codes) {
+    /* We look if the previously printed line, if any, did share
+     * the same information. If so, we just append the new inflectional codes.
+     * Otherwise, we print the new line.
+     *
+     * NOTE: in factorize mode, we always ignore duplicates */
+    int err;
+    struct dela_entry* entry = tokenize_DELAF_line(s,1,&err,0);
+    if (entry==NULL) {
+      /* We have a non DELAF entry line, like for instance a comment one */
+      if (*last!=NULL && *last!=(struct dela_entry*)-1) {
+        /* If there was at least one line already printed, then this line
+         * awaits for its \n */
+        u_fprintf(inf->f_out, "\n");
+      }
+      /* Then we print the line */
+      u_fprintf(inf->f_out, "%S\n",s);
+      /* And we reset *last */
+      if (*last==(struct dela_entry*)-1) {
+        *last=NULL;
+      } else if (*last!=NULL) {
+        free_dela_entry(*last);
+        *last=NULL;
+      }
+    } else {
+      /* So, we have a dic entry. Was there a previous one ? */
+      if (*last==NULL || *last==(struct dela_entry*)-1) {
+        /* No ? So we print the line, and the current entry becomes *last */
+        u_fputs(s, inf->f_out);
+        *last=entry;
+      } else {
+        /* Yes ? We must compare if the codes are compatible */
+        if (are_compatible(*last,entry)) {
+          /* We look for any code of entry if it was already in *last */
+          for (int j=0;j<entry->n_inflectional_codes;j++) {
+            if (!dic_entry_contain_inflectional_code(*last,entry->inflectional_codes[j])) {
+              u_fprintf(inf->f_out, ":%S",entry->inflectional_codes[j]);
+              /* We also have to add the newly printed code to *last */
+              (*last)->inflectional_codes[((*last)->n_inflectional_codes)++]=u_strdup(entry->inflectional_codes[j]);
+            }
+          }
+          /* And we must free entry */
+          free_dela_entry(entry);
+        } else {
+          /* If codes are not compatible, we print the \n for the previous
+           * line, then the current line that becomes *last */
+          u_fprintf(inf->f_out, "\n%S",s);
+          free_dela_entry(*last);
+          *last=entry;
+        }
+      }
+    }
+  } else {
+    /* Normal way: we print each line one after the other */
+    for (i = 0; i < n; i++) {
+      u_fprintf(inf->f_out, "%S\n", s);
+      (inf->resulting_line_number)++;
+    }
+  }
+}
+
 /**
  * Explores the node n, dumps the corresponding lines to the output file,
  * and then frees the node. 'pos' is the current position in the string 's'.
  */
 int explore_node(struct sort_tree_node* n, struct sort_infos* inf,
     struct dela_entry* *last) {
-  int i, N;
+  int N;
   struct sort_tree_transition* t = NULL;
   struct couple* couple = NULL;
   struct couple* tmp    = NULL;
@@ -745,65 +872,7 @@ int explore_node(struct sort_tree_node* n, struct sort_infos* inf,
     /* If the node is a final one, we print the corresponding lines */
     couple = n->couples;
     while (couple != NULL) {
-      if (inf->factorize_inflectional_codes) {
-        /* We look if the previously printed line, if any, did share
-         * the same information. If so, we just append the new inflectional codes.
-         * Otherwise, we print the new line.
-         *
-         * NOTE: in factorize mode, we always ignore duplicates */
-        int err;
-        struct dela_entry* entry = tokenize_DELAF_line(couple->s,1,&err,0);
-        if (entry==NULL) {
-          /* We have a non DELAF entry line, like for instance a comment one */
-          if (*last!=NULL && *last!=(struct dela_entry*)-1) {
-            /* If there was at least one line already printed, then this line
-             * awaits for its \n */
-            u_fprintf(inf->f_out, "\n");
-          }
-          /* Then we print the line */
-          u_fprintf(inf->f_out, "%S\n",couple->s);
-          /* And we reset *last */
-          if (*last==(struct dela_entry*)-1) {
-            *last=NULL;
-          } else if (*last!=NULL) {
-            free_dela_entry(*last);
-            *last=NULL;
-          }
-        } else {
-          /* So, we have a dic entry. Was there a previous one ? */
-          if (*last==NULL || *last==(struct dela_entry*)-1) {
-            /* No ? So we print the line, and the current entry becomes *last */
-            u_fputs(couple->s, inf->f_out);
-            *last=entry;
-          } else {
-            /* Yes ? We must compare if the codes are compatible */
-            if (are_compatible(*last,entry)) {
-              /* We look for any code of entry if it was already in *last */
-              for (int j=0;j<entry->n_inflectional_codes;j++) {
-                if (!dic_entry_contain_inflectional_code(*last,entry->inflectional_codes[j])) {
-                  u_fprintf(inf->f_out, ":%S",entry->inflectional_codes[j]);
-                  /* We also have to add the newly printed code to *last */
-                  (*last)->inflectional_codes[((*last)->n_inflectional_codes)++]=u_strdup(entry->inflectional_codes[j]);
-                }
-              }
-              /* And we must free entry */
-              free_dela_entry(entry);
-            } else {
-              /* If codes are not compatible, we print the \n for the previous
-               * line, then the current line that becomes *last */
-              u_fprintf(inf->f_out, "\n%S",couple->s);
-              free_dela_entry(*last);
-              *last=entry;
-            }
-          }
-        }
-      } else {
-        /* Normal way: we print each line one after the other */
-        for (i = 0; i < couple->n; i++) {
-          u_fprintf(inf->f_out, "%S\n", couple->s);
-          (inf->resulting_line_number)++;
-        }
-      }
+      output_line(couple->s, couple->n, inf, last);
       tmp = couple;
       couple = couple->next;
       free(tmp->s);
@@ -890,6 +959,364 @@ static void quicksort(struct sort_tree_transition** t, int m, int n,
 }
 
 
+/**
+ * Returns the character that labels the sort tree transition for c, i.e.
+ * the canonical character of its class if c is a letter.
+ */
+static inline unichar sort_key(unichar c, struct sort_infos* inf) {
+  return (inf->class_numbers[c] != 0) ? inf->canonical[c] : c;
+}
+
+/**
+ * Compares two lines according to the order in which the sort tree would
+ * print them: first by their sequences of character classes, a line being
+ * printed before the lines it is a prefix of, and then, for lines with the
+ * same classes, like insert_string does. Returns 0 if a and b are equal.
+ */
+static int line_cmp(const unichar* a, const unichar* b, struct sort_infos* inf) {
+  int i = 0;
+  while (a[i] != '\0' && b[i] != '\0') {
+    unichar key_a = sort_key(a[i], inf);
+    unichar key_b = sort_key(b[i], inf);
+    if (key_a != key_b) {
+      return char_cmp(key_a, key_b, inf);
+    }
+    i++;
+  }
+  if (a[i] != '\0') {
+    return 1;
+  }
+  if (b[i] != '\0') {
+    return -1;
+  }
+  return inf->REVERSE * strcmp2((unichar*)a, (unichar*)b, inf);
+}
+
+/**
+ * Sorts the n lines of t with line_cmp. 'tmp' must be able to hold n/2 lines.
+ */
+static void merge_sort_lines(unichar** t, unichar** tmp, int n,
+    struct sort_infos* inf) {
+  if (n < 2) {
+    return;
+  }
+  int middle = n / 2;
+  merge_sort_lines(t, tmp, middle, inf);
+  merge_sort_lines(t + middle, tmp, n - middle, inf);
+  if (line_cmp(t[middle - 1], t[middle], inf) <= 0) {
+    /* Both halves are already in order */
+    return;
+  }
+  memcpy(tmp, t, middle * sizeof(unichar*));
+  int i = 0, j = middle, k = 0;
+  while (i < middle && j < n) {
+    if (line_cmp(tmp[i], t[j], inf) <= 0) {
+      t[k++] = tmp[i++];
+    } else {
+      t[k++] = t[j++];
+    }
+  }
+  while (i < middle) {
+    t[k++] = tmp[i++];
+  }
+}
+
+/**
+ * A sorted sequence of lines to be merged with others: either a sorted slice
+ * of the lines in memory, or a run file previously saved on disk. A run file
+ * is a sequence of records (number of occurrences, length, characters).
+ */
+struct sorted_lines {
+  unichar** lines;
+  int n_lines;
+  int pos;
+  U_FILE* f;
+  unichar buffer[LINE_LENGTH + 1];
+  /* The current line, or NULL if there is no more line */
+  unichar* current;
+  int n;
+};
+
+/**
+ * Moves to the next line of the given sequence.
+ */
+static void next_sorted_line(struct sorted_lines* s) {
+  if (s->f == NULL) {
+    if (s->pos < s->n_lines) {
+      s->current = s->lines[(s->pos)++];
+      s->n = 1;
+    } else {
+      s->current = NULL;
+    }
+    return;
+  }
+  int header[2];
+  if (2 != fread(header, sizeof(int), 2, s->f) || header[1] > LINE_LENGTH
+      || header[1] != (int)fread(s->buffer, sizeof(unichar), header[1], s->f)) {
+    s->current = NULL;
+    return;
+  }
+  s->buffer[header[1]] = '\0';
+  s->n = header[0];
+  s->current = s->buffer;
+}
+
+/**
+ * This structure describes the work of a SortTxt thread: sorting a slice of
+ * the lines in memory.
+ */
+struct sort_lines_slice {
+  unichar** lines;
+  unichar** tmp;
+  int n;
+  struct sort_infos* inf;
+};
+
+static void ABSTRACT_CALLBACK_UNITEX sort_lines_thread(void* private_data,
+    unsigned int /* thread_number */) {
+  struct sort_lines_slice* slice = (struct sort_lines_slice*) private_data;
+  merge_sort_lines(slice->lines, slice->tmp, slice->n, slice->inf);
+}
+
+/**
+ * Cuts the n lines into at most n_threads slices, sorts them in parallel and
+ * initializes 'sequences' with them. Returns the number of slices.
+ */
+static int sort_lines_in_slices(unichar** lines, unichar** tmp, int n,
+    int n_threads, struct sort_infos* inf, struct sorted_lines* sequences) {
+  int n_slices = (n < n_threads) ? n : n_threads;
+  if (n_slices == 0) {
+    return 0;
+  }
+  struct sort_lines_slice* slices = (struct sort_lines_slice*) malloc(
+      n_slices * sizeof(struct sort_lines_slice));
+  void** slices_ptr = (void**) malloc(n_slices * sizeof(void*));
+  if (slices == NULL || slices_ptr == NULL) {
+    fatal_alloc_error("sort_lines_in_slices");
+  }
+  for (int i = 0; i < n_slices; i++) {
+    int start = (int) ((long long) n * i / n_slices);
+    int end = (int) ((long long) n * (i + 1) / n_slices);
+    slices[i].lines = lines + start;
+    slices[i].tmp = tmp + start;
+    slices[i].n = end - start;
+    slices[i].inf = inf;
+    slices_ptr[i] = &(slices[i]);
+    sequences[i].lines = lines + start;
+    sequences[i].n_lines = end - start;
+    sequences[i].pos = 0;
+    sequences[i].f = NULL;
+  }
+  if (n_slices == 1) {
+    sort_lines_thread(slices_ptr[0], 0);
+  } else {
+    logger::SyncDoRunThreads((unsigned int) n_slices, sort_lines_thread, slices_ptr);
+  }
+  free(slices_ptr);
+  free(slices);
+  return n_slices;
+}
+
+/**
+ * Restores the heap property below position i in the heap of sequences,
+ * ordered by their current lines.
+ */
+static void sift_down_sorted_lines(struct sorted_lines** heap, int size,
+    int i, struct sort_infos* inf) {
+  for (;;) {
+    int smallest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < size && line_cmp(heap[left]->current, heap[smallest]->current, inf) < 0) {
+      smallest = left;
+    }
+    if (right < size && line_cmp(heap[right]->current, heap[smallest]->current, inf) < 0) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      return;
+    }
+    struct sorted_lines* tmp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+/**
+ * Writes a line that occurs n times, either as a record in a run file or,
+ * if 'run' is NULL, in the sorted output.
+ */
+static void save_merged_line(unichar* s, int n, U_FILE* run,
+    struct sort_infos* inf, struct dela_entry* *last) {
+  if (run == NULL) {
+    output_line(s, n, inf, last);
+    return;
+  }
+  int header[2];
+  header[0] = n;
+  header[1] = u_strlen(s);
+  fwrite(header, sizeof(int), 2, run);
+  fwrite(s, sizeof(unichar), header[1], run);
+}
+
+/**
+ * Merges the k sorted sequences, merging equal lines, and saves the result
+ * either in the run file 'run' or, if 'run' is NULL, in the sorted output.
+ */
+static void merge_sorted_lines(struct sorted_lines* sequences, int k,
+    U_FILE* run, struct sort_infos* inf, struct dela_entry* *last) {
+  struct sorted_lines** heap = (struct sorted_lines**) malloc(
+      (k + 1) * sizeof(struct sorted_lines*));
+  unichar* pending = (unichar*) malloc((LINE_LENGTH + 1) * sizeof(unichar));
+  if (heap == NULL || pending == NULL) {
+    fatal_alloc_error("merge_sorted_lines");
+  }
+  int size = 0;
+  for (int i = 0; i < k; i++) {
+    next_sorted_line(&(sequences[i]));
+    if (sequences[i].current != NULL) {
+      heap[size++] = &(sequences[i]);
+    }
+  }
+  for (int i = size / 2 - 1; i >= 0; i--) {
+    sift_down_sorted_lines(heap, size, i, inf);
+  }
+  int n_pending = 0;
+  while (size > 0) {
+    struct sorted_lines* s = heap[0];
+    if (n_pending != 0 && !line_cmp(pending, s->current, inf)) {
+      if (!inf->REMOVE_DUPLICATES) {
+        n_pending += s->n;
+      }
+    } else {
+      if (n_pending != 0) {
+        save_merged_line(pending, n_pending, run, inf, last);
+      }
+      u_strcpy(pending, s->current);
+      n_pending = s->n;
+    }
+    next_sorted_line(s);
+    if (s->current == NULL) {
+      heap[0] = heap[--size];
+    }
+    sift_down_sorted_lines(heap, size, 0, inf);
+  }
+  if (n_pending != 0) {
+    save_merged_line(pending, n_pending, run, inf, last);
+  }
+  free(pending);
+  free(heap);
+}
+
+/**
+ * Sorts the lines in memory and saves them as the run file #n.
+ */
+static void save_sorted_run(unichar** lines, unichar** tmp, int n_lines,
+    const char* run_prefix, int n, int n_threads, struct sort_infos* inf,
+    struct sorted_lines* sequences) {
+  char name[FILENAME_MAX];
+  sprintf(name, "%s.run%d", run_prefix, n);
+  U_FILE* run = u_fopen(BINARY, name, U_WRITE);
+  if (run == NULL) {
+    fatal_error("Cannot create temporary file %s\n", name);
+  }
+  int k = sort_lines_in_slices(lines, tmp, n_lines, n_threads, inf, sequences);
+  merge_sorted_lines(sequences, k, run, inf, NULL);
+  u_fclose(run);
+}
+
+/**
+ * Sorts the text without the sort tree, keeping at most about 'memory' bytes
+ * of lines in memory. Lines are loaded until this limit is reached, then they
+ * are sorted by n_threads threads and saved as a sorted run in a temporary
+ * file named 'run_prefix'.runN. Finally, all the runs are merged into the
+ * output file. If the whole text fits in memory, no run file is created.
+ * The output is the same as the one of 'sort'.
+ */
+static void sort_in_external_memory(struct sort_infos* inf,
+    const char* run_prefix, size_t memory, int n_threads) {
+  /* Half of the memory holds the characters, the other half the two arrays
+   * of pointers used to sort the lines */
+  size_t max_size = 0x3FFFFFFF;
+  int pool_size = (int) ((memory / 2 / sizeof(unichar) < max_size) ? memory / 2 / sizeof(unichar) : max_size);
+  int max_lines = (int) ((memory / 4 / sizeof(unichar*) < max_size) ? memory / 4 / sizeof(unichar*) : max_size);
+  if (pool_size < LINE_LENGTH + 1) {
+    pool_size = LINE_LENGTH + 1;
+  }
+  if (max_lines < 1) {
+    max_lines = 1;
+  }
+  unichar* pool = (unichar*) malloc(pool_size * sizeof(unichar));
+  unichar** lines = (unichar**) malloc(max_lines * sizeof(unichar*));
+  unichar** tmp = (unichar**) malloc(max_lines * sizeof(unichar*));
+  struct sorted_lines* sequences = (struct sorted_lines*) malloc(
+      n_threads * sizeof(struct sorted_lines));
+  if (pool == NULL || lines == NULL || tmp == NULL || sequences == NULL) {
+    fatal_alloc_error("sort_in_external_memory");
+  }
+  u_printf("Loading text...\n");
+  unichar line[LINE_LENGTH + 1];
+  int length;
+  int more;
+  int pool_used = 0;
+  int n_lines = 0;
+  int n_runs = 0;
+  do {
+    more = get_line(inf, line, &length);
+    if (length == 0) {
+      continue;
+    }
+    if (pool_used + length + 1 > pool_size || n_lines == max_lines) {
+      save_sorted_run(lines, tmp, n_lines, run_prefix, n_runs++, n_threads,
+          inf, sequences);
+      pool_used = 0;
+      n_lines = 0;
+    }
+    lines[n_lines++] = pool + pool_used;
+    u_strcpy(pool + pool_used, line);
+    pool_used += length + 1;
+  } while (more);
+  u_printf("%d lines read\n", inf->number_of_lines);
+  u_printf("Sorting and saving...\n");
+  /* -1 means that no line at all was already printed */
+  struct dela_entry* last = (struct dela_entry*) -1;
+  if (n_runs == 0) {
+    int k = sort_lines_in_slices(lines, tmp, n_lines, n_threads, inf, sequences);
+    merge_sorted_lines(sequences, k, NULL, inf, &last);
+  } else {
+    if (n_lines != 0) {
+      save_sorted_run(lines, tmp, n_lines, run_prefix, n_runs++, n_threads,
+          inf, sequences);
+    }
+    free(sequences);
+    sequences = (struct sorted_lines*) malloc(n_runs * sizeof(struct sorted_lines));
+    if (sequences == NULL) {
+      fatal_alloc_error("sort_in_external_memory");
+    }
+    u_printf("Merging %d runs...\n", n_runs);
+    char name[FILENAME_MAX];
+    for (int i = 0; i < n_runs; i++) {
+      sprintf(name, "%s.run%d", run_prefix, i);
+      sequences[i].f = u_fopen(BINARY, name, U_READ);
+      if (sequences[i].f == NULL) {
+        fatal_error("Cannot open temporary file %s\n", name);
+      }
+    }
+    merge_sorted_lines(sequences, n_runs, NULL, inf, &last);
+    for (int i = 0; i < n_runs; i++) {
+      u_fclose(sequences[i].f);
+      sprintf(name, "%s.run%d", run_prefix, i);
+      af_remove(name);
+    }
+  }
+  end_output(inf, last);
+  free(sequences);
+  free(tmp);
+  free(lines);
+  free(pool);
+}
+
 /**
  * Converts the string 'src' into a string with no diacritic sign and
  * in which initial vowels and following consons have been swapped.
@@ -66,6 +66,25 @@ UNITEX_FUNC void UNITEX_CALL SyncReleaseMutex(SYNC_Mutex_OBJECT pMut);
 UNITEX_FUNC void UNITEX_CALL SyncDeleteMutex(SYNC_Mutex_OBJECT pMut);
 
 
+/*
+ * Atomic operations. They are full memory barriers. SyncAtomicIncrement and
+ * SyncAtomicDecrement return the new value, SyncAtomicCompareExchange stores
+ * 'exchange' if '*value' is equal to 'comparand' and returns the previous value.
+ */
+UNITEX_FUNC long UNITEX_CALL SyncAtomicIncrement(volatile long* value);
+UNITEX_FUNC long UNITEX_CALL SyncAtomicDecrement(volatile long* value);
+UNITEX_FUNC long UNITEX_CALL SyncAtomicCompareExchange(volatile long* value,long exchange,long comparand);
+UNITEX_FUNC void* UNITEX_CALL SyncAtomicLoadPointer(void* volatile* ptr);
+UNITEX_FUNC void UNITEX_CALL SyncAtomicStorePointer(void* volatile* ptr,void* value);
+
+/*
+ * Lets the other threads run, while the current one waits for them.
+ */
+UNITEX_FUNC void UNITEX_CALL SyncYield();
+
+
+
+
 
 
 #ifdef __cplusplus
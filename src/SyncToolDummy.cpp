@@ -123,6 +123,43 @@ UNITEX_FUNC void UNITEX_CALL SyncDeleteMutex(SYNC_Mutex_OBJECT pMut)
 }
 
 
+/*
+Without thread support, atomic operations are plain ones
+*/
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicIncrement(volatile long* value)
+{
+    return ++(*value);
+}
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicDecrement(volatile long* value)
+{
+    return --(*value);
+}
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicCompareExchange(volatile long* value,long exchange,long comparand)
+{
+    long previous = *value;
+    if (previous == comparand)
+        *value = exchange;
+    return previous;
+}
+
+UNITEX_FUNC void* UNITEX_CALL SyncAtomicLoadPointer(void* volatile* ptr)
+{
+    return *ptr;
+}
+
+UNITEX_FUNC void UNITEX_CALL SyncAtomicStorePointer(void* volatile* ptr,void* value)
+{
+    *ptr = value;
+}
+
+UNITEX_FUNC void UNITEX_CALL SyncYield()
+{
+}
+
+
 
 
 
@@ -37,6 +37,7 @@
 
 #include <sys/time.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 
 
@@ -140,5 +141,44 @@ UNITEX_FUNC void UNITEX_CALL SyncDeleteMutex(SYNC_Mutex_OBJECT pMut)
 }
 
 
+/*
+Atomic operations, using the GCC builtins
+*/
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicIncrement(volatile long* value)
+{
+    return __sync_add_and_fetch(value,1);
+}
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicDecrement(volatile long* value)
+{
+    return __sync_sub_and_fetch(value,1);
+}
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicCompareExchange(volatile long* value,long exchange,long comparand)
+{
+    return __sync_val_compare_and_swap(value,comparand,exchange);
+}
+
+UNITEX_FUNC void* UNITEX_CALL SyncAtomicLoadPointer(void* volatile* ptr)
+{
+    void* value = *ptr;
+    __sync_synchronize();
+    return value;
+}
+
+UNITEX_FUNC void UNITEX_CALL SyncAtomicStorePointer(void* volatile* ptr,void* value)
+{
+    __sync_synchronize();
+    *ptr = value;
+    __sync_synchronize();
+}
+
+UNITEX_FUNC void UNITEX_CALL SyncYield()
+{
+    sched_yield();
+}
+
+
 
 } // namespace unitex
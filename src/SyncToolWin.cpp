@@ -189,6 +189,45 @@ UNITEX_FUNC void UNITEX_CALL SyncDeleteMutex(SYNC_Mutex_OBJECT pMut)
 }
 
 
+/* Atomic operations for Win32 API */
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicIncrement(volatile long* value)
+{
+    return InterlockedIncrement(value);
+}
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicDecrement(volatile long* value)
+{
+    return InterlockedDecrement(value);
+}
+
+UNITEX_FUNC long UNITEX_CALL SyncAtomicCompareExchange(volatile long* value,long exchange,long comparand)
+{
+    return InterlockedCompareExchange(value,exchange,comparand);
+}
+
+UNITEX_FUNC void* UNITEX_CALL SyncAtomicLoadPointer(void* volatile* ptr)
+{
+    void* value = *ptr;
+    MemoryBarrier();
+    return value;
+}
+
+UNITEX_FUNC void UNITEX_CALL SyncAtomicStorePointer(void* volatile* ptr,void* value)
+{
+    InterlockedExchangePointer(ptr,value);
+}
+
+UNITEX_FUNC void UNITEX_CALL SyncYield()
+{
+#ifdef UNITEX_USING_WINRT_API
+    YieldProcessor();
+#else
+    SwitchToThread();
+#endif
+}
+
+
 
 
 #endif
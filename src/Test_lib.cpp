@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "IOBuffer.h"
 #include "Unicode.h"
 #include "Reg2Grf.h"
@@ -43,6 +44,169 @@ using namespace unitex;
 using namespace logger;
 #endif
 
+
+static const char utf8_bom[] = { (char)0xEF, (char)0xBB, (char)0xBF };
+
+
+/**
+ * Reads the whole given file. The returned buffer must be freed.
+ */
+static char* read_test_file(const char* name, size_t* size) {
+UNITEXFILEMAPPED* umf = NULL;
+const void* buffer = NULL;
+*size = 0;
+GetUnitexFileReadBuffer(name, &umf, &buffer, size);
+if (umf == NULL) {
+    return NULL;
+}
+char* res = (char*)malloc(*size + 1);
+if (res != NULL) {
+    memcpy(res, buffer, *size);
+}
+CloseUnitexFileReadBuffer(umf, buffer, *size);
+return res;
+}
+
+
+/**
+ * Locates a grammar that produces 80 matches with long outputs from each
+ * token with the hashed cache and a memory limit of a few entries, so
+ * that entries are evicted while the matches of an origin are cached.
+ * Returns 0 if the concordance is the same as with the tree cache.
+ */
+static int check_locate_hash_cache() {
+const char* words[] = { "bako", "rimu", "tesa" };
+size_t size = 0;
+char* text = (char*)malloc(600 * 5 + 2);
+char* fst2 = (char*)malloc(1024 + 40 * 128);
+if (text == NULL || fst2 == NULL) {
+    free(text);
+    free(fst2);
+    return 1;
+}
+unsigned int seed = 1;
+for (int i = 0; i < 600; i++) {
+    seed = seed * 1103515245u + 12345u;
+    size += sprintf(text + size, "%s ", words[(seed >> 16) % 3]);
+}
+text[size - 1] = '\n';
+WriteUnitexFile("$:lc/text.snt", utf8_bom, sizeof(utf8_bom), text, size);
+const char* alphabet = "Aa\nBb\nCc\nDd\nEe\nFf\nGg\nHh\nIi\nJj\nKk\nLl\nMm\nNn\nOo\nPp\nQq\nRr\nSs\nTt\nUu\nVv\nWw\nXx\nYy\nZz\n";
+WriteUnitexFile("$:lc/Alphabet.txt", utf8_bom, sizeof(utf8_bom), alphabet, strlen(alphabet));
+/* The initial state goes to the final state 1 with <MOT>/o0xx..., <MOT>/o1xx...,
+ * etc., and then to the final state 2 with <MOT> */
+size = sprintf(fst2, "0000000001\n-1 main\n:");
+for (int i = 1; i <= 40; i++) {
+    size += sprintf(fst2 + size, " %d 1", i);
+}
+size += sprintf(fst2 + size, " \nt 41 2 \nt \nf \n%%<E>\n");
+for (int i = 0; i < 40; i++) {
+    size += sprintf(fst2 + size, "%%<MOT>/o%d", i);
+    for (int j = 0; j < 100; j++) {
+        fst2[size++] = 'x';
+    }
+    fst2[size++] = '\n';
+}
+size += sprintf(fst2 + size, "%%<MOT>\nf\n");
+WriteUnitexFile("$:lc/g.fst2", utf8_bom, sizeof(utf8_bom), fst2, size);
+free(text);
+free(fst2);
+/* Locate needs a real extension directory with an init.upp file */
+CreateUnitexFolder("lc_elg");
+WriteUnitexFile("lc_elg/init.upp", NULL, 0, "", 0);
+
+int ret = UnitexTool_public_run_string("UnitexTool Tokenize $:lc/text.snt -a$:lc/Alphabet.txt -qutf8-no-bom");
+ret |= UnitexTool_public_run_string("UnitexTool Locate -t$:lc/text.snt -a$:lc/Alphabet.txt -A -R -b -Elc_elg "
+                                    "--locate_cache=tree $:lc/g.fst2 -qutf8-no-bom");
+size_t tree_size = 0;
+char* tree = read_test_file("$:lc/text_snt/concord.ind", &tree_size);
+ret |= UnitexTool_public_run_string("UnitexTool Locate -t$:lc/text.snt -a$:lc/Alphabet.txt -A -R -b -Elc_elg "
+                                    "--locate_cache=hash --locate_cache_size=60k $:lc/g.fst2 -qutf8-no-bom");
+size_t hash_size = 0;
+char* hash = read_test_file("$:lc/text_snt/concord.ind", &hash_size);
+if (ret != 0 || tree == NULL || hash == NULL || tree_size != hash_size || memcmp(tree, hash, tree_size)) {
+    ret = 1;
+}
+free(tree);
+free(hash);
+RemoveUnitexFolder("$:lc");
+RemoveUnitexFolder("lc_elg");
+return ret;
+}
+
+/**
+ * Reads the given UTF8 file with u_fget_unichars_raw, 'chunk' characters
+ * at a time, into 'dest'. Returns the number of characters read.
+ */
+static int read_utf8_in_blocks(const char* name, unichar* dest, int capacity, int chunk) {
+VersatileEncodingConfig vec = VEC_DEFAULT;
+vec.mask_encoding_compatibility_input = UTF8_NO_BOM_POSSIBLE;
+U_FILE* f = u_fopen(&vec, name, U_READ);
+if (f == NULL) {
+    return -1;
+}
+int n = 0;
+while (n < capacity) {
+    int wanted = (capacity - n < chunk) ? capacity - n : chunk;
+    int read = u_fget_unichars_raw(dest + n, wanted, f);
+    if (read == EOF || read == 0) {
+        break;
+    }
+    n += read;
+}
+u_fclose(f);
+return n;
+}
+
+
+/**
+ * Reads a UTF8 file made of malformed sequences with the block decoder of
+ * u_fget_unichars_raw and checks that each bad first byte, bad continuation
+ * byte and incomplete final sequence is handled exactly as u_fgetc_raw does.
+ * Returns 0 if both readers give the same characters.
+ */
+static int check_utf8_block_decoding() {
+const unsigned char bytes[] = {
+    'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j',
+    0xC3, 0xA9,                     /* e acute */
+    0x80,                           /* continuation byte in first position */
+    0xE9, 't', 0xE9, ' ',           /* latin-1 text: bad byte 2 of a 3 byte sequence */
+    0xE2, 0x82, 'x',                /* bad byte 3 of a 3 byte sequence */
+    0xF0, 0x9F, 0x98, 0x80,         /* character above 0xFFFF */
+    0xF8, 0x88, 0x80, 0x80, 0x80,   /* 5 byte sequence */
+    0xFF,                           /* invalid first byte */
+    'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's',
+    0xE2, 0x82                      /* incomplete sequence at the end of file */
+};
+WriteUnitexFile("$:lc/utf8.txt", NULL, 0, bytes, sizeof(bytes));
+unichar expected[sizeof(bytes)];
+int n_expected = 0;
+VersatileEncodingConfig vec = VEC_DEFAULT;
+vec.mask_encoding_compatibility_input = UTF8_NO_BOM_POSSIBLE;
+U_FILE* f = u_fopen(&vec, "$:lc/utf8.txt", U_READ);
+if (f == NULL) {
+    RemoveUnitexFolder("$:lc");
+    return 1;
+}
+int c;
+while ((c = u_fgetc_raw(f)) != EOF) {
+    expected[n_expected++] = (unichar)c;
+}
+u_fclose(f);
+int ret = 0;
+/* Small chunks make sequences straddle two calls */
+const int chunks[] = { (int)sizeof(bytes), 3, 1 };
+for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+    unichar got[sizeof(bytes)];
+    int n = read_utf8_in_blocks("$:lc/utf8.txt", got, (int)sizeof(bytes), chunks[i]);
+    if (n != n_expected || memcmp(got, expected, n * sizeof(unichar))) {
+        ret = 1;
+    }
+}
+RemoveUnitexFolder("$:lc");
+return ret;
+}
+
 /**
  * This program is an example of compilation using the unitex library (unitex.dll/libunitex.so).
  * It prints the .grf file corresponding to "a+(b.c)".
@@ -126,6 +290,22 @@ if (CheckRegexLibInUnitex()) {
 }
 
 
+if (check_locate_hash_cache() == 0) {
+    puts("Locate hash cache is consistent with the tree cache.");
+} else {
+    puts("Locate hash cache is NOT consistent with the tree cache.");
+    retValue = 1;
+}
+
+
+if (check_utf8_block_decoding() == 0) {
+    puts("UTF8 block decoding is consistent with u_fgetc.");
+} else {
+    puts("UTF8 block decoding is NOT consistent with u_fgetc.");
+    retValue = 1;
+}
+
+
 const char* name="biniou";
 const char* content = "a+(b.c)";
 // write UTF8 file with BOM
@@ -32,6 +32,7 @@
 #include "File.h"
 #include "MappedFileHelper.h"
 #include "DebugMode.h"
+#include "base/compiler/intrinsics.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -88,17 +89,90 @@ static long CalcPerfHalfHundred(long text_size, long matching_units) {
  */
 void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
         struct locate_parameters* p) {
+    unsigned long total_count_step = launch_locate_on_range(out, 0, p->buffer_size, text_size, p);
+    display_locate_statistics(text_size, total_count_step, info, p);
+}
+
+
+/**
+ * Returns 1 if 'token' may start a match according to the bits of
+ * 'first_tokens', or if it is not a valid token.
+ */
+static inline int is_possible_origin(unsigned int token, unsigned int n_tokens,
+        const unsigned char* bits) {
+    return token >= n_tokens || ((bits[token >> 3] >> (token & 7)) & 1);
+}
+
+
+/**
+ * Returns the first position in [start;end[ whose token may start a match
+ * according to 'first_tokens', or 'end' if there is none. A position that
+ * does not contain a valid token also stops the scan, since the caller
+ * must stop on it.
+ */
+static inline int skip_impossible_origins(const int* buffer, int start, int end,
+        int n_tokens, const struct bit_array* first_tokens) {
+    const unsigned char* bits = first_tokens->array;
+    int i = start;
+#if UNITEX_HAS_CPU_EXTENSION(AVX2)
+    /* The next origin is often close, so that the first positions are tested
+     * one by one. Then, 8 tokens are tested at once by gathering the 4 bytes
+     * that start with the byte of each token's bit; compute_first_tokens pads
+     * the bit array so that these reads stay inside it */
+    int first_end = (end - start < 8) ? end : start + 8;
+    for (; i < first_end; i++) {
+        if (is_possible_origin((unsigned int) buffer[i], (unsigned int) n_tokens, bits)) {
+            return i;
+        }
+    }
+    const __m256i max_token = _mm256_set1_epi32(n_tokens - 1);
+    const __m256i seven = _mm256_set1_epi32(7);
+    const __m256i one = _mm256_set1_epi32(1);
+    while (i + 8 <= end) {
+        __m256i tokens = _mm256_loadu_si256((const __m256i*) (buffer + i));
+        __m256i invalid = _mm256_or_si256(_mm256_cmpgt_epi32(tokens, max_token),
+                _mm256_cmpgt_epi32(_mm256_setzero_si256(), tokens));
+        __m256i bytes = _mm256_andnot_si256(invalid, _mm256_srli_epi32(tokens, 3));
+        __m256i words = _mm256_i32gather_epi32((const int*) bits, bytes, 1);
+        __m256i hits = _mm256_or_si256(invalid, _mm256_and_si256(
+                _mm256_srlv_epi32(words, _mm256_and_si256(tokens, seven)), one));
+        if (!_mm256_testz_si256(hits, hits)) {
+            break;
+        }
+        i += 8;
+    }
+#endif
+    while (i < end && !is_possible_origin((unsigned int) buffer[i], (unsigned int) n_tokens, bits)) {
+        i++;
+    }
+    return i;
+}
+
+
+/**
+ * Performs the Locate operation for all the origins in [start;end[ and
+ * saves the occurrences on the fly. The whole text remains visible to the
+ * exploration, so that a match may end after 'end' or, with a left context,
+ * start before 'start'; such a match sets p->range_overflow. The progress
+ * is only printed if text_size is not 0. Returns the number of exploration
+ * steps.
+ */
+unsigned long launch_locate_on_range(U_FILE* out, int start, int end, long int text_size,
+        struct locate_parameters* p) {
     p->token_error_ctx.n_errors = 0;
     p->token_error_ctx.last_start = -1;
     p->token_error_ctx.last_length = 0;
     p->token_error_ctx.n_matches_at_token_pos__locate = 0;
     p->token_error_ctx.n_matches_at_token_pos__morphological_locate = 0;
+    p->range_start = start;
+    p->range_end = end;
+    p->range_overflow = 0;
 
     //fill_buffer(p->token_buffer, f);
     OptimizedFst2State initial_state =
             p->optimized_states[p->fst2->initial_states[1]];
-    p->current_origin = 0;
-	  p->last_origin = 0;
+    p->current_origin = start;
+	  p->last_origin = start;
     int n_read = 0;
     int unite;
     clock_t startTime = clock();
@@ -106,6 +180,9 @@ void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
     unsigned long total_count_step = 0;
 
     unite = (int)(((text_size / 100) > 1000) ? (text_size / 100) : 1000);
+    if (text_size == 0) {
+        unite = 0;
+    }
     variable_backup_memory_reserve* backup_reserve =
             create_variable_backup_memory_reserve(p->input_variables,1);
     p->backup_memory_reserve = backup_reserve;
@@ -119,10 +196,29 @@ void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
 
     int pos = 0;
 
-    while (p->current_origin < p->buffer_size &&
+    /* The origins whose token cannot start any match are skipped in bulk,
+     * unless an extension may move the origin itself */
+    const struct bit_array* first_tokens =
+            p->elg->has_main_event(ELG_MAIN_EVENT_SLIDE) ? NULL : p->first_tokens;
+
+    while (p->current_origin < end &&
            p->buffer[p->current_origin] < p->tokens->size &&
           (p->search_limit == -1 || p->number_of_matches < p->search_limit)) {
 
+        if (first_tokens != NULL) {
+            /* While there are pending matches, we move one origin at a time, so
+             * that they are saved in the same order as without skipping */
+            int limit = (p->match_list == NULL) ? end : p->current_origin + 1;
+            int next_origin = skip_impossible_origins(p->buffer, p->current_origin,
+                    limit, p->tokens->size, first_tokens);
+            if (next_origin != p->current_origin) {
+                p->match_list = save_matches(p->match_list, next_origin - 1, out, p,
+                        p->al.prv_alloc_generic);
+                p->current_origin = next_origin;
+                continue;
+            }
+        }
+
         if (unite != 0) {
             n_read = p->current_origin % unite;
             if (n_read == 0 && ((currentTime = clock()) - startTime > DELAY_PER_SEC)) {
@@ -146,7 +242,11 @@ void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
             !get_value(p->failfast,current_token)) {
 
             int cache_found = 0;
-            if (p->useLocateCache) {
+            if (p->useLocateCache==HASH_LOCATE_CACHE) {
+                cache_found = consult_hash_cache(p->buffer, p->current_origin,
+                    p->buffer_size, p->hash_cache,
+                    p->cached_match_vector);
+            } else if (p->useLocateCache) {
                 cache_found =  consult_cache(p->buffer, p->current_origin,
                     p->buffer_size, p->match_cache,
                     p->cached_match_vector);
@@ -235,6 +335,10 @@ void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
                     }
                 }
                 struct match_list* tmp;
+                /* The hashed cache receives all the matches of the origin at once,
+                 * so that an eviction never leaves only a part of them */
+                struct match_list* hash_cached_matches = NULL;
+                struct match_list** hash_cached_last = &hash_cached_matches;
                 while (p->match_cache_first != NULL) {
                     real_add_match(p->match_cache_first, p, p->al.prv_alloc_generic);
                     tmp = p->match_cache_first;
@@ -252,14 +356,24 @@ void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
                          * then, if the text contains "volley ball meeting", we will find
                          * "volley" in cache and skip longer matches like "volley ball".
                          */
-                        cache_match(tmp, p->buffer,
+                        if (p->hash_cache != NULL) {
+                            *hash_cached_last = tmp;
+                            hash_cached_last = &(tmp->next);
+                        } else {
+                            cache_match(tmp, p->buffer,
                                 tmp->m.start_pos_in_token,
                                 p->last_matched_position,
                                 &(p->match_cache[current_token]), p->al.prv_alloc_generic);
+                        }
                     } else {
                         free_match_list_element(tmp, p->al.prv_alloc_generic);
                     }
                 }
+                if (hash_cached_matches != NULL) {
+                    hash_cache_match(hash_cached_matches, p->buffer,
+                        p->current_origin, p->last_matched_position,
+                        p->hash_cache, p->al.prv_alloc_generic);
+                }
                 p->match_cache_last = NULL;
                 free_parsing_info(matches,&p->al.pa);
                 if (p->dic_variables != NULL) {
@@ -276,9 +390,22 @@ void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
     p->backup_memory_reserve = NULL;
 
     if ((p->search_limit == -1 || p->number_of_matches < p->search_limit)) {
-      p->match_list = save_matches(p->match_list,p->current_origin+1, out, p, p->al.prv_alloc_generic);
+      /* If the range stops before the end of the text, the remaining matches
+       * may end after the range, so we must save all of them */
+      int last_position = (end < p->buffer_size) ? p->buffer_size : p->current_origin+1;
+      p->match_list = save_matches(p->match_list,last_position, out, p, p->al.prv_alloc_generic);
     }
 
+    return total_count_step;
+}
+
+
+/**
+ * Prints the statistics of a Locate operation and saves them in the
+ * 'info' file, if not NULL.
+ */
+void display_locate_statistics(long int text_size, unsigned long total_count_step,
+        U_FILE* info, struct locate_parameters* p) {
     u_printf("100%% done      \n\n");
     u_printf("%d match%s\n", p->number_of_matches,
             (p->number_of_matches == 1) ? "" : "es");
@@ -296,6 +423,13 @@ void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
     }
     u_printf("%u exploration step%s\n",(unsigned int)total_count_step, (p->number_of_outputs
             == 1) ? "" : "s");
+    if (p->hash_cache != NULL) {
+        u_printf("Locate cache: %lu hit%s, %lu miss%s, %lu eviction%s\n",
+                p->hash_cache->hits, (p->hash_cache->hits == 1) ? "" : "s",
+                p->hash_cache->misses, (p->hash_cache->misses == 1) ? "" : "es",
+                p->hash_cache->evictions, (p->hash_cache->evictions == 1) ? "" : "s");
+    }
+    print_elg_call_cache_statistics(U_STDOUT, p->elg_cache);
 
     /*
     {
@@ -317,6 +451,13 @@ void launch_locate(U_FILE* out, long int text_size, U_FILE* info,
             u_fprintf(info, "(%2.3f%% of the text is covered)\n",
                     (float) (((float)per_halfhundred) / (float) 1000.0));
         }
+        if (p->hash_cache != NULL) {
+            u_fprintf(info, "Locate cache: %lu hit%s, %lu miss%s, %lu eviction%s\n",
+                    p->hash_cache->hits, (p->hash_cache->hits == 1) ? "" : "s",
+                    p->hash_cache->misses, (p->hash_cache->misses == 1) ? "" : "es",
+                    p->hash_cache->evictions, (p->hash_cache->evictions == 1) ? "" : "s");
+        }
+        print_elg_call_cache_statistics(info, p->elg_cache);
     }
 }
 
@@ -1845,29 +1986,36 @@ struct locate_parameters* p /* miscellaneous parameters needed by the function *
 }
 
 
+/* Below this size, a sorted window is scanned rather than halved */
+#define LINEAR_SEARCH_WINDOW 16
+
 /**
- * Looks for 'a' in the given array. Returns its position or -1 if not found.
+ * Looks for 'a' in the given sorted array. Returns the position of its first
+ * occurrence or -1 if not found. The window that contains 'a' is first
+ * narrowed by halving it without branching on the comparison, which avoids
+ * mispredictions on states with thousands of token transitions. The remaining
+ * window is then scanned by counting the elements lower than 'a', a loop
+ * without early exit that compilers can vectorize.
  */
 static int binary_search(int a, int* t, int n) {
-    int start, middle;
     if (n == 0 || t == NULL)
         return -1;
-    if (a < t[0])
-        return -1;
-    if (a > t[n - 1])
+    if (a < t[0] || a > t[n - 1])
         return -1;
-    n = n - 1;
-    start = 0;
-    while (start <= n) {
-        middle = ((start + n) >> 1); // like /2, but faster (depends on compiler)
-        if (t[middle] == a)
-            return middle;
-        if (t[middle] < a) {
-            start = middle + 1;
-        } else {
-            n = middle - 1;
-        }
+    const int* base = t;
+    int size = n;
+    while (size > LINEAR_SEARCH_WINDOW) {
+        int half = size >> 1;
+        base = (base[half] < a) ? base + half : base;
+        size = size - half;
+    }
+    int lower = 0;
+    for (int i = 0; i < size; i++) {
+        lower += (base[i] < a);
     }
+    int position = (int)(base - t) + lower;
+    if (position < n && t[position] == a)
+        return position;
     return -1;
 }
 
@@ -2294,6 +2442,14 @@ struct match_list* ptr;
         /* we can save the match (necessary for SHORTEST_MATCHES: there
          * may be no shorter match) */
 
+        /* The match may leave the range of origins being explored, see
+         * launch_locate_on_range */
+        if (l->m.start_pos_in_token < p->range_start) {
+            p->range_overflow |= RANGE_OVERFLOW_BEFORE;
+        }
+        if (l->m.end_pos_in_token >= p->range_end) {
+            p->range_overflow |= RANGE_OVERFLOW_AFTER;
+        }
         /* We save the match according to the new concord.ind format
          * that takes into account 3 kinds of information:
          *   1) offset in token
@@ -67,6 +67,8 @@ namespace unitex {
 
 void error_at_token_pos(const char* message,int start,int length,struct locate_parameters* p,const struct optimizedFst2State*);
 void launch_locate(U_FILE*,long int,U_FILE*,struct locate_parameters*);
+unsigned long launch_locate_on_range(U_FILE*,int,int,long int,struct locate_parameters*);
+void display_locate_statistics(long int,unsigned long,U_FILE*,struct locate_parameters*);
 void core_tokenized_locate(/*int,*/OptimizedFst2State,int,/*int,*/struct parsing_info**,struct locate_n_matches*,struct list_context*,struct locate_parameters*);
 unichar* get_token_sequence(struct locate_parameters*, int, int);
 
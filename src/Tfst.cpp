@@ -24,6 +24,7 @@
 #include "Tfst.h"
 #include "File.h"
 #include "TfstStats.h"
+#include "String_hash.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -31,7 +32,59 @@
 
 namespace unitex {
 
+/*
+ * Binary text automaton (.tfstb).
+ *
+ * A .tfstb file contains the same information as a .tfst and its .tind,
+ * but it is made of 32 bit integers in the byte order of the machine that
+ * wrote it, followed by a pool of null-terminated unichar strings, so that
+ * it can be used right from its af_open_mapfile mapping:
+ *
+ *   header[TFSTB_HEADER_SIZE]
+ *   sentence records
+ *   sentence_table[N+1]   (start of each record, the last one being the end)
+ *   string pool
+ *
+ * A sentence record is:
+ *
+ *   number, text, n_tokens, offset_in_tokens, offset_in_chars, n_states, n_transitions, n_tags
+ *   tokens[n_tokens]
+ *   token_sizes[n_tokens]
+ *   final[n_states]                   (1 for final states)
+ *   first_transition[n_states+1]      (transitions of state #i are in [first[i];first[i+1]])
+ *   transitions[n_transitions][2]     (tag number, destination state)
+ *   tags[n_tags][7]                   (content, then the 6 bounds of the Match)
+ *
+ * Record starts are counted in integers from the start of the file, and strings
+ * are offsets in unichars from the start of the pool. Tag contents are interned,
+ * so that a tag like {the,.DET} is stored only once for the whole text. The
+ * epsilon tag has TFSTB_NO_CONTENT as content. Transitions are stored in the
+ * same order as in the .tfst, so that loading a sentence from a .tfst or from
+ * its .tfstb gives the same outgoing transition lists.
+ */
+#define TFSTB_VERSION 1
+#define TFSTB_BYTE_ORDER 0x01020304
+#define TFSTB_HEADER_SIZE 12
+#define TFSTB_SENTENCE_HEADER_SIZE 8
+#define TFSTB_TAG_SIZE 7
+#define TFSTB_NO_CONTENT 0xFFFFFFFF
+
+enum {
+   TFSTB_H_VERSION=2,
+   TFSTB_H_BYTE_ORDER,
+   TFSTB_H_UNICHAR_SIZE,
+   TFSTB_H_SENTENCES,
+   TFSTB_H_SENTENCE_TABLE,
+   TFSTB_H_POOL,
+   TFSTB_H_POOL_SIZE,
+   TFSTB_H_FILE_SIZE
+};
+
+static const char tfstb_magic[8]={'T','F','S','T','b','i','n',0};
+
 void free_current_sentence(Tfst*);
+static Tfst* open_binary_text_automaton(const char* name);
+static void load_binary_sentence(Tfst* tfst,int n);
 
 
 
@@ -55,6 +108,8 @@ t->offset_in_tokens=-1;
 t->offset_in_chars=-1;
 t->automaton=NULL;
 t->tags=NULL;
+t->map=NULL;
+t->image=NULL;
 return t;
 }
 
@@ -66,6 +121,10 @@ void close_text_automaton(Tfst* t) {
 if (t==NULL) return;
 if (t->tfst!=NULL) u_fclose(t->tfst);
 if (t->tind!=NULL) u_fclose(t->tind);
+if (t->map!=NULL) {
+   af_release_mapfile_pointer(t->map,t->image);
+   af_close_mapfile(t->map);
+}
 free_current_sentence(t);
 free(t);
 }
@@ -77,8 +136,14 @@ free(t);
  *  - the .tfst does not exist
  *  - the .tind does not exist
  *  - the .tfst does not start by a number >0
+ *
+ * If the given file is a binary text automaton (.tfstb), it is mapped
+ * in memory and no .tind is needed.
  */
 Tfst* open_text_automaton(const VersatileEncodingConfig* vec,const char* tfst) {
+if (is_binary_text_automaton(tfst)) {
+   return open_binary_text_automaton(tfst);
+}
 char tind[FILENAME_MAX];
 remove_extension(tfst,tind);
 strcat(tind,".tind");
@@ -143,6 +208,9 @@ tfst->tags=NULL;
  * given text automaton. Remember that sentences are numbered from 1.
  */
 long get_sentence_offset(Tfst* t,int n) {
+if (t->image!=NULL) {
+   return 4*(long)t->image[t->image[TFSTB_H_SENTENCE_TABLE]+n-1];
+}
 long pos=4*(n-1);
 fseek(t->tind,pos,SEEK_SET);
 unsigned char tab[4];
@@ -241,6 +309,10 @@ if (tfst->current_sentence!=NO_SENTENCE_LOADED) {
    free_current_sentence(tfst);
 }
 tfst->current_sentence=n;
+if (tfst->image!=NULL) {
+   load_binary_sentence(tfst,n);
+   return;
+}
 long offset=get_sentence_offset(tfst,n);
 fseek(tfst->tfst,offset,SEEK_SET);
 /* Now we can read the sentence */
@@ -342,6 +414,7 @@ t->m.start_pos_in_letter=-1;
 t->m.end_pos_in_token=-1;
 t->m.end_pos_in_char=-1;
 t->m.end_pos_in_letter=-1;
+t->preferred=0;
 return t;
 }
 
@@ -532,4 +605,440 @@ for (int i=0;i<t->token_sizes->nbelems;i++) {
 }
 }
 
+
+/**
+ * Returns 1 if the given file is a binary text automaton; 0 otherwise.
+ */
+int is_binary_text_automaton(const char* name) {
+ABSTRACTFILE* f=af_fopen(name,"rb");
+if (f==NULL) {
+   return 0;
+}
+char magic[sizeof(tfstb_magic)];
+int ret=(sizeof(magic)==af_fread(magic,1,sizeof(magic),f) && !memcmp(magic,tfstb_magic,sizeof(magic)));
+af_fclose(f);
+return ret;
+}
+
+
+/**
+ * Maps the given binary text automaton. Returns NULL if the file is not a valid
+ * .tfstb written on a compatible machine.
+ */
+static Tfst* open_binary_text_automaton(const char* name) {
+ABSTRACTMAPFILE* map=af_open_mapfile(name,MAPFILE_OPTION_READ,0);
+if (map==NULL) {
+   error("Cannot open file %s\n",name);
+   return NULL;
+}
+size_t size=af_get_mapfile_size(map);
+const unsigned int* image=(const unsigned int*)af_get_mapfile_pointer(map);
+if (image==NULL || size<TFSTB_HEADER_SIZE*sizeof(unsigned int)
+      || memcmp(image,tfstb_magic,sizeof(tfstb_magic))
+      || image[TFSTB_H_VERSION]!=TFSTB_VERSION
+      || image[TFSTB_H_BYTE_ORDER]!=TFSTB_BYTE_ORDER
+      || image[TFSTB_H_UNICHAR_SIZE]!=sizeof(unichar)
+      || image[TFSTB_H_FILE_SIZE]!=size
+      || (int)image[TFSTB_H_SENTENCES]<=0
+      || (size_t)image[TFSTB_H_SENTENCE_TABLE]+image[TFSTB_H_SENTENCES]+1>image[TFSTB_H_POOL]
+      || image[TFSTB_H_POOL]*sizeof(unsigned int)+image[TFSTB_H_POOL_SIZE]*sizeof(unichar)>size
+      /* The last string of the pool must be terminated, so that no string
+       * that starts in the pool can be read beyond it */
+      || image[TFSTB_H_POOL_SIZE]==0
+      || ((const unichar*)(image+image[TFSTB_H_POOL]))[image[TFSTB_H_POOL_SIZE]-1]!='\0') {
+   error("Invalid binary text automaton %s\n",name);
+   if (image!=NULL) af_release_mapfile_pointer(map,image);
+   af_close_mapfile(map);
+   return NULL;
+}
+Tfst* t=new_Tfst(NULL,NULL,(int)image[TFSTB_H_SENTENCES]);
+t->map=map;
+t->image=image;
+return t;
+}
+
+
+/**
+ * Checks the indices of the given sentence record, whose size has already
+ * been checked, so that loading it cannot read outside of the mapping nor
+ * build transitions to missing states or tags. Returns 1 if the record is
+ * valid; 0 otherwise.
+ */
+static int check_binary_sentence(const unsigned int* image,const unsigned int* r) {
+unsigned int pool_size=image[TFSTB_H_POOL_SIZE];
+unsigned int n_tokens=r[2];
+unsigned int n_states=r[5];
+unsigned int n_transitions=r[6];
+unsigned int n_tags=r[7];
+if (r[1]>=pool_size) {
+   return 0;
+}
+const unsigned int* first=r+TFSTB_SENTENCE_HEADER_SIZE+2*n_tokens+n_states;
+if (first[0]!=0 || first[n_states]!=n_transitions) {
+   return 0;
+}
+for (unsigned int i=0;i<n_states;i++) {
+   if (first[i]>first[i+1]) {
+      return 0;
+   }
+}
+const unsigned int* transitions=first+n_states+1;
+for (unsigned int j=0;j<n_transitions;j++) {
+   if (transitions[2*j]>=n_tags || transitions[2*j+1]>=n_states) {
+      return 0;
+   }
+}
+const unsigned int* tags=transitions+2*n_transitions;
+for (unsigned int i=0;i<n_tags;i++) {
+   unsigned int content=tags[TFSTB_TAG_SIZE*i];
+   if (content!=TFSTB_NO_CONTENT && content>=pool_size) {
+      return 0;
+   }
+}
+return 1;
+}
+
+
+/**
+ * Loads the given sentence of a binary text automaton. Nothing has to be
+ * parsed: the sentence is built right from the mapped arrays.
+ */
+static void load_binary_sentence(Tfst* tfst,int n) {
+const unsigned int* image=tfst->image;
+const unsigned int* table=image+image[TFSTB_H_SENTENCE_TABLE];
+const unsigned int* r=image+table[n-1];
+const unichar* pool=(const unichar*)(image+image[TFSTB_H_POOL]);
+if (table[n-1]<TFSTB_HEADER_SIZE || table[n]>image[TFSTB_H_SENTENCE_TABLE] || table[n-1]>=table[n]
+      || table[n]-table[n-1]<TFSTB_SENTENCE_HEADER_SIZE || (int)r[0]!=n) {
+   fatal_error("load_sentence: invalid binary sentence #%d\n",n);
+}
+int n_tokens=(int)r[2];
+int n_states=(int)r[5];
+int n_transitions=(int)r[6];
+int n_tags=(int)r[7];
+if (n_tokens<0 || n_states<0 || n_transitions<0 || n_tags<0
+      || TFSTB_SENTENCE_HEADER_SIZE+2*(size_t)n_tokens+2*(size_t)n_states+1
+      +2*(size_t)n_transitions+TFSTB_TAG_SIZE*(size_t)n_tags!=table[n]-table[n-1]
+      || !check_binary_sentence(image,r)) {
+   fatal_error("load_sentence: invalid binary sentence #%d\n",n);
+}
+tfst->text=u_strdup(pool+r[1]);
+tfst->offset_in_tokens=(int)r[3];
+tfst->offset_in_chars=(int)r[4];
+const int* tokens=(const int*)(r+TFSTB_SENTENCE_HEADER_SIZE);
+const int* token_sizes=tokens+n_tokens;
+tfst->tokens=new_vector_int(n_tokens+1);
+tfst->token_sizes=new_vector_int(n_tokens+1);
+memcpy(tfst->tokens->tab,tokens,n_tokens*sizeof(int));
+memcpy(tfst->token_sizes->tab,token_sizes,n_tokens*sizeof(int));
+tfst->tokens->nbelems=n_tokens;
+tfst->token_sizes->nbelems=n_tokens;
+const unsigned int* final=(const unsigned int*)(token_sizes+n_tokens);
+const unsigned int* first=final+n_states;
+const int* transitions=(const int*)(first+n_states+1);
+const int* tags=transitions+2*n_transitions;
+tfst->automaton=new_SingleGraph(n_states+1,INT_TAGS);
+for (int i=0;i<n_states;i++) {
+   SingleGraphState s=add_state(tfst->automaton);
+   if (i==0) {
+      /* By convention, the first state is initial */
+      set_initial_state(s);
+   }
+   if (final[i]) {
+      set_final_state(s);
+   }
+   /* As when reading a .tfst, each transition is inserted at the head
+    * of the transition list */
+   for (int j=(int)first[i];j<(int)first[i+1];j++) {
+      add_outgoing_transition(s,transitions[2*j],transitions[2*j+1]);
+   }
+}
+tfst->tags=new_vector_ptr(n_tags+1);
+for (int i=0;i<n_tags;i++) {
+   const int* t=tags+TFSTB_TAG_SIZE*i;
+   if ((unsigned int)t[0]==TFSTB_NO_CONTENT) {
+      vector_ptr_add(tfst->tags,new_TfstTag(T_EPSILON));
+      continue;
+   }
+   TfstTag* tag=new_TfstTag(T_STD);
+   tag->content=u_strdup(pool+t[0]);
+   tag->m.start_pos_in_token=t[1];
+   tag->m.start_pos_in_char=t[2];
+   tag->m.start_pos_in_letter=t[3];
+   tag->m.end_pos_in_token=t[4];
+   tag->m.end_pos_in_char=t[5];
+   tag->m.end_pos_in_letter=t[6];
+   vector_ptr_add(tfst->tags,tag);
+}
+}
+
+
+/**
+ * This structure is used to write a binary text automaton. Sentence records
+ * are written as soon as they are built, while the sentence table and the
+ * string pool are kept in memory until the end.
+ */
+struct tfstb_writer {
+   ABSTRACTFILE* f;
+   /* Number of integers written so far */
+   unsigned int n_ints;
+   vector_int* sentences;
+   vector_int* record;
+   unichar* pool;
+   unsigned int n_pool;
+   unsigned int capacity_pool;
+   /* Interned tag contents, and their offsets in the pool */
+   struct string_hash* contents;
+   vector_int* content_offsets;
+};
+
+
+/**
+ * Copies the given string into the pool and returns its offset.
+ */
+static unsigned int tfstb_add_string(struct tfstb_writer* w,const unichar* str) {
+unsigned int length=u_strlen(str)+1;
+while (w->n_pool+length>w->capacity_pool) {
+   w->capacity_pool=(w->capacity_pool==0)?4096:2*w->capacity_pool;
+   w->pool=(unichar*)realloc(w->pool,w->capacity_pool*sizeof(unichar));
+   if (w->pool==NULL) {
+      fatal_alloc_error("tfstb_add_string");
+   }
+}
+unsigned int offset=w->n_pool;
+memcpy(w->pool+w->n_pool,str,length*sizeof(unichar));
+w->n_pool+=length;
+return offset;
+}
+
+
+/**
+ * Returns the pool offset of the given tag content, adding it if needed.
+ */
+static unsigned int tfstb_add_content(struct tfstb_writer* w,const unichar* content) {
+int n=get_value_index(content,w->contents);
+if (n==w->content_offsets->nbelems) {
+   vector_int_add(w->content_offsets,(int)tfstb_add_string(w,content));
+}
+return (unsigned int)w->content_offsets->tab[n];
+}
+
+
+static struct tfstb_writer* new_tfstb_writer(const char* name) {
+ABSTRACTFILE* f=af_fopen(name,"wb");
+if (f==NULL) {
+   return NULL;
+}
+struct tfstb_writer* w=(struct tfstb_writer*)malloc(sizeof(struct tfstb_writer));
+if (w==NULL) {
+   fatal_alloc_error("new_tfstb_writer");
+}
+w->f=f;
+w->sentences=new_vector_int();
+w->record=new_vector_int();
+w->pool=NULL;
+w->n_pool=0;
+w->capacity_pool=0;
+w->contents=new_string_hash(DONT_USE_VALUES);
+w->content_offsets=new_vector_int();
+/* We reserve the header, that will be written at the end */
+unsigned int header[TFSTB_HEADER_SIZE];
+memset(header,0,sizeof(header));
+if (TFSTB_HEADER_SIZE!=af_fwrite(header,sizeof(unsigned int),TFSTB_HEADER_SIZE,f)) {
+   fatal_error("Write error in new_tfstb_writer\n");
+}
+w->n_ints=TFSTB_HEADER_SIZE;
+return w;
+}
+
+
+/**
+ * Saves the current sentence of the given text automaton.
+ */
+static void tfstb_write_sentence(struct tfstb_writer* w,const Tfst* tfst) {
+vector_int* r=w->record;
+r->nbelems=0;
+SingleGraph g=tfst->automaton;
+int n_transitions=0;
+for (int i=0;i<g->number_of_states;i++) {
+   for (Transition* t=g->states[i]->outgoing_transitions;t!=NULL;t=t->next) {
+      n_transitions++;
+   }
+}
+vector_int_add(r,tfst->current_sentence);
+vector_int_add(r,(int)tfstb_add_string(w,tfst->text));
+vector_int_add(r,tfst->tokens->nbelems);
+vector_int_add(r,tfst->offset_in_tokens);
+vector_int_add(r,tfst->offset_in_chars);
+vector_int_add(r,g->number_of_states);
+vector_int_add(r,n_transitions);
+vector_int_add(r,tfst->tags->nbelems);
+for (int i=0;i<tfst->tokens->nbelems;i++) {
+   vector_int_add(r,tfst->tokens->tab[i]);
+}
+for (int i=0;i<tfst->token_sizes->nbelems;i++) {
+   vector_int_add(r,tfst->token_sizes->tab[i]);
+}
+for (int i=0;i<g->number_of_states;i++) {
+   vector_int_add(r,is_final_state(g->states[i])?1:0);
+}
+n_transitions=0;
+for (int i=0;i<g->number_of_states;i++) {
+   vector_int_add(r,n_transitions);
+   for (Transition* t=g->states[i]->outgoing_transitions;t!=NULL;t=t->next) {
+      n_transitions++;
+   }
+}
+vector_int_add(r,n_transitions);
+for (int i=0;i<g->number_of_states;i++) {
+   /* Transition lists are in the reverse order of the .tfst one */
+   int start=r->nbelems;
+   for (Transition* t=g->states[i]->outgoing_transitions;t!=NULL;t=t->next) {
+      vector_int_add(r,t->state_number);
+      vector_int_add(r,t->tag_number);
+   }
+   for (int a=start,b=r->nbelems-1;a<b;a++,b--) {
+      int tmp=r->tab[a];
+      r->tab[a]=r->tab[b];
+      r->tab[b]=tmp;
+   }
+}
+for (int i=0;i<tfst->tags->nbelems;i++) {
+   TfstTag* t=(TfstTag*)(tfst->tags->tab[i]);
+   vector_int_add(r,(t->type==T_EPSILON)?(int)TFSTB_NO_CONTENT:(int)tfstb_add_content(w,t->content));
+   vector_int_add(r,t->m.start_pos_in_token);
+   vector_int_add(r,t->m.start_pos_in_char);
+   vector_int_add(r,t->m.start_pos_in_letter);
+   vector_int_add(r,t->m.end_pos_in_token);
+   vector_int_add(r,t->m.end_pos_in_char);
+   vector_int_add(r,t->m.end_pos_in_letter);
+}
+vector_int_add(w->sentences,(int)w->n_ints);
+if ((size_t)r->nbelems!=af_fwrite(r->tab,sizeof(int),r->nbelems,w->f)) {
+   fatal_error("Write error in tfstb_write_sentence\n");
+}
+w->n_ints+=r->nbelems;
+}
+
+
+/**
+ * Writes the sentence table, the pool and the header, and closes the file.
+ * Returns 1 in case of success; 0 otherwise.
+ */
+static int close_tfstb_writer(struct tfstb_writer* w) {
+int ok=1;
+unsigned int header[TFSTB_HEADER_SIZE];
+memset(header,0,sizeof(header));
+memcpy(header,tfstb_magic,sizeof(tfstb_magic));
+header[TFSTB_H_VERSION]=TFSTB_VERSION;
+header[TFSTB_H_BYTE_ORDER]=TFSTB_BYTE_ORDER;
+header[TFSTB_H_UNICHAR_SIZE]=sizeof(unichar);
+header[TFSTB_H_SENTENCES]=(unsigned int)w->sentences->nbelems;
+header[TFSTB_H_SENTENCE_TABLE]=w->n_ints;
+vector_int_add(w->sentences,(int)w->n_ints);
+if ((size_t)w->sentences->nbelems!=af_fwrite(w->sentences->tab,sizeof(int),w->sentences->nbelems,w->f)) {
+   ok=0;
+}
+w->n_ints+=w->sentences->nbelems;
+/* We keep the file size a multiple of 4 */
+if (w->n_pool%2) {
+   tfstb_add_string(w,U_EMPTY);
+}
+header[TFSTB_H_POOL]=w->n_ints;
+header[TFSTB_H_POOL_SIZE]=w->n_pool;
+header[TFSTB_H_FILE_SIZE]=w->n_ints*sizeof(unsigned int)+w->n_pool*sizeof(unichar);
+if (w->n_pool!=0 && w->n_pool!=af_fwrite(w->pool,sizeof(unichar),w->n_pool,w->f)) {
+   ok=0;
+}
+if (af_fseek(w->f,0,SEEK_SET) || TFSTB_HEADER_SIZE!=af_fwrite(header,sizeof(unsigned int),TFSTB_HEADER_SIZE,w->f)) {
+   ok=0;
+}
+af_fclose(w->f);
+free_vector_int(w->sentences);
+free_vector_int(w->record);
+free(w->pool);
+free_string_hash(w->contents);
+free_vector_int(w->content_offsets);
+free(w);
+return ok;
+}
+
+
+/**
+ * Converts the given textual text automaton into a binary one.
+ * Returns 1 in case of success; 0 otherwise.
+ */
+int convert_tfst_to_tfstb(const VersatileEncodingConfig* vec,const char* tfst,const char* tfstb) {
+Tfst* t=open_text_automaton(vec,tfst);
+if (t==NULL) {
+   return 0;
+}
+struct tfstb_writer* w=new_tfstb_writer(tfstb);
+if (w==NULL) {
+   error("Cannot create %s\n",tfstb);
+   close_text_automaton(t);
+   return 0;
+}
+for (int i=1;i<=t->N;i++) {
+   load_sentence(t,i);
+   tfstb_write_sentence(w,t);
+}
+close_text_automaton(t);
+if (!close_tfstb_writer(w)) {
+   error("Write error on %s\n",tfstb);
+   return 0;
+}
+return 1;
+}
+
+
+/**
+ * Converts the given binary text automaton into a textual one, with its .tind.
+ * Returns 1 in case of success; 0 otherwise.
+ */
+int convert_tfstb_to_tfst(const VersatileEncodingConfig* vec,const char* tfstb,const char* tfst) {
+Tfst* t=open_text_automaton(vec,tfstb);
+if (t==NULL) {
+   return 0;
+}
+char tind[FILENAME_MAX];
+remove_extension(tfst,tind);
+strcat(tind,".tind");
+U_FILE* out_tfst=u_fopen(vec,tfst,U_WRITE);
+if (out_tfst==NULL) {
+   error("Cannot create %s\n",tfst);
+   close_text_automaton(t);
+   return 0;
+}
+U_FILE* out_tind=u_fopen(BINARY,tind,U_WRITE);
+if (out_tind==NULL) {
+   error("Cannot create %s\n",tind);
+   u_fclose(out_tfst);
+   close_text_automaton(t);
+   return 0;
+}
+u_fprintf(out_tfst,"%010d\n",t->N);
+for (int i=1;i<=t->N;i++) {
+   load_sentence(t,i);
+   /* save_current_sentence writes transition lists as they are, so we
+    * reverse them in order to get the same .tfst as the original one */
+   for (int j=0;j<t->automaton->number_of_states;j++) {
+      Transition* reversed=NULL;
+      Transition* tr=t->automaton->states[j]->outgoing_transitions;
+      while (tr!=NULL) {
+         Transition* next=tr->next;
+         tr->next=reversed;
+         reversed=tr;
+         tr=next;
+      }
+      t->automaton->states[j]->outgoing_transitions=reversed;
+   }
+   save_current_sentence(t,out_tfst,out_tind,NULL,0,NULL);
+}
+u_fclose(out_tind);
+u_fclose(out_tfst);
+close_text_automaton(t);
+return 1;
+}
+
 } // namespace unitex
@@ -32,6 +32,7 @@
 #include "SingleGraph.h"
 #include "Match.h"
 #include "HashTable.h"
+#include "Af_stdio.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -77,6 +78,11 @@ typedef struct {
    /* The tags of the current sentence automaton */
    vector_ptr* tags;
 
+   /* If the text automaton is a binary .tfstb, it is mapped in memory
+    * and 'tfst' and 'tind' are NULL */
+   ABSTRACTMAPFILE* map;
+   const unsigned int* image;
+
 } Tfst;
 
 
@@ -132,6 +138,7 @@ Tfst* new_Tfst(U_FILE* tfst,U_FILE* tind,int N);
 Tfst* open_text_automaton(const VersatileEncodingConfig*,const char* tfst);
 void close_text_automaton(Tfst* tfst);
 void load_sentence(Tfst* tfst,int n);
+long get_sentence_offset(Tfst* t,int n);
 void save_current_sentence(Tfst* tfst,U_FILE* out_tfst,U_FILE* tind,unichar** tags,int n_tags,
                             struct hash_table* form_frequencies);
 
@@ -141,6 +148,10 @@ void TfstTag_to_string(TfstTag*,unichar*);
 
 void compute_token_contents(Tfst*);
 
+int is_binary_text_automaton(const char* name);
+int convert_tfst_to_tfstb(const VersatileEncodingConfig*,const char* tfst,const char* tfstb);
+int convert_tfstb_to_tfst(const VersatileEncodingConfig*,const char* tfstb,const char* tfst);
+
 } // namespace unitex
 
 #endif
@@ -36,6 +36,7 @@
 #include "Token.h"
 #include "Offsets.h"
 #include "Overlap.h"
+#include "logger/SyncLogger.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -48,10 +49,15 @@ namespace unitex {
 
 static void sort_and_save_by_frequence(U_FILE*,vector_ptr*,vector_int*);
 static void sort_and_save_by_alph_order(U_FILE*,vector_ptr*,vector_int*);
-static void compute_statistics(U_FILE*,vector_ptr*,Alphabet*,int,int,int,int);
-static int tokenization(U_FILE*,U_FILE*,U_FILE*,Alphabet*,vector_ptr*,struct hash_table*,vector_int*,
+static void compute_statistics(U_FILE*,vector_ptr*,const Alphabet*,int,int,int,int);
+static void save_statistics_files(const VersatileEncodingConfig*,const char*,vector_ptr*,vector_int*,
+                                  const Alphabet*,int,int,int,int);
+static int tokenization(U_FILE*,U_FILE*,U_FILE*,const Alphabet*,vector_ptr*,struct hash_table*,vector_int*,
         vector_int*,vector_int*,
-           int*,int*,int*,int*,U_FILE*,vector_offset*,int);
+           int*,int*,int*,int*,U_FILE*,vector_offset*,int,
+           const unichar* chunk=NULL,int chunk_length=0,vector_int* codes=NULL,int report_errors=1);
+static int tokenization_in_threads(U_FILE*,U_FILE*,U_FILE*,Alphabet*,vector_ptr*,struct hash_table*,vector_int*,
+        vector_int*,vector_int*,int*,int*,int*,int*,int,int);
 static void save_new_line_positions(U_FILE*,vector_int*);
 static int load_token_file(char* filename, const VersatileEncodingConfig*,vector_ptr* tokens,struct hash_table* hashtable,vector_int* n_occur);
 
@@ -85,6 +91,9 @@ const char* usage_Tokenize =
          "  -w/--word_by_word: word by word tokenization (default);\n"
          "  -t TOKENS/--tokens=TOKENS: specifies a tokens.txt file to load and modify, instead of\n"
          "                             creating a new one from scratch;\n"
+         "  -j N/--threads=N: tokenizes the text with N threads working on chunks cut at\n"
+         "                    new lines (default: 1). The output is the same as with a single\n"
+         "                    thread. --output_offsets forces the use of a single thread;\n"
          "Offset options:\n"
          "  --input_offsets=XXX: base offset file to be used\n"
          "  --output_offsets=XXX: offset file to be produced (at \"uima\" format)\n"
@@ -107,12 +116,13 @@ static void usage() {
   u_printf(usage_Tokenize);
 }
 
-const char* optstring_Tokenize=":a:cwt:Vhk:q:$:@:";
+const char* optstring_Tokenize=":a:cwt:Vhk:q:$:@:j:";
 const struct option_TS lopts_Tokenize[]={
   {"alphabet", required_argument_TS, NULL, 'a'},
   {"char_by_char", no_argument_TS, NULL, 'c'},
   {"word_by_word", no_argument_TS, NULL, 'w'},
   {"tokens", required_argument_TS, NULL, 't'},
+  {"threads", required_argument_TS, NULL, 'j'},
   {"input_encoding",required_argument_TS,NULL,'k'},
   {"output_encoding",required_argument_TS,NULL,'q'},
   {"input_offsets",required_argument_TS,NULL,'$'},
@@ -149,6 +159,8 @@ char* out_offsets = (buffer_filename + (step_filename_buffer * 3));
 VersatileEncodingConfig vec=VEC_DEFAULT;
 int val,index=-1;
 int mode=NORMAL;
+int n_threads=1;
+char foo;
 bool only_verify_arguments = false;
 UnitexGetOpt options;
 while (EOF!=(val=options.parse_long(argc,argv,optstring_Tokenize,lopts_Tokenize,&index))) {
@@ -169,6 +181,12 @@ while (EOF!=(val=options.parse_long(argc,argv,optstring_Tokenize,lopts_Tokenize,
              }
              strcpy(token_file,options.vars()->optarg);
              break;
+   case 'j': if (1!=sscanf(options.vars()->optarg,"%d%c",&n_threads,&foo) || n_threads<=0) {
+                error("Invalid number of threads: %s\n",options.vars()->optarg);
+                free(buffer_filename);
+                return USAGE_ERROR_CODE;
+             }
+             break;
    case 'k': if (options.vars()->optarg[0]=='\0') {
                 error("Empty input_encoding argument\n");
                 free(buffer_filename);
@@ -375,10 +393,17 @@ int TOKENS_TOTAL=0;
 int WORDS_TOTAL=0;
 int DIGITS_TOTAL=0;
 u_printf("Tokenizing text...\n");
-int result_tokenization = tokenization(text,out,output,alph,tokens,hashtable,n_occur,n_enter_pos,
+int result_tokenization;
+if (n_threads>1 && f_out_offsets==NULL) {
+   result_tokenization=tokenization_in_threads(text,out,output,alph,tokens,hashtable,n_occur,n_enter_pos,
+                          snt_offsets,
+                          &SENTENCES,&TOKENS_TOTAL,&WORDS_TOTAL,&DIGITS_TOTAL,(mode!=NORMAL),n_threads);
+} else {
+   result_tokenization=tokenization(text,out,output,alph,tokens,hashtable,n_occur,n_enter_pos,
                           snt_offsets,
                           &SENTENCES,&TOKENS_TOTAL,&WORDS_TOTAL,&DIGITS_TOTAL,f_out_offsets,
                           v_in_offsets,(mode!=NORMAL));
+}
 u_printf((result_tokenization == 0) ? "\nDone.\n" : "\nTokenization error.\n");
 save_new_line_positions(enter,n_enter_pos);
 if (!save_snt_offsets(snt_offsets,snt_offsets_pos)) {
@@ -406,39 +431,8 @@ u_fclose(out);
 u_fclose(text);
 
 write_number_of_tokens(&vec,tokens_txt,tokens->nbelems);
-// we compute some statistics
 get_snt_path(argv[options.vars()->optind],tokens_txt);
-strcat(tokens_txt,"stats.n");
-output=u_fopen(&vec,tokens_txt,U_WRITE);
-if (output==NULL) {
-   error("Cannot write %s\n",tokens_txt);
-}
-else {
-   compute_statistics(output,tokens,alph,SENTENCES,TOKENS_TOTAL,WORDS_TOTAL,DIGITS_TOTAL);
-   u_fclose(output);
-}
-// we save the tokens by frequence
-get_snt_path(argv[options.vars()->optind],tokens_txt);
-strcat(tokens_txt,"tok_by_freq.txt");
-output=u_fopen(&vec,tokens_txt,U_WRITE);
-if (output==NULL) {
-   error("Cannot write %s\n",tokens_txt);
-}
-else {
-   sort_and_save_by_frequence(output,tokens,n_occur);
-   u_fclose(output);
-}
-// we save the tokens by alphabetical order
-get_snt_path(argv[options.vars()->optind],tokens_txt);
-strcat(tokens_txt,"tok_by_alph.txt");
-output=u_fopen(&vec,tokens_txt,U_WRITE);
-if (output==NULL) {
-   error("Cannot write %s\n",tokens_txt);
-}
-else {
-   sort_and_save_by_alph_order(output,tokens,n_occur);
-   u_fclose(output);
-}
+save_statistics_files(&vec,tokens_txt,tokens,n_occur,alph,SENTENCES,TOKENS_TOTAL,WORDS_TOTAL,DIGITS_TOTAL);
 
 free_hash_table(hashtable);
 free_vector_int(n_enter_pos);
@@ -604,7 +598,7 @@ static inline void fast_fwrite_raw(U_FILE* f, int n, unsigned char*out_buffer, u
     (*pos_out_buffer)++;
 }
 
-#define TOKENIZE_GET_BUFFER_SIZE 0x200
+#define TOKENIZE_GET_BUFFER_SIZE 0x4000
 
 static inline int fast_u_fgetc_raw(U_FILE* f, unichar*buffer,unsigned int* pos_in_buffer, unsigned int* filled_in_buffer)
 {
@@ -617,6 +611,10 @@ static inline int fast_u_fgetc_raw(U_FILE* f, unichar*buffer,unsigned int* pos_i
             return c;
         }
 
+        if (f == NULL) {
+            /* We are reading a chunk of text already in memory */
+            return EOF;
+        }
         *filled_in_buffer = 0;
         *pos_in_buffer = 0;
         int res = u_fget_unichars_raw(buffer, TOKENIZE_GET_BUFFER_SIZE, f);
@@ -658,27 +656,54 @@ static inline int enlarge_token_buffer_if_needed(unichar** token_buffer, size_t
     return enlarge_token_buffer_as_needed(token_buffer, buffer_size, size_needed);
 }
 
+/**
+ * Saves the number of a token, either in the coded text or, when a chunk of
+ * text is tokenized by a thread, in the 'codes' vector.
+ */
+static inline void save_token_code(U_FILE* coded_text,vector_int* codes,int n,unsigned char* out_buffer,unsigned int* pos_out_buffer) {
+if (codes!=NULL) {
+   vector_int_add(codes,n);
+   return;
+}
+fast_fwrite_raw(coded_text, n, out_buffer, pos_out_buffer, TOKENIZE_WRITE_BUFFER_SIZE);
+}
+
 #define TOKENIZE_ORIGINAL_TOKEN_BUFFER_SIZE 0x400
 
-static int tokenization(U_FILE* f_read,U_FILE* coded_text,U_FILE* output,Alphabet* alph,
+/**
+ * Tokenizes the text read from 'f_read'. If 'chunk' is not NULL, the
+ * 'chunk_length' characters it contains are tokenized instead, the token
+ * numbers are stored in 'codes' and nothing is written: this is how the
+ * threads of tokenization_in_threads and tokenize_buffer work. 'snt_offsets'
+ * may then be NULL. If 'report_errors' is 0, invalid tags make the function
+ * fail without any message.
+ */
+static int tokenization(U_FILE* f_read,U_FILE* coded_text,U_FILE* output,const Alphabet* alph,
                          vector_ptr* tokens,struct hash_table* hashtable,
                          vector_int* n_occur,vector_int* n_enter_pos,
                          /* snt_offsets is used to note shifts induced by separator normalization */
                          vector_int* snt_offsets,
                          int *SENTENCES,int *TOKENS_TOTAL,int *WORDS_TOTAL,
                          int *DIGITS_TOTAL,U_FILE* f_out_offsets,vector_offset* v_in_offsets,
-                         int char_by_char) {
+                         int char_by_char,const unichar* chunk,int chunk_length,vector_int* codes,
+                         int report_errors) {
 int c;
 int n;
 char ENTER;
 int COUNT=0;
 int current_megabyte=0;
 int shift=0;
-unichar read_buffer[TOKENIZE_GET_BUFFER_SIZE];
+unichar file_buffer[TOKENIZE_GET_BUFFER_SIZE];
+unichar* read_buffer=file_buffer;
 unsigned char write_buffer[(TOKENIZE_WRITE_BUFFER_SIZE * 4) + 0x10];
 unsigned int pos_in_buffer = 0;
 unsigned int filled_in_buffer = 0;
 unsigned int pos_out_buffer = 0;
+if (chunk!=NULL) {
+   read_buffer=(unichar*)chunk;
+   filled_in_buffer=(unsigned int)chunk_length;
+   f_read=NULL;
+}
 c = fast_u_fgetc_raw(f_read, read_buffer, &pos_in_buffer, &filled_in_buffer);
 int current_pos;
 int snt_offsets_shift=0;
@@ -693,7 +718,7 @@ if (token_buffer == NULL) {
 while ((c!=EOF) && (result == 0)) {
    current_pos=COUNT;
    COUNT++;
-   if ((COUNT/(1024*512))!=current_megabyte) {
+   if (codes==NULL && (COUNT/(1024*512))!=current_megabyte) {
       current_megabyte++;
       int z=(COUNT/(1024*512));
       u_printf("%d megabyte%s read...       \r",z,(z>1)?"s":"");
@@ -709,7 +734,7 @@ while ((c!=EOF) && (result == 0)) {
       token_buffer[0]=' ';
       token_buffer[1]='\0';
       n=get_token_number(token_buffer,tokens,hashtable,n_occur);
-      if (COUNT-current_pos!=1) {
+      if (COUNT-current_pos!=1 && snt_offsets!=NULL) {
           /* If there is a shift with the .snt file */
           add_snt_offsets(snt_offsets,*TOKENS_TOTAL,snt_offsets_shift,snt_offsets_shift+(COUNT-current_pos-1));
           snt_offsets_shift+=(COUNT-current_pos-1);
@@ -720,14 +745,14 @@ while ((c!=EOF) && (result == 0)) {
          vector_int_add(n_enter_pos,*TOKENS_TOTAL);
       }
       (*TOKENS_TOTAL)++;
-      fast_fwrite_raw(coded_text, n, write_buffer, &pos_out_buffer, TOKENIZE_WRITE_BUFFER_SIZE);
+      save_token_code(coded_text, codes, n, write_buffer, &pos_out_buffer);
    }
    else if (c=='{') {
      token_buffer[0]='{';
      int z=1;
      bool protected_char = false; // Cassys add
      while ((((c = fast_u_fgetc_raw(f_read, read_buffer, &pos_in_buffer, &filled_in_buffer)) != '}' && c
-                    != '{' && c != '\n') || protected_char)) {
+                    != '{' && c != '\n') || protected_char) && c != EOF) {
             protected_char = false; // Cassys add
             if (c == '\\') { // Cassys add
                 protected_char = true; // Cassys add
@@ -741,13 +766,17 @@ while ((c!=EOF) && (result == 0)) {
         // if the tag has no ending }
         enlarge_token_buffer_if_needed(&token_buffer, &token_buffer_size, z + 1);
         token_buffer[z]='\0';
-        error("Error: a tag without ending } has been found:\n%S\n",token_buffer);
+        if (report_errors) {
+           error("Error: a tag without ending } has been found:\n%S\n",token_buffer);
+        }
         free(token_buffer);
         return DEFAULT_ERROR_CODE;
      }
      if (c=='\n') {
         // if the tag contains a return
-        error("Error: a tag containing a new-line sequence has been found\n");
+        if (report_errors) {
+           error("Error: a tag containing a new-line sequence has been found\n");
+        }
         free(token_buffer);
         return DEFAULT_ERROR_CODE;
      }
@@ -760,7 +789,9 @@ while ((c!=EOF) && (result == 0)) {
      } else {
         if (u_strcmp(token_buffer,"{STOP}") && !check_tag_token(token_buffer,1)) {
            // if a tag is incorrect, we exit
-           error("The text contains an invalid tag. Unitex cannot process it.");
+           if (report_errors) {
+              error("The text contains an invalid tag. Unitex cannot process it.");
+           }
            free(token_buffer);
            return DEFAULT_ERROR_CODE;
         }
@@ -769,7 +800,7 @@ while ((c!=EOF) && (result == 0)) {
      COUNT++;
      result=save_token_offset(f_out_offsets,token_buffer,n,current_pos,COUNT,v_in_offsets,&offset_index,&shift);
      (*TOKENS_TOTAL)++;
-     fast_fwrite_raw(coded_text, n, write_buffer, &pos_out_buffer, TOKENIZE_WRITE_BUFFER_SIZE);
+     save_token_code(coded_text, codes, n, write_buffer, &pos_out_buffer);
      c = fast_u_fgetc_raw(f_read, read_buffer, &pos_in_buffer, &filled_in_buffer);
    }
    else {
@@ -783,7 +814,7 @@ while ((c!=EOF) && (result == 0)) {
                  &shift);
          (*TOKENS_TOTAL)++;
          if (c>='0' && c<='9') (*DIGITS_TOTAL)++;
-         fast_fwrite_raw(coded_text, n, write_buffer, &pos_out_buffer, TOKENIZE_WRITE_BUFFER_SIZE);
+         save_token_code(coded_text, codes, n, write_buffer, &pos_out_buffer);
          c = fast_u_fgetc_raw(f_read, read_buffer, &pos_in_buffer, &filled_in_buffer);
       }
       else {
@@ -799,13 +830,15 @@ while ((c!=EOF) && (result == 0)) {
                  &shift);
          (*TOKENS_TOTAL)++;
          (*WORDS_TOTAL)++;
-         fast_fwrite_raw(coded_text, n, write_buffer, &pos_out_buffer, TOKENIZE_WRITE_BUFFER_SIZE);
+         save_token_code(coded_text, codes, n, write_buffer, &pos_out_buffer);
       }
    }
 }
 fast_fwrite_raw_flush(coded_text, write_buffer, &pos_out_buffer);
-for (n=0;n<tokens->nbelems;n++) {
-   u_fprintf(output,"%S\n",tokens->tab[n]);
+if (output!=NULL) {
+   for (n=0;n<tokens->nbelems;n++) {
+      u_fprintf(output,"%S\n",tokens->tab[n]);
+   }
 }
 if (result!=0) {
    u_printf("Unsucessfull.\n");
@@ -817,6 +850,295 @@ return SUCCESS_RETURN_CODE;
 }
 
 
+/**
+ * Number of characters tokenized by each thread in one round of
+ * tokenization_in_threads.
+ */
+#define TOKENIZE_CHUNK_SIZE 0x400000
+
+/**
+ * This structure describes the work of a Tokenize thread: a chunk of text
+ * tokenized with its own token numbering, that will be merged into the
+ * global one afterwards.
+ */
+struct tokenize_chunk {
+   const unichar* text;
+   int length;
+   Alphabet* alph;
+   int char_by_char;
+   vector_ptr* tokens;
+   struct hash_table* hashtable;
+   vector_int* n_occur;
+   vector_int* codes;
+   vector_int* n_enter_pos;
+   vector_int* snt_offsets;
+   int SENTENCES;
+   int TOKENS_TOTAL;
+   int WORDS_TOTAL;
+   int DIGITS_TOTAL;
+   int result;
+};
+
+
+static void init_tokenize_chunk(struct tokenize_chunk* chunk,const unichar* text,int length,
+                                Alphabet* alph,int char_by_char) {
+chunk->text=text;
+chunk->length=length;
+chunk->alph=alph;
+chunk->char_by_char=char_by_char;
+chunk->tokens=new_vector_ptr(4096);
+chunk->hashtable=new_hash_table((HASH_FUNCTION)hash_unichar,(EQUAL_FUNCTION)((EQUAL_UNICHAR_FUNCTION)u_equal),
+                                (FREE_FUNCTION)free,NULL,(KEYCOPY_FUNCTION)keycopy);
+chunk->n_occur=new_vector_int(4096);
+chunk->codes=new_vector_int(length/2+1);
+chunk->n_enter_pos=new_vector_int(1024);
+chunk->snt_offsets=new_vector_int(1024);
+chunk->SENTENCES=0;
+chunk->TOKENS_TOTAL=0;
+chunk->WORDS_TOTAL=0;
+chunk->DIGITS_TOTAL=0;
+chunk->result=0;
+}
+
+
+static void free_tokenize_chunk(struct tokenize_chunk* chunk) {
+free_vector_ptr(chunk->tokens,free);
+free_hash_table(chunk->hashtable);
+free_vector_int(chunk->n_occur);
+free_vector_int(chunk->codes);
+free_vector_int(chunk->n_enter_pos);
+free_vector_int(chunk->snt_offsets);
+}
+
+
+static void ABSTRACT_CALLBACK_UNITEX tokenize_chunk_thread(void* private_data,unsigned int /* thread_number */) {
+struct tokenize_chunk* chunk=(struct tokenize_chunk*)private_data;
+chunk->result=tokenization(NULL,NULL,NULL,chunk->alph,chunk->tokens,chunk->hashtable,chunk->n_occur,
+                           chunk->n_enter_pos,chunk->snt_offsets,&(chunk->SENTENCES),&(chunk->TOKENS_TOTAL),
+                           &(chunk->WORDS_TOTAL),&(chunk->DIGITS_TOTAL),NULL,NULL,chunk->char_by_char,
+                           chunk->text,chunk->length,chunk->codes);
+}
+
+
+static inline int is_separator(unichar c) {
+return c==' ' || c==0x0d || c==0x0a || c=='\t';
+}
+
+
+/**
+ * If text[i] is a new line that is not protected by a backslash, returns the
+ * position of the first character of the separator sequence that contains it;
+ * -1 otherwise. Since a tag cannot contain such a new line, the text can be
+ * cut at this position without changing its tokenization.
+ */
+static int chunk_boundary_at(const unichar* text,int i) {
+if (i==0 || text[i]!='\n' || text[i-1]=='\\') {
+   return -1;
+}
+while (i>0 && is_separator(text[i-1])) {
+   i--;
+}
+return i;
+}
+
+
+/**
+ * Returns the first position >=from and <to where the text can be cut,
+ * provided that it is greater than 'min', or -1 if there is none.
+ */
+static int find_next_chunk_boundary(const unichar* text,int from,int to,int min) {
+for (int i=from;i<to;i++) {
+   int boundary=chunk_boundary_at(text,i);
+   if (boundary>min) {
+      return boundary;
+   }
+}
+return -1;
+}
+
+
+/**
+ * Returns the last position where the text[0..length-1] can be cut, or -1 if
+ * there is none.
+ */
+static int find_last_chunk_boundary(const unichar* text,int length) {
+for (int i=length-1;i>0;i--) {
+   int boundary=chunk_boundary_at(text,i);
+   if (boundary>0) {
+      return boundary;
+   }
+}
+return -1;
+}
+
+
+/**
+ * Splits text[0..length-1] into at most 'n' chunks of about the same size.
+ * The chunk #i starts at bounds[i] and ends before bounds[i+1].
+ * Returns the number of chunks.
+ */
+static int split_text_into_chunks(const unichar* text,int length,int n,int* bounds) {
+int n_chunks=0;
+bounds[0]=0;
+for (int i=1;i<n;i++) {
+   int target=(int)((long long)length*i/n);
+   if (target<=bounds[n_chunks]) {
+      target=bounds[n_chunks]+1;
+   }
+   int boundary=find_next_chunk_boundary(text,target,length,bounds[n_chunks]);
+   if (boundary==-1) break;
+   bounds[++n_chunks]=boundary;
+}
+bounds[++n_chunks]=length;
+return n_chunks;
+}
+
+
+/**
+ * Adds the result of a chunk to the global data: its tokens are numbered in
+ * the order of their first occurrence, exactly as if the chunk had been
+ * tokenized after the previous ones, and its codes are saved in the coded text.
+ */
+static void merge_tokenize_chunk(struct tokenize_chunk* chunk,U_FILE* coded_text,
+                                 vector_ptr* tokens,struct hash_table* hashtable,
+                                 vector_int* n_occur,vector_int* n_enter_pos,
+                                 vector_int* snt_offsets,int* snt_offsets_shift,
+                                 int *SENTENCES,int *TOKENS_TOTAL,int *WORDS_TOTAL,
+                                 int *DIGITS_TOTAL) {
+int* renumber=(int*)malloc((chunk->tokens->nbelems+1)*sizeof(int));
+if (renumber==NULL) {
+   fatal_alloc_error("merge_tokenize_chunk");
+}
+for (int i=0;i<chunk->tokens->nbelems;i++) {
+   int ret;
+   unichar* token=(unichar*)chunk->tokens->tab[i];
+   struct any* value=get_value(hashtable,token,HT_INSERT_IF_NEEDED,&ret);
+   if (ret==HT_KEY_ADDED) {
+      /* The token string is moved from the chunk to the global token list */
+      value->_int=vector_ptr_add(tokens,token);
+      chunk->tokens->tab[i]=NULL;
+      vector_int_add(n_occur,0);
+   }
+   renumber[i]=value->_int;
+   n_occur->tab[renumber[i]]+=chunk->n_occur->tab[i];
+}
+int* codes=chunk->codes->tab;
+for (int i=0;i<chunk->codes->nbelems;i++) {
+   codes[i]=renumber[codes[i]];
+}
+fwrite(codes,sizeof(int),chunk->codes->nbelems,coded_text);
+free(renumber);
+for (int i=0;i<chunk->n_enter_pos->nbelems;i++) {
+   vector_int_add(n_enter_pos,*TOKENS_TOTAL+chunk->n_enter_pos->tab[i]);
+}
+/* snt_offsets contains triples (token position, shift before, shift after) */
+int local_shift=0;
+for (int i=0;i<chunk->snt_offsets->nbelems;i=i+3) {
+   add_snt_offsets(snt_offsets,*TOKENS_TOTAL+chunk->snt_offsets->tab[i],
+                   *snt_offsets_shift+chunk->snt_offsets->tab[i+1],
+                   *snt_offsets_shift+chunk->snt_offsets->tab[i+2]);
+   local_shift=chunk->snt_offsets->tab[i+2];
+}
+(*snt_offsets_shift)+=local_shift;
+(*SENTENCES)+=chunk->SENTENCES;
+(*TOKENS_TOTAL)+=chunk->TOKENS_TOTAL;
+(*WORDS_TOTAL)+=chunk->WORDS_TOTAL;
+(*DIGITS_TOTAL)+=chunk->DIGITS_TOTAL;
+}
+
+
+/**
+ * Multi-threaded version of tokenization. The text is read by blocks that are
+ * cut into chunks at new lines, the chunks are tokenized by parallel threads
+ * with their own token lists, and then merged in text order, so that the
+ * output is the same as the one of tokenization. The end of a block that
+ * follows its last possible cut is kept for the next one.
+ */
+static int tokenization_in_threads(U_FILE* f_read,U_FILE* coded_text,U_FILE* output,Alphabet* alph,
+                         vector_ptr* tokens,struct hash_table* hashtable,
+                         vector_int* n_occur,vector_int* n_enter_pos,
+                         vector_int* snt_offsets,
+                         int *SENTENCES,int *TOKENS_TOTAL,int *WORDS_TOTAL,
+                         int *DIGITS_TOTAL,int char_by_char,int n_threads) {
+int capacity=n_threads*TOKENIZE_CHUNK_SIZE;
+unichar* text=(unichar*)malloc(capacity*sizeof(unichar));
+int* bounds=(int*)malloc((n_threads+1)*sizeof(int));
+struct tokenize_chunk* chunks=(struct tokenize_chunk*)malloc(n_threads*sizeof(struct tokenize_chunk));
+void** chunks_ptr=(void**)malloc(n_threads*sizeof(void*));
+if (text==NULL || bounds==NULL || chunks==NULL || chunks_ptr==NULL) {
+   fatal_alloc_error("tokenization_in_threads");
+}
+u_printf("Using %d threads...\n",n_threads);
+int filled=0;
+int end_of_file=0;
+int snt_offsets_shift=0;
+long long total_read=0;
+int result=SUCCESS_RETURN_CODE;
+while (result==SUCCESS_RETURN_CODE && (!end_of_file || filled>0)) {
+   if (!end_of_file) {
+      int n=u_fget_unichars_raw(text+filled,capacity-filled,f_read);
+      if (n>0) {
+         filled=filled+n;
+      }
+      if (filled<capacity) {
+         end_of_file=1;
+      }
+   }
+   if (filled==0) break;
+   int length=filled;
+   if (!end_of_file) {
+      length=find_last_chunk_boundary(text,filled);
+      if (length==-1) {
+         /* No place to cut the text: we need a larger block */
+         capacity=capacity*2;
+         unichar* more_text=(unichar*)realloc(text,capacity*sizeof(unichar));
+         if (more_text==NULL) {
+            fatal_alloc_error("tokenization_in_threads");
+         }
+         text=more_text;
+         continue;
+      }
+   }
+   int n_chunks=split_text_into_chunks(text,length,n_threads,bounds);
+   for (int i=0;i<n_chunks;i++) {
+      init_tokenize_chunk(&(chunks[i]),text+bounds[i],bounds[i+1]-bounds[i],alph,char_by_char);
+      chunks_ptr[i]=&(chunks[i]);
+   }
+   logger::SyncDoRunThreads((unsigned int)n_chunks,tokenize_chunk_thread,chunks_ptr);
+   for (int i=0;i<n_chunks;i++) {
+      if (result==SUCCESS_RETURN_CODE) {
+         if (chunks[i].result!=SUCCESS_RETURN_CODE) {
+            result=chunks[i].result;
+         } else {
+            merge_tokenize_chunk(&(chunks[i]),coded_text,tokens,hashtable,n_occur,n_enter_pos,
+                                 snt_offsets,&snt_offsets_shift,SENTENCES,TOKENS_TOTAL,
+                                 WORDS_TOTAL,DIGITS_TOTAL);
+         }
+      }
+      free_tokenize_chunk(&(chunks[i]));
+   }
+   memmove(text,text+length,(filled-length)*sizeof(unichar));
+   filled=filled-length;
+   total_read+=length;
+   int z=(int)(total_read/(1024*512));
+   if (z>0) {
+      u_printf("%d megabyte%s read...       \r",z,(z>1)?"s":"");
+   }
+}
+free(chunks_ptr);
+free(chunks);
+free(bounds);
+free(text);
+if (result!=SUCCESS_RETURN_CODE) {
+   return result;
+}
+for (int n=0;n<tokens->nbelems;n++) {
+   u_fprintf(output,"%S\n",tokens->tab[n]);
+}
+return SUCCESS_RETURN_CODE;
+}
+
+
 
 static int partition_pour_quicksort_by_frequence(int m, int n,vector_ptr* tokens,vector_int* n_occur) {
 int pivot;
@@ -911,7 +1233,7 @@ for (int i=0;i<tokens->nbelems;i++) {
 
 
 
-static void compute_statistics(U_FILE *f,vector_ptr* tokens,Alphabet* alph,
+static void compute_statistics(U_FILE *f,vector_ptr* tokens,const Alphabet* alph,
                         int SENTENCES,int TOKENS_TOTAL,int WORDS_TOTAL,int DIGITS_TOTAL) {
 int DIFFERENT_DIGITS=0;
 int DIFFERENT_WORDS=0;
@@ -933,4 +1255,127 @@ static void save_new_line_positions(U_FILE* f,vector_int* n_enter_pos) {
 fwrite(n_enter_pos->tab,sizeof(int),n_enter_pos->nbelems,f);
 }
 
+
+
+/**
+ * Saves the stats.n, tok_by_freq.txt and tok_by_alph.txt files of the given
+ * snt directory. Note that 'tokens' and 'n_occur' are sorted by this function.
+ */
+static void save_statistics_files(const VersatileEncodingConfig* vec,const char* snt_dir,
+                                  vector_ptr* tokens,vector_int* n_occur,const Alphabet* alph,
+                                  int SENTENCES,int TOKENS_TOTAL,int WORDS_TOTAL,int DIGITS_TOTAL) {
+char name[FILENAME_MAX];
+U_FILE* f;
+// we compute some statistics
+strcpy(name,snt_dir);
+strcat(name,"stats.n");
+f=u_fopen(vec,name,U_WRITE);
+if (f==NULL) {
+   error("Cannot write %s\n",name);
+}
+else {
+   compute_statistics(f,tokens,alph,SENTENCES,TOKENS_TOTAL,WORDS_TOTAL,DIGITS_TOTAL);
+   u_fclose(f);
+}
+// we save the tokens by frequence
+strcpy(name,snt_dir);
+strcat(name,"tok_by_freq.txt");
+f=u_fopen(vec,name,U_WRITE);
+if (f==NULL) {
+   error("Cannot write %s\n",name);
+}
+else {
+   sort_and_save_by_frequence(f,tokens,n_occur);
+   u_fclose(f);
+}
+// we save the tokens by alphabetical order
+strcpy(name,snt_dir);
+strcat(name,"tok_by_alph.txt");
+f=u_fopen(vec,name,U_WRITE);
+if (f==NULL) {
+   error("Cannot write %s\n",name);
+}
+else {
+   sort_and_save_by_alph_order(f,tokens,n_occur);
+   u_fclose(f);
+}
+}
+
+
+struct token_table* new_token_table() {
+struct token_table* table=(struct token_table*)malloc(sizeof(struct token_table));
+if (table==NULL) {
+   fatal_alloc_error("new_token_table");
+}
+table->tokens=new_vector_ptr(4096);
+table->hashtable=new_hash_table((HASH_FUNCTION)hash_unichar,(EQUAL_FUNCTION)((EQUAL_UNICHAR_FUNCTION)u_equal),
+                                (FREE_FUNCTION)free,NULL,(KEYCOPY_FUNCTION)keycopy);
+table->n_occur=new_vector_int(4096);
+return table;
+}
+
+
+void free_token_table(struct token_table* table) {
+if (table==NULL) return;
+free_vector_ptr(table->tokens,free);
+free_hash_table(table->hashtable);
+free_vector_int(table->n_occur);
+free(table);
+}
+
+
+/**
+ * Tokenizes the 'length' characters of 'text' exactly as Tokenize does, the
+ * tokens being numbered in 'table'. Their numbers are appended to 'codes',
+ * and the positions in 'codes' of the separators that contain a new line are
+ * appended to 'enter_pos'. Returns 0 on success.
+ */
+int tokenize_buffer(const unichar* text,int length,const Alphabet* alph,int char_by_char,
+                    struct token_table* table,vector_int* codes,vector_int* enter_pos,int report_errors) {
+int SENTENCES=0;
+int TOKENS_TOTAL=codes->nbelems;
+int WORDS_TOTAL=0;
+int DIGITS_TOTAL=0;
+return tokenization(NULL,NULL,NULL,alph,table->tokens,table->hashtable,table->n_occur,enter_pos,NULL,
+                    &SENTENCES,&TOKENS_TOTAL,&WORDS_TOTAL,&DIGITS_TOTAL,NULL,NULL,char_by_char,
+                    text,length,codes,report_errors);
+}
+
+
+/**
+ * Saves the stats.n, tok_by_freq.txt and tok_by_alph.txt files of the given
+ * snt directory for a text whose token sequence is 'codes', as Tokenize would
+ * have done if it had read this text.
+ */
+void save_token_statistics(const VersatileEncodingConfig* vec,const char* snt_dir,
+                           const unichar* const* tokens,int n_tokens,const vector_int* codes,
+                           const Alphabet* alph,int char_by_char) {
+vector_ptr* sorted_tokens=new_vector_ptr(n_tokens+1);
+vector_int* n_occur=new_vector_int(n_tokens+1);
+for (int i=0;i<n_tokens;i++) {
+   vector_ptr_add(sorted_tokens,(void*)tokens[i]);
+   vector_int_add(n_occur,0);
+}
+for (int i=0;i<codes->nbelems;i++) {
+   n_occur->tab[codes->tab[i]]++;
+}
+int SENTENCES=0;
+int WORDS_TOTAL=0;
+int DIGITS_TOTAL=0;
+for (int i=0;i<n_tokens;i++) {
+   const unichar* s=tokens[i];
+   int n=n_occur->tab[i];
+   if (s[0]=='{') {
+      if (!u_strcmp(s,"{S}")) SENTENCES+=n;
+   } else if (s[0]!=' ') {
+      /* The same counters as the ones of tokenization */
+      if (is_letter(s[0],alph)) WORDS_TOTAL+=n;
+      if (s[1]=='\0' && s[0]>='0' && s[0]<='9' && (char_by_char || !is_letter(s[0],alph))) DIGITS_TOTAL+=n;
+   }
+}
+save_statistics_files(vec,snt_dir,sorted_tokens,n_occur,alph,SENTENCES,codes->nbelems,WORDS_TOTAL,DIGITS_TOTAL);
+free_vector_ptr(sorted_tokens);
+free_vector_int(n_occur);
+}
+
 } // namespace unitex
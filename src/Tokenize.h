@@ -23,6 +23,9 @@
 #define TokenizeH
 
 #include "UnitexGetOpt.h"
+#include "Unicode.h"
+#include "Alphabet.h"
+#include "Vector.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -36,6 +39,23 @@ extern const char* usage_Tokenize;
 
 int main_Tokenize(int argc,char* const argv[]);
 
+/**
+ * The tokens found by tokenize_buffer, numbered in their order of
+ * appearance, with their number of occurrences.
+ */
+struct token_table {
+   vector_ptr* tokens;
+   struct hash_table* hashtable;
+   vector_int* n_occur;
+};
+
+struct token_table* new_token_table();
+void free_token_table(struct token_table*);
+int tokenize_buffer(const unichar*,int,const Alphabet*,int,struct token_table*,
+                    vector_int*,vector_int*,int);
+void save_token_statistics(const VersatileEncodingConfig*,const char*,const unichar* const*,int,
+                           const vector_int*,const Alphabet*,int);
+
 } // namespace unitex
 
 #endif
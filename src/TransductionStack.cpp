@@ -124,6 +124,232 @@ void push_output_string(struct stack_unichar* stack,const char* s) {
 push_input_string(stack,s,0);
 }
 
+
+static void free_elg_call_result(void* ptr) {
+struct elg_call_result* res=(struct elg_call_result*)ptr;
+if (res==NULL) return;
+for (int i=0;i<res->n_outputs;i++) {
+   free(res->outputs[i]);
+}
+free(res->outputs);
+free(res);
+}
+
+
+/**
+ * Allocates and returns a cache for the results of the pure extended
+ * functions, that will contain at most 'max_size' results.
+ */
+struct elg_call_cache* new_elg_call_cache(int max_size) {
+struct elg_call_cache* c=(struct elg_call_cache*)malloc(sizeof(struct elg_call_cache));
+if (c==NULL) {
+   fatal_alloc_error("new_elg_call_cache");
+}
+c->max_size=max_size;
+c->results=new_hash_table((HASH_FUNCTION)hash_unichar,(EQUAL_FUNCTION)((EQUAL_UNICHAR_FUNCTION)u_equal),
+      (FREE_FUNCTION)free,free_elg_call_result,(KEYCOPY_FUNCTION)keycopy);
+c->functions=new_string_hash_ptr();
+c->flushes=0;
+c->key=new_Ustring(256);
+return c;
+}
+
+
+static void free_elg_function_stats(void* ptr) {
+struct elg_function_stats* stats=(struct elg_function_stats*)ptr;
+if (stats==NULL) return;
+free(stats->name);
+free(stats);
+}
+
+
+/**
+ * Frees the given cache.
+ */
+void free_elg_call_cache(struct elg_call_cache* c) {
+if (c==NULL) return;
+free_hash_table(c->results);
+free_string_hash_ptr(c->functions,free_elg_function_stats);
+free_Ustring(c->key);
+free(c);
+}
+
+
+/**
+ * Returns the counters of the function named 'name', creating them if needed.
+ */
+static struct elg_function_stats* get_elg_function_stats(struct elg_call_cache* c,const unichar* name) {
+int index=get_value_index(name,c->functions,INSERT_IF_NEEDED,NULL);
+struct elg_function_stats* stats=(struct elg_function_stats*)c->functions->value[index];
+if (stats==NULL) {
+   stats=(struct elg_function_stats*)malloc(sizeof(struct elg_function_stats));
+   if (stats==NULL) {
+      fatal_alloc_error("get_elg_function_stats");
+   }
+   stats->name=u_strdup(name);
+   stats->pure=-1;
+   stats->hits=0;
+   stats->misses=0;
+   c->functions->value[index]=stats;
+}
+return stats;
+}
+
+
+/**
+ * Adds the counters of 'src' to the ones of 'dest'. This is used to
+ * gather the statistics of the Locate threads.
+ */
+void merge_elg_call_cache_statistics(struct elg_call_cache* dest,const struct elg_call_cache* src) {
+if (dest==NULL || src==NULL) return;
+for (int i=0;i<src->functions->size;i++) {
+   const struct elg_function_stats* s=(const struct elg_function_stats*)src->functions->value[i];
+   struct elg_function_stats* d=get_elg_function_stats(dest,s->name);
+   if (d->pure==-1) {
+      d->pure=s->pure;
+   }
+   d->hits+=s->hits;
+   d->misses+=s->misses;
+}
+dest->flushes+=src->flushes;
+}
+
+
+/**
+ * Prints the hit/miss counters of the pure extended functions that have
+ * been called, if any.
+ */
+void print_elg_call_cache_statistics(U_FILE* f,const struct elg_call_cache* c) {
+if (c==NULL) return;
+for (int i=0;i<c->functions->size;i++) {
+   const struct elg_function_stats* s=(const struct elg_function_stats*)c->functions->value[i];
+   if (s->pure!=1 || s->hits+s->misses==0) continue;
+   u_fprintf(f,"ELG cache: @%S: %lu hit%s, %lu miss%s\n",s->name,
+             s->hits,(s->hits==1)?"":"s",
+             s->misses,(s->misses==1)?"":"es");
+}
+if (c->flushes!=0) {
+   u_fprintf(f,"ELG cache: %lu flush%s\n",c->flushes,(c->flushes==1)?"":"es");
+}
+}
+
+
+/**
+ * Adds a string argument to the key of the current call. The length is
+ * used as a prefix, so that two different argument lists cannot give the
+ * same key.
+ */
+static void add_elg_call_key_string(Ustring* key,const unichar* s,int length) {
+char prefix[16];
+sprintf(prefix,"s%d:",length);
+u_strcat(key,prefix);
+u_strcat(key,s,length);
+}
+
+
+/**
+ * Loads the extended function and pushes the arguments that have only been
+ * recorded in the key of the current call so far, as process_extended_output
+ * would have done. 'utf8' is a buffer used to encode the strings. Returns 0,
+ * the new value of the 'elg_deferred' flag.
+ */
+static int push_deferred_elg_call(struct locate_parameters* p,const char* extension_name,
+                                  const char* function_name,char* utf8) {
+p->elg->load_extension(extension_name,function_name);
+const unichar* key=p->elg_cache->key->str;
+int i=0;
+while (key[i]!='(') i++;
+i++;
+while (key[i]!='\0' && key[i]!='!') {
+   switch (key[i]) {
+      case 'n': p->elg->pushnil(); i++; break;
+      case 't': p->elg->pushboolean(1); i++; break;
+      case 'f': p->elg->pushboolean(0); i++; break;
+      case 's': {
+         int length=0;
+         for (i++;key[i]!=':';i++) {
+            length=length*10+(key[i]-'0');
+         }
+         i++;
+         unichar* tmp=u_strndup(key+i,length);
+         p->elg->pushlstring(utf8,u_encode_utf8(tmp,utf8));
+         free(tmp);
+         i+=length;
+         break;
+      }
+      default: fatal_error("push_deferred_elg_call: invalid key\n");
+   }
+}
+return 0;
+}
+
+
+/**
+ * Stores the result of the current call, whose key is in c->key. 'retval' is
+ * the value returned by vm::call, 'old_top' and 'old_sets' are the states
+ * of the render before the call. If the cache is full, it is flushed first.
+ */
+static void memoize_elg_call_result(struct elg_call_cache* c,int retval,int old_top,int old_sets,
+                                    const struct extended_output_render* r) {
+if (c->results->number_of_elements>=c->max_size) {
+   clear_hash_table(c->results);
+   c->flushes++;
+}
+struct elg_call_result* res=(struct elg_call_result*)malloc(sizeof(struct elg_call_result));
+if (res==NULL) {
+   fatal_alloc_error("memoize_elg_call_result");
+}
+res->retval=retval;
+res->is_set=0;
+res->cut_after=0;
+res->n_outputs=0;
+res->outputs=NULL;
+if (retval) {
+   if (r->output_sets->nbelems>old_sets) {
+      /* The function returned an array */
+      const vector_ptr* set=(const vector_ptr*)r->output_sets->tab[old_sets];
+      res->is_set=1;
+      res->cut_after=r->cut_after_policy->tab[old_sets];
+      res->n_outputs=set->nbelems;
+   } else {
+      res->n_outputs=1;
+   }
+   res->outputs=(unichar**)malloc(res->n_outputs*sizeof(unichar*));
+   if (res->outputs==NULL) {
+      fatal_alloc_error("memoize_elg_call_result");
+   }
+   if (res->is_set) {
+      const vector_ptr* set=(const vector_ptr*)r->output_sets->tab[old_sets];
+      for (int i=0;i<res->n_outputs;i++) {
+         res->outputs[i]=u_strdup((const unichar*)set->tab[i]);
+      }
+   } else {
+      res->outputs[0]=u_strndup(r->stack_template->buffer+old_top+1,r->stack_template->top-old_top);
+   }
+}
+get_value(c->results,c->key->str,HT_INSERT_IF_NEEDED)->_ptr=res;
+}
+
+
+/**
+ * Applies to the render a memoized result, as vm::call would have done.
+ * Returns the value that vm::call returned.
+ */
+static int replay_elg_call_result(const struct elg_call_result* res,struct extended_output_render* r) {
+if (!res->retval) {
+   return 0;
+}
+if (res->is_set) {
+   int set_number=r->new_output_set(res->n_outputs,res->cut_after,r->stack_template->top);
+   for (int i=0;i<res->n_outputs;i++) {
+      r->add_output(set_number,res->outputs[i]);
+   }
+} else {
+   push_array(r->stack_template,res->outputs[0],u_strlen(res->outputs[0]));
+}
+return 1;
+}
+
 //// A RAII class to make sure lua state gets closed when exceptions are thrown
 //class LuaClose {
 //    lua_State* L;
@@ -331,7 +557,36 @@ for (;;) {
 //          fatal_error("Error loading @%S, function doesn't exists\n",function_name);
 //        }
 
-        p->elg->load_extension(char_extension_name, char_function_name);
+        // 17.10.26 the calls to a function declared pure by its extension
+        // are memoized, unless an argument is a reference. Once we know that
+        // the function is pure, we don't push anything onto the Lua stack
+        // until we know that the result is not in the cache (elg_deferred)
+        struct elg_function_stats* elg_stats = NULL;
+        int elg_memoize = 0;
+        int elg_deferred = 0;
+        if (p->elg_cache != NULL) {
+          Ustring* key = p->elg_cache->key;
+          empty(key);
+          u_strcat(key, extension_name);
+          if (function_name[0]) {
+            u_strcat(key, ".");
+            u_strcat(key, function_name);
+          }
+          elg_stats = get_elg_function_stats(p->elg_cache, key->str);
+          elg_deferred = (elg_stats->pure == 1);
+        }
+
+        if (!elg_deferred) {
+          p->elg->load_extension(char_extension_name, char_function_name);
+          if (elg_stats != NULL && elg_stats->pure == -1) {
+            elg_stats->pure = p->elg->is_pure_function(char_function_name);
+          }
+        }
+
+        if (elg_stats != NULL && elg_stats->pure == 1) {
+          elg_memoize = 1;
+          u_strcat(p->elg_cache->key, "(");
+        }
 
         variable_name[0] = '\0';
         variable_index   = -1;
@@ -600,31 +855,43 @@ for (;;) {
                 break;
               case PARAM_TNIL:
                 // push a nil value
-                p->elg->pushnil();
+                if (!elg_deferred) p->elg->pushnil();
+                if (elg_memoize) u_strcat(p->elg_cache->key, 'n');
                 ++script_params_count;
                 break;
               case PARAM_TBOOLEAN:
                 // push a boolean
-                p->elg->pushboolean(tboolean_parameter);
+                if (!elg_deferred) p->elg->pushboolean(tboolean_parameter);
+                if (elg_memoize) u_strcat(p->elg_cache->key, tboolean_parameter ? 't' : 'f');
                 ++script_params_count;
                 break;
               case PARAM_TLIGHTUSERDATA:
                 // push a light user data
+                if (elg_deferred) elg_deferred = push_deferred_elg_call(p, char_extension_name, char_function_name, tstring_parameter_stack);
                 p->elg->pushlightuserdata(tlightuserdata);
+                elg_memoize = 0;
                 ++script_params_count;
                 break;
               case PARAM_TNUMBER:
                 // push a number
+                if (elg_deferred) elg_deferred = push_deferred_elg_call(p, char_extension_name, char_function_name, tstring_parameter_stack);
                 p->elg->pushinteger(tnumber_parameter);
+                // the number is the index of a variable passed by reference
+                elg_memoize = 0;
                 ++script_params_count;
                 break;
               case PARAM_TSTRING:
                 // push the content of the paramater stack as an encoded utf8 string
                 if(!is_empty(parameter_stack)) {
                   parameter_stack->buffer[parameter_stack->top+1]='\0';
-                  // 12.09.16 add u_encode_utf8 to allow send unicode chars
-                  int tstring_parameter_length = u_encode_utf8(parameter_stack->buffer,tstring_parameter_stack);
-                  p->elg->pushlstring(tstring_parameter_stack, tstring_parameter_length);
+                  if (!elg_deferred) {
+                    // 12.09.16 add u_encode_utf8 to allow send unicode chars
+                    int tstring_parameter_length = u_encode_utf8(parameter_stack->buffer,tstring_parameter_stack);
+                    p->elg->pushlstring(tstring_parameter_stack, tstring_parameter_length);
+                  }
+                  if (elg_memoize) {
+                    add_elg_call_key_string(p->elg_cache->key, parameter_stack->buffer, parameter_stack->top+1);
+                  }
                   empty(parameter_stack);
                   tstring_parameter_stack[0] = '\0';
                   ++script_params_count;
@@ -636,14 +903,18 @@ for (;;) {
                 break;
               case PARAM_TUSERDATA:
                 // push a user data
+                if (elg_deferred) elg_deferred = push_deferred_elg_call(p, char_extension_name, char_function_name, tstring_parameter_stack);
                 p->elg->pushuserdata(tuserdata);
+                elg_memoize = 0;
                 ++script_params_count;
                 break;
               case PARAM_TTHREAD:
                 break;
               case PARAM_TLIGHTUSTRING:
                 // push a ustring data
+                if (elg_deferred) elg_deferred = push_deferred_elg_call(p, char_extension_name, char_function_name, tstring_parameter_stack);
                 p->elg->pushlightustring(tustring);
+                elg_memoize = 0;
                 ++script_params_count;
                 break;
             }
@@ -732,7 +1003,37 @@ for (;;) {
 //        ++script_params_count;
 //        p->elg->push(p->graph_filename);
 //        p->elg->setglobal("stack_pointer");
-        if(!p->elg->call(char_function_name,script_params_count,cut_after,r)) {
+        if (elg_memoize) {
+          if (cut_after != CUT_AFTER_EXHAUSTIVELY_CHECK) {
+            u_strcat(p->elg_cache->key, '!');
+          }
+          struct any* value = get_value(p->elg_cache->results, p->elg_cache->key->str, HT_DONT_INSERT);
+          if (value != NULL) {
+            // the result is already known, there is no need to call the function
+            elg_stats->hits++;
+            if (!elg_deferred) {
+              p->elg->cancel_call(script_params_count);
+            }
+            if (!replay_elg_call_result((struct elg_call_result*) value->_ptr, r)) {
+              r->stack_template->top=old_stack_pointer;
+              return 0;
+            }
+            ++i1;
+            continue;
+          }
+          elg_stats->misses++;
+          if (elg_deferred) {
+            elg_deferred = push_deferred_elg_call(p, char_extension_name, char_function_name, tstring_parameter_stack);
+          }
+        }
+
+        int elg_old_top = r->stack_template->top;
+        int elg_old_sets = r->output_sets->nbelems;
+        int elg_retval = p->elg->call(char_function_name,script_params_count,cut_after,r);
+        if (elg_memoize) {
+          memoize_elg_call_result(p->elg_cache, elg_retval, elg_old_top, elg_old_sets, r);
+        }
+        if(!elg_retval) {
           r->stack_template->top=old_stack_pointer;
           p->elg->restore_local_environment();
 //          p->elg->setup_local_environment();
@@ -26,6 +26,9 @@
 #include "LocatePattern.h"
 #include "Stack_unichar.h"
 #include "UnitexString.h"
+#include "String_hash.h"
+#include "HashTable.h"
+#include "Ustring.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -60,6 +63,55 @@ void push_output_string(struct stack_unichar*, const char*);
 void push_output_string(struct stack_unichar*,unichar*);
 
 
+/**
+ * This is the memoized result of a call to a pure extended function. If
+ * the function returned an array, 'outputs' contains its elements and
+ * 'cut_after' is the cut policy of the call. Otherwise, 'outputs' contains
+ * the only string that was appended to the output. 'retval' is the value
+ * returned by vm::call.
+ */
+struct elg_call_result {
+   int retval;
+   int is_set;
+   int cut_after;
+   int n_outputs;
+   unichar** outputs;
+};
+
+
+/**
+ * Counters of an extended function named 'name' ("extension.function").
+ * 'pure' is -1 until the function is called for the first time.
+ */
+struct elg_function_stats {
+   unichar* name;
+   int pure;
+   unsigned long hits;
+   unsigned long misses;
+};
+
+
+/**
+ * This cache memoizes the results of the extended functions that their
+ * extension declares pure. The keys are made of the extension name, the
+ * function name and the arguments. When 'results' contains 'max_size'
+ * entries, it is flushed. 'functions' associates elg_function_stats to the
+ * function names.
+ */
+struct elg_call_cache {
+   int max_size;
+   struct hash_table* results;
+   struct string_hash_ptr* functions;
+   unsigned long flushes;
+   /* Buffer used to build the key of the current call */
+   Ustring* key;
+};
+
+struct elg_call_cache* new_elg_call_cache(int max_size);
+void free_elg_call_cache(struct elg_call_cache*);
+void merge_elg_call_cache_statistics(struct elg_call_cache* dest,const struct elg_call_cache* src);
+void print_elg_call_cache_statistics(U_FILE*,const struct elg_call_cache*);
+
 void append_literal_output(struct stack_unichar*, struct locate_parameters*, int*);
 int deal_with_extended_output(unichar*, struct locate_parameters*, struct extended_output_render*);
 int process_extended_output(unichar*,struct locate_parameters*, int, struct extended_output_render*, OutputVariables*);
@@ -45,6 +45,7 @@
 #include "HashTable.h"
 #include "TfstStats.h"
 #include "Offsets.h"
+#include "Tfst.h"
 
 #ifndef HAS_UNITEX_NAMESPACE
 #define HAS_UNITEX_NAMESPACE 1
@@ -116,6 +117,10 @@ const char* usage_Txt2Tfst =
          "  -t XXX/--tagset=XXX: use the XXX ELAG tagset file to normalize the dictionary entries\n"
          "  -K/--korean: tells Txt2Tfst that it works on Korean\n"
          "  -S/--no_statistics: do not produce statistics file\n"
+         "  -b/--binary: also saves the text automaton in the binary format \"text.tfstb\",\n"
+         "               that can be given to LocateTfst, Elag, Tagger, etc. instead of \"text.tfst\"\n"
+         "  -T/--convert: <snt> is not a text but a text automaton, which is converted into\n"
+         "                the other format: X.tfst gives X.tfstb and X.tfstb gives X.tfst and X.tind\n"
          "  -V/--only-verify-arguments: only verify arguments syntax and exit\n"
          "  -h/--help: this help\n"
          "\n"
@@ -132,7 +137,7 @@ static void usage() {
 }
 
 
-const char* optstring_Txt2Tfst=":a:cn:t:KVhk:q:S";
+const char* optstring_Txt2Tfst=":a:cn:t:KVhk:q:SbT";
 const struct option_TS lopts_Txt2Tfst[]={
   {"alphabet", required_argument_TS, NULL, 'a'},
   {"clean", no_argument_TS, NULL, 'c'},
@@ -144,6 +149,8 @@ const struct option_TS lopts_Txt2Tfst[]={
   {"input_encoding",required_argument_TS,NULL,'k'},
   {"output_encoding",required_argument_TS,NULL,'q'},
   {"no_statistics",no_argument_TS,NULL,'S'},
+  {"binary",no_argument_TS,NULL,'b'},
+  {"convert",no_argument_TS,NULL,'T'},
   {NULL, no_argument_TS, NULL, 0}
 };
 
@@ -155,6 +162,8 @@ if (argc==1) {
 }
 
 int save_statistics=1;
+int binary=0;
+int convert=0;
 char alphabet[FILENAME_MAX]="";
 char norm[FILENAME_MAX]="";
 char tagset[FILENAME_MAX]="";
@@ -189,6 +198,10 @@ while (EOF!=(val=options.parse_long(argc,argv,optstring_Txt2Tfst,lopts_Txt2Tfst,
              break;
    case 'S': save_statistics = 0;
              break;
+   case 'b': binary=1;
+             break;
+   case 'T': convert=1;
+             break;
    case 'V': only_verify_arguments = true;
              break;
    case 'h': usage();
@@ -240,6 +253,23 @@ if (only_verify_arguments) {
   return SUCCESS_RETURN_CODE;
 }
 
+if (convert) {
+   const char* input=argv[options.vars()->optind];
+   char output[FILENAME_MAX];
+   remove_extension(input,output);
+   int ok;
+   if (is_binary_text_automaton(input)) {
+      strcat(output,".tfst");
+      u_printf("Converting %s into %s...\n",input,output);
+      ok=convert_tfstb_to_tfst(&vec,input,output);
+   } else {
+      strcat(output,".tfstb");
+      u_printf("Converting %s into %s...\n",input,output);
+      ok=convert_tfst_to_tfstb(&vec,input,output);
+   }
+   return ok?SUCCESS_RETURN_CODE:DEFAULT_ERROR_CODE;
+}
+
 struct DELA_tree* tree=new_DELA_tree();
 int buffer[MAX_TOKENS_IN_SENTENCE];
 char tokens_txt[FILENAME_MAX];
@@ -450,6 +480,16 @@ u_fclose(tind);
 // close tfst before call write_number_of_graphs()
 u_fclose(tfst);
 write_number_of_graphs(&vec,text_tfst,sentence_number-1,0);
+int ret=SUCCESS_RETURN_CODE;
+if (binary) {
+   char text_tfstb[FILENAME_MAX];
+   get_snt_path(argv[options.vars()->optind],text_tfstb);
+   strcat(text_tfstb,"text.tfstb");
+   u_printf("Saving %s...\n",text_tfstb);
+   if (!convert_tfst_to_tfstb(&vec,text_tfst,text_tfstb)) {
+      ret=DEFAULT_ERROR_CODE;
+   }
+}
 free_text_tokens(tokens);
 delete korean;
 free_alphabet(alph);
@@ -457,7 +497,7 @@ free_DELA_tree(tree);
 
 /* After the execution, tag_list should have been emptied, so that we don't
  * need to do it here */
-return SUCCESS_RETURN_CODE;
+return ret;
 }
 
 } // namespace unitex
@@ -1085,6 +1085,36 @@ return c;
 
 
 int u_ungetc_raw(Encoding,unichar,ABSTRACTFILE*);
+/**
+ * Reads the character that may follow a \r that has just been read, and puts
+ * it back into the file if it is not a \n.
+ */
+static void skip_LF_after_CR(Encoding encoding,ABSTRACTFILE* f) {
+int c;
+if (encoding==UTF8) {
+   unsigned char b;
+   if (af_fread(&b,1,1,f)!=1) return;
+   c=b;
+} else {
+   c=u_fgetc_raw(encoding,f);
+}
+if (c==EOF || c==0x0A) return;
+switch(encoding) {
+   case UTF16_LE:
+   case BIG_ENDIAN_UTF16:
+   case PLATFORM_DEPENDENT_UTF16: {
+      u_ungetc_raw(encoding,(unichar)c,f);
+      break;
+   }
+   case UTF8:
+   case ASCII: {
+      af_ungetc((char)c,f);
+      break;
+   }
+}
+}
+
+
 /**
  * A version of u_fgetc that returns \n whatever it reads \n, \r or \r\n.
  */
@@ -1097,35 +1127,7 @@ if (c==0x0A) {
    return '\n';
 }
 if (c==0x0D) {
-   if (encoding==UTF8) {
-      /* In UTF8, we know that if we look for a \n, it will take 1 byte. This
-       * is a trick in order to avoid reading a character made of several bytes
-       * that we should put back to the file. */
-      if (af_fread(&c,1,1,f)!=1)
-          c=EOF;
-   } else {
-      c=u_fgetc_raw(encoding,f);
-   }
-   if (c==EOF) {
-      return '\n';
-   }
-   if (c!=0x0A) {
-      /* If there is no 0x0A after 0x0D, we put back the character */
-      switch(encoding) {
-         case UTF16_LE:
-         case BIG_ENDIAN_UTF16:
-         case PLATFORM_DEPENDENT_UTF16:
-         {
-            u_ungetc_raw(encoding,(unichar)c,f);
-            break;
-         }
-         case UTF8:
-         case ASCII: {
-            af_ungetc((char)c,f);
-            break;
-         }
-      }
-   }
+   skip_LF_after_CR(encoding,f);
    return '\n';
 }
 return c;
@@ -1140,11 +1142,11 @@ return c;
  * WARNING: this function will be deprecated
  */
 int u_fread_raw(Encoding encoding,unichar* t,int N,ABSTRACTFILE* f) {
-int i,c;
-for (i=0;i<N;i++) {
-   c=u_fgetc_raw(encoding,f);
-   if (c==EOF) return i;
-   t[i]=(unichar)c;
+int i=0;
+while (i<N) {
+   int n=u_fget_unichars_raw(encoding,t+i,N-i,f);
+   if (n<=0) break;
+   i=i+n;
 }
 return i;
 }
@@ -1155,20 +1157,38 @@ return i;
  * Returns the number of characters read. This function converts \r\n into \n.
  *
  * The '*OK' parameter is set to 0 if at least one '\0' was found and ignored; 1 otherwise.
+ *
+ * Characters are decoded by blocks directly into 't'. Since a raw character
+ * never produces more than one character of output, the block we read never
+ * exceeds what remains to fill, and the filtering can be done in place.
  */
 int u_fread(Encoding encoding,unichar* t,int N,ABSTRACTFILE* f,int *OK) {
-int i,c;
+int i=0;
+int previous_was_CR=0;
 *OK=1;
-i=0;
 while (i<N) {
-   c=u_fgetc_CR(encoding,f);
-   if (c==EOF) return i;
-   if (c=='\0') {
-      *OK=0;
-   } else {
-      t[i++]=(unichar)c;
+   int n=u_fget_unichars_raw(encoding,t+i,N-i,f);
+   if (n<=0) return i;
+   int end=i+n;
+   for (int j=i;j<end;j++) {
+      unichar c=t[j];
+      if (previous_was_CR) {
+         previous_was_CR=0;
+         if (c==0x0A) continue;
+      }
+      if (c=='\0') {
+         *OK=0;
+      } else if (c==0x0D) {
+         t[i++]='\n';
+         previous_was_CR=1;
+      } else {
+         t[i++]=c;
+      }
    }
 }
+if (previous_was_CR) {
+   skip_LF_after_CR(encoding,f);
+}
 return i;
 }
 
@@ -1180,16 +1200,18 @@ return i;
  * The '*OK' parameter is set to 0 if at least one '\0' was found and ignored; 1 otherwise.
  */
 int u_fread_raw(Encoding encoding,unichar* t,int N,ABSTRACTFILE* f,int *OK) {
-int i,c;
+int i=0;
 *OK=1;
-i=0;
 while (i<N) {
-   c= u_fgetc_raw(encoding,f);
-   if (c==EOF) return i;
-   if (c=='\0') {
-      *OK=0;
-   } else {
-      t[i++]=(unichar)c;
+   int n=u_fget_unichars_raw(encoding,t+i,N-i,f);
+   if (n<=0) return i;
+   int end=i+n;
+   for (int j=i;j<end;j++) {
+      if (t[j]=='\0') {
+         *OK=0;
+      } else {
+         t[i++]=t[j];
+      }
    }
 }
 return i;
@@ -1924,167 +1946,193 @@ return length;
 
 
 /**
- * get a lot of unichar from file, only limited by size and end of file
+ * Size of the byte cache used by u_fget_unichars_raw. Decoding is done one
+ * block at a time, so that the per-character overhead of af_fread disappears.
  */
-int u_fget_unichars_raw(Encoding encoding, unichar* buffer, int size, ABSTRACTFILE* f)
-{
-#define BUFFER_IN_CACHE_SIZE_FGET_CHAR (0x100)
-
- unsigned char tab_in[BUFFER_IN_CACHE_SIZE_FGET_CHAR];
+#define BUFFER_IN_CACHE_SIZE_FGET_CHAR (0x1000)
 
- switch (encoding) {
-    case UTF16_LE:
-    case BIG_ENDIAN_UTF16:
-    {
-        int hibytepos = (encoding == UTF16_LE) ? 1 : 0;
 
-        int size_to_do = size;
-        int size_done = 0;
-        for (;;)
-        {
-            if (size_to_do == 0)
-                return size_done;
-            int try_size = size_to_do;
-            if (try_size > (BUFFER_IN_CACHE_SIZE_FGET_CHAR / 2))
-                try_size = (BUFFER_IN_CACHE_SIZE_FGET_CHAR / 2);
-            size_t read_bytes_in_file = af_fread(&tab_in[0], 1, (size_t)try_size * 2, f);
-            if ((read_bytes_in_file <= 0) || (read_bytes_in_file == ((size_t)EOF)))
-            {
-                if (size_done > 0)
-                    return size_done;
-                else
-                    return (int)read_bytes_in_file;
-            }
-            if (read_bytes_in_file > 0)
-            {
-                int nb_unichar_read = (int)read_bytes_in_file / 2;
-                for (int i = 0; i < nb_unichar_read; i++) {
-
-                    unichar c = (unichar)((((unichar)tab_in[(i * 2) + hibytepos]) << 8) | (tab_in[(i * 2) + (1 - hibytepos)]));
-
-                    *(buffer + size_done + i) = c;
-
-                }
-                size_done += nb_unichar_read;
-                size_to_do -= nb_unichar_read;
-
-            }
-        }
-    }
-
-
-    case UTF8:
-    {
-
-
-        size_t pos_already_read_in_disk = 0;
-        int pos_in_unichar_line = 0;
-
-        for (;;)
-        {
-            size_t size_to_read_binary = BUFFER_IN_CACHE_SIZE_FGET_CHAR - pos_already_read_in_disk;
-
-            size_t read_binary_in_file = 0;
-            if (size_to_read_binary>0)
-                read_binary_in_file = af_fread(&tab_in[pos_already_read_in_disk], 1, (size_t)size_to_read_binary, f);
-            if ((read_binary_in_file <= 0) || (read_binary_in_file == ((size_t)EOF)))
-            {
-                if (pos_in_unichar_line == 0)
-                    return EOF;
-                else
-                {
-                    return pos_in_unichar_line;
-                }
-            }
-            read_binary_in_file += pos_already_read_in_disk;
-
-            if (read_binary_in_file > 0)
-            {
-                int i;
-                pos_already_read_in_disk = 0;
-                for (i = 0; i<(int)read_binary_in_file;)
-                {
-                    unichar c;
-                    unsigned char ch = tab_in[i];
-                    int index=kUTF8ByteInfoIndex[static_cast<uint8_t>(ch)];
-                    int nbbyte=kUTF8ByteInfo[index].width;
-
-                    if (i + nbbyte >(int)read_binary_in_file)
-                    {
-                        pos_already_read_in_disk = read_binary_in_file - i;
-                        int j;
-                        for (j = 0; j<(int)pos_already_read_in_disk; j++)
-                            tab_in[j] = tab_in[i + j];
-                        break;
-                    }
-
-                    c=((unichar)ch) & kUTF8ByteInfo[index].mask;
-                    int nbbyte_loop = nbbyte;
-
-                    if (nbbyte_loop>0) {
-                        int i_in_char = 0;
-                        for (;;)
-                        {
-                            nbbyte_loop--;
-                            if (nbbyte_loop == 0)
-                                break;
-                            i_in_char++;
-                            c = (unichar)((c << 6) | ((tab_in[i + i_in_char]) & 0x3F));
-                        }
-                    }
+/**
+ * Returns a non-zero value if the 8 bytes starting at 'p' are all ASCII ones.
+ * The 8 bytes are tested at once as a single 64-bit word.
+ */
+static inline int is_ascii_block8(const unsigned char* p) {
+uint64_t w;
+memcpy(&w,p,sizeof(w));
+return (w & (uint64_t)0x8080808080808080ULL)==0;
+}
 
-                    if (pos_in_unichar_line == size)
-                    {
-                        af_fseek(f, -1 * (long)(read_binary_in_file - i), SEEK_CUR);
 
-                        return pos_in_unichar_line;
-                    }
+/**
+ * Decodes the UTF-8 bytes src[0..n-1] into 'dest', which can hold 'dest_size'
+ * characters. Decoding stops when 'dest' is full or at a trailing incomplete
+ * sequence, whose bytes are left unconsumed. Malformed sequences produce a '?'
+ * and an error message, exactly as u_fgetc_UTF8_raw does.
+ *
+ * Returns the number of characters written; '*consumed' receives the number
+ * of bytes used.
+ */
+static int decode_utf8_block(const unsigned char* src,size_t n,unichar* dest,int dest_size,size_t* consumed) {
+size_t i=0;
+int k=0;
+while (k<dest_size && i<n) {
+   /* Fast path for runs of ASCII characters */
+   while (i+8<=n && k+8<=dest_size && is_ascii_block8(src+i)) {
+      for (int j=0;j<8;j++) {
+         dest[k+j]=(unichar)src[i+j];
+      }
+      i=i+8;
+      k=k+8;
+   }
+   if (k==dest_size || i==n) break;
+   unsigned char c=src[i];
+   if (c<=0x7F) {
+      dest[k++]=(unichar)c;
+      i++;
+      continue;
+   }
+   int number_of_bytes;
+   unsigned int value;
+   if ((c&0xE0)==0xC0) {
+      value=c&31;
+      number_of_bytes=2;
+   }
+   else if ((c&0xF0)==0xE0) {
+      value=c&15;
+      number_of_bytes=3;
+   }
+   else if ((c&0xF8)==0xF0) {
+      value=c&7;
+      number_of_bytes=4;
+   }
+   else if ((c&0xFC)==0xF8) {
+      value=c&3;
+      number_of_bytes=5;
+   }
+   else if ((c&0xFE)==0xFC) {
+      value=c&1;
+      number_of_bytes=6;
+   }
+   else {
+      error("Encoding error in first byte of a unicode sequence\n");
+      dest[k++]='?';
+      i++;
+      continue;
+   }
+   if (i+number_of_bytes>n) {
+      /* Incomplete sequence: the caller must provide the following bytes */
+      break;
+   }
+   int j;
+   for (j=1;j<number_of_bytes;j++) {
+      unsigned char b=src[i+j];
+      if ((b&0xC0)!=0x80) {
+         error("Encoding error in byte %d of a %d byte unicode sequence\n",j+1,number_of_bytes);
+         break;
+      }
+      value=(value<<6)|(b&0x3F);
+   }
+   dest[k++]=(j==number_of_bytes) ? (unichar)value : (unichar)'?';
+   /* Even after a bad byte, the whole sequence is consumed, since
+    * u_fgetc_UTF8_raw reads all its bytes before checking them */
+   i=i+number_of_bytes;
+}
+*consumed=i;
+return k;
+}
 
-                    buffer[pos_in_unichar_line++] = c;
 
-                    i += nbbyte;
-                }
+/**
+ * get a lot of unichar from file, only limited by size and end of file
+ *
+ * Bytes are read by blocks and decoded in bulk. We never read more bytes than
+ * the number of characters still wanted (each character takes at least one
+ * byte), so that no byte has to be put back into the file.
+ */
+int u_fget_unichars_raw(Encoding encoding, unichar* buffer, int size, ABSTRACTFILE* f)
+{
+unsigned char tab_in[BUFFER_IN_CACHE_SIZE_FGET_CHAR];
+int size_done=0;
+switch (encoding) {
+   case UTF16_LE:
+   case BIG_ENDIAN_UTF16:
+   case PLATFORM_DEPENDENT_UTF16: {
+      int little_endian=(encoding==UTF16_LE) || (encoding==PLATFORM_DEPENDENT_UTF16 && is_platform_little_endian());
+      int native=(little_endian==(is_platform_little_endian() ? 1 : 0));
+      while (size_done<size) {
+         int try_size=size-size_done;
+         if (try_size>(BUFFER_IN_CACHE_SIZE_FGET_CHAR/2)) {
+            try_size=BUFFER_IN_CACHE_SIZE_FGET_CHAR/2;
+         }
+         size_t read_bytes_in_file=af_fread(tab_in,1,(size_t)try_size*2,f);
+         if ((read_bytes_in_file==0) || (read_bytes_in_file==((size_t)EOF))) {
+            break;
+         }
+         int nb_unichar_read=(int)(read_bytes_in_file/2);
+         unichar* dest=buffer+size_done;
+         if (native) {
+            memcpy(dest,tab_in,nb_unichar_read*sizeof(unichar));
+         } else {
+            int hibytepos=little_endian ? 1 : 0;
+            for (int i=0;i<nb_unichar_read;i++) {
+               dest[i]=(unichar)((((unichar)tab_in[2*i+hibytepos])<<8) | tab_in[2*i+1-hibytepos]);
             }
-        }
-    }
-
+         }
+         size_done+=nb_unichar_read;
+      }
+      return size_done;
+   }
 
-    default:
-    case ASCII:
-    {
-        int size_to_do = size;
-        int size_done = 0;
-        for (;;)
-        {
-            if (size_to_do == 0)
-                return size_done;
-            int try_size = size_to_do;
-            if (try_size > (BUFFER_IN_CACHE_SIZE_FGET_CHAR))
-                try_size = (BUFFER_IN_CACHE_SIZE_FGET_CHAR);
-            size_t read_bytes_in_file = af_fread(&tab_in[0], 1, (size_t)try_size, f);
-            if ((read_bytes_in_file <= 0) || (read_bytes_in_file == ((size_t)EOF)))
-            {
-                if (size_done > 0)
-                    return size_done;
-                else
-                    return (int)read_bytes_in_file;
+   case UTF8: {
+      /* Number of bytes of an incomplete sequence kept at the beginning of tab_in */
+      size_t pending=0;
+      while (size_done<size) {
+         size_t try_size=(size_t)(size-size_done);
+         if (try_size>BUFFER_IN_CACHE_SIZE_FGET_CHAR-pending) {
+            try_size=BUFFER_IN_CACHE_SIZE_FGET_CHAR-pending;
+         }
+         size_t read_bytes_in_file=af_fread(tab_in+pending,1,try_size,f);
+         if ((read_bytes_in_file==0) || (read_bytes_in_file==((size_t)EOF))) {
+            /* An incomplete sequence at the end of the file is ignored */
+            break;
+         }
+         size_t available=pending+read_bytes_in_file;
+         size_t consumed;
+         size_done+=decode_utf8_block(tab_in,available,buffer+size_done,size-size_done,&consumed);
+         pending=available-consumed;
+         if (pending!=0) {
+            if (size_done==size) {
+               /* Should not happen, given how many bytes we read, but we
+                * never want to lose bytes */
+               af_fseek(f,-(long)pending,SEEK_CUR);
+               break;
             }
+            memmove(tab_in,tab_in+consumed,pending);
+         }
+      }
+      return (size_done==0) ? EOF : size_done;
+   }
 
-            if (read_bytes_in_file > 0)
-            {
-                int nb_unichar_read = (int)read_bytes_in_file;
-                for (int i = 0; i < nb_unichar_read; i++) {
-
-                    unichar c = (unichar)tab_in[i];
-
-                    *(buffer + size_done + i) = c;
-                }
-                size_done += nb_unichar_read;
-                size_to_do -= nb_unichar_read;
-            }
-        }
-    }
- }
+   default:
+   case ASCII: {
+      while (size_done<size) {
+         int try_size=size-size_done;
+         if (try_size>BUFFER_IN_CACHE_SIZE_FGET_CHAR) {
+            try_size=BUFFER_IN_CACHE_SIZE_FGET_CHAR;
+         }
+         size_t read_bytes_in_file=af_fread(tab_in,1,(size_t)try_size,f);
+         if ((read_bytes_in_file==0) || (read_bytes_in_file==((size_t)EOF))) {
+            break;
+         }
+         unichar* dest=buffer+size_done;
+         for (size_t i=0;i<read_bytes_in_file;i++) {
+            dest[i]=(unichar)tab_in[i];
+         }
+         size_done+=(int)read_bytes_in_file;
+      }
+      return size_done;
+   }
+}
 }
 
 
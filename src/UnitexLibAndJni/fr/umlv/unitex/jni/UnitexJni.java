@@ -318,6 +318,46 @@ public class UnitexJni {
 	public native static void freePersistentAlphabet(String filename);
 
 
+	/**
+	 * Functions to work on a text without handling Unitex files: a session
+	 * keeps a tokenized text and the matches of the last locate. If workFolder
+	 * is null, the files of the session are kept in memory. createSession
+	 * returns 0 on failure, and each session must be freed by freeSession.
+	 * A session must not be used by several threads at the same time.
+	 */
+	public native static long createSession(String alphabet, boolean charByChar,
+			String workFolder);
+	public native static void freeSession(long session);
+	public native static boolean sessionSetText(long session, String text);
+	public native static boolean sessionApplyDictionaries(long session,
+			String[] dictionaries);
+
+	/**
+	 * applies a .fst2 grammar to the text of the session, options being
+	 * Locate options like "-M" or "-E elgFolder". Returns the number of
+	 * matches, or -1 on failure
+	 */
+	public native static int sessionLocate(long session, String fst2,
+			String[] options);
+
+	/**
+	 * returns 4 ints for each match: start token, end token, start offset
+	 * and end offset (exclusive) in the text given to sessionSetText
+	 */
+	public native static int[] sessionGetMatchPositions(long session);
+
+	/**
+	 * same as sessionGetMatchPositions, without copy: the buffer uses the
+	 * native byte order and is valid until the next sessionLocate,
+	 * sessionSetText or freeSession on the session
+	 */
+	public native static java.nio.ByteBuffer sessionGetMatchBuffer(long session);
+
+	/**
+	 * returns the output of each match, or null for matches without output
+	 */
+	public native static String[] sessionGetMatchOutputs(long session);
+
 	/**
 	 * Returns the major Unitex version number
 	 */
@@ -1012,3 +1012,151 @@ standard_unload_persistence_alphabet(name.getJString());
 }
 
 #endif
+
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    createSession
+ * Signature: (Ljava/lang/String;ZLjava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_fr_umlv_unitex_jni_UnitexJni_createSession
+  (JNIEnv *env, jclass, jstring alphabet, jboolean char_by_char, jstring work_folder)
+{
+	jstringToCUtf jstc_alphabet;
+	jstringToCUtf jstc_work_folder;
+	if (alphabet != NULL)
+		jstc_alphabet.initJString(env,alphabet);
+	if (work_folder != NULL)
+		jstc_work_folder.initJString(env,work_folder);
+	UNITEXSESSION* session = CreateUnitexSession(jstc_alphabet.getJString(),char_by_char ? 1 : 0,
+	                                             jstc_work_folder.getJString());
+	return (jlong)(size_t)session;
+}
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    freeSession
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_fr_umlv_unitex_jni_UnitexJni_freeSession
+  (JNIEnv *, jclass, jlong session)
+{
+	FreeUnitexSession((UNITEXSESSION*)(size_t)session);
+}
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionSetText
+ * Signature: (JLjava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionSetText
+  (JNIEnv *env, jclass, jlong session, jstring text)
+{
+	if ((session == 0) || (text == NULL))
+		return JNI_FALSE;
+	jsize len = env->GetStringLength(text);
+	const jchar* chars = env->GetStringChars(text, NULL);
+	if (chars == NULL)
+		return JNI_FALSE;
+	int ret = UnitexSessionSetText((UNITEXSESSION*)(size_t)session,(const unsigned short*)chars,(size_t)len);
+	env->ReleaseStringChars(text, chars);
+	return (ret == 0) ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionApplyDictionaries
+ * Signature: (J[Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionApplyDictionaries
+  (JNIEnv *env, jclass, jlong session, jobjectArray dictionaries)
+{
+	if ((session == 0) || (dictionaries == NULL))
+		return JNI_FALSE;
+	char**args=argsFromStrArray(env, dictionaries);
+	if (args == NULL)
+		return JNI_FALSE;
+	int ret = UnitexSessionApplyDictionaries((UNITEXSESSION*)(size_t)session,args,countArgs(args));
+	freeArgs(args);
+	return (ret == 0) ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionLocate
+ * Signature: (JLjava/lang/String;[Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionLocate
+  (JNIEnv *env, jclass, jlong session, jstring fst2, jobjectArray options)
+{
+	if ((session == 0) || (fst2 == NULL))
+		return -1;
+	jstringToCUtf jstc_fst2;
+	jstc_fst2.initJString(env,fst2);
+	char**args=(options != NULL) ? argsFromStrArray(env, options) : NULL;
+	UNITEXSESSION* s = (UNITEXSESSION*)(size_t)session;
+	int ret = UnitexSessionLocate(s,jstc_fst2.getJString(),args,(args != NULL) ? countArgs(args) : 0);
+	if (args != NULL)
+		freeArgs(args);
+	return (ret == 0) ? (jint)UnitexSessionGetMatchCount(s) : -1;
+}
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionGetMatchPositions
+ * Signature: (J)[I
+ */
+JNIEXPORT jintArray JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionGetMatchPositions
+  (JNIEnv *env, jclass, jlong session)
+{
+	UNITEXSESSION* s = (UNITEXSESSION*)(size_t)session;
+	jsize len = (s != NULL) ? (jsize)(UnitexSessionGetMatchCount(s) * UNITEX_SESSION_MATCH_FIELDS) : 0;
+	jintArray jarrRet = env->NewIntArray(len);
+	if ((jarrRet != NULL) && (len > 0))
+		env->SetIntArrayRegion(jarrRet,0,len,(const jint*)UnitexSessionGetMatchPositions(s));
+	return jarrRet;
+}
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionGetMatchBuffer
+ * Signature: (J)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionGetMatchBuffer
+  (JNIEnv *env, jclass, jlong session)
+{
+	UNITEXSESSION* s = (UNITEXSESSION*)(size_t)session;
+	if ((s == NULL) || (UnitexSessionGetMatchPositions(s) == NULL))
+		return NULL;
+	jlong size = (jlong)UnitexSessionGetMatchCount(s) * UNITEX_SESSION_MATCH_FIELDS * sizeof(jint);
+	return env->NewDirectByteBuffer((void*)UnitexSessionGetMatchPositions(s),size);
+}
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionGetMatchOutputs
+ * Signature: (J)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionGetMatchOutputs
+  (JNIEnv *env, jclass, jlong session)
+{
+	UNITEXSESSION* s = (UNITEXSESSION*)(size_t)session;
+	int n = (s != NULL) ? UnitexSessionGetMatchCount(s) : 0;
+	jclass cls = env->FindClass("java/lang/String");
+	jobjectArray jarray = env->NewObjectArray((jsize)n, cls, NULL);
+	if (jarray == NULL)
+		return NULL;
+	for (int i = 0; i < n; i++)
+	{
+		const unsigned short* output = UnitexSessionGetMatchOutput(s,i);
+		if (output == NULL)
+			continue;
+		jsize len = 0;
+		while (output[len] != 0)
+			len++;
+		jstring jstr = env->NewString((const jchar*)output,len);
+		env->SetObjectArrayElement(jarray, i, jstr);
+		env->DeleteLocalRef(jstr);
+	}
+	return jarray;
+}
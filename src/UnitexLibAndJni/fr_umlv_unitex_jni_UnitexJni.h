@@ -287,6 +287,70 @@ JNIEXPORT jint JNICALL Java_fr_umlv_unitex_jni_UnitexJni_getMinorVersionNumber
 JNIEXPORT jint JNICALL Java_fr_umlv_unitex_jni_UnitexJni_getSvnRevisionNumber
   (JNIEnv *, jclass);
 
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    createSession
+ * Signature: (Ljava/lang/String;ZLjava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_fr_umlv_unitex_jni_UnitexJni_createSession
+  (JNIEnv *, jclass, jstring, jboolean, jstring);
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    freeSession
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_fr_umlv_unitex_jni_UnitexJni_freeSession
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionSetText
+ * Signature: (JLjava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionSetText
+  (JNIEnv *, jclass, jlong, jstring);
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionApplyDictionaries
+ * Signature: (J[Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionApplyDictionaries
+  (JNIEnv *, jclass, jlong, jobjectArray);
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionLocate
+ * Signature: (JLjava/lang/String;[Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionLocate
+  (JNIEnv *, jclass, jlong, jstring, jobjectArray);
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionGetMatchPositions
+ * Signature: (J)[I
+ */
+JNIEXPORT jintArray JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionGetMatchPositions
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionGetMatchBuffer
+ * Signature: (J)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionGetMatchBuffer
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     fr_umlv_unitex_jni_UnitexJni
+ * Method:    sessionGetMatchOutputs
+ * Signature: (J)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_fr_umlv_unitex_jni_UnitexJni_sessionGetMatchOutputs
+  (JNIEnv *, jclass, jlong);
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,6 +40,26 @@
 #include "UnitexLibDir.h"
 #include "UnitexLibIO.h"
 
+#include "Unicode.h"
+#include "File.h"
+#include "ProgramInvoker.h"
+#include "Tokenize.h"
+#include "Dico.h"
+#include "Locate.h"
+#include "LocateMatches.h"
+#include "Text_tokens.h"
+#include "Offsets.h"
+#include "Alphabet.h"
+#include "CompressedDic.h"
+#include "Fst2.h"
+#include "Persistence.h"
+#include "SyncTool.h"
+#include "VirtualFiles.h"
+
+#ifdef HAS_UNITEX_NAMESPACE
+using namespace unitex;
+#endif
+
 
 /**
  * Get a const void* pointer to a raw Unitex file content (from system filesystem or filespace)
@@ -245,3 +265,466 @@ UNITEX_FUNC void UNITEX_CALL ReleaseUnitexFileList(const char* path,char**list)
     af_release_list_file(path,list);
 }
 #endif
+
+
+/**
+ * A resource that a session made persistent, so that it is loaded once for
+ * all the calls made on the session instead of once per call. It is
+ * registered under a name of the session folder, so that it is private to
+ * the session.
+ */
+enum session_resource_kind {
+    SESSION_ALPHABET,
+    SESSION_DICTIONARY,
+    SESSION_FST2
+};
+
+struct session_resource {
+    char* name;
+    char* persistent_name;
+    enum session_resource_kind kind;
+    struct session_resource* next;
+};
+
+
+/**
+ * A text and the results of the last operations made on it.
+ */
+struct _UNITEXSESSION {
+    char* folder;
+    char* alphabet;
+    int char_by_char;
+    char* snt;
+    char* snt_dir;
+    /* resources loaded by the session, freed with it */
+    struct session_resource* resources;
+    int n_resources;
+    /* offset in the text of each token of text.cod, plus the text length */
+    int* token_offsets;
+    int n_text_tokens;
+    int n_matches;
+    int* match_positions;
+    unichar** match_outputs;
+};
+
+
+static volatile long n_sessions_created = 0;
+
+
+static char* concat_session_path(const char* folder,const char* name)
+{
+    char* path = (char*)malloc(strlen(folder)+strlen(name)+2);
+    if (path == NULL)
+        return NULL;
+    strcpy(path,folder);
+    strcat(path,name);
+    return path;
+}
+
+
+static int load_session_resource(const char* name,const char* persistent_name,enum session_resource_kind kind)
+{
+    switch (kind)
+    {
+        case SESSION_ALPHABET: return load_persistent_alphabet(name,persistent_name);
+        case SESSION_DICTIONARY: return load_persistent_dictionary(name,persistent_name);
+        default: return load_persistent_fst2(name,persistent_name);
+    }
+}
+
+
+static void free_session_resource(const char* persistent_name,enum session_resource_kind kind)
+{
+    switch (kind)
+    {
+        case SESSION_ALPHABET: free_persistent_alphabet(persistent_name); break;
+        case SESSION_DICTIONARY: free_persistent_dictionary(persistent_name); break;
+        default: free_persistent_fst2(persistent_name); break;
+    }
+}
+
+
+/**
+ * Returns the name that the tools invoked on the session must be given for
+ * the given resource. A resource that the caller already made persistent is
+ * used as is. Otherwise, it is loaded the first time it is used, under a
+ * name of the session folder that keeps its base name, since Dico reads
+ * the priority of a dictionary in it. If it cannot be loaded, its own name
+ * is returned, so that the tool reports the error.
+ */
+static const char* get_session_resource(UNITEXSESSION* session,const char* name,enum session_resource_kind kind)
+{
+    if (is_persistent_filename(name))
+        return name;
+    for (struct session_resource* r=session->resources;r!=NULL;r=r->next)
+    {
+        if (r->kind == kind && !strcmp(r->name,name))
+            return r->persistent_name;
+    }
+    char base[FILENAME_MAX];
+    remove_path(name,base);
+    char* persistent_name = (char*)malloc(strlen(session->folder)+strlen(base)+32);
+    if (persistent_name == NULL)
+        return name;
+    sprintf(persistent_name,"%sresource%d_%s",session->folder,session->n_resources,base);
+    struct session_resource* r = (struct session_resource*)malloc(sizeof(struct session_resource));
+    if (r != NULL)
+        r->name = strdup(name);
+    if (r == NULL || r->name == NULL || !load_session_resource(name,persistent_name,kind))
+    {
+        if (r != NULL)
+            free(r->name);
+        free(r);
+        free(persistent_name);
+        return name;
+    }
+    r->persistent_name = persistent_name;
+    r->kind = kind;
+    r->next = session->resources;
+    session->resources = r;
+    (session->n_resources)++;
+    return persistent_name;
+}
+
+
+static void free_session_resources(UNITEXSESSION* session)
+{
+    while (session->resources != NULL)
+    {
+        struct session_resource* r = session->resources;
+        session->resources = r->next;
+        free_session_resource(r->persistent_name,r->kind);
+        free(r->persistent_name);
+        free(r->name);
+        free(r);
+    }
+}
+
+
+static void clear_session_matches(UNITEXSESSION* session)
+{
+    for (int i=0;i<session->n_matches;i++)
+        free(session->match_outputs[i]);
+    free(session->match_outputs);
+    free(session->match_positions);
+    session->match_outputs = NULL;
+    session->match_positions = NULL;
+    session->n_matches = 0;
+}
+
+
+static void clear_session_text(UNITEXSESSION* session)
+{
+    clear_session_matches(session);
+    free(session->token_offsets);
+    session->token_offsets = NULL;
+    session->n_text_tokens = 0;
+}
+
+
+/**
+ * Creates a session. alphabet may be NULL when char_by_char is set.
+ * If work_folder is NULL, the files of the session are kept in memory,
+ * in a folder of the virtual file system.
+ */
+UNITEX_FUNC UNITEXSESSION* UNITEX_CALL CreateUnitexSession(const char* alphabet,int char_by_char,const char* work_folder)
+{
+    UNITEXSESSION* session = (UNITEXSESSION*)malloc(sizeof(UNITEXSESSION));
+    if (session == NULL)
+        return NULL;
+    memset(session,0,sizeof(UNITEXSESSION));
+    char folder[0x100];
+    if (work_folder == NULL)
+    {
+        long n = SyncAtomicIncrement(&n_sessions_created);
+        sprintf(folder,"%sunitex_session_%ld%s",VIRTUAL_FILE_PFX,n,PATH_SEPARATOR_STRING);
+        session->folder = strdup(folder);
+    }
+    else
+    {
+        size_t len = strlen(work_folder);
+        session->folder = (char*)malloc(len+2);
+        if (session->folder != NULL)
+        {
+            strcpy(session->folder,work_folder);
+            if (len == 0 || (work_folder[len-1] != '/' && work_folder[len-1] != '\\'))
+                strcat(session->folder,PATH_SEPARATOR_STRING);
+        }
+    }
+    if (session->folder != NULL)
+    {
+        session->snt = concat_session_path(session->folder,"text.snt");
+        session->snt_dir = concat_session_path(session->folder,"text_snt" PATH_SEPARATOR_STRING);
+    }
+    if (alphabet != NULL)
+        session->alphabet = strdup(alphabet);
+    session->char_by_char = char_by_char;
+    if (session->folder == NULL || session->snt == NULL || session->snt_dir == NULL ||
+        (alphabet != NULL && session->alphabet == NULL))
+    {
+        FreeUnitexSession(session);
+        return NULL;
+    }
+    if (session->alphabet != NULL)
+        get_session_resource(session,session->alphabet,SESSION_ALPHABET);
+    return session;
+}
+
+
+/**
+ * Frees a session, removes its files and frees the resources it loaded.
+ */
+UNITEX_FUNC void UNITEX_CALL FreeUnitexSession(UNITEXSESSION* session)
+{
+    if (session == NULL)
+        return;
+    clear_session_text(session);
+    if (session->snt_dir != NULL)
+        af_remove_folder_unlogged(session->snt_dir);
+    if (session->snt != NULL)
+        af_remove_unlogged(session->snt);
+    free_session_resources(session);
+    free(session->snt_dir);
+    free(session->snt);
+    free(session->alphabet);
+    free(session->folder);
+    free(session);
+}
+
+
+/**
+ * Computes the offset in the text of each token of text.cod. Since Tokenize
+ * turns each sequence of separators into a single space token, the shifts
+ * of snt_offsets.pos are added to the token lengths.
+ */
+static int load_session_token_offsets(UNITEXSESSION* session)
+{
+    VersatileEncodingConfig vec = VEC_DEFAULT;
+    char* tokens_txt = concat_session_path(session->snt_dir,"tokens.txt");
+    char* text_cod = concat_session_path(session->snt_dir,"text.cod");
+    char* snt_offsets_pos = concat_session_path(session->snt_dir,"snt_offsets.pos");
+    if (tokens_txt == NULL || text_cod == NULL || snt_offsets_pos == NULL)
+    {
+        free(tokens_txt);
+        free(text_cod);
+        free(snt_offsets_pos);
+        return 1;
+    }
+    struct text_tokens* tokens = load_text_tokens(&vec,tokens_txt);
+    vector_int* snt_offsets = load_snt_offsets(snt_offsets_pos);
+    UNITEXFILEMAPPED* amf;
+    const void* buffer;
+    size_t size_file;
+    GetUnitexFileReadBuffer(text_cod,&amf,&buffer,&size_file);
+    free(tokens_txt);
+    free(text_cod);
+    free(snt_offsets_pos);
+    int ret = 1;
+    if (tokens != NULL && snt_offsets != NULL && buffer != NULL)
+    {
+        int n = (int)(size_file/sizeof(int));
+        const int* cod = (const int*)buffer;
+        session->token_offsets = (int*)malloc((n+1)*sizeof(int));
+        if (session->token_offsets != NULL)
+        {
+            /* snt_offsets contains triples (token position, shift before, shift after) */
+            int offset = 0;
+            int shift = 0;
+            int k = 0;
+            ret = 0;
+            for (int i=0;i<n;i++)
+            {
+                session->token_offsets[i] = offset+shift;
+                if (cod[i] < 0 || cod[i] >= tokens->N)
+                {
+                    ret = 1;
+                    break;
+                }
+                if (k < snt_offsets->nbelems && snt_offsets->tab[k] == i)
+                {
+                    shift = snt_offsets->tab[k+2];
+                    k = k+3;
+                }
+                offset += u_strlen(tokens->token[cod[i]]);
+            }
+            session->token_offsets[n] = offset+shift;
+            session->n_text_tokens = n;
+        }
+    }
+    CloseUnitexFileReadBuffer(amf,buffer,size_file);
+    if (snt_offsets != NULL)
+        free_vector_int(snt_offsets);
+    if (tokens != NULL)
+        free_text_tokens(tokens);
+    return ret;
+}
+
+
+/**
+ * Replaces the text of the session by the given UTF-16 text, and tokenizes it.
+ * The text is not normalized, so that the offsets of the matches are
+ * offsets in the given text.
+ */
+UNITEX_FUNC int UNITEX_CALL UnitexSessionSetText(UNITEXSESSION* session,const unsigned short* text,size_t length)
+{
+    clear_session_text(session);
+    af_remove_folder_unlogged(session->snt_dir);
+    CreateUnitexFolder(session->snt_dir);
+    const unsigned short bom = 0xFEFF;
+    if (WriteUnitexFile(session->snt,&bom,sizeof(bom),text,length*sizeof(unsigned short)) != 0)
+        return 1;
+    ProgramInvoker* invoker = new_ProgramInvoker(main_Tokenize,"main_Tokenize");
+    add_argument(invoker,session->snt);
+    if (session->alphabet != NULL)
+    {
+        add_argument(invoker,"-a");
+        add_argument(invoker,get_session_resource(session,session->alphabet,SESSION_ALPHABET));
+    }
+    if (session->char_by_char)
+        add_argument(invoker,"-c");
+    int ret = invoke(invoker);
+    free_ProgramInvoker(invoker);
+    if (ret != 0)
+        return ret;
+    return load_session_token_offsets(session);
+}
+
+
+/**
+ * Applies the given dictionaries (.bin or .fst2) to the text of the session.
+ * They are loaded once, and kept until the session is freed.
+ */
+UNITEX_FUNC int UNITEX_CALL UnitexSessionApplyDictionaries(UNITEXSESSION* session,const char* const* dictionaries,int n_dictionaries)
+{
+    if (session->token_offsets == NULL)
+        return 1;
+    ProgramInvoker* invoker = new_ProgramInvoker(main_Dico,"main_Dico");
+    add_argument(invoker,"-t");
+    add_argument(invoker,session->snt);
+    if (session->alphabet != NULL)
+    {
+        add_argument(invoker,"-a");
+        add_argument(invoker,get_session_resource(session,session->alphabet,SESSION_ALPHABET));
+    }
+    for (int i=0;i<n_dictionaries;i++)
+    {
+        char extension[FILENAME_MAX];
+        get_extension(dictionaries[i],extension);
+        add_argument(invoker,get_session_resource(session,dictionaries[i],
+                                 strcmp(extension,".fst2") ? SESSION_DICTIONARY : SESSION_FST2));
+    }
+    int ret = invoke(invoker);
+    free_ProgramInvoker(invoker);
+    return ret;
+}
+
+
+/**
+ * Loads the matches of concord.ind, and computes their offsets in the text.
+ */
+static int load_session_matches(UNITEXSESSION* session)
+{
+    VersatileEncodingConfig vec = VEC_DEFAULT;
+    char* concord_ind = concat_session_path(session->snt_dir,"concord.ind");
+    if (concord_ind == NULL)
+        return 1;
+    U_FILE* f = u_fopen(&vec,concord_ind,U_READ);
+    free(concord_ind);
+    if (f == NULL)
+        return 1;
+    struct match_list* list = load_match_list(f,NULL,NULL);
+    u_fclose(f);
+    int n = 0;
+    for (struct match_list* tmp=list;tmp!=NULL;tmp=tmp->next)
+        n++;
+    int ret = 0;
+    session->match_positions = (int*)malloc((n>0 ? n : 1)*UNITEX_SESSION_MATCH_FIELDS*sizeof(int));
+    session->match_outputs = (unichar**)malloc((n>0 ? n : 1)*sizeof(unichar*));
+    if (session->match_positions == NULL || session->match_outputs == NULL)
+    {
+        free(session->match_positions);
+        free(session->match_outputs);
+        session->match_positions = NULL;
+        session->match_outputs = NULL;
+        free_match_list(list);
+        return 1;
+    }
+    for (struct match_list* tmp=list;tmp!=NULL;tmp=tmp->next)
+    {
+        const Match* m = &(tmp->m);
+        if (m->start_pos_in_token < 0 || m->end_pos_in_token >= session->n_text_tokens)
+        {
+            ret = 1;
+            break;
+        }
+        int* pos = session->match_positions + (session->n_matches*UNITEX_SESSION_MATCH_FIELDS);
+        pos[0] = m->start_pos_in_token;
+        pos[1] = m->end_pos_in_token;
+        pos[2] = session->token_offsets[m->start_pos_in_token]+m->start_pos_in_char;
+        pos[3] = session->token_offsets[m->end_pos_in_token]+m->end_pos_in_char+1;
+        session->match_outputs[session->n_matches] = (tmp->output != NULL) ? u_strdup(tmp->output) : NULL;
+        (session->n_matches)++;
+    }
+    free_match_list(list);
+    return ret;
+}
+
+
+/**
+ * Applies the given .fst2 grammar to the text of the session. options
+ * are passed to Locate, e.g. "-M" or "-E elg_folder". The matches are then available
+ * with UnitexSessionGetMatchPositions and UnitexSessionGetMatchOutput.
+ * The grammar is loaded once, and kept until the session is freed.
+ */
+UNITEX_FUNC int UNITEX_CALL UnitexSessionLocate(UNITEXSESSION* session,const char* fst2,const char* const* options,int n_options)
+{
+    clear_session_matches(session);
+    if (session->token_offsets == NULL)
+        return 1;
+    ProgramInvoker* invoker = new_ProgramInvoker(main_Locate,"main_Locate");
+    add_argument(invoker,"-t");
+    add_argument(invoker,session->snt);
+    if (session->alphabet != NULL)
+    {
+        add_argument(invoker,"-a");
+        add_argument(invoker,get_session_resource(session,session->alphabet,SESSION_ALPHABET));
+    }
+    if (session->char_by_char)
+        add_argument(invoker,"-c");
+    for (int i=0;i<n_options;i++)
+        add_argument(invoker,options[i]);
+    add_argument(invoker,get_session_resource(session,fst2,SESSION_FST2));
+    int ret = invoke(invoker);
+    free_ProgramInvoker(invoker);
+    if (ret != 0)
+        return ret;
+    return load_session_matches(session);
+}
+
+
+UNITEX_FUNC int UNITEX_CALL UnitexSessionGetMatchCount(const UNITEXSESSION* session)
+{
+    return session->n_matches;
+}
+
+
+/**
+ * Returns UNITEX_SESSION_MATCH_FIELDS ints for each match of the last
+ * Locate. The array is valid until the next call on the session.
+ */
+UNITEX_FUNC const int* UNITEX_CALL UnitexSessionGetMatchPositions(const UNITEXSESSION* session)
+{
+    return session->match_positions;
+}
+
+
+/**
+ * Returns the output of the given match as a null-terminated UTF-16
+ * string, or NULL if there is no output.
+ */
+UNITEX_FUNC const unsigned short* UNITEX_CALL UnitexSessionGetMatchOutput(const UNITEXSESSION* session,int n)
+{
+    if (n < 0 || n >= session->n_matches)
+        return NULL;
+    return session->match_outputs[n];
+}
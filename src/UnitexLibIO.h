@@ -76,6 +76,45 @@ UNITEX_FUNC char** UNITEX_CALL GetUnitexFileList(const char* path);
 UNITEX_FUNC void UNITEX_CALL ReleaseUnitexFileList(const char* path,char**list);
 #endif
 
+
+/*
+ * Session API
+ *
+ * A session holds one text, tokenized once, on which dictionaries can be
+ * applied and grammars can be located many times. Tokenize, Dico and Locate
+ * are still run on the files of the text, that stay in a private in-memory
+ * folder (or in work_folder, if given), but the matches of the last Locate
+ * are kept in memory, with their offsets in the text, so that the caller
+ * does not have to parse concord.ind again. The alphabet, dictionaries and
+ * grammars used on a session are loaded the first time they are used, under
+ * names private to the session, and freed with the session. Those that the
+ * caller already made persistent are used as they are.
+ *
+ * Functions returning int return 0 in case of success.
+ */
+typedef struct _UNITEXSESSION UNITEXSESSION;
+
+/* number of ints describing a match returned by UnitexSessionGetMatchPositions:
+ * first token, last token, offset of the first char in the text and offset
+ * after the last char, in UTF-16 units */
+#define UNITEX_SESSION_MATCH_FIELDS 4
+
+UNITEX_FUNC UNITEXSESSION* UNITEX_CALL CreateUnitexSession(const char* alphabet,int char_by_char,const char* work_folder);
+
+UNITEX_FUNC void UNITEX_CALL FreeUnitexSession(UNITEXSESSION* session);
+
+UNITEX_FUNC int UNITEX_CALL UnitexSessionSetText(UNITEXSESSION* session,const unsigned short* text,size_t length);
+
+UNITEX_FUNC int UNITEX_CALL UnitexSessionApplyDictionaries(UNITEXSESSION* session,const char* const* dictionaries,int n_dictionaries);
+
+UNITEX_FUNC int UNITEX_CALL UnitexSessionLocate(UNITEXSESSION* session,const char* fst2,const char* const* options,int n_options);
+
+UNITEX_FUNC int UNITEX_CALL UnitexSessionGetMatchCount(const UNITEXSESSION* session);
+
+UNITEX_FUNC const int* UNITEX_CALL UnitexSessionGetMatchPositions(const UNITEXSESSION* session);
+
+UNITEX_FUNC const unsigned short* UNITEX_CALL UnitexSessionGetMatchOutput(const UNITEXSESSION* session,int n);
+
 #ifdef __cplusplus
 }
 #endif
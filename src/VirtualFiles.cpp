@@ -46,19 +46,64 @@ namespace virtualfile {
 static void fill_fileio_func_array_extensible(t_fileio_func_array_extensible * my_VFS);
 
 
+/**
+ * Number of shards of the inode index. Each shard is a hash table with
+ * its own lock, so that threads working on different files rarely wait
+ * for each other.
+ */
+#define VFS_N_SHARDS 64
+
+/* Initial number of buckets of a shard */
+#define VFS_MIN_BUCKETS 16
+
+
+/**
+ * A piece of the content of a virtual file. The data follows the
+ * structure in memory.
+ */
+typedef struct VFS_CHUNK_ {
+    struct VFS_CHUNK_* next;
+    unsigned long capacity;
+} VFS_CHUNK;
+
+#define VFS_CHUNK_DATA(chunk) ((char*)((chunk)+1))
+
+
 /**
 * Description of a VFS inode.
+*
+* The content is a list of chunks that are all full, except the last one.
+* When the file grows, a new chunk at least as large as the current
+* capacity is appended, so that the content is never copied and that
+* the number of chunks stays logarithmic in the file size.
+*
+* The inode lock protects the content. 'n_open', 'open_in_write_mode',
+* 'to_remove' and the bucket links are protected by the lock of the shard
+* the inode belongs to. When both are needed, the shard lock must be taken
+* first.
 */
 typedef struct VFS_INODE_ {
     struct VFS* vfs;
     char* name;
-    void* ptr;
+    unsigned int hash;
+    VFS_CHUNK* chunks;
+    VFS_CHUNK* last_chunk;
     unsigned long size;
     unsigned long capacity;
+    /* Incremented each time the chunk list is rebuilt, so that the file
+     * pointers know that their cached chunk is no longer valid */
+    unsigned long generation;
+    /* If not NULL, the content was moved to this file to save memory */
+    char* spill_filename;
+    /* Value of the use counter when the file was last closed */
+    long last_use;
+    SYNC_Mutex_OBJECT lock;
     int open_in_write_mode;
     /* How many open pointers have we on this inode ?
     * If we don't know, we can't make remove operation safely */
     int n_open;
+    /* The inode is no longer in the index, and must be freed
+     * when the last open pointer is closed */
     int to_remove;
 
     struct VFS_INODE_* next;
@@ -66,26 +111,50 @@ typedef struct VFS_INODE_ {
 
 
 /**
-* Description of a file pointer returned by our open.
+* Description of a file pointer returned by our open. We keep the chunk
+* containing the current position, so that sequential reads and writes
+* don't have to walk the chunk list.
 */
 typedef struct {
     VFS_INODE* inode;
     TYPEOPEN_MF open_type;
     unsigned long pos;
+    VFS_CHUNK* chunk;
+    unsigned long chunk_start;
+    unsigned long generation;
 } VFS_FILE;
 
 
+/**
+* A part of the inode index.
+*/
+typedef struct {
+    SYNC_Mutex_OBJECT lock;
+    VFS_INODE** buckets;
+    unsigned int n_buckets;
+    unsigned int n_inodes;
+} VFS_SHARD;
+
+
 /**
 * Description of the VFS space
 */
 struct VFS {
     const char* pfx;
     int default_block_size;
-    VFS_INODE* list;
+    VFS_SHARD shards[VFS_N_SHARDS];
+    /* Memory quota for the file contents, 0 if none, and directory
+     * where the cold files are spilled. They are protected by VFS_mutex */
+    unsigned long memory_quota;
+    unsigned long resident_size;
+    char* spill_dir;
+    long n_spilled;
+    /* Counter used to find the least recently used files */
+    volatile long use_counter;
 };
 
 
-static struct VFS VFS_id = { VIRTUAL_FILE_PFX, 4096, NULL };
+static struct VFS VFS_id = { VIRTUAL_FILE_PFX, 4096, {}, 0, 0, NULL, 0, 0 };
 
 
 
@@ -119,6 +188,9 @@ if (init_done) {
     return;
 }
 mutex = SyncBuildMutex();
+for (int i=0;i<VFS_N_SHARDS;i++) {
+    VFS_id.shards[i].lock = SyncBuildMutex();
+}
 t_fileio_func_array_extensible my_VFS;
 fill_fileio_func_array_extensible(&my_VFS);
 
@@ -141,6 +213,12 @@ if (!RemoveAbstractFileSpaceExtensible(&my_VFS, &VFS_id)) {
     fatal_error("Cannot uninstall virtual file system\n");
 }
 
+for (int i=0;i<VFS_N_SHARDS;i++) {
+    if (VFS_id.shards[i].lock != NULL) {
+        SyncDeleteMutex(VFS_id.shards[i].lock);
+        VFS_id.shards[i].lock = NULL;
+    }
+}
 if (mutex != NULL) {
     SyncDeleteMutex(mutex);
     mutex = NULL;
@@ -173,25 +251,106 @@ return strstr(name,vfs->pfx)==name;
 
 
 /**
- * Tests if there is an inode for the given name.
+ * FNV-1a hash of a file name.
+ */
+static unsigned int hash_name(const char* name) {
+unsigned int h=2166136261u;
+while (*name) {
+    h=(h^(unsigned char)(*name))*16777619u;
+    name++;
+}
+return h;
+}
+
+
+static inline VFS_SHARD* get_shard(VFS* vfs,unsigned int hash) {
+return &(vfs->shards[hash%VFS_N_SHARDS]);
+}
+
+
+static inline VFS_INODE** get_bucket(VFS_SHARD* shard,unsigned int hash) {
+return &(shard->buckets[(hash/VFS_N_SHARDS)%shard->n_buckets]);
+}
+
+
+/**
+ * Updates the amount of memory used by the file contents.
  */
-static VFS_INODE* get_inode(VFS* vfs,const char* name) {
+static void add_resident_size(VFS* vfs,long n) {
+if (n==0) return;
 SyncGetMutex(VFS_mutex);
-VFS_INODE* inode=vfs->list;
+vfs->resident_size=(unsigned long)((long)vfs->resident_size+n);
+SyncReleaseMutex(VFS_mutex);
+}
+
+
+/**
+ * Looks for the inode of the given name. The shard lock must be held.
+ */
+static VFS_INODE* find_inode(VFS_SHARD* shard,const char* name,unsigned int hash) {
+if (shard->buckets==NULL) return NULL;
+VFS_INODE* inode=*get_bucket(shard,hash);
 while (inode!=NULL) {
-    if (!strcmp(inode->name,name)) {
-        SyncReleaseMutex(VFS_mutex);
+    if (inode->hash==hash && !strcmp(inode->name,name)) {
         return inode;
     }
     inode=inode->next;
 }
-SyncReleaseMutex(VFS_mutex);
 return NULL;
 }
 
 
-static VFS_INODE* create_inode(VFS* vfs,const char* name,TYPEOPEN_MF TypeOpen) {
-DISCARD_UNUSED_PARAMETER(TypeOpen)
+/**
+ * Inserts the inode in the shard, and enlarges the shard if it becomes
+ * too crowded. The shard lock must be held.
+ */
+static void insert_inode(VFS_SHARD* shard,VFS_INODE* inode) {
+if (shard->buckets==NULL || shard->n_inodes>=2*shard->n_buckets) {
+    unsigned int n=(shard->buckets==NULL)?VFS_MIN_BUCKETS:2*shard->n_buckets;
+    VFS_INODE** buckets=(VFS_INODE**)calloc(n,sizeof(VFS_INODE*));
+    if (buckets==NULL) {
+        fatal_alloc_error("insert_inode");
+    }
+    for (unsigned int i=0;i<shard->n_buckets;i++) {
+        VFS_INODE* tmp=shard->buckets[i];
+        while (tmp!=NULL) {
+            VFS_INODE* next=tmp->next;
+            VFS_INODE** bucket=&(buckets[(tmp->hash/VFS_N_SHARDS)%n]);
+            tmp->next=*bucket;
+            *bucket=tmp;
+            tmp=next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets=buckets;
+    shard->n_buckets=n;
+}
+VFS_INODE** bucket=get_bucket(shard,inode->hash);
+inode->next=*bucket;
+*bucket=inode;
+(shard->n_inodes)++;
+}
+
+
+/**
+ * Removes the inode from the index, so that the file does not exist anymore
+ * for the next opens. The shard lock must be held.
+ */
+static void unlink_inode(VFS_SHARD* shard,VFS_INODE* inode) {
+VFS_INODE** tmp=get_bucket(shard,inode->hash);
+while (*tmp!=NULL) {
+    if (*tmp==inode) {
+        *tmp=inode->next;
+        inode->next=NULL;
+        (shard->n_inodes)--;
+        return;
+    }
+    tmp=&((*tmp)->next);
+}
+}
+
+
+static VFS_INODE* create_inode(VFS* vfs,const char* name,unsigned int hash) {
 VFS_INODE* inode=(VFS_INODE*)malloc(sizeof(VFS_INODE));
 if (inode==NULL) {
     fatal_alloc_error("create_inode");
@@ -201,77 +360,374 @@ inode->name=strdup(name);
 if (inode->name==NULL) {
     fatal_alloc_error("create_inode");
 }
+inode->hash=hash;
+inode->chunks=NULL;
+inode->last_chunk=NULL;
 inode->size=0;
-inode->capacity=inode->vfs->default_block_size;
-inode->ptr=malloc(inode->capacity);
-if (inode->ptr==NULL) {
-    fatal_alloc_error("create_inode");
-}
+inode->capacity=0;
+inode->generation=0;
+inode->spill_filename=NULL;
+inode->last_use=0;
+inode->lock=SyncBuildMutex();
 inode->open_in_write_mode=0;
 inode->n_open=0;
 inode->to_remove=0;
-SyncGetMutex(VFS_mutex);
-inode->next=vfs->list;
-vfs->list=inode;
-SyncReleaseMutex(VFS_mutex);
+inode->next=NULL;
 return inode;
 }
 
 
-static VFS_INODE* remove_inode(VFS_INODE* list,VFS_INODE* inode) {
-if (list==NULL) {
-    return NULL;
+/**
+ * Frees the content of the inode, either in memory or spilled on the disk.
+ */
+static void free_content(VFS_INODE* inode) {
+VFS_CHUNK* chunk=inode->chunks;
+while (chunk!=NULL) {
+    VFS_CHUNK* next=chunk->next;
+    free(chunk);
+    chunk=next;
 }
-if (list!=inode) {
-    list->next=remove_inode(list->next,inode);
-    return list;
+add_resident_size(inode->vfs,-(long)inode->capacity);
+inode->chunks=NULL;
+inode->last_chunk=NULL;
+inode->capacity=0;
+(inode->generation)++;
+if (inode->spill_filename!=NULL) {
+    remove(inode->spill_filename);
+    free(inode->spill_filename);
+    inode->spill_filename=NULL;
 }
-VFS_INODE* next=list->next;
-if (inode->ptr!=NULL) {
-    free(inode->ptr);
 }
+
+
+static void free_inode(VFS_INODE* inode) {
+free_content(inode);
+SyncDeleteMutex(inode->lock);
 free(inode->name);
 free(inode);
-return next;
 }
 
-static void delete_inode(VFS_INODE* inode) {
+
+/**
+ * Appends to the content a chunk of at least 'n' bytes.
+ */
+static void add_chunk(VFS_INODE* inode,unsigned long n) {
+if (n<inode->capacity) n=inode->capacity;
+if (n<(unsigned long)inode->vfs->default_block_size) n=inode->vfs->default_block_size;
+VFS_CHUNK* chunk=(VFS_CHUNK*)malloc(sizeof(VFS_CHUNK)+n);
+if (chunk==NULL) {
+    fatal_error("Cannot allocate buffer to write virtual file %s\n",inode->name);
+}
+chunk->next=NULL;
+chunk->capacity=n;
+if (inode->last_chunk==NULL) {
+    inode->chunks=chunk;
+} else {
+    inode->last_chunk->next=chunk;
+}
+inode->last_chunk=chunk;
+inode->capacity+=n;
+add_resident_size(inode->vfs,(long)n);
+}
+
+
+/**
+ * Replaces the content by a single chunk of 'n' bytes, and returns it.
+ */
+static VFS_CHUNK* set_single_chunk(VFS_INODE* inode,unsigned long n) {
+VFS_CHUNK* chunk=(VFS_CHUNK*)malloc(sizeof(VFS_CHUNK)+n);
+if (chunk==NULL) {
+    fatal_alloc_error("set_single_chunk");
+}
+free_content(inode);
+chunk->next=NULL;
+chunk->capacity=n;
+inode->chunks=chunk;
+inode->last_chunk=chunk;
+inode->capacity=n;
+add_resident_size(inode->vfs,(long)n);
+return chunk;
+}
+
+
+/**
+ * Makes the content contiguous and returns a pointer on it.
+ * The inode lock must be held.
+ */
+static void* flatten_content(VFS_INODE* inode) {
+if (inode->chunks==NULL) {
+    add_chunk(inode,inode->vfs->default_block_size);
+    (inode->generation)++;
+}
+if (inode->chunks->next==NULL) {
+    return VFS_CHUNK_DATA(inode->chunks);
+}
+VFS_CHUNK* chunks=inode->chunks;
+unsigned long capacity=inode->capacity;
+VFS_CHUNK* chunk=(VFS_CHUNK*)malloc(sizeof(VFS_CHUNK)+inode->size);
+if (chunk==NULL) {
+    fatal_alloc_error("flatten_content");
+}
+chunk->next=NULL;
+chunk->capacity=inode->size;
+unsigned long pos=0;
+while (chunks!=NULL) {
+    VFS_CHUNK* next=chunks->next;
+    unsigned long n=inode->size-pos;
+    if (n>chunks->capacity) n=chunks->capacity;
+    memcpy(VFS_CHUNK_DATA(chunk)+pos,VFS_CHUNK_DATA(chunks),n);
+    pos+=n;
+    free(chunks);
+    chunks=next;
+}
+inode->chunks=chunk;
+inode->last_chunk=chunk;
+inode->capacity=inode->size;
+(inode->generation)++;
+add_resident_size(inode->vfs,(long)inode->size-(long)capacity);
+return VFS_CHUNK_DATA(chunk);
+}
+
+
+/**
+ * Loads back in memory the content of a spilled file. The inode lock
+ * must be held.
+ */
+static void unspill_content(VFS_INODE* inode) {
+if (inode->spill_filename==NULL) return;
+FILE* f=real_fopen(inode->spill_filename,"rb");
+if (f==NULL) {
+    fatal_error("Cannot reload virtual file %s from %s\n",inode->name,inode->spill_filename);
+}
+char* spill_filename=inode->spill_filename;
+inode->spill_filename=NULL;
+if (inode->size!=0) {
+    VFS_CHUNK* chunk=set_single_chunk(inode,inode->size);
+    if (inode->size!=(unsigned long)fread(VFS_CHUNK_DATA(chunk),1,inode->size,f)) {
+        fatal_error("Error reloading content of %s\n",inode->name);
+    }
+}
+fclose(f);
+remove(spill_filename);
+free(spill_filename);
+}
+
+
+/**
+ * Moves the content of the inode to the spill directory.
+ * The inode lock must be held. Returns 1 in case of success; 0 otherwise.
+ */
+static int spill_content(VFS_INODE* inode,const char* spill_dir,long n) {
+char* spill_filename=(char*)malloc(strlen(spill_dir)+64);
+if (spill_filename==NULL) {
+    fatal_alloc_error("spill_content");
+}
+sprintf(spill_filename,"%s%svfs_%p_%ld.tmp",spill_dir,PATH_SEPARATOR_STRING,(void*)inode->vfs,n);
+FILE* f=real_fopen(spill_filename,"wb");
+if (f==NULL) {
+    free(spill_filename);
+    return 0;
+}
+unsigned long pos=0;
+for (VFS_CHUNK* chunk=inode->chunks;chunk!=NULL && pos<inode->size;chunk=chunk->next) {
+    unsigned long len=inode->size-pos;
+    if (len>chunk->capacity) len=chunk->capacity;
+    if (len!=(unsigned long)fwrite(VFS_CHUNK_DATA(chunk),1,len,f)) {
+        fclose(f);
+        remove(spill_filename);
+        free(spill_filename);
+        return 0;
+    }
+    pos+=len;
+}
+fclose(f);
+free_content(inode);
+inode->spill_filename=spill_filename;
+return 1;
+}
+
+
+/**
+ * A file that can be spilled to respect the memory quota.
+ */
+typedef struct {
+    VFS_INODE* inode;
+    unsigned int hash;
+    long last_use;
+} VFS_SPILL_CANDIDATE;
+
+
+static int compare_spill_candidates(const void* a,const void* b) {
+long x=((const VFS_SPILL_CANDIDATE*)a)->last_use;
+long y=((const VFS_SPILL_CANDIDATE*)b)->last_use;
+return (x<y)?-1:((x>y)?1:0);
+}
+
+
+/**
+ * If the file contents use more memory than the quota, moves the least
+ * recently used files that are not open to the spill directory.
+ * No lock must be held by the caller.
+ */
+static void enforce_memory_quota(VFS* vfs) {
 SyncGetMutex(VFS_mutex);
-VFS* vfs=inode->vfs;
-vfs->list=remove_inode(vfs->list,inode);
+int over_quota=(vfs->memory_quota!=0 && vfs->resident_size>vfs->memory_quota);
+char* spill_dir=over_quota?strdup(vfs->spill_dir):NULL;
 SyncReleaseMutex(VFS_mutex);
+if (!over_quota) return;
+if (spill_dir==NULL) {
+    fatal_alloc_error("enforce_memory_quota");
+}
+/* We collect all the files that could be spilled */
+int n=0,capacity=16;
+VFS_SPILL_CANDIDATE* candidates=(VFS_SPILL_CANDIDATE*)malloc(capacity*sizeof(VFS_SPILL_CANDIDATE));
+if (candidates==NULL) {
+    fatal_alloc_error("enforce_memory_quota");
+}
+for (int i=0;i<VFS_N_SHARDS;i++) {
+    VFS_SHARD* shard=&(vfs->shards[i]);
+    SyncGetMutex(shard->lock);
+    for (unsigned int j=0;j<shard->n_buckets;j++) {
+        for (VFS_INODE* inode=shard->buckets[j];inode!=NULL;inode=inode->next) {
+            if (inode->n_open!=0 || inode->capacity==0) continue;
+            if (n==capacity) {
+                capacity=2*capacity;
+                candidates=(VFS_SPILL_CANDIDATE*)realloc(candidates,capacity*sizeof(VFS_SPILL_CANDIDATE));
+                if (candidates==NULL) {
+                    fatal_alloc_error("enforce_memory_quota");
+                }
+            }
+            candidates[n].inode=inode;
+            candidates[n].hash=inode->hash;
+            candidates[n].last_use=inode->last_use;
+            n++;
+        }
+    }
+    SyncReleaseMutex(shard->lock);
+}
+qsort(candidates,n,sizeof(VFS_SPILL_CANDIDATE),compare_spill_candidates);
+for (int i=0;i<n;i++) {
+    SyncGetMutex(VFS_mutex);
+    over_quota=(vfs->memory_quota!=0 && vfs->resident_size>vfs->memory_quota);
+    long spill_number=++(vfs->n_spilled);
+    SyncReleaseMutex(VFS_mutex);
+    if (!over_quota) break;
+    /* The candidate may have been removed, renamed or opened meanwhile,
+     * so we look for it again */
+    VFS_SHARD* shard=get_shard(vfs,candidates[i].hash);
+    SyncGetMutex(shard->lock);
+    VFS_INODE* inode=*get_bucket(shard,candidates[i].hash);
+    while (inode!=NULL && inode!=candidates[i].inode) {
+        inode=inode->next;
+    }
+    if (inode!=NULL && inode->n_open==0 && inode->last_use==candidates[i].last_use) {
+        SyncGetMutex(inode->lock);
+        /* Another thread may have spilled it meanwhile */
+        int ok=(inode->capacity==0) || spill_content(inode,spill_dir,spill_number);
+        SyncReleaseMutex(inode->lock);
+        if (!ok) {
+            SyncReleaseMutex(shard->lock);
+            error("Cannot spill virtual files to %s\n",spill_dir);
+            break;
+        }
+    }
+    SyncReleaseMutex(shard->lock);
+}
+free(candidates);
+free(spill_dir);
+}
+
+
+/**
+ * Looks for the inode of the given name and marks it as used, so that it
+ * can be neither freed nor spilled until release_inode is called.
+ */
+static VFS_INODE* acquire_inode(VFS* vfs,const char* name) {
+unsigned int hash=hash_name(name);
+VFS_SHARD* shard=get_shard(vfs,hash);
+SyncGetMutex(shard->lock);
+VFS_INODE* inode=find_inode(shard,name,hash);
+if (inode!=NULL) {
+    (inode->n_open)++;
+}
+SyncReleaseMutex(shard->lock);
+return inode;
+}
+
+
+/**
+ * Releases an inode obtained by acquire_inode or by an open. The inode
+ * is freed if it was removed and if nobody uses it anymore.
+ */
+static void release_inode(VFS_INODE* inode,int close_write_mode) {
+VFS_SHARD* shard;
+for (;;) {
+    /* The inode may be renamed, and thus may change of shard */
+    unsigned int hash=inode->hash;
+    shard=get_shard(inode->vfs,hash);
+    SyncGetMutex(shard->lock);
+    if (inode->hash==hash) break;
+    SyncReleaseMutex(shard->lock);
+}
+if (close_write_mode) {
+    /* As there should only be one file in write mode at the same time,
+     * if the current one was, we reset the flag
+     */
+    inode->open_in_write_mode=0;
+}
+(inode->n_open)--;
+inode->last_use=SyncAtomicIncrement(&(inode->vfs->use_counter));
+int to_free=(inode->n_open==0 && inode->to_remove);
+SyncReleaseMutex(shard->lock);
+if (to_free) {
+    free_inode(inode);
+}
 }
 
 
 /**
+ * Replaces the content of the inode by the one of the file on the disk.
  * Returns 1 if the file content has been successfully loaded in memory,
  * or 0 if the file did not exist. A fatal error is raised if there
- * is no memory enough to load the file.
+ * is no memory enough to load the file. The inode lock must be held.
  */
 static int load_file_content(VFS_INODE* inode) {
-SyncGetMutex(VFS_mutex);
 FILE* f=real_fopen(inode->name+strlen(inode->vfs->pfx),"rb");
 if (f==NULL) {
-    SyncReleaseMutex(VFS_mutex);
     return 0;
 }
 fseek(f,0,SEEK_END);
-inode->size=ftell(f);
-inode->capacity=inode->size;
+unsigned long size=ftell(f);
 fseek(f,0,SEEK_SET);
-inode->ptr=malloc(inode->size);
-if (inode->ptr==NULL) {
-    fatal_alloc_error("load_file_content");
-}
-if (inode->size!=(unsigned long)fread(inode->ptr,1,inode->size,f)) {
+VFS_CHUNK* chunk=set_single_chunk(inode,size);
+inode->size=size;
+if (inode->size!=(unsigned long)fread(VFS_CHUNK_DATA(chunk),1,inode->size,f)) {
     fatal_error("Error loading content of %s\n",inode->name);
 }
 fclose(f);
-SyncReleaseMutex(VFS_mutex);
 return 1;
 }
 
 
+/**
+ * Sets the chunk of the file pointer to the one that contains the
+ * position 'pos'. The result is NULL if 'pos' is at the end of the
+ * allocated content. The inode lock must be held.
+ */
+static void locate_chunk(VFS_FILE* f,unsigned long pos) {
+VFS_INODE* inode=f->inode;
+if (f->chunk==NULL || f->generation!=inode->generation || f->chunk_start>pos) {
+    f->chunk=inode->chunks;
+    f->chunk_start=0;
+    f->generation=inode->generation;
+}
+while (f->chunk!=NULL && pos>=f->chunk_start+f->chunk->capacity) {
+    f->chunk_start+=f->chunk->capacity;
+    f->chunk=f->chunk->next;
+}
+}
+
+
 /**
  * open
  */
@@ -282,34 +738,55 @@ case OPEN_READ_MF: error("open READ: %s\n",name); break;
 case OPEN_READWRITE_MF: error("open READWRITE: %s\n",name); break;
 case OPEN_CREATE_MF: error("open CREATE: %s\n",name); break;
 }*/
-VFS_INODE* inode=get_inode(vfs,name);
+unsigned int hash=hash_name(name);
+VFS_SHARD* shard=get_shard(vfs,hash);
+SyncGetMutex(shard->lock);
+VFS_INODE* inode=find_inode(shard,name,hash);
 int inode_created=0;
 if (inode==NULL) {
     if (TypeOpen == OPEN_READ_MF) {
+        SyncReleaseMutex(shard->lock);
         return NULL;
     }
-    inode=create_inode(vfs,name,TypeOpen);
+    inode=create_inode(vfs,name,hash);
+    insert_inode(shard,inode);
     inode_created=1;
 }
 /* If an inode exists, we must test if there is a concurrent
  * write access on the file */
 if (TypeOpen!=OPEN_READ_MF) {
     if (inode->open_in_write_mode) {
+        SyncReleaseMutex(shard->lock);
         fatal_error("Cannot have a concurrent write access on virtual file %s\n",name);
     } else {
         inode->open_in_write_mode=1;
     }
 }
+(inode->n_open)++;
+/* We lock the inode before releasing the shard, so that nobody can
+ * read a created inode before its content is loaded */
+SyncGetMutex(inode->lock);
+SyncReleaseMutex(shard->lock);
 if (inode_created && TypeOpen!=OPEN_CREATE_MF) {
     /* If we have to load the file content from disk, we do it */
     if (!load_file_content(inode)) {
+        SyncReleaseMutex(inode->lock);
+        SyncGetMutex(shard->lock);
+        unlink_inode(shard,inode);
+        inode->to_remove=1;
+        SyncReleaseMutex(shard->lock);
+        release_inode(inode,1);
         return NULL;
     }
 }
 if (TypeOpen==OPEN_CREATE_MF) {
     /* A created file must be truncated */
+    free_content(inode);
     inode->size=0;
+} else {
+    unspill_content(inode);
 }
+SyncReleaseMutex(inode->lock);
 VFS_FILE* f=(VFS_FILE*)malloc(sizeof(VFS_FILE));
 if (f==NULL) {
     fatal_alloc_error("my_fnc_memOpenLowLevel");
@@ -317,7 +794,9 @@ if (f==NULL) {
 f->inode=inode;
 f->open_type=TypeOpen;
 f->pos=0;
-(inode->n_open)++;
+f->chunk=NULL;
+f->chunk_start=0;
+f->generation=0;
 return f;
 }
 
@@ -332,12 +811,24 @@ if (f->open_type==OPEN_CREATE_MF) {
     /* Cannot read in write-only mode */
     return 0;
 }
-unsigned int to_read=(unsigned int)(f->inode->size-f->pos);
+VFS_INODE* inode=f->inode;
+SyncGetMutex(inode->lock);
+unsigned long to_read=(f->pos<inode->size)?(inode->size-f->pos):0;
 if (size<to_read) {
-    to_read=(unsigned int)size;
-}
-memcpy(Buf,((char*)f->inode->ptr)+f->pos,to_read);
-f->pos+=to_read;
+    to_read=(unsigned long)size;
+}
+unsigned long done=0;
+locate_chunk(f,f->pos);
+while (done<to_read) {
+    unsigned long offset=f->pos-f->chunk_start;
+    unsigned long n=f->chunk->capacity-offset;
+    if (n>to_read-done) n=to_read-done;
+    memcpy((char*)Buf+done,VFS_CHUNK_DATA(f->chunk)+offset,n);
+    done+=n;
+    f->pos+=n;
+    locate_chunk(f,f->pos);
+}
+SyncReleaseMutex(inode->lock);
 return to_read;
 }
 
@@ -352,22 +843,28 @@ if (f->open_type==OPEN_READ_MF) {
     /* Cannot write in read-only mode */
     return 0;
 }
-if (f->pos+size>f->inode->capacity) {
-    /* We need to enlarge our buffer */
-    unsigned int n=(unsigned int)(f->inode->capacity);
-    if (n==0) n=1;
-    while (f->pos+size>n) n=n*2;
-    f->inode->ptr=realloc(f->inode->ptr,n);
-    if (f->inode->ptr==NULL) {
-        fatal_error("Cannot allocate buffer to write virtual file %s\n",f->inode->name);
-    }
-    f->inode->capacity=n;
-}
-memcpy((char*)(f->inode->ptr)+f->pos,Buf,size);
-f->pos+=(unsigned long)size;
-if (f->pos>f->inode->size) {
-    f->inode->size=f->pos;
-}
+VFS_INODE* inode=f->inode;
+SyncGetMutex(inode->lock);
+if (f->pos+size>inode->capacity) {
+    /* We need to enlarge the content, which is done without moving
+     * what has already been written */
+    add_chunk(inode,(unsigned long)(f->pos+size-inode->capacity));
+}
+unsigned long done=0;
+locate_chunk(f,f->pos);
+while (done<size) {
+    unsigned long offset=f->pos-f->chunk_start;
+    unsigned long n=f->chunk->capacity-offset;
+    if (n>size-done) n=(unsigned long)(size-done);
+    memcpy(VFS_CHUNK_DATA(f->chunk)+offset,(const char*)Buf+done,n);
+    done+=n;
+    f->pos+=n;
+    locate_chunk(f,f->pos);
+}
+if (f->pos>inode->size) {
+    inode->size=f->pos;
+}
+SyncReleaseMutex(inode->lock);
 return size;
 }
 
@@ -401,18 +898,11 @@ int ABSTRACT_CALLBACK_UNITEX my_fnc_memLowLevelClose(ABSTRACTFILE_PTR llFile,voi
 DISCARD_UNUSED_PARAMETER(privateSpacePtr)
 VFS_FILE* f=(VFS_FILE*)llFile;
 VFS_INODE* inode=f->inode;
-(f->inode->n_open)--;
-/* We have to update the open_in_write_mode flag */
-if (f->open_type!=OPEN_READ_MF) {
-    /* As there should only be one file in write mode at the same time,
-     * if the current one was, we reset the flag
-     */
-    f->inode->open_in_write_mode=0;
-}
+VFS* vfs=inode->vfs;
+int write_mode=(f->open_type!=OPEN_READ_MF);
 free(f);
-if (inode->n_open==0 && inode->to_remove) {
-    delete_inode(inode);
-}
+release_inode(inode,write_mode);
+enforce_memory_quota(vfs);
 return 0;
 }
 
@@ -437,18 +927,68 @@ VFS_FILE* f=(VFS_FILE*)llFile;
 }
 
 
+/**
+ * Locks the shards of the two given hash values, always in the same
+ * order to avoid deadlocks.
+ */
+static void lock_two_shards(VFS* vfs,unsigned int hash1,unsigned int hash2) {
+unsigned int i=hash1%VFS_N_SHARDS;
+unsigned int j=hash2%VFS_N_SHARDS;
+if (i>j) {
+    unsigned int tmp=i;
+    i=j;
+    j=tmp;
+}
+SyncGetMutex(vfs->shards[i].lock);
+if (i!=j) SyncGetMutex(vfs->shards[j].lock);
+}
+
+
+static void unlock_two_shards(VFS* vfs,unsigned int hash1,unsigned int hash2) {
+unsigned int i=hash1%VFS_N_SHARDS;
+unsigned int j=hash2%VFS_N_SHARDS;
+if (i!=j) SyncReleaseMutex(vfs->shards[j].lock);
+SyncReleaseMutex(vfs->shards[i].lock);
+}
+
+
 /**
  * rename
  */
 int ABSTRACT_CALLBACK_UNITEX my_fnc_memFileRename(const char* _OldFilename,const char* _NewFilename,void* privateSpacePtr) {
-VFS_INODE* inode=get_inode((VFS*)privateSpacePtr,_OldFilename);
-if (inode==NULL) return 1;
-if (!strcmp(_OldFilename,_NewFilename)) return 0;
-free(inode->name);
-inode->name=strdup(_NewFilename);
-if (inode->name==NULL) {
+VFS* vfs=(VFS*)privateSpacePtr;
+unsigned int old_hash=hash_name(_OldFilename);
+unsigned int new_hash=hash_name(_NewFilename);
+lock_two_shards(vfs,old_hash,new_hash);
+VFS_SHARD* old_shard=get_shard(vfs,old_hash);
+VFS_SHARD* new_shard=get_shard(vfs,new_hash);
+VFS_INODE* inode=find_inode(old_shard,_OldFilename,old_hash);
+if (inode==NULL || !strcmp(_OldFilename,_NewFilename)) {
+    unlock_two_shards(vfs,old_hash,new_hash);
+    return (inode==NULL);
+}
+char* name=strdup(_NewFilename);
+if (name==NULL) {
     fatal_alloc_error("my_fnc_memFileRename");
 }
+/* An existing file with the new name is replaced */
+VFS_INODE* replaced=find_inode(new_shard,_NewFilename,new_hash);
+if (replaced!=NULL) {
+    unlink_inode(new_shard,replaced);
+    replaced->to_remove=1;
+    if (replaced->n_open!=0) {
+        replaced=NULL;
+    }
+}
+unlink_inode(old_shard,inode);
+free(inode->name);
+inode->name=name;
+inode->hash=new_hash;
+insert_inode(new_shard,inode);
+unlock_two_shards(vfs,old_hash,new_hash);
+if (replaced!=NULL) {
+    free_inode(replaced);
+}
 return 0;
 }
 
@@ -457,11 +997,21 @@ return 0;
  * remove
  */
 int ABSTRACT_CALLBACK_UNITEX my_fnc_memFileRemove(const char* lpFileName,void* privateSpacePtr) {
-VFS_INODE* inode=get_inode((VFS*)privateSpacePtr,lpFileName);
-if (inode==NULL) return 1;
+VFS* vfs=(VFS*)privateSpacePtr;
+unsigned int hash=hash_name(lpFileName);
+VFS_SHARD* shard=get_shard(vfs,hash);
+SyncGetMutex(shard->lock);
+VFS_INODE* inode=find_inode(shard,lpFileName,hash);
+if (inode==NULL) {
+    SyncReleaseMutex(shard->lock);
+    return 1;
+}
+unlink_inode(shard,inode);
 inode->to_remove=1;
-if (inode->n_open==0) {
-    delete_inode(inode);
+int to_free=(inode->n_open==0);
+SyncReleaseMutex(shard->lock);
+if (to_free) {
+    free_inode(inode);
 }
 return 0;
 }
@@ -470,33 +1020,41 @@ return 0;
 const void* my_fnc_memFile_getMapPointer(ABSTRACTFILE_PTR llFile, afs_size_type pos, afs_size_type /*len*/,int /*options*/,
         afs_size_type /* value_for_options*/,void* /* privateSpacePtr */) {
 VFS_FILE* f=(VFS_FILE*)llFile;
-return ((char*)f->inode->ptr)+pos;
+SyncGetMutex(f->inode->lock);
+char* ptr=(char*)flatten_content(f->inode);
+SyncReleaseMutex(f->inode->lock);
+return ptr+pos;
 }
 
 /**
  * Returns the current list of virtual files.
  */
 char** VFS_ls() {
-VFS_INODE* inode=VFS_id.list;
-int n=0;
-while (inode!=NULL) {
-    n++;
-    inode=inode->next;
-}
-n++;
-char** names=(char**)malloc(n*sizeof(char*));
+int n=0,capacity=16;
+char** names=(char**)malloc(capacity*sizeof(char*));
 if (names==NULL) {
     fatal_alloc_error("VFS_ls");
 }
-inode=VFS_id.list;
-n=0;
-while (inode!=NULL) {
-    names[n]=strdup(inode->name);
-    if (names[n]==NULL) {
-        fatal_alloc_error("VFS_ls");
+for (int i=0;i<VFS_N_SHARDS;i++) {
+    VFS_SHARD* shard=&(VFS_id.shards[i]);
+    SyncGetMutex(shard->lock);
+    for (unsigned int j=0;j<shard->n_buckets;j++) {
+        for (VFS_INODE* inode=shard->buckets[j];inode!=NULL;inode=inode->next) {
+            if (n+1==capacity) {
+                capacity=2*capacity;
+                names=(char**)realloc(names,capacity*sizeof(char*));
+                if (names==NULL) {
+                    fatal_alloc_error("VFS_ls");
+                }
+            }
+            names[n]=strdup(inode->name);
+            if (names[n]==NULL) {
+                fatal_alloc_error("VFS_ls");
+            }
+            n++;
+        }
     }
-    n++;
-    inode=inode->next;
+    SyncReleaseMutex(shard->lock);
 }
 names[n]=NULL;
 return names;
@@ -550,11 +1108,13 @@ static void fill_fileio_func_array_extensible(t_fileio_func_array_extensible * m
  * or -1 if not found
  */
 long VFS_size(const char* name) {
-VFS_INODE* inode=get_inode(&VFS_id,name);
+VFS_INODE* inode=acquire_inode(&VFS_id,name);
 if (inode==NULL) {
     return -1;
 }
-return inode->size;
+long size=inode->size;
+release_inode(inode,0);
+return size;
 }
 
 
@@ -565,11 +1125,16 @@ return inode->size;
  * DON'T FREE THIS POINTER!
  */
 void* VFS_content(const char* name) {
-VFS_INODE* inode=get_inode(&VFS_id,name);
+VFS_INODE* inode=acquire_inode(&VFS_id,name);
 if (inode==NULL) {
     return NULL;
 }
-return inode->ptr;
+SyncGetMutex(inode->lock);
+unspill_content(inode);
+void* ptr=flatten_content(inode);
+SyncReleaseMutex(inode->lock);
+release_inode(inode,0);
+return ptr;
 }
 
 
@@ -578,11 +1143,16 @@ return inode->ptr;
  * Returns 1 in case of success; 0 otherwise.
  */
 int VFS_reload(const char* name) {
-VFS_INODE* inode=get_inode(&VFS_id,name);
+VFS_INODE* inode=acquire_inode(&VFS_id,name);
 if (inode==NULL) {
     return 0;
 }
-return load_file_content(inode);
+SyncGetMutex(inode->lock);
+int ret=load_file_content(inode);
+SyncReleaseMutex(inode->lock);
+release_inode(inode,0);
+enforce_memory_quota(&VFS_id);
+return ret;
 }
 
 
@@ -591,36 +1161,107 @@ return load_file_content(inode);
  * Returns 1 in case of success; 0 otherwise.
  */
 int VFS_dump(const char* name) {
-VFS_INODE* inode=get_inode(&VFS_id,name);
+VFS_INODE* inode=acquire_inode(&VFS_id,name);
 if (inode==NULL) return 0;
 create_path_to_file(name+strlen(inode->vfs->pfx));
 FILE* f=real_fopen(name+strlen(inode->vfs->pfx),"wb");
 if (f==NULL) {
+    release_inode(inode,0);
     return 0;
 }
-if (inode->size!=fwrite(inode->ptr,1,inode->size,f)) {
-    fclose(f);
-    return 0;
+SyncGetMutex(inode->lock);
+unspill_content(inode);
+int ret=1;
+unsigned long pos=0;
+for (VFS_CHUNK* chunk=inode->chunks;chunk!=NULL && pos<inode->size;chunk=chunk->next) {
+    unsigned long len=inode->size-pos;
+    if (len>chunk->capacity) len=chunk->capacity;
+    if (len!=fwrite(VFS_CHUNK_DATA(chunk),1,len,f)) {
+        ret=0;
+        break;
+    }
+    pos+=len;
 }
+SyncReleaseMutex(inode->lock);
 fclose(f);
-return 1;
+release_inode(inode,0);
+return ret;
 }
 
 
 void VFS_remove(const char* name) {
-VFS_INODE* inode=get_inode(&VFS_id,name);
-if (inode==NULL) return;
-my_fnc_memFileRemove(inode->name,&VFS_id);
+my_fnc_memFileRemove(name,&VFS_id);
 }
 
 
 void VFS_reset() {
-while (VFS_id.list!=NULL) {
-    my_fnc_memFileRemove(VFS_id.list->name,&VFS_id);
+for (int i=0;i<VFS_N_SHARDS;i++) {
+    VFS_SHARD* shard=&(VFS_id.shards[i]);
+    VFS_INODE* to_free=NULL;
+    SyncGetMutex(shard->lock);
+    for (unsigned int j=0;j<shard->n_buckets;j++) {
+        VFS_INODE* inode=shard->buckets[j];
+        while (inode!=NULL) {
+            VFS_INODE* next=inode->next;
+            inode->to_remove=1;
+            if (inode->n_open==0) {
+                inode->next=to_free;
+                to_free=inode;
+            } else {
+                inode->next=NULL;
+            }
+            inode=next;
+        }
+        shard->buckets[j]=NULL;
+    }
+    shard->n_inodes=0;
+    SyncReleaseMutex(shard->lock);
+    while (to_free!=NULL) {
+        VFS_INODE* next=to_free->next;
+        free_inode(to_free);
+        to_free=next;
+    }
 }
 }
 
 
+/**
+ * Sets the memory quota for the content of the virtual files.
+ * Returns 1 in case of success; 0 otherwise.
+ */
+int VFS_set_memory_quota(unsigned long quota,const char* spill_dir) {
+char* dir=NULL;
+if (quota!=0) {
+    if (spill_dir==NULL || spill_dir[0]=='\0') {
+        return 0;
+    }
+    dir=strdup(spill_dir);
+    if (dir==NULL) {
+        fatal_alloc_error("VFS_set_memory_quota");
+    }
+}
+SyncGetMutex(VFS_mutex);
+free(VFS_id.spill_dir);
+VFS_id.spill_dir=dir;
+VFS_id.memory_quota=quota;
+SyncReleaseMutex(VFS_mutex);
+enforce_memory_quota(&VFS_id);
+return 1;
+}
+
+
+/**
+ * Returns the number of bytes used in memory by the content of the
+ * virtual files.
+ */
+unsigned long VFS_memory_usage() {
+SyncGetMutex(VFS_mutex);
+unsigned long size=VFS_id.resident_size;
+SyncReleaseMutex(VFS_mutex);
+return size;
+}
+
+
 
 
 } // namespace virtualfile
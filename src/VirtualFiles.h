@@ -36,6 +36,10 @@ namespace virtualfile {
  * open in read mode, its content will be loaded. Then, the disk
  * will not be touched again, until VFS_dump is called to save the file
  * or VFS_reload is called to load again the file from the disk.
+ *
+ * If a memory quota is set with VFS_set_memory_quota, the content of
+ * the least recently used files that are not open is moved to a spill
+ * directory when the quota is exceeded, and loaded back on the next open.
  */
 
 #define VIRTUAL_FILE_PFX "$:"
@@ -52,7 +56,8 @@ char** VFS_ls();
 long VFS_size(const char* name);
 
 /* Returns a pointer on the virtual file content
- * THIS MUST NOT BE FREED! */
+ * THIS MUST NOT BE FREED! If a memory quota is set, the pointer is
+ * only valid while the file is open */
 void* VFS_content(const char* name);
 
 /* Reloads a file from the disk */
@@ -67,6 +72,16 @@ void VFS_remove(const char* name);
 /* Deletes all virtual files */
 void VFS_reset();
 
+/* Limits to 'quota' bytes the memory used by the content of the virtual
+ * files, 0 meaning no limit. The files exceeding the quota are spilled
+ * into 'spill_dir', that must exist. Returns 1 in case of success; 0 if
+ * no spill directory is given */
+int VFS_set_memory_quota(unsigned long quota,const char* spill_dir);
+
+/* Returns the number of bytes used in memory by the content of
+ * the virtual files */
+unsigned long VFS_memory_usage();
+
 } // namespace virtualfile
 } // namespace unitex
 
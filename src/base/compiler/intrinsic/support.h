@@ -92,5 +92,9 @@
 #if UNITEX_HAS_CPU_EXTENSION(AES)
 #include <wmmintrin.h>                    // Advanced Encryption Standard
 #endif  // UNITEX_HAS_CPU_EXTENSION(AES)
+
+#if UNITEX_HAS_CPU_EXTENSION(AVX2)
+#include <immintrin.h>                    // Advanced Vector Extensions 2
+#endif  // UNITEX_HAS_CPU_EXTENSION(AVX2)
 /* ************************************************************************** */
 #endif  // UNITEX_BASE_COMPILER_INTRINSIC_SUPPORT_H_                // NOLINT
@@ -60,6 +60,7 @@
  *         UNITEX_HAS_CPU_EXTENSION(SSE42)  \\ Streaming SIMD Extensions 4.2
  *         UNITEX_HAS_CPU_EXTENSION(SSE5)   \\ Streaming SIMD Extensions 5
  *         UNITEX_HAS_CPU_EXTENSION(AES)    \\ AES Instruction Set
+ *         UNITEX_HAS_CPU_EXTENSION(AVX2)   \\ Advanced Vector Extensions 2
  * @endcode
  *
  * @see    UNITEX_HAS_CPU_EXTENSION_MMX
@@ -73,6 +74,7 @@
  * @see    UNITEX_HAS_CPU_EXTENSION_SSE42
  * @see    UNITEX_HAS_CPU_EXTENSION_SSE5
  * @see    UNITEX_HAS_CPU_EXTENSION_AES
+ * @see    UNITEX_HAS_CPU_EXTENSION_AVX2
  */
 #define UNITEX_HAS_CPU_EXTENSION(ExtensionName)\
         (UNITEX_HAS_CPU_EXTENSION_##ExtensionName == 1)
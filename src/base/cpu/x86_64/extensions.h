@@ -57,6 +57,7 @@
 // SSE5:   Streaming SIMD Extensions 5 instructions
 // AES:    Advanced Encryption Standard Instruction Set
 // PCLMUL: Carryless multiply instruction
+// AVX2:   Advanced Vector Extensions 2 instructions
 // gcc -dM -E -x c /dev/null -march=native
 #if UNITEX_HAVE(MMX)     || __MMX__     ||\
     UNITEX_HAVE(3DNOW)   || __3dNOW__   ||\
@@ -69,7 +70,8 @@
     UNITEX_HAVE(SSE42)   || __SSE4_2__  ||\
     UNITEX_HAVE(SSE5)    || __SSSE5__   ||\
     UNITEX_HAVE(AES)     || __AES__     ||\
-    UNITEX_HAVE(PCLMUL)  || __PCLMUL__
+    UNITEX_HAVE(PCLMUL)  || __PCLMUL__  ||\
+    UNITEX_HAVE(AVX2)    || __AVX2__
 /* ************************************************************************** */
 #  if UNITEX_HAVE(MMX)   || __MMX__
 #  define UNITEX_HAS_CPU_EXTENSION_MMX     1   // MultiMedia eXtensions
@@ -116,6 +118,10 @@
 #  define UNITEX_HAS_CPU_EXTENSION_AES     1   // AES Instruction Set
 #  endif  // UNITEX_HAVE(AES)
 
+#  if UNITEX_HAVE(AVX2)  || __AVX2__
+#  define UNITEX_HAS_CPU_EXTENSION_AVX2    1   // Advanced Vector Extensions 2
+#  endif  // UNITEX_HAVE(AVX2)
+
 # endif  // UNITEX_HAVE(MMX) ...
 /* ************************************************************************** */
 #endif  //  UNITEX_CPU_IS(X86) || UNITEX_CPU_IS(X64)